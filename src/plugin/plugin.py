@@ -41,6 +41,15 @@ config_serviceapp.servicemp3 = ConfigSubsection()
 config_serviceapp.servicemp3.replace = ConfigBoolean(default=False, descriptions={0: _("original"), 1: _("serviceapp")})
 config_serviceapp.servicemp3.replace.value = serviceapp_client.isServiceMP3Replaced()
 config_serviceapp.servicemp3.player = ConfigSelection(default="gstplayer", choices=player_choices)
+config_serviceapp.player_pool = ConfigBoolean(default=False, descriptions={False: _("false"), True: _("true")})
+config_serviceapp.playlist_cache_ttl = ConfigInteger(300, limits=(0, 86400))
+config_serviceapp.playlist_cache_snapshot = ConfigBoolean(default=False, descriptions={False: _("false"), True: _("true")})
+config_serviceapp.bandwidth_margin = ConfigInteger(70, limits=(0, 100))
+config_serviceapp.bandwidth_snapshot = ConfigBoolean(default=False, descriptions={False: _("false"), True: _("true")})
+config_serviceapp.hls_proxy_prefetch = ConfigInteger(0, limits=(0, 8))
+config_serviceapp.hls_proxy_cache = ConfigInteger(16, limits=(1, 128))
+config_serviceapp.player_history = ConfigSelection(default="disabled", choices=[
+    ("disabled", _("disabled")), ("remember", _("remember")), ("fallback", _("remember and fall back"))])
 
 config_serviceapp.options = ConfigSubDict()
 config_serviceapp.options["servicemp3"] = ConfigSubsection()
@@ -139,6 +148,20 @@ def init_serviceapp_settings():
                 player_cfg.mp3_swdecoding.value,
                 rtmp_proto_val)
 
+    serviceapp_client.setPlayerPool(config_serviceapp.player_pool.value)
+    serviceapp_client.setPlaylistCache(config_serviceapp.playlist_cache_ttl.value,
+            snapshot=config_serviceapp.playlist_cache_snapshot.value)
+    # without the proxy only playlist downloads are measured, which are too
+    # small to tell the speed of the server
+    bandwidth_margin = config_serviceapp.bandwidth_margin.value if config_serviceapp.hls_proxy_prefetch.value else 0
+    serviceapp_client.setBandwidthEstimator(bandwidth_margin,
+            snapshot=config_serviceapp.bandwidth_snapshot.value)
+    serviceapp_client.setHlsProxy(config_serviceapp.hls_proxy_prefetch.value,
+            config_serviceapp.hls_proxy_cache.value)
+    serviceapp_client.setPlayerHistory({"disabled": serviceapp_client.PLAYER_HISTORY_DISABLED,
+            "remember": serviceapp_client.PLAYER_HISTORY_REMEMBER,
+            "fallback": serviceapp_client.PLAYER_HISTORY_FALLBACK}[config_serviceapp.player_history.value])
+
     if config_serviceapp.servicemp3.player.value == "gstplayer":
         serviceapp_client.setServiceMP3GstPlayer()
     elif config_serviceapp.servicemp3.player.value == "exteplayer3":
@@ -256,6 +279,22 @@ class ServiceAppSettings(ConfigListScreen, Screen):
                 config_list += configlist_servicemp3 + self.player_options("exteplayer3", "servicemp3")
             else:
                 config_list += configlist_servicemp3
+        config_list.append(getConfigListEntry(_("Keep player ready"),
+            config_serviceapp.player_pool, _("Keep one idle player process started, so the next service starts faster. Uses more memory.")))
+        config_list.append(getConfigListEntry(_("HLS playlist cache (seconds)"),
+            config_serviceapp.playlist_cache_ttl, _("How long explored HLS master playlist is used without asking the server again. Afterwards it's only revalidated when the server supports it. 0 disables the cache.")))
+        config_list.append(getConfigListEntry(_("Keep HLS playlist cache over restart"),
+            config_serviceapp.playlist_cache_snapshot, _("Save cached HLS master playlists to the flash, so they are used also after restart of Enigma2.")))
+        config_list.append(getConfigListEntry(_("HLS measured bandwidth usage (%)"),
+            config_serviceapp.bandwidth_margin, _("Part of the measured download speed of the server which automatically selected HLS stream may use. Stream is switched to lower one when playback repeatedly runs out of data. Segments are measured by the local proxy, so the measurement is used only when HLS segment prefetch is enabled. 0 disables the measurement, only the connection speed is used then.")))
+        config_list.append(getConfigListEntry(_("Remember measured bandwidth"),
+            config_serviceapp.bandwidth_snapshot, _("Save measured download speed of the servers to the flash, so it is used also after restart of Enigma2.")))
+        config_list.append(getConfigListEntry(_("HLS segment prefetch (segments)"),
+            config_serviceapp.hls_proxy_prefetch, _("HLS streams are played through local proxy, which downloads this many next segments in advance, so unstable connection doesn't interrupt the playback. 0 disables the proxy.")))
+        config_list.append(getConfigListEntry(_("HLS segment cache (MB)"),
+            config_serviceapp.hls_proxy_cache, _("Memory used by the local proxy for downloaded HLS segments.")))
+        config_list.append(getConfigListEntry(_("Remember player of the stream"),
+            config_serviceapp.player_history, _("Streams of the server are played by the player which started them fastest without errors, player which repeatedly fails is avoided. With fall back the other player is tried at once when the player fails before the playback starts. Services of gstplayer and exteplayer3 keep their own player.")))
         config_list.append(getConfigListEntry("", ConfigNothing()))
         config_list.append(getConfigListEntry(_("ServiceGstPlayer (%s)" % str(serviceapp_client.ID_SERVICEGSTPLAYER)), ConfigNothing()))
         config_list += self.player_options("gstplayer", "servicegstplayer")
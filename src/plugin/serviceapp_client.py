@@ -17,6 +17,13 @@ OPTIONS_SERVICEEXTEPLAYER3 = 2
 OPTIONS_USER = 3
 
 _SERVICEMP3_REPLACE_PATH = eEnv.resolve("$sysconfdir/enigma2/serviceapp_replaceservicemp3")
+_PLAYLIST_CACHE_PATH = eEnv.resolve("$sysconfdir/enigma2/serviceapp_playlists.cache")
+_BANDWIDTH_PATH = eEnv.resolve("$sysconfdir/enigma2/serviceapp_bandwidth")
+_PLAYER_HISTORY_PATH = eEnv.resolve("$sysconfdir/enigma2/serviceapp_players")
+
+PLAYER_HISTORY_DISABLED = 0
+PLAYER_HISTORY_REMEMBER = 1
+PLAYER_HISTORY_FALLBACK = 2
 
 
 def isExtEplayer3Available():
@@ -51,6 +58,26 @@ def setUseUserSettings():
 	serviceapp.use_user_settings()
 
 
+def setPlayerPool(enabled):
+	serviceapp.player_pool_enable(enabled)
+
+
+def setPlaylistCache(ttl, maxEntries=256, snapshot=False):
+	serviceapp.playlist_cache_set(ttl, maxEntries, _PLAYLIST_CACHE_PATH if snapshot else "")
+
+
+def setBandwidthEstimator(margin, snapshot=True):
+	serviceapp.bandwidth_estimator_set(margin, _BANDWIDTH_PATH if snapshot else "")
+
+
+def setPlayerHistory(mode, snapshot=True):
+	serviceapp.player_history_set(mode, _PLAYER_HISTORY_PATH if snapshot else "")
+
+
+def setHlsProxy(prefetch, cacheSizeMb=16):
+	serviceapp.hls_proxy_set(prefetch, cacheSizeMb * 1024)
+
+
 def setServiceAppSettings(settingId, HLSExplorer, autoSelectStream, connectionSpeedInKb, autoTurnOnSubtitles=True):
 	return serviceapp.serviceapp_set_setting(settingId,
                 HLSExplorer,
@@ -0,0 +1,82 @@
+#include <string.h>
+
+#include <lib/base/eerror.h>
+#include "asyncexplorer.h"
+#include "asyncjob.h"
+#include "playlistcache.h"
+
+struct ExplorerJob: public AsyncJob
+{
+	std::string url;
+	HeaderMap headers;
+	M3U8MasterPlaylist playlist;
+
+	void run()
+	{
+		M3U8VariantsExplorer ve(url, headers);
+		ve.setCancelFlag(&cancelled);
+		playlist = ve.getPlaylist();
+	}
+};
+
+AsyncVariantsExplorer::AsyncVariantsExplorer():
+	mJob(NULL),
+	mSerial(0),
+	mMessage(eApp, 1)
+{
+	CONNECT(mMessage.recv_msg, AsyncVariantsExplorer::gotMessage);
+}
+
+AsyncVariantsExplorer::~AsyncVariantsExplorer()
+{
+	cancel();
+}
+
+int AsyncVariantsExplorer::start(const std::string &url, const HeaderMap &headers)
+{
+	cancel();
+	ExplorerJob *job = new ExplorerJob();
+	job->url = url;
+	job->headers = headers;
+	int ret = job->start(&mMessage, ++mSerial);
+	if (ret)
+	{
+		eWarning("AsyncVariantsExplorer::start - cannot create thread: %s", strerror(ret));
+		delete job;
+		return -1;
+	}
+	eDebug("AsyncVariantsExplorer::start - %s", url.c_str());
+	mJob = job;
+	return 0;
+}
+
+void AsyncVariantsExplorer::cancel()
+{
+	if (!mJob)
+		return;
+	eDebug("AsyncVariantsExplorer::cancel - %s", mJob->url.c_str());
+	mJob->cancel();
+	mJob = NULL;
+}
+
+void AsyncVariantsExplorer::gotMessage(const unsigned int &serial)
+{
+	// result of a job cancelled after it was sent
+	if (!mJob || mJob->serial != serial)
+		return;
+	mPlaylist = mJob->playlist;
+	mJob->release();
+	mJob = NULL;
+	eDebug("AsyncVariantsExplorer::gotMessage - explored %zu variants, %zu renditions",
+		mPlaylist.variants.size(), mPlaylist.renditions.size());
+	explored(!mPlaylist.variants.empty());
+}
+
+bool AsyncVariantsExplorer::getCached(const std::string &url, const HeaderMap &headers, M3U8MasterPlaylist &playlist)
+{
+	PlaylistCacheEntry entry;
+	if (PlaylistCache::getInstance()->lookup(PlaylistCache::key(url, headers), entry) != PlaylistCache::fresh)
+		return false;
+	playlist = entry.playlist;
+	return true;
+}
@@ -0,0 +1,53 @@
+#ifndef __asyncexplorer_h
+#define __asyncexplorer_h
+
+#include <lib/base/ebase.h>
+#include <lib/base/message.h>
+#include <lib/python/connections.h>
+
+#include "m3u8.h"
+
+struct ExplorerJob;
+
+// Explores variants of HLS master playlist in detached worker thread, so
+// slow server doesn't block the mainloop. Result is passed back to the
+// mainloop and announced by explored signal.
+//
+// Cancelled job is not waited for, it gives up at its next request and its
+// result is dropped.
+#if SIGCXX_MAJOR_VERSION == 2
+class AsyncVariantsExplorer: public sigc::trackable
+#else
+class AsyncVariantsExplorer: public Object
+#endif
+{
+	ExplorerJob *mJob;
+	unsigned int mSerial;
+	M3U8MasterPlaylist mPlaylist;
+	eFixedMessagePump<unsigned int> mMessage;
+
+	void gotMessage(const unsigned int &serial);
+public:
+	AsyncVariantsExplorer();
+	~AsyncVariantsExplorer();
+
+	// returns -1 when worker thread cannot be started
+	int start(const std::string &url, const HeaderMap &headers);
+	void cancel();
+	bool running() const { return mJob != NULL; }
+	// playlist of the last finished exploration
+	const M3U8MasterPlaylist &getPlaylist() const { return mPlaylist; }
+
+	// playlist of the cache which doesn't need revalidation, so variant
+	// can be selected without any request, variant urls of the stale one
+	// may have expired already
+	static bool getCached(const std::string &url, const HeaderMap &headers, M3U8MasterPlaylist &playlist);
+
+#if SIGCXX_MAJOR_VERSION == 2
+	sigc::signal1<void,int> explored;
+#else
+	Signal1<void,int> explored;
+#endif
+};
+
+#endif
@@ -0,0 +1,50 @@
+#include "asyncjob.h"
+
+pthread_mutex_t AsyncJob::sMutex = PTHREAD_MUTEX_INITIALIZER;
+
+int AsyncJob::start(eFixedMessagePump<unsigned int> *pump, unsigned int serial)
+{
+	mPump = pump;
+	mRefs = 2;
+	this->serial = serial;
+	cancelled = false;
+
+	pthread_t tid;
+	pthread_attr_t attr;
+	pthread_attr_init(&attr);
+	pthread_attr_setdetachstate(&attr, PTHREAD_CREATE_DETACHED);
+	int ret = pthread_create(&tid, &attr, AsyncJob::thread, this);
+	pthread_attr_destroy(&attr);
+	return ret;
+}
+
+void AsyncJob::cancel()
+{
+	pthread_mutex_lock(&sMutex);
+	mPump = NULL;
+	cancelled = true;
+	pthread_mutex_unlock(&sMutex);
+	release();
+}
+
+void AsyncJob::release()
+{
+	pthread_mutex_lock(&sMutex);
+	bool last = --mRefs == 0;
+	pthread_mutex_unlock(&sMutex);
+	if (last)
+		delete this;
+}
+
+void *AsyncJob::thread(void *arg)
+{
+	AsyncJob *job = (AsyncJob *) arg;
+	job->run();
+
+	pthread_mutex_lock(&sMutex);
+	if (job->mPump)
+		job->mPump->send(job->serial);
+	pthread_mutex_unlock(&sMutex);
+	job->release();
+	return NULL;
+}
@@ -0,0 +1,41 @@
+#ifndef __asyncjob_h
+#define __asyncjob_h
+
+#include <pthread.h>
+#include <atomic>
+
+#include <lib/base/message.h>
+
+// Job of a detached worker thread which passes its result back to the
+// mainloop by message pump of its owner.
+//
+// Job is shared by the worker thread and the owner which started it, the
+// one who drops the last reference deletes it. Cancelled job is not waited
+// for, it gives up at its next check of cancelled and its result is dropped.
+class AsyncJob
+{
+	// guards pump and refs of all jobs
+	static pthread_mutex_t sMutex;
+	eFixedMessagePump<unsigned int> *mPump;
+	int mRefs;
+
+	static void *thread(void *arg);
+protected:
+	// called in the worker thread
+	virtual void run() = 0;
+public:
+	std::atomic<bool> cancelled;
+	// sent to the pump when the job finishes
+	unsigned int serial;
+
+	AsyncJob(): mPump(NULL), mRefs(0), cancelled(false), serial(0){}
+	virtual ~AsyncJob(){}
+	// returns error of pthread_create, job is not started then
+	int start(eFixedMessagePump<unsigned int> *pump, unsigned int serial);
+	// owner leaves the job to the worker thread, nothing is sent then
+	void cancel();
+	// owner is done with the result
+	void release();
+};
+
+#endif
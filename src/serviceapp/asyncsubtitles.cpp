@@ -0,0 +1,75 @@
+#include <string.h>
+
+#include <lib/base/eerror.h>
+#include "asyncjob.h"
+#include "asyncsubtitles.h"
+
+struct SubtitleJob: public AsyncJob
+{
+	std::string path;
+	int fps;
+	int result;
+	SubtitleTimeline timeline;
+
+	void run()
+	{
+		result = SubtitleManager::read(path, timeline, true, &cancelled, fps);
+	}
+};
+
+AsyncSubtitleLoader::AsyncSubtitleLoader():
+	mJob(NULL),
+	mSerial(0),
+	mMessage(eApp, 1)
+{
+	CONNECT(mMessage.recv_msg, AsyncSubtitleLoader::gotMessage);
+}
+
+AsyncSubtitleLoader::~AsyncSubtitleLoader()
+{
+	cancel();
+}
+
+int AsyncSubtitleLoader::start(const std::string &path, int fps)
+{
+	cancel();
+	SubtitleJob *job = new SubtitleJob();
+	job->path = path;
+	job->fps = fps;
+	job->result = -1;
+	int ret = job->start(&mMessage, ++mSerial);
+	if (ret)
+	{
+		eWarning("AsyncSubtitleLoader::start - cannot create thread: %s", strerror(ret));
+		delete job;
+		return -1;
+	}
+	eDebug("AsyncSubtitleLoader::start - %s", path.c_str());
+	mJob = job;
+	return 0;
+}
+
+void AsyncSubtitleLoader::cancel()
+{
+	if (!mJob)
+		return;
+	eDebug("AsyncSubtitleLoader::cancel - %s", mJob->path.c_str());
+	mJob->cancel();
+	mJob = NULL;
+}
+
+void AsyncSubtitleLoader::gotMessage(const unsigned int &serial)
+{
+	// result of a job cancelled after it was sent
+	if (!mJob || mJob->serial != serial)
+		return;
+	int result = mJob->result;
+	mPath = mJob->path;
+	mTimeline.clear();
+	mTimeline.swap(mJob->timeline);
+	mJob->release();
+	mJob = NULL;
+	eDebug("AsyncSubtitleLoader::gotMessage - %s: %s, %zu subtitles", mPath.c_str(),
+		result < 0 ? "error" : "success", mTimeline.size());
+	loaded(result == 0);
+}
@@ -0,0 +1,52 @@
+#ifndef __asyncsubtitles_h
+#define __asyncsubtitles_h
+
+#include <lib/base/ebase.h>
+#include <lib/base/message.h>
+#include <lib/python/connections.h>
+
+#include "subtitles/subtitles.h"
+
+struct SubtitleJob;
+
+// Reads external subtitle file in detached worker thread, so large file
+// or file on slow network mount doesn't block the mainloop. Result is
+// passed back to the mainloop and announced by loaded signal.
+//
+// Cancelled job is not waited for, it gives up after its current step
+// and its result is dropped.
+#if SIGCXX_MAJOR_VERSION == 2
+class AsyncSubtitleLoader: public sigc::trackable
+#else
+class AsyncSubtitleLoader: public Object
+#endif
+{
+	SubtitleJob *mJob;
+	unsigned int mSerial;
+	std::string mPath;
+	SubtitleTimeline mTimeline;
+	eFixedMessagePump<unsigned int> mMessage;
+
+	void gotMessage(const unsigned int &serial);
+public:
+	AsyncSubtitleLoader();
+	~AsyncSubtitleLoader();
+
+	// returns -1 when worker thread cannot be started, fps of the video
+	// in 1/1000 is used by frame based formats, -1 when it's not known
+	int start(const std::string &path, int fps);
+	void cancel();
+	bool running() const { return mJob != NULL; }
+	// path and timeline of the last finished load, timeline can be moved
+	// to the SubtitleManager
+	const std::string &getPath() const { return mPath; }
+	SubtitleTimeline &getTimeline() { return mTimeline; }
+
+#if SIGCXX_MAJOR_VERSION == 2
+	sigc::signal1<void,int> loaded;
+#else
+	Signal1<void,int> loaded;
+#endif
+};
+
+#endif
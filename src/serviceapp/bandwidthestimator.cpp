@@ -0,0 +1,233 @@
+#include <limits.h>
+#include <math.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include <unistd.h>
+#include <algorithm>
+
+#include "common.h"
+#include "bandwidthestimator.h"
+
+// smaller transfers measure mostly latency of the request
+#define MIN_SAMPLE_BYTES 16000
+#define MIN_TOTAL_BYTES 128000
+#define FAST_HALF_LIFE 2.0
+#define SLOW_HALF_LIFE 5.0
+// weight in seconds of estimate restored from snapshot or limited by underrun
+#define RESET_WEIGHT 5.0
+#define DEFAULT_MARGIN 70
+#define MAX_HOSTS 64
+
+#define SNAPSHOT_HEADER "SERVICEAPP_BANDWIDTH 1"
+#define SNAPSHOT_MAX_AGE (7 * 24 * 3600)
+
+Ewma::Ewma(double halfLife):
+    mAlpha(exp(log(0.5) / halfLife)),
+    mEstimate(0),
+    mTotalWeight(0)
+{
+}
+
+void Ewma::sample(double weight, double value)
+{
+    double adjAlpha = pow(mAlpha, weight);
+    mEstimate = value * (1 - adjAlpha) + adjAlpha * mEstimate;
+    mTotalWeight += weight;
+}
+
+void Ewma::reset(double value, double weight)
+{
+    mEstimate = value * (1 - pow(mAlpha, weight));
+    mTotalWeight = weight;
+}
+
+// average starts from zero, so early estimate is corrected by weight it has
+double Ewma::getEstimate() const
+{
+    double zeroFactor = 1 - pow(mAlpha, mTotalWeight);
+    return zeroFactor > 0 ? mEstimate / zeroFactor : 0;
+}
+
+BandwidthHost::BandwidthHost():
+    fast(FAST_HALF_LIFE),
+    slow(SLOW_HALF_LIFE),
+    bytes(0),
+    limited(false),
+    updated(0)
+{
+}
+
+unsigned long int BandwidthHost::getEstimate() const
+{
+    if (bytes < MIN_TOTAL_BYTES && !limited)
+        return 0;
+    double estimate = std::min(fast.getEstimate(), slow.getEstimate());
+    return estimate < (double)ULONG_MAX ? (unsigned long int)estimate : ULONG_MAX;
+}
+
+BandwidthEstimator *BandwidthEstimator::getInstance()
+{
+    static BandwidthEstimator estimator;
+    return &estimator;
+}
+
+BandwidthEstimator::BandwidthEstimator():
+    SnapshotStore("BandwidthEstimator", SNAPSHOT_HEADER),
+    mMargin(DEFAULT_MARGIN)
+{
+}
+
+BandwidthEstimator::~BandwidthEstimator()
+{
+    saveLocked(true);
+}
+
+void BandwidthEstimator::addSample(const std::string &host, size_t bytes, int64_t durationMs)
+{
+    if (host.empty() || bytes < MIN_SAMPLE_BYTES)
+        return;
+    if (durationMs < 1)
+        durationMs = 1;
+    double weight = durationMs / 1000.0;
+    double bitrate = bytes * 8 / weight;
+    pthread_mutex_lock(&mMutex);
+    BandwidthHost &entry = mHosts[host];
+    entry.fast.sample(weight, bitrate);
+    entry.slow.sample(weight, bitrate);
+    entry.bytes += bytes;
+    entry.updated = getMonotonicMs();
+    fprintf(stderr, "[BandwidthEstimator] %s: %zu bytes in %lldms, %.0f b/s, estimate %lu b/s\n", host.c_str(),
+            bytes, (long long)durationMs, bitrate, entry.getEstimate());
+    trim();
+    setDirty(true);
+    saveLocked(false);
+    pthread_mutex_unlock(&mMutex);
+}
+
+void BandwidthEstimator::addUnderrun(const std::string &host, unsigned long int bitrate)
+{
+    if (host.empty() || !bitrate)
+        return;
+    pthread_mutex_lock(&mMutex);
+    BandwidthHost &entry = mHosts[host];
+    unsigned long int estimate = entry.getEstimate();
+    if (!estimate || estimate > bitrate)
+    {
+        entry.fast.reset(bitrate, RESET_WEIGHT);
+        entry.slow.reset(bitrate, RESET_WEIGHT);
+    }
+    entry.limited = true;
+    entry.updated = getMonotonicMs();
+    fprintf(stderr, "[BandwidthEstimator] %s: underrun at %lu b/s, estimate %lu b/s\n", host.c_str(),
+            bitrate, entry.getEstimate());
+    trim();
+    setDirty(true);
+    saveLocked(false);
+    pthread_mutex_unlock(&mMutex);
+}
+
+unsigned long int BandwidthEstimator::getEstimate(const std::string &host)
+{
+    unsigned long int estimate = 0;
+    pthread_mutex_lock(&mMutex);
+    std::map<std::string, BandwidthHost>::const_iterator it = mHosts.find(host);
+    if (it != mHosts.end())
+        estimate = it->second.getEstimate();
+    pthread_mutex_unlock(&mMutex);
+    return estimate;
+}
+
+unsigned long int BandwidthEstimator::getBudget(const std::string &host)
+{
+    unsigned long int estimate = getEstimate(host);
+    pthread_mutex_lock(&mMutex);
+    unsigned int margin = mMargin;
+    pthread_mutex_unlock(&mMutex);
+    return (unsigned long int)((double)estimate * margin / 100);
+}
+
+// snapshot is kept, see setSnapshot
+void BandwidthEstimator::clear()
+{
+    pthread_mutex_lock(&mMutex);
+    mHosts.clear();
+    setDirty(false);
+    pthread_mutex_unlock(&mMutex);
+}
+
+// least recently updated hosts are dropped
+void BandwidthEstimator::trim()
+{
+    while (mHosts.size() > MAX_HOSTS)
+    {
+        std::map<std::string, BandwidthHost>::iterator oldest = mHosts.begin();
+        for (std::map<std::string, BandwidthHost>::iterator it(mHosts.begin()); it != mHosts.end(); it++)
+        {
+            if (it->second.updated < oldest->second.updated)
+                oldest = it;
+        }
+        mHosts.erase(oldest);
+    }
+}
+
+void BandwidthEstimator::setMargin(unsigned int percent)
+{
+    pthread_mutex_lock(&mMutex);
+    mMargin = std::min(percent, 100U);
+    pthread_mutex_unlock(&mMutex);
+}
+
+void BandwidthEstimator::writeSnapshot(FILE *f)
+{
+    int64_t now = getMonotonicMs();
+    time_t wallNow = time(NULL);
+    for (std::map<std::string, BandwidthHost>::const_iterator it(mHosts.begin()); it != mHosts.end(); it++)
+    {
+        const BandwidthHost &entry = it->second;
+        unsigned long int estimate = entry.getEstimate();
+        // host names don't contain whitespace
+        if (estimate)
+            fprintf(f, "%s %lu %llu %d %lld\n", it->first.c_str(), estimate, (unsigned long long)entry.bytes,
+                    entry.limited, (long long)(wallNow - (now - entry.updated) / 1000));
+    }
+}
+
+bool BandwidthEstimator::readSnapshot(FILE *f, size_t &loaded)
+{
+    char line[512];
+    bool valid = true;
+    int64_t now = getMonotonicMs();
+    time_t wallNow = time(NULL);
+    while (fgets(line, sizeof(line), f))
+    {
+        char host[256];
+        unsigned long int estimate;
+        unsigned long long bytes;
+        int limited;
+        long long updated;
+        if (sscanf(line, "%255s %lu %llu %d %lld", host, &estimate, &bytes, &limited, &updated) != 5)
+        {
+            valid = false;
+            break;
+        }
+        // updated in the future, clock was changed
+        if (updated > wallNow)
+            updated = wallNow;
+        if (wallNow - updated > SNAPSHOT_MAX_AGE || !estimate)
+            continue;
+        BandwidthHost &entry = mHosts[host];
+        // measured since the start wins
+        if (entry.updated)
+            continue;
+        entry.fast.reset(estimate, RESET_WEIGHT);
+        entry.slow.reset(estimate, RESET_WEIGHT);
+        entry.bytes = bytes;
+        entry.limited = limited;
+        entry.updated = now - (int64_t)(wallNow - updated) * 1000;
+        loaded++;
+    }
+    trim();
+    return valid;
+}
@@ -0,0 +1,76 @@
+#ifndef __bandwidthestimator_h
+#define __bandwidthestimator_h
+
+#include <pthread.h>
+#include <stdint.h>
+#include <map>
+#include <string>
+
+#include "snapshot.h"
+
+// exponentially weighted moving average of samples weighted by their
+// duration, older samples lose half of their weight every halfLife seconds
+class Ewma
+{
+    double mAlpha;
+    double mEstimate;
+    double mTotalWeight;
+public:
+    Ewma(double halfLife);
+    void sample(double weight, double value);
+    // starts again from value, as if it was measured for weight seconds
+    void reset(double value, double weight);
+    double getEstimate() const;
+};
+
+struct BandwidthHost
+{
+    // fast average follows drops of the throughput quickly, slow one
+    // ignores short peaks, lower of them is used
+    Ewma fast;
+    Ewma slow;
+    uint64_t bytes;
+    // limited by underrun of the player, trusted without enough bytes
+    bool limited;
+    int64_t updated;
+    BandwidthHost();
+    unsigned long int getEstimate() const;
+};
+
+// Process-wide estimate of the download throughput per host.
+//
+// Samples are transfers of playlists and segments, transfers too small to
+// measure the throughput rather than latency are ignored. Estimate is used
+// only after enough bytes were measured or once the player reported
+// underruns, then the bitrate which couldn't be sustained caps it.
+//
+// Estimates can be saved to a snapshot file, so known hosts start with
+// the right variant also after restart of the enigma2.
+class BandwidthEstimator: public SnapshotStore
+{
+    std::map<std::string, BandwidthHost> mHosts;
+    unsigned int mMargin;
+
+    void trim();
+    void writeSnapshot(FILE *f);
+    bool readSnapshot(FILE *f, size_t &loaded);
+    BandwidthEstimator();
+    ~BandwidthEstimator();
+public:
+    static BandwidthEstimator *getInstance();
+
+    // bytes downloaded from the host in durationMs, including request
+    void addSample(const std::string &host, size_t bytes, int64_t durationMs);
+    // player couldn't keep up with the bitrate (bits/s) from the host
+    void addUnderrun(const std::string &host, unsigned long int bitrate);
+    // bits/s, 0 when the host is not known yet
+    unsigned long int getEstimate(const std::string &host);
+    // part of the estimate which variant may use, 0 when not known
+    unsigned long int getBudget(const std::string &host);
+    void clear();
+
+    // percentage of the estimate used for variant selection, 0 disables it
+    void setMargin(unsigned int percent);
+};
+
+#endif
@@ -0,0 +1,264 @@
+#include <errno.h>
+#include <iconv.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <string.h>
+
+#include "charset.h"
+#include "charsettables.h"
+#include "common.h"
+
+// uchardet doesn't get better with more text than this
+#define DETECT_MAX (256 * 1024)
+
+#define HIGH_BITS 0x8080808080808080ULL
+
+static const char replacement[] = "\xEF\xBF\xBD";
+
+// length of the run of 7-bit characters at the start, eight bytes are
+// checked at once
+static size_t asciiLength(const unsigned char *p, const unsigned char *end)
+{
+    const unsigned char *start = p;
+    while (end - p >= 8)
+    {
+        uint64_t word;
+        memcpy(&word, p, 8);
+        if (word & HIGH_BITS)
+            break;
+        p += 8;
+    }
+    while (p < end && *p < 0x80)
+        p++;
+    return p - start;
+}
+
+bool isUTF8(const char *data, size_t len, bool *ascii)
+{
+    const unsigned char *p = (const unsigned char *) data, *end = p + len;
+    bool only_ascii = true;
+    while (p < end)
+    {
+        p += asciiLength(p, end);
+        if (p >= end)
+            break;
+        only_ascii = false;
+        unsigned char c = *p;
+        size_t n;
+        uint32_t cp;
+        if (c >= 0xC2 && c <= 0xDF)
+        {
+            n = 1;
+            cp = c & 0x1F;
+        }
+        else if (c >= 0xE0 && c <= 0xEF)
+        {
+            n = 2;
+            cp = c & 0x0F;
+        }
+        else if (c >= 0xF0 && c <= 0xF4)
+        {
+            n = 3;
+            cp = c & 0x07;
+        }
+        else
+            return false;
+        if ((size_t)(end - p) <= n)
+            return false;
+        for (size_t i = 1; i <= n; i++)
+        {
+            if ((p[i] & 0xC0) != 0x80)
+                return false;
+            cp = (cp << 6) | (p[i] & 0x3F);
+        }
+        if ((n == 2 && (cp < 0x800 || (cp >= 0xD800 && cp <= 0xDFFF))) || (n == 3 && (cp < 0x10000 || cp > 0x10FFFF)))
+            return false;
+        p += n + 1;
+    }
+    if (ascii)
+        *ascii = only_ascii;
+    return true;
+}
+
+// upper case with the usual aliases of the table names
+static std::string normalizeName(const std::string &encoding)
+{
+    std::string name;
+    for (size_t i = 0; i < encoding.size(); i++)
+        name += toupper((unsigned char) encoding[i]);
+    if (!name.compare(0, 2, "CP") && name.size() == 6 && !name.compare(2, 2, "12"))
+        name = "WINDOWS-" + name.substr(2);
+    else if (!name.compare(0, 7, "ISO8859") || !name.compare(0, 8, "ISO_8859"))
+        name = "ISO-8859-" + name.substr(name[3] == '_' ? 9 : 8);
+    else if (name == "LATIN1")
+        name = "ISO-8859-1";
+    else if (name == "US-ASCII")
+        name = "ASCII";
+    return name;
+}
+
+static const CharsetTable *findTable(const std::string &name)
+{
+    for (size_t i = 0; i < sizeof(charsetTables) / sizeof(charsetTables[0]); i++)
+    {
+        if (name == charsetTables[i].name)
+            return &charsetTables[i];
+    }
+    return NULL;
+}
+
+static char *putUTF8(char *out, uint16_t cp)
+{
+    if (cp < 0x800)
+    {
+        *out++ = 0xC0 | (cp >> 6);
+        *out++ = 0x80 | (cp & 0x3F);
+    }
+    else
+    {
+        *out++ = 0xE0 | (cp >> 12);
+        *out++ = 0x80 | ((cp >> 6) & 0x3F);
+        *out++ = 0x80 | (cp & 0x3F);
+    }
+    return out;
+}
+
+// characters of the tables take at most three bytes in UTF-8
+static void convertByTable(const unsigned char *p, const unsigned char *end, const CharsetTable *table,
+        std::string &output)
+{
+    output.resize((end - p) * 3);
+    char *start = &output[0], *out = start;
+    while (p < end)
+    {
+        size_t run = asciiLength(p, end);
+        memcpy(out, p, run);
+        out += run;
+        p += run;
+        if (p < end)
+            out = putUTF8(out, table->chars[*p++ - 0x80]);
+    }
+    output.resize(out - start);
+}
+
+static int convertByIconv(const char *data, size_t len, const std::string &encoding, std::string &output)
+{
+    iconv_t cd = iconv_open("UTF-8", encoding.c_str());
+    if (cd == (iconv_t) -1)
+        return -1;
+    output.clear();
+    output.reserve(len + len / 2);
+    char buf[4096];
+    char *in = (char *) data;
+    size_t in_left = len;
+    while (in_left)
+    {
+        char *out = buf;
+        size_t out_left = sizeof(buf);
+        size_t ret = iconv(cd, &in, &in_left, &out, &out_left);
+        output.append(buf, out - buf);
+        if (ret == (size_t) -1 && errno != E2BIG)
+        {
+            // invalid or incomplete sequence
+            output += replacement;
+            in++;
+            in_left--;
+        }
+    }
+    char *out = buf;
+    size_t out_left = sizeof(buf);
+    iconv(cd, NULL, NULL, &out, &out_left);
+    output.append(buf, out - buf);
+    iconv_close(cd);
+    return 0;
+}
+
+static bool isLetterByte(unsigned char c)
+{
+    return (c >= 'a' && c <= 'z') || (c >= 'A' && c <= 'Z') || c >= 0xC0;
+}
+
+std::string guessCentralEuropean(const char *data, size_t len, const std::string &detected)
+{
+    const unsigned char *start = (const unsigned char *) data, *end = start + len;
+    const CharsetTable *windows1250 = findTable("WINDOWS-1250");
+    // positive for WINDOWS-1250
+    int64_t score = 0;
+    for (const unsigned char *p = start; p < end; p++)
+    {
+        p += asciiLength(p, end);
+        if (p >= end)
+            break;
+        // control characters of ISO-8859-2 are not used in text
+        if (*p < 0xA0)
+        {
+            if (windows1250->chars[*p - 0x80] != 0xFFFD)
+                score += 4;
+            continue;
+        }
+        // letter is expected next to other letters, symbol elsewhere
+        int letter = windows1250Letters[*p - 0xA0];
+        if (letter)
+        {
+            bool letter_around = (p > start && isLetterByte(p[-1])) || (p + 1 < end && isLetterByte(p[1]));
+            score += letter_around ? letter : -letter;
+        }
+    }
+    if (score > 0)
+        return "WINDOWS-1250";
+    if (score < 0)
+        return "ISO-8859-2";
+    return detected;
+}
+
+int convertCharset(const char *data, size_t len, const std::string &encoding, std::string &output)
+{
+    std::string name = normalizeName(encoding);
+    const CharsetTable *table = findTable(name);
+    if (table)
+    {
+        convertByTable((const unsigned char *) data, (const unsigned char *) data + len, table, output);
+        return 0;
+    }
+    if (convertByIconv(data, len, name, output) == 0)
+        return 0;
+#ifndef NO_PYTHON
+    // codecs of python know some encodings which iconv of the image
+    // doesn't, it can be called from worker threads
+    PyGILState_STATE state = PyGILState_Ensure();
+    int ret = convertToUTF8(std::string(data, len), encoding, output);
+    PyGILState_Release(state);
+    if (ret == 0)
+        return 0;
+#endif
+    fprintf(stderr, "convertCharset - %s is not supported\n", encoding.c_str());
+    return -1;
+}
+
+int toUTF8(const char *data, size_t len, std::string &output, std::string *encoding)
+{
+    bool ascii;
+    if (isUTF8(data, len, &ascii))
+    {
+        if (encoding)
+            *encoding = ascii ? "ASCII" : "UTF-8";
+        return 1;
+    }
+    std::string name;
+#ifndef NO_UCHARDET
+    if (detectEncoding(std::string(data, std::min(len, (size_t) DETECT_MAX)), name) != 0)
+        name.clear();
+#endif
+    if (name.empty())
+    {
+        fprintf(stderr, "toUTF8 - cannot detect encoding\n");
+        return -1;
+    }
+    name = normalizeName(name);
+    if (name == "ISO-8859-2" || name == "WINDOWS-1250")
+        name = guessCentralEuropean(data, len, name);
+    fprintf(stderr, "toUTF8 - detected input encoding: %s\n", name.c_str());
+    if (encoding)
+        *encoding = name;
+    return convertCharset(data, len, name, output) < 0 ? -1 : 0;
+}
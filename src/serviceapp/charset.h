@@ -0,0 +1,34 @@
+#ifndef __charset_h
+#define __charset_h
+
+#include <stddef.h>
+#include <string>
+
+// Detection and conversion of text files to UTF-8 without the Python
+// interpreter.
+//
+// Valid UTF-8, pure ASCII included, is recognized by a scan which checks
+// eight bytes at once and is used as it is. Single byte codepages are
+// converted by built-in tables, other encodings by iconv and as the last
+// resort by Python codecs.
+
+// valid UTF-8 without overlong forms and surrogates, ascii is set when
+// there are only 7-bit characters
+bool isUTF8(const char *data, size_t len, bool *ascii=NULL);
+
+// ISO-8859-2 and WINDOWS-1250 differ mostly in the bytes which are control
+// characters or symbols in one of them and letters in the other one, text
+// is scored by them in one pass, detected encoding is returned when the
+// score is even
+std::string guessCentralEuropean(const char *data, size_t len, const std::string &detected);
+
+// returns -1 when the encoding is not supported, invalid bytes are
+// replaced by U+FFFD
+int convertCharset(const char *data, size_t len, const std::string &encoding, std::string &output);
+
+// returns 1 when the data is UTF-8 already and output is not touched,
+// 0 when the output holds the converted data and -1 when the encoding
+// cannot be detected or converted
+int toUTF8(const char *data, size_t len, std::string &output, std::string *encoding=NULL);
+
+#endif
@@ -6,6 +6,7 @@
 #include <stdint.h>
 #include <string>
 #include <sys/stat.h>
+#include <time.h>
 
 #include "common.h"
 
@@ -195,10 +196,12 @@ int listDir(const std::string &dirpath, std::vector<std::string> *files, std::ve
     return 0;
 }
 
-static const uint8_t iso8859_2_unused_utf8[10][2] = {
-    {0xc2,0x8a},{0xc2,0x8c},{0xc2,0x8d},{0xc2,0x8e},{0xc2,0x8f},
-    {0xc2,0x9a},{0xc2,0x9c},{0xc2,0x9d},{0xc2,0x9e},{0xc2,0x9f}};
-
+int64_t getMonotonicMs()
+{
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return (int64_t)ts.tv_sec * 1000 + ts.tv_nsec / 1000000;
+}
 
 #ifndef NO_UCHARDET
 int detectEncoding(const std::string &content, std::string &encoding)
@@ -208,6 +211,7 @@ int detectEncoding(const std::string &content, std::string &encoding)
     if (retval != 0)
     {
         fprintf(stderr, "uchardet error: handle data error.\n");
+        uchardet_delete(handle);
         return 1;
     }
     uchardet_data_end(handle);
@@ -247,50 +251,6 @@ int convertToUTF8(const std::string &input_string, const std::string &input_enco
     Py_DECREF(py_string);
     return 0;
 }
-
-int convertToUTF8(const std::string &input_string, std::string &output_string)
-{
-    std::string input_encoding;
-    if (detectEncoding(input_string, input_encoding) != 0)
-    {
-        fprintf(stderr, "convertToUTF8 - cannot detect encoding\n");
-        return -1;
-    }
-    fprintf(stderr, "convertToUTF8 - detected input encoding: %s\n", input_encoding.c_str());
-    if (convertToUTF8(input_string, input_encoding, output_string) != 0)
-    {
-        fprintf(stderr, "convertToUTF8 - cannot convert to utf-8");
-        return -1;
-    }
-    // workaround when uchardet detects wrongly ISO-8859-2 instead
-    // of WINDOWS-1250
-    if (input_encoding == "ISO-8859-2")
-    {
-        bool decode_again = false;
-        for (int i = 0; i < 10; i++)
-        {
-            fprintf(stderr, "convertToUTF8 - looking for %#x,%#x: ", iso8859_2_unused_utf8[i][0], iso8859_2_unused_utf8[i][1]);
-            void *ptr = memmem(output_string.c_str(), output_string.length(), iso8859_2_unused_utf8[i], 2);
-            if (ptr != NULL)
-            {
-                fprintf(stderr, "found\n");
-                decode_again = true;
-                break;
-            }
-            printf("not found\n");
-        }
-        if (decode_again)
-        {
-            fprintf(stderr, "convertToUTF8 - ISO-8859-2 is not right encoding, trying WINDOWS-1250\n");
-            if (0 != convertToUTF8(input_string, "WINDOWS-1250", output_string))
-            {
-                fprintf(stderr, "convertToUTF8 - cannot convert to utf-8");
-                return -1;
-            }
-        }
-    }
-    return 0;
-}
 #endif
 
 static int unquotePlus(char* out, const char* in);
@@ -9,6 +9,7 @@
 #include <uchardet/uchardet.h>
 #endif
 
+#include <stdint.h>
 #include <algorithm>
 #include <cctype>
 #include <functional>
@@ -84,6 +85,8 @@ public:
 void splitExtension(const std::string &path, std::string &basename, std::string &extension);
 void splitPath(const std::string &path, std::string &dirpath, std::string &filename);
 int listDir(const std::string &dirpath, std::vector<std::string> *directories, std::vector<std::string> *files);
+// milliseconds of CLOCK_MONOTONIC
+int64_t getMonotonicMs();
 
 #ifndef NO_UCHARDET
 int detectEncoding(const std::string &content, std::string &encoding);
@@ -91,7 +94,6 @@ int detectEncoding(const std::string &content, std::string &encoding);
 
 #ifndef NO_PYTHON
 int convertToUTF8(const std::string &input_string, const std::string &input_encoding, std::string &output_string);
-int convertToUTF8(const std::string &input_string, std::string &output_string);
 #endif
 HeaderMap getHeaders(const std::string& url);
 
@@ -0,0 +1,249 @@
+#include <poll.h>
+
+#include "common.h"
+#include "connectionpool.h"
+
+#define CONNECT_TIMEOUT 5
+
+ConnectionPool *ConnectionPool::getInstance()
+{
+    static ConnectionPool pool;
+    return &pool;
+}
+
+ConnectionPool::ConnectionPool():
+    mSslCtx(NULL),
+    mMaxIdle(8),
+    mIdleTimeout(15000),
+    mConnects(0),
+    mReuses(0),
+    mResumptions(0)
+{
+    pthread_mutex_init(&mMutex, NULL);
+}
+
+ConnectionPool::~ConnectionPool()
+{
+    clear();
+    for (std::map<std::string, SSL_SESSION *>::iterator it(mSessions.begin()); it != mSessions.end(); it++)
+        SSL_SESSION_free(it->second);
+    if (mSslCtx)
+        SSL_CTX_free(mSslCtx);
+    pthread_mutex_destroy(&mMutex);
+}
+
+// created on first https request, SSL library is initialized by then
+SSL_CTX *ConnectionPool::sslContext()
+{
+    if (mSslCtx == NULL)
+    {
+        mSslCtx = SSL_CTX_new(SSLv23_client_method());
+        if (mSslCtx == NULL)
+        {
+            fprintf(stderr, "[ConnectionPool] Error in SSL_CTX_new:\n");
+            ERR_print_errors_fp(stderr);
+            return NULL;
+        }
+        SSL_CTX_set_default_verify_paths(mSslCtx);
+    }
+    return mSslCtx;
+}
+
+void ConnectionPool::close(HttpConnection &conn)
+{
+    if (conn.ssl)
+    {
+        SSL_shutdown(conn.ssl);
+        SSL_free(conn.ssl);
+        conn.ssl = NULL;
+    }
+    if (conn.fd >= 0)
+    {
+        ::close(conn.fd);
+        conn.fd = -1;
+    }
+}
+
+// drops connections idle for too long
+void ConnectionPool::expire()
+{
+    int64_t now = getMonotonicMs();
+    std::list<HttpConnection>::iterator it(mIdle.begin());
+    while (it != mIdle.end())
+    {
+        if (now - it->idleSince > mIdleTimeout)
+        {
+            close(*it);
+            it = mIdle.erase(it);
+        }
+        else
+            it++;
+    }
+}
+
+// idle connection which has something to read was closed by server
+static bool isAlive(const HttpConnection &conn)
+{
+    struct pollfd pfd = {conn.fd, POLLIN, 0};
+    return poll(&pfd, 1, 0) == 0;
+}
+
+int ConnectionPool::acquire(const std::string &scheme, const std::string &host, int port, HttpConnection &conn,
+        const std::atomic<bool> *cancelled)
+{
+    char portstr[16];
+    snprintf(portstr, sizeof(portstr), "%d", port);
+    std::string key = scheme + "://" + host + ":" + portstr;
+    bool secure = scheme == "https";
+    SSL *ssl = NULL;
+
+    pthread_mutex_lock(&mMutex);
+    expire();
+    // most recently used first
+    for (std::list<HttpConnection>::iterator it(mIdle.begin()); it != mIdle.end();)
+    {
+        if (it->key != key)
+        {
+            it++;
+            continue;
+        }
+        HttpConnection idle = *it;
+        it = mIdle.erase(it);
+        if (!isAlive(idle))
+        {
+            close(idle);
+            continue;
+        }
+        conn = idle;
+        conn.reused = true;
+        mReuses++;
+        pthread_mutex_unlock(&mMutex);
+        fprintf(stderr, "[ConnectionPool] reusing connection to %s\n", key.c_str());
+        return 0;
+    }
+    if (secure)
+    {
+        SSL_CTX *ctx = sslContext();
+        if (ctx)
+            ssl = SSL_new(ctx);
+        if (ssl == NULL)
+        {
+            pthread_mutex_unlock(&mMutex);
+            return -1;
+        }
+        std::map<std::string, SSL_SESSION *>::iterator it = mSessions.find(key);
+        if (it != mSessions.end())
+            SSL_set_session(ssl, it->second);
+    }
+    mConnects++;
+    pthread_mutex_unlock(&mMutex);
+
+    int fd = Connect(host.c_str(), port, CONNECT_TIMEOUT, cancelled);
+    if (fd < 0)
+    {
+        fprintf(stderr, "[ConnectionPool] cannot connect to %s\n", key.c_str());
+        if (ssl)
+            SSL_free(ssl);
+        return -1;
+    }
+    if (ssl)
+    {
+        if (SSLConnect(host.c_str(), fd, ssl) < 0)
+        {
+            SSL_free(ssl);
+            ::close(fd);
+            return -1;
+        }
+        bool resumed = SSL_session_reused(ssl);
+        fprintf(stderr, "[ConnectionPool] (SSL) connected to %s with %s encryption%s\n",
+                key.c_str(), SSL_get_cipher(ssl), resumed ? ", session resumed" : "");
+        // just inform about verification error but continue to work
+        if (SSL_get_verify_result(ssl) != X509_V_OK)
+        {
+            fprintf(stderr, "[ConnectionPool] (SSL) Error in certificate verification: %s\n",
+                    X509_verify_cert_error_string(SSL_get_verify_result(ssl)));
+        }
+        if (resumed)
+        {
+            pthread_mutex_lock(&mMutex);
+            mResumptions++;
+            pthread_mutex_unlock(&mMutex);
+        }
+    }
+    conn.fd = fd;
+    conn.ssl = ssl;
+    conn.key = key;
+    conn.reused = false;
+    return 0;
+}
+
+void ConnectionPool::release(HttpConnection &conn, bool reusable)
+{
+    if (conn.fd < 0)
+        return;
+    pthread_mutex_lock(&mMutex);
+    if (conn.ssl)
+    {
+        // tls 1.3 session tickets come after the handshake, so session
+        // is taken when the connection was used
+        SSL_SESSION *session = SSL_get1_session(conn.ssl);
+        if (session)
+        {
+            std::map<std::string, SSL_SESSION *>::iterator it = mSessions.find(conn.key);
+            if (it != mSessions.end())
+            {
+                SSL_SESSION_free(it->second);
+                it->second = session;
+            }
+            else
+                mSessions[conn.key] = session;
+        }
+    }
+    if (reusable && mMaxIdle)
+    {
+        conn.idleSince = getMonotonicMs();
+        mIdle.push_front(conn);
+        while (mIdle.size() > mMaxIdle)
+        {
+            close(mIdle.back());
+            mIdle.pop_back();
+        }
+    }
+    else
+    {
+        close(conn);
+    }
+    pthread_mutex_unlock(&mMutex);
+    conn = HttpConnection();
+}
+
+void ConnectionPool::clear()
+{
+    pthread_mutex_lock(&mMutex);
+    for (std::list<HttpConnection>::iterator it(mIdle.begin()); it != mIdle.end(); it++)
+        close(*it);
+    mIdle.clear();
+    pthread_mutex_unlock(&mMutex);
+}
+
+void ConnectionPool::setLimits(size_t maxIdle, int idleTimeoutMs)
+{
+    pthread_mutex_lock(&mMutex);
+    mMaxIdle = maxIdle;
+    mIdleTimeout = idleTimeoutMs;
+    while (mIdle.size() > mMaxIdle)
+    {
+        close(mIdle.back());
+        mIdle.pop_back();
+    }
+    pthread_mutex_unlock(&mMutex);
+}
+
+void ConnectionPool::getStats(unsigned int &connects, unsigned int &reuses, unsigned int &resumptions)
+{
+    pthread_mutex_lock(&mMutex);
+    connects = mConnects;
+    reuses = mReuses;
+    resumptions = mResumptions;
+    pthread_mutex_unlock(&mMutex);
+}
@@ -0,0 +1,63 @@
+#ifndef __connectionpool_h
+#define __connectionpool_h
+
+#include <pthread.h>
+#include <stdint.h>
+#include <list>
+#include <map>
+#include <string>
+
+#include "wrappers.h"
+
+struct HttpConnection
+{
+    int fd;
+    SSL *ssl;
+    std::string key; // scheme://host:port
+    bool reused;
+    int64_t idleSince;
+    HttpConnection(): fd(-1), ssl(NULL), reused(false), idleSince(0){}
+};
+
+// Process-wide pool of keep-alive http(s) connections.
+//
+// Connections are kept idle per scheme, host and port for following
+// requests, i.e. redirects and repeated exploration of the same provider.
+// All TLS connections share one SSL_CTX and last session of the host is
+// offered for resumption, so new connection to known host doesn't need
+// full handshake.
+class ConnectionPool
+{
+    pthread_mutex_t mMutex;
+    SSL_CTX *mSslCtx;
+    std::list<HttpConnection> mIdle;
+    std::map<std::string, SSL_SESSION *> mSessions;
+    size_t mMaxIdle;
+    int mIdleTimeout;
+    unsigned int mConnects;
+    unsigned int mReuses;
+    unsigned int mResumptions;
+
+    SSL_CTX *sslContext();
+    void close(HttpConnection &conn);
+    void expire();
+    ConnectionPool();
+    ~ConnectionPool();
+public:
+    static ConnectionPool *getInstance();
+
+    // idle connection to the host or new one, returns -1 on failure,
+    // connecting gives up once the cancelled flag is set
+    int acquire(const std::string &scheme, const std::string &host, int port, HttpConnection &conn,
+            const std::atomic<bool> *cancelled=NULL);
+    // connection is kept for next request only when reusable, i.e. whole
+    // response was read and server didn't ask to close it
+    void release(HttpConnection &conn, bool reusable);
+    // closes idle connections, sessions are kept
+    void clear();
+    void setLimits(size_t maxIdle, int idleTimeoutMs);
+    // number of new connections, reused connections and resumed TLS sessions
+    void getStats(unsigned int &connects, unsigned int &reuses, unsigned int &resumptions);
+};
+
+#endif
@@ -38,29 +38,13 @@ struct ExtEplayer3Options : public IOption
 	int update(const std::string&, const std::string&);
 };
 
-class ExtEplayer3: public PlayerApp, public BasePlayer
+class ExtEplayer3: public ExtPlayer
 {
 	ExtEplayer3Options mPlayerOptions;
-	void handleProcessStopped(int retval);
-	void handleJsonOutput(cJSON* json);
 	std::vector<std::string> buildCommand();
-	public:
+	bool buildStandbyCommand(std::vector<std::string> &args, std::string &handover);
+public:
 	ExtEplayer3(ExtEplayer3Options& options);
-	int start(eMainloop *context);
-
-	int sendStop();
-	int sendForceStop();
-	int sendPause();
-	int sendResume();
-	int sendUpdateLength();
-	int sendUpdatePosition();
-	int sendUpdateAudioTracksList();
-	int sendUpdateAudioTrackCurrent();
-	int sendAudioSelectTrack(int trackId);
-	int sendUpdateSubtitleTracksList();
-	int sendUpdateSubtitleTrackCurrent();
-	int sendSubtitleSelectTrack(int trackId);
-	int sendSeekTo(int seconds);
-	int sendSeekRelative(int seconds);
+	bool supportsAudioUrl() const { return true; }
 };
 #endif
@@ -1,127 +1,81 @@
 #include <time.h>
+#include <algorithm>
 #include <extplayer.h>
-#include <cJSON/cJSON.h>
+#include "common.h"
+#include "playerpool.h"
 #include <error.h>
 
-void PlayerApp::handleJsonStr(const std::string& data)
+void PlayerApp::handleEvent(const PlayerEvent &event)
 {
-	eLog(5, "PlayerApp::handleJsonStr: %s", data.c_str());
-	cJSON *json = cJSON_Parse(data.c_str());
-	if (!json)
+	eLog(5, "PlayerApp::handleEvent: %.*s", (int)event.keyLen, event.key);
+	if (event.type == PlayerEvent::playbackPlay && !standbyArgs.empty())
 	{
-		eDebug("Error before: [%s]", cJSON_GetErrorPtr());
-		return;
+		// get the next player ready, but don't slow down start of this one
+		PlayerPool::getInstance()->prepare(standbyArgs);
+		standbyArgs.clear();
 	}
-	handleJsonOutput(json);
-	cJSON_Delete(json);
+	handlePlayerEvent(event);
 }
-void PlayerApp::handleOutput(const std::string& mydata)
-{
-	//FIXME
-	std::size_t pos = 0;
-	std::size_t startpos = 0;
 
-	while((pos = mydata.find('\n', pos)) != std::string::npos)
-	{
-		if (truncated)
-		{
-			if (mydata[pos-1] != '}')
-			{
-				jsonstr = "";
-				truncated = 0;
-				return;
-			}
-			handleJsonStr(jsonstr + mydata.substr(startpos, pos - startpos));
-			jsonstr = "";
-			truncated = 0;
-		}
-		else
-		{
-			if (mydata[0] != '{')
-			{
-				jsonstr = "";
-				truncated = 0;
-				return;
-			}
-			handleJsonStr(mydata.substr(startpos, pos - startpos));
-			jsonstr = "";
-			truncated = 0;
-		}
-		pos+=1;
-		startpos = pos;
-	}
-	if (startpos != std::string::npos && startpos != mydata.length())
-	{
-		//std::cout << "remains: " << mydata.length()-startpos;
-		if (mydata[mydata.length()-1] == '}')
-		{
-			handleJsonStr(mydata.substr(startpos, mydata.length() - pos));
-			truncated = 0;
-		}
-		else
-		{
-			truncated = 1;
-			jsonstr = mydata.substr(startpos);
-		}
-	}
+void PlayerApp::handleUndecodable(const char *data, size_t len)
+{
+	eDebug("PlayerApp::handleUndecodable - cannot decode: %.*s", (int)len, data);
 }
 
-void PlayerApp::stderrAvail(const char *data)
+void PlayerApp::stderrAvail(const char *data, int len)
 {
-	std::string mydata(data);
-	eLog(5, "PlayerApp::stderrAvail: %s", mydata.c_str());
+	eLog(5, "PlayerApp::stderrAvail: %.*s", len, data);
 	if (parseOutput == STD_ERROR)
 	{
-		handleOutput(mydata);
+		protocol.feed(data, len, *this);
 	}
 }
 
-void PlayerApp::stdoutAvail(const char *data)
+void PlayerApp::stdoutAvail(const char *data, int len)
 {
-	std::string mydata(data);
-	eLog(5, "PlayerApp::stdoutAvail: %s", mydata.c_str());
+	eLog(5, "PlayerApp::stdoutAvail: %.*s", len, data);
 	if (parseOutput == STD_OUTPUT)
 	{
-		handleOutput(mydata);
+		protocol.feed(data, len, *this);
 	}
 }
 
 void PlayerApp::appClosed(int retval)
 {
+	protocol.flush(*this);
 	handleProcessStopped(retval);
 }
 
 int PlayerApp::processStart(eMainloop *context)
 {
+	protocol.reset();
 	console = new eConsoleContainer();
 	CONNECT(console->appClosed, PlayerApp::appClosed);
 	CONNECT(console->stdoutAvail, PlayerApp::stdoutAvail);
 	CONNECT(console->stderrAvail, PlayerApp::stderrAvail);
-	const std::vector<std::string> args = buildCommand();
-	eDebugNoNewLine("PlayerApp::processStart: ");
-	char **cargs = (char **) malloc(sizeof(char *) * args.size()+1);
-	for (size_t i=0; i <= args.size(); i++)
+
+	PlayerPool *pool = PlayerPool::getInstance();
+	std::string handover;
+	standbyArgs.clear();
+	// pool reads only stderr of standby players
+	if (parseOutput == STD_ERROR && pool->isEnabled() && buildStandbyCommand(standbyArgs, handover))
 	{
-		// execvp needs args array terminated with NULL
-		if (i == args.size())
+		PlayerPool::Process process;
+		if (pool->acquire(standbyArgs, process))
 		{
-			cargs[i] = NULL;
-			eDebugNoNewLine("\n");
-		}
-		else
-		{
-			cargs[i] = strdup(args[i].c_str());
-			if (i != 0 && cargs[i][0] != '-')
-				eDebugNoNewLine("\"%s\" ", cargs[i]);
-			else
-				eDebugNoNewLine("%s ", cargs[i]);
+			eDebug("PlayerApp::processStart: using standby player, pid = %d", process.pid);
+			console->attach(context, process.pid, process.fd);
+			protocol.feed(process.output.c_str(), process.output.size(), *this);
+			processSend(handover);
+			return 0;
 		}
 	}
-	int ret = console->execute(context, cargs[0], cargs);
-	for (size_t i=0; i < args.size(); i++)
-		free(cargs[i]);
-	free(cargs);
-	return ret;
+	else
+	{
+		standbyArgs.clear();
+	}
+
+	return console->execute(context, buildCommand());
 }
 
 int PlayerApp::processSend(const std::string& data)
@@ -135,6 +89,30 @@ int PlayerApp::processSend(const std::string& data)
 	return -1;
 }
 
+int PlayerApp::processSend(int command)
+{
+	std::string data;
+	if (protocol.encode(command, data) < 0)
+		return -1;
+	return processSend(data);
+}
+
+int PlayerApp::processSend(int command, int arg)
+{
+	std::string data;
+	if (protocol.encode(command, arg, data) < 0)
+		return -1;
+	return processSend(data);
+}
+
+int PlayerApp::processSend(int command, const std::string& arg)
+{
+	std::string data;
+	if (protocol.encode(command, arg, data) < 0)
+		return -1;
+	return processSend(data);
+}
+
 void PlayerApp::processKill()
 {
 	if (console && console->running())
@@ -149,68 +127,213 @@ bool PlayerApp::processRunning()
 }
 
 
-void WaitThread::thread()
+void BasePlayer::handlePlayerEvent(const PlayerEvent &event)
 {
-	hasStarted();
-	pthread_mutex_lock(&mutex);
-	if (!waitForUpdate)
-	{
-		eDebug("WaitThread - not waiting");
-		goto unlock;
-	}
-	struct timespec ts;
-	if (clock_gettime(CLOCK_REALTIME, &ts) == -1)
-	{
-		perror("WaitThread - cannot get clock:");
-		goto unlock;
-	}
-	ts.tv_sec += timeout / 1000;
-	ts.tv_nsec += (timeout % 1000) * 1000000;
-	eDebug("WaitThread - waiting for %ldms", timeout);
-	if (pthread_cond_timedwait(&cond, &mutex, &ts) == ETIMEDOUT)
+	int sts = event[PlayerEvent::fSts].toInt();
+	switch (event.type)
 	{
-		eDebug("WaitThread - timed out");
-		waitForUpdate = false;
-		timedOut = true;
-		goto unlock;
+		case PlayerEvent::playbackPlay:
+			if (!sts)
+				recvStarted(0);
+			break;
+		case PlayerEvent::videoCurrent:
+		{
+			videoStream v;
+			v.id = event[PlayerEvent::fId].toInt();
+			v.description = event[PlayerEvent::fE].toString();
+			v.language_code = event[PlayerEvent::fN].toString();
+			v.width = event[PlayerEvent::fW].toInt();
+			v.height = event[PlayerEvent::fH].toInt();
+			v.framerate = event[PlayerEvent::fF].toInt();
+			// older players don't report progressive
+			v.progressive = event[PlayerEvent::fP].toInt(-1);
+			recvVideoTrackCurrent(0, v);
+			break;
+		}
+		case PlayerEvent::audioSelected:
+			if (!sts)
+				recvAudioTrackSelected(0, event[PlayerEvent::fId].toInt());
+			else
+				recvAudioTrackSelected(1, -1);
+			break;
+		case PlayerEvent::audioCurrent:
+		{
+			audioStream a;
+			a.id = event[PlayerEvent::fId].toInt();
+			a.description = event[PlayerEvent::fE].toString();
+			a.language_code = event[PlayerEvent::fN].toString();
+			recvAudioTrackCurrent(0, a);
+			break;
+		}
+		case PlayerEvent::audioList:
+		{
+			std::vector<audioStream> streams;
+			PlayerEvent item;
+			PlayerEventItems items(event);
+			while (items.next(item))
+			{
+				audioStream a;
+				a.id = item[PlayerEvent::fId].toInt();
+				a.description = item[PlayerEvent::fE].toString();
+				a.language_code = item[PlayerEvent::fN].toString();
+				streams.push_back(a);
+			}
+			recvAudioTracksList(0, streams);
+			break;
+		}
+		case PlayerEvent::subtitleSelected:
+			if (!sts)
+				recvSubtitleTrackSelected(0, event[PlayerEvent::fId].toInt());
+			else
+				recvSubtitleTrackSelected(1, -1);
+			break;
+		case PlayerEvent::subtitleCurrent:
+		{
+			subtitleStream s;
+			s.id = event[PlayerEvent::fId].toInt();
+			s.description = event[PlayerEvent::fE].toString();
+			s.language_code = event[PlayerEvent::fN].toString();
+			recvSubtitleTrackCurrent(0, s);
+			break;
+		}
+		case PlayerEvent::subtitleList:
+		{
+			std::vector<subtitleStream> streams;
+			PlayerEvent item;
+			PlayerEventItems items(event);
+			while (items.next(item))
+			{
+				subtitleStream s;
+				s.id = item[PlayerEvent::fId].toInt();
+				s.description = item[PlayerEvent::fE].toString();
+				s.language_code = item[PlayerEvent::fN].toString();
+				streams.push_back(s);
+			}
+			recvSubtitleTracksList(0, streams);
+			break;
+		}
+		case PlayerEvent::subtitleAdd:
+		{
+			// exteplayer3
+			subtitleMessage s;
+			s.start_ms = event[PlayerEvent::fS].toInt();
+			s.end_ms = event[PlayerEvent::fE].toInt();
+			s.duration_ms = s.end_ms - s.start_ms;
+			s.text = event[PlayerEvent::fT].toString();
+			recvSubtitleMessage(s);
+			break;
+		}
+		case PlayerEvent::playbackSubtitle:
+		{
+			// gstplayer
+			subtitleMessage s;
+			s.start_ms = event[PlayerEvent::fStart].toInt();
+			s.duration_ms = event[PlayerEvent::fDuration].toInt();
+			s.end_ms = s.start_ms + s.duration_ms;
+			s.text = event[PlayerEvent::fText].toString();
+			recvSubtitleMessage(s);
+			break;
+		}
+		case PlayerEvent::playbackLength:
+			if (!sts)
+				recvLength(0, event[PlayerEvent::fLength].toDouble() * 1000);
+			break;
+		case PlayerEvent::position:
+			recvPosition(0, event[PlayerEvent::fMs].toInt());
+			break;
+		case PlayerEvent::gstError:
+		{
+			errorMessage e;
+			e.message = event[PlayerEvent::fMsg].toString();
+			recvErrorMessage(e);
+			break;
+		}
+		case PlayerEvent::gstMissingPlugin:
+		{
+			errorMessage e;
+			e.message = "GStreamer plugin ";
+			e.message += event[PlayerEvent::fMsg].toString();
+			e.message += " is not available!";
+			recvErrorMessage(e);
+			break;
+		}
+		case PlayerEvent::playbackContinue:
+			recvResumed(sts ? 1 : 0);
+			break;
+		case PlayerEvent::playbackPause:
+			recvPaused(sts ? 1 : 0);
+			break;
+		case PlayerEvent::playbackSeekAbs:
+			recvSeekTo(sts ? 1 : 0, 0);
+			break;
+		case PlayerEvent::playbackSeek:
+			recvSeekRelative(sts ? 1 : 0, 0);
+			break;
+		case PlayerEvent::playbackStop:
+		case PlayerEvent::playbackFastForward:
+		case PlayerEvent::playbackInfo:
+		case PlayerEvent::playbackStandby:
+			break;
+		default:
+			eDebug("BasePlayer::handlePlayerEvent - unhandled key \"%.*s\"", (int)event.keyLen, event.key);
+			break;
 	}
-	eDebug("WaitThread - in time\n");
-unlock:
-	pthread_mutex_unlock(&mutex);
 }
 
 
-void PlayerBackend::sendMessage(const Message& m, int timeout)
+// track lists got by updateTrackLists are used without asking again
+#define TRACK_LISTS_FRESH_MS 1000
+
+// Sends requests of given types to the player thread and waits for all
+// of them to be completed by player replies, returns -1 when timed out.
+int PlayerBackend::sendRequests(const int *types, int count, int timeout)
 {
-	if (timeout > 0)
-	{
-		mWaitForUpdate = true;
-		WaitThread t(mWaitMutex, mWaitCond, mWaitForUpdate, timeout);
-		t.run();
-		mMessageThread.send(m);
-		t.kill();
-	}
-	else
-	{
-		mWaitForUpdate = false;
-		mMessageThread.send(m);
-	}
+	unsigned int first = mRequests.add(types, count);
+	for (int i = 0; i < count; i++)
+		mMessageThread.send(Message(types[i]));
+	return mRequests.wait(first, count, timeout);
 }
 
-void PlayerBackend::recvMessage()
+// shorter stalls are rather hiccups of the player than empty buffer
+#define UNDERRUN_MIN_STALL 1000
+
+void PlayerBackend::_updatePosition()
+{
+	mPositionPolls++;
+	pPlayer->sendUpdatePosition();
+}
+
+// (re)starts polling of player position when the clock wants other delay
+void PlayerBackend::updatePolling()
 {
-	pthread_mutex_lock(&mWaitMutex);
-	if (mWaitForUpdate)
+	unsigned int delay;
 	{
-		mWaitForUpdate = false;
-		pthread_cond_signal(&mWaitCond);
+		eSingleLocker l(mPositionLock);
+		delay = mPositionClock.pollDelay();
 	}
-	pthread_mutex_unlock(&mWaitMutex);
+	if (delay == mPollDelay)
+		return;
+	mPollDelay = delay;
+	mTimer->stop();
+	if (delay)
+		mTimer->start(delay, false);
 }
 
-void PlayerBackend::_updatePosition()
+void PlayerBackend::recvPosition(int status, int mseconds)
 {
-	pPlayer->sendUpdatePosition();
+	if (status)
+		return;
+	int64_t stalled;
+	{
+		eSingleLocker l(mPositionLock);
+		stalled = mPositionClock.received(mseconds, getMonotonicMs());
+	}
+	if (stalled >= UNDERRUN_MIN_STALL)
+	{
+		eDebug("PlayerBackend::recvPosition - playback stalled for %lldms", (long long)stalled);
+		mMessageMain.send(Message(Message::underrun, (int)stalled));
+	}
+	updatePolling();
 }
 
 int PlayerBackend::start(const std::string& path, const std::map<std::string,std::string>& headers)
@@ -227,12 +350,8 @@ int PlayerBackend::stop()
 	if (mThreadRunning)
 	{
 		// wait 10 seconds for normal exit if timed out then kill process
-		mWaitForStop = true;
-		WaitThread t(mWaitForStopMutex, mWaitForStopCond, mWaitForStop, 10000);
-		t.run();
-		mMessageThread.send(Message(Message::tStop));
-		t.kill();
-		if (t.isTimedOut())
+		int type = Message::tStop;
+		if (sendRequests(&type, 1, 10000) < 0)
 		{
 			mMessageThread.send(Message(Message::tKill));
 		}
@@ -279,12 +398,12 @@ int PlayerBackend::getPlayPosition(int& mseconds)
 	{
 		return -1;
 	}
-	if (!mPositionInMs) 
+	eSingleLocker l(mPositionLock);
+	if (!mPositionClock.position(getMonotonicMs(), mseconds))
 	{
 		//mMessageThread.send(Message(Message::tGetPosition));
 		return -2;
 	}
-	mseconds = mPositionInMs;
 	return 0;
 }
 
@@ -313,12 +432,21 @@ int PlayerBackend::getErrorMessage(errorMessage& error)
 	return 0;
 }
 
+int PlayerBackend::updateTrackLists(int timeout)
+{
+	int types[] = {Message::tAudioList, Message::tSubtitleList};
+	if (sendRequests(types, 2, timeout) < 0)
+		return -1;
+	mTrackListsTime = getMonotonicMs();
+	return 0;
+}
+
 int PlayerBackend::audioGetNumberOfTracks(int timeout)
 {
-	if (!mWaitForUpdate)
+	if (getMonotonicMs() - mTrackListsTime > TRACK_LISTS_FRESH_MS)
 	{
-		Message m (Message::tAudioList);
-		sendMessage(m, timeout);
+		int type = Message::tAudioList;
+		sendRequests(&type, 1, timeout);
 	}
 	return mAudioStreams.size();
 }
@@ -360,10 +488,10 @@ int PlayerBackend::audioGetTrackInfo(audioStream& trackInfo, int trackNum)
 
 int PlayerBackend::subtitleGetNumberOfTracks(int timeout)
 {
-	if (!mWaitForUpdate)
+	if (getMonotonicMs() - mTrackListsTime > TRACK_LISTS_FRESH_MS)
 	{
-		Message m(Message::tSubtitleList);
-		sendMessage(m, timeout);
+		int type = Message::tSubtitleList;
+		sendRequests(&type, 1, timeout);
 	}
 	return mSubtitleStreams.size();
 }
@@ -431,7 +559,18 @@ void PlayerBackend::gotMessage(const PlayerBackend::Message& message)
 			break;
 		case Message::tStop:
 			eDebug("PlayerBackend::gotMessage - tStop");
-			mTimer->stop();
+			{
+				eSingleLocker l(mPositionLock);
+				mPositionClock.stop();
+			}
+			if (mTimer)
+				updatePolling();
+			if (playbackStarted)
+			{
+				int64_t elapsed = getMonotonicMs() - mPlaybackStartTime;
+				eDebug("PlayerBackend::gotMessage - position polls: %u in %llds, fixed %ums polling would send %lld",
+						mPositionPolls, (long long)elapsed / 1000, PositionClock::pollFast, (long long)elapsed / PositionClock::pollFast);
+			}
 			pPlayer->sendStop();
 			break;
 		case Message::tKill:
@@ -448,11 +587,21 @@ void PlayerBackend::gotMessage(const PlayerBackend::Message& message)
 			break;
 		case Message::tSeekTo:
 			eDebug("PlayerBackend::gotMessage - tSeekTo");
+			{
+				eSingleLocker l(mPositionLock);
+				mPositionClock.seek(getMonotonicMs());
+			}
 			pPlayer->sendSeekTo(message.dataInt);
+			updatePolling();
 			break;
 		case Message::tSeekRelative:
 			eDebug("PlayerBackend::gotMessage - tSeekRelative");
+			{
+				eSingleLocker l(mPositionLock);
+				mPositionClock.seek(getMonotonicMs());
+			}
 			pPlayer->sendSeekRelative(message.dataInt);
+			updatePolling();
 			break;
 		case Message::tAudioSelect:
 			eDebug("PlayerBackend::gotMessage - tAudioSelect");
@@ -508,12 +657,18 @@ void PlayerBackend::gotMessage(const PlayerBackend::Message& message)
 		case Message::audioList:
 			eDebug("PlayerBackend::gotMessage - audioList");
 			break;
+		case Message::underrun:
+			eDebug("PlayerBackend::gotMessage - underrun");
+			gotPlayerMessage(PlayerMessage::underrun);
+			break;
 		case Message::error:
 			eDebug("PlayerBackend::gotMessage - error");
 			gotPlayerMessage(PlayerMessage::error);
 			break;
 		case Message::subtitleAvailable:
 			eDebug("PlayerBackend::gotMessage - subtitleAvailable");
+			// subtitles pushed from now on will be notified again
+			mSubtitlesNotified.store(false);
 			gotPlayerMessage(PlayerMessage::subtitleAvailable);
 			break;
 		default:
@@ -541,20 +696,24 @@ void PlayerBackend::recvStarted(int status)
 	if (playbackStarted || status)
 		return;
 	playbackStarted = true;
-	mTimer->start(mTimerDelay, false);
+	mPlaybackStartTime = getMonotonicMs();
+	bool pushed = pPlayer->sendPositionSubscribe(PositionClock::pollSlow) == 0;
+	if (pushed)
+		eDebug("PlayerBackend::recvStart - player pushes position updates");
+	{
+		eSingleLocker l(mPositionLock);
+		mPositionClock.start(pushed);
+	}
+	_updatePosition();
+	updatePolling();
 	mMessageMain.send(Message(Message::start));
 }
 
 void PlayerBackend::recvStopped(int retval)
 {
-	pthread_mutex_lock(&mWaitForStopMutex);
-	if (mWaitForStop)
-	{
-		mWaitForStop = false;
-		pthread_cond_signal(&mWaitForStopCond);
-	}
-	pthread_mutex_unlock(&mWaitForStopMutex);
 	eDebug("PlayerBackend::recvStopped - retval = %d", retval);
+	// player has exited, nothing else will be answered
+	mRequests.complete(Message::tStop, true);
 	quit(0);
 	mMessageMain.send(Message(Message::stop));
 }
@@ -564,7 +723,13 @@ void PlayerBackend::recvPaused(int status)
 	eDebug("PlayerBackend::recvPause - status = %d", status);
 	if (!status)
 	{
-		mTimer->stop();
+		{
+			eSingleLocker l(mPositionLock);
+			mPositionClock.pause(getMonotonicMs());
+		}
+		updatePolling();
+		// get exact position where we stopped
+		_updatePosition();
 		mMessageMain.send(Message(Message::pause));
 	}
 }
@@ -574,7 +739,11 @@ void PlayerBackend::recvResumed(int status)
 	eDebug("PlayerBackend::recvResume - status = %d", status);
 	if (!status)
 	{
-		mTimer->start(mTimerDelay, false);
+		{
+			eSingleLocker l(mPositionLock);
+			mPositionClock.resume();
+		}
+		updatePolling();
 		mMessageMain.send(Message(Message::resume));
 	}
 }
@@ -583,7 +752,7 @@ void PlayerBackend::recvAudioTracksList(int status, std::vector<audioStream>& st
 {
 	if(!status) 
 		mAudioStreams = streams;
-	recvMessage();
+	mRequests.complete(Message::tAudioList);
 }
 
 void PlayerBackend::recvAudioTrackCurrent(int status, audioStream& stream)
@@ -625,7 +794,7 @@ void PlayerBackend::recvSubtitleTracksList(int status, std::vector<subtitleStrea
 { 
 	if(!status) 
 		mSubtitleStreams = streams;
-	recvMessage();
+	mRequests.complete(Message::tSubtitleList);
 }
 
 void PlayerBackend::recvSubtitleTrackCurrent(int status, subtitleStream& stream)
@@ -687,22 +856,22 @@ void PlayerBackend::recvVideoTrackCurrent(int status, videoStream& stream)
 
 void PlayerBackend::recvSubtitleMessage(subtitleMessage& sub)
 {
-	eSingleLocker s(mSubLock);
-	mSubtitles.push(sub);
-	mMessageMain.send(Message(Message::subtitleAvailable));
+	if (!mSubtitles.push(sub))
+	{
+		eWarning("PlayerBackend::recvSubtitleMessage - queue is full, subtitle dropped (%u)", mSubtitles.dropped());
+		return;
+	}
+	// one wakeup of main thread for the whole burst of subtitles
+	if (!mSubtitlesNotified.exchange(true))
+		mMessageMain.send(Message(Message::subtitleAvailable));
 }
 
-int PlayerBackend::getSubtitles(std::queue< subtitleMessage >& subtitles)
+int PlayerBackend::getSubtitles(std::vector<subtitleMessage>& subtitles)
 {
-	eSingleLocker s(mSubLock);
-	if (mSubtitles.empty())
+	subtitleMessage sub;
+	while (mSubtitles.pop(sub))
 	{
-		return -1;
-	}
-	while (!mSubtitles.empty())
-	{
-		subtitles.push(mSubtitles.front());
-		mSubtitles.pop();
+		subtitles.push_back(std::move(sub));
 	}
-	return 0;
+	return subtitles.empty() ? -1 : 0;
 }
@@ -7,8 +7,12 @@
 #include <lib/python/connections.h>
 
 
-#include "cJSON/cJSON.h"
 #include "myconsole.h"
+#include "playerevent.h"
+#include "playerprotocol.h"
+#include "playerrequests.h"
+#include "positionclock.h"
+#include "spscqueue.h"
 #include "subtitles/subtitles.h"
 
 #ifndef eLog
@@ -22,33 +26,42 @@ enum
 };
 
 #if SIGCXX_MAJOR_VERSION == 2
-class PlayerApp: public sigc::trackable
+class PlayerApp: public sigc::trackable, public iPlayerEventHandler
 #else
-class PlayerApp: public Object
+class PlayerApp: public Object, public iPlayerEventHandler
 #endif
 {
 	ePtr<eConsoleContainer> console;
-	std::string jsonstr;
 	unsigned int parseOutput;
-	unsigned int truncated;
-	void stdoutAvail(const char *data);
-	void stderrAvail(const char *data);
+	// standby command for the pool, replacement is prepared when playback starts
+	std::vector<std::string> standbyArgs;
+	void stdoutAvail(const char *data, int len);
+	void stderrAvail(const char *data, int len);
 	void appClosed(int retval);
-	void handleOutput(const std::string& data);
-	void handleJsonStr(const std::string& data);
+	void handleEvent(const PlayerEvent &event);
+	void handleUndecodable(const char *data, size_t len);
 	void handleAppClosed(int retval);
 protected:
+	PlayerProtocol protocol;
 	virtual std::vector<std::string> buildCommand() = 0;
-	virtual void handleJsonOutput(cJSON *json) = 0;
+	// command which starts player in standby mode (see playerpool.h) and
+	// command which hands stream over to it, false when not supported
+	virtual bool buildStandbyCommand(std::vector<std::string> &args, std::string &handover){ return false; }
+	virtual void handlePlayerEvent(const PlayerEvent &event) = 0;
 	virtual void handleProcessStopped(int retval) = 0;
 	int processStart(eMainloop *context);
 	int processSend(const std::string& data);
+	// encoded by the protocol of the player, -1 when not supported
+	int processSend(int command);
+	int processSend(int command, int arg);
+	int processSend(int command, const std::string& arg);
 	void processKill();
 	bool processRunning();
 public:
-	PlayerApp(int parseOutput=STD_ERROR):
-		parseOutput(parseOutput),
-		truncated(0){}
+	// messages in frames come on stdout, otherwise they are mixed with logging on stderr
+	PlayerApp(const PlayerTraits &traits):
+		parseOutput(traits.framed ? STD_OUTPUT : STD_ERROR),
+		protocol(traits){}
 	~PlayerApp(){}
 };
 
@@ -66,6 +79,7 @@ struct PlayerMessage
 		videoProgressiveChanged,
 		videoFramerateChanged,
 		subtitleAvailable,
+		underrun,
 	};
 };
 
@@ -109,6 +123,8 @@ public:
 	virtual int sendResume(){ return -1;}
 	virtual int sendUpdateLength(){ return -1;}
 	virtual int sendUpdatePosition(){ return -1;}
+	// player reports position by itself every intervalMs, returns -1 when not supported
+	virtual int sendPositionSubscribe(int intervalMs){ return -1;}
 	virtual int sendUpdateAudioTracksList(){ return -1;}
 	virtual int sendUpdateAudioTrackCurrent(){ return -1;}
 	virtual int sendAudioSelectTrack(int trackId){ return -1;}
@@ -168,6 +184,8 @@ protected:
 	void recvSeekTo(int status, int seconds){pCallback->recvSeekTo(status, seconds);};
 	void recvSeekRelative(int status, int seconds){pCallback->recvSeekRelative(status, seconds);};
 	void recvErrorMessage(errorMessage& message){pCallback->recvErrorMessage(message);};
+
+	void handlePlayerEvent(const PlayerEvent &event);
 public:
 	virtual ~BasePlayer(){}
 
@@ -176,7 +194,37 @@ public:
 	void setHttpHeaders(const std::map<std::string, std::string>& headers){mHeaders = headers;}
 
 	virtual int start(eMainloop *context) = 0;
+	// audio of the stream can be passed in separate url, "url&suburi=audiourl"
+	virtual bool supportsAudioUrl() const { return false; }
+};
 
+
+// player application controlled by PlayerProtocol, backends
+// provide only command line and traits of the protocol
+class ExtPlayer: public PlayerApp, public BasePlayer
+{
+	void handlePlayerEvent(const PlayerEvent &event){BasePlayer::handlePlayerEvent(event);}
+	void handleProcessStopped(int retval){recvStopped(0);}
+public:
+	ExtPlayer(const PlayerTraits &traits):
+		PlayerApp(traits){}
+	int start(eMainloop *context){ return processStart(context);}
+
+	int sendStop(){ return processSend(PlayerCommand::stop);}
+	int sendForceStop(){ processKill(); return 0;}
+	int sendPause(){ return processSend(PlayerCommand::pause);}
+	int sendResume(){ return processSend(PlayerCommand::resume);}
+	int sendUpdateLength(){ return processSend(PlayerCommand::updateLength);}
+	int sendUpdatePosition(){ return processSend(PlayerCommand::updatePosition);}
+	int sendPositionSubscribe(int intervalMs){ return processSend(PlayerCommand::positionSubscribe, intervalMs);}
+	int sendUpdateAudioTracksList(){ return processSend(PlayerCommand::audioList);}
+	int sendUpdateAudioTrackCurrent(){ return processSend(PlayerCommand::audioCurrent);}
+	int sendAudioSelectTrack(int trackId){ return processSend(PlayerCommand::audioSelect, trackId);}
+	int sendUpdateSubtitleTracksList(){ return processSend(PlayerCommand::subtitleList);}
+	int sendUpdateSubtitleTrackCurrent(){ return processSend(PlayerCommand::subtitleCurrent);}
+	int sendSubtitleSelectTrack(int trackId){ return processSend(PlayerCommand::subtitleSelect, trackId);}
+	int sendSeekTo(int seconds){ return processSend(PlayerCommand::seekTo, seconds);}
+	int sendSeekRelative(int seconds){ return processSend(PlayerCommand::seekRelative, seconds);}
 };
 
 
@@ -219,6 +267,7 @@ class PlayerBackend: public Object, public eThread, public eMainloop, public iPl
 			videoFramerateChanged,
 			videoProgressiveChanged,
 			subtitleAvailable,
+			underrun,
 			error,
 		};
 		Message(int type)
@@ -227,7 +276,14 @@ class PlayerBackend: public Object, public eThread, public eMainloop, public iPl
 			:type(type), dataInt(dataInt) {}
 	};
 
-	int mPositionInMs, mLengthInMs;
+	int mLengthInMs;
+	// shared by player thread and main thread, guarded by mPositionLock
+	PositionClock mPositionClock;
+	eSingleLock mPositionLock;
+	// delay of the poll timer, follows the clock
+	unsigned int mPollDelay;
+	unsigned int mPositionPolls;
+	int64_t mPlaybackStartTime;
 	bool playbackStarted;
 	bool mThreadRunning;
 
@@ -240,27 +296,25 @@ class PlayerBackend: public Object, public eThread, public eMainloop, public iPl
 
 	std::vector<audioStream> mAudioStreams;
 	std::vector<subtitleStream> mSubtitleStreams;
-	std::queue<subtitleMessage> mSubtitles;
+	// subtitles from player thread to main thread, subtitleAvailable
+	// message is sent only when there is no such message pending
+	SPSCQueue<subtitleMessage> mSubtitles;
+	std::atomic<bool> mSubtitlesNotified;
 
 	eFixedMessagePump<Message> mMessageMain, mMessageThread;
 	ePtr<eTimer> mTimer;
-	unsigned int mTimerDelay;
 
-	eSingleLock mSubLock;
-	
-	pthread_mutex_t mWaitMutex;
-	pthread_cond_t mWaitCond;
-	bool mWaitForUpdate;
 
-	pthread_mutex_t mWaitForStopMutex;
-	pthread_cond_t mWaitForStopCond;
-	bool mWaitForStop;
+	// requests sent to the player thread which wait for reply of the player
+	PlayerRequests mRequests;
+	// when both track lists were received by updateTrackLists
+	int64_t mTrackListsTime;
 
 	void gotMessage(const Message &message);
 	void _updatePosition();
+	void updatePolling();
 
-	void sendMessage(const Message& m, int timeout=0);
-	void recvMessage();
+	int sendRequests(const int *types, int count, int timeout);
 	
 	// eThread
 	void thread();
@@ -272,7 +326,7 @@ class PlayerBackend: public Object, public eThread, public eMainloop, public iPl
 	void recvPaused(int status);
 	void recvResumed(int status);
 	void recvLength(int status, int mseconds){ if (!status) mLengthInMs = mseconds; }
-	void recvPosition(int status, int mseconds){ if (!status) mPositionInMs = mseconds; }
+	void recvPosition(int status, int mseconds);
 	void recvAudioTracksList(int status, std::vector<audioStream>& streams);
 	void recvAudioTrackCurrent(int status, audioStream& stream);
 	void recvAudioTrackSelected(int status, int trackId);
@@ -287,8 +341,10 @@ class PlayerBackend: public Object, public eThread, public eMainloop, public iPl
 
 public:
 	PlayerBackend(BasePlayer* extplayer):
-		mPositionInMs(0),
 		mLengthInMs(0),
+		mPollDelay(0),
+		mPositionPolls(0),
+		mPlaybackStartTime(0),
 		playbackStarted(false),
 		mThreadRunning(false),
 		pPlayer(extplayer),
@@ -296,20 +352,15 @@ public:
 		pCurrentVideo(NULL),
 		pCurrentSubtitle(NULL),
 		pErrorMessage(NULL),
+		mSubtitles(1024),
+		mSubtitlesNotified(false),
 		mMessageMain(eApp, 1),
 		mMessageThread(this, 1),
-		mTimerDelay(100), // updated play position timer
-		mWaitForUpdate(false),
-		mWaitForStop(false)
-
+		mTrackListsTime(0)
 	{
 		pPlayer->setCallback(this);
 		CONNECT(mMessageThread.recv_msg, PlayerBackend::gotMessage);
 		CONNECT(mMessageMain.recv_msg, PlayerBackend::gotMessage);
-		pthread_mutex_init(&mWaitMutex, NULL);
-		pthread_cond_init(&mWaitCond, NULL);
-		pthread_mutex_init(&mWaitForStopMutex, NULL);
-		pthread_cond_init(&mWaitForStopCond, NULL);
 	}
 	~PlayerBackend()
 	{
@@ -322,10 +373,6 @@ public:
 		if (pCurrentSubtitle != NULL)
 			delete pCurrentSubtitle;
 		stop();
-		pthread_mutex_destroy(&mWaitMutex);
-		pthread_cond_destroy(&mWaitCond);
-		pthread_mutex_destroy(&mWaitForStopMutex);
-		pthread_cond_destroy(&mWaitForStopCond);
 	}
 	int start(const std::string& path, const std::map<std::string,std::string>& headers);
 	int stop();
@@ -336,7 +383,10 @@ public:
 	int getLength(int& mseconds);
 	int getPlayPosition(int& mseconds);
 	int getErrorMessage(errorMessage& error);
-	int getSubtitles(std::queue<subtitleMessage>&);
+	int getSubtitles(std::vector<subtitleMessage>&);
+	// asks for audio and subtitle track lists in one round trip, so the
+	// queries which follow within TRACK_LISTS_FRESH_MS don't ask again
+	int updateTrackLists(int timeout);
 	int audioGetNumberOfTracks(int timeout=0);
 	int audioSelectTrack(int trackId);
 	int audioGetTrackInfo(audioStream& trackInfo, int trackId);
@@ -350,24 +400,4 @@ public:
 	PSignal1<void,int> gotPlayerMessage;
 };
 
-class WaitThread: public eThread
-{
-	bool& waitForUpdate;
-	pthread_mutex_t& mutex;
-	pthread_cond_t& cond;
-	long timeout;
-	void thread();
-	bool timedOut;
-public:
-	WaitThread(pthread_mutex_t& mutex, pthread_cond_t& cond, bool& waitForUpdate, long timeout):
-		waitForUpdate(waitForUpdate),
-		mutex(mutex),
-		cond(cond),
-		timeout(timeout),
-		timedOut(false)
-	{
-	}
-	bool isTimedOut(){return timedOut;}
-};
-
 #endif
@@ -26,28 +26,12 @@ private:
 	SettingMap settingMap;
 };
 
-class GstPlayer: public PlayerApp, public BasePlayer
+class GstPlayer: public ExtPlayer
 {
 	GstPlayerOptions mPlayerOptions;
-	void handleJsonOutput(cJSON* json);
-	void handleProcessStopped(int retval);
 	std::vector<std::string> buildCommand();
+	bool buildStandbyCommand(std::vector<std::string> &args, std::string &handover);
 public:
 	GstPlayer(GstPlayerOptions& options);
-	int start(eMainloop *context);
-	int sendStop();
-	int sendForceStop();
-	int sendPause();
-	int sendResume();
-	int sendUpdateLength();
-	int sendUpdatePosition();
-	int sendUpdateAudioTracksList();
-	int sendUpdateAudioTrackCurrent();
-	int sendAudioSelectTrack(int trackId);
-	int sendUpdateSubtitleTracksList();
-	int sendUpdateSubtitleTrackCurrent();
-	int sendSubtitleSelectTrack(int trackId);
-	int sendSeekTo(int seconds);
-	int sendSeekRelative(int seconds);
 };
 #endif
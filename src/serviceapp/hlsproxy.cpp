@@ -0,0 +1,916 @@
+#include <ctype.h>
+#include <errno.h>
+#include <fcntl.h>
+#include <poll.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include <unistd.h>
+#include <arpa/inet.h>
+#include <netinet/in.h>
+#include <sys/socket.h>
+#include <algorithm>
+
+#include "bandwidthestimator.h"
+#include "connectionpool.h"
+#include "hlsproxy.h"
+#include "m3u8.h"
+
+#define DEFAULT_DEPTH 0
+#define DEFAULT_CACHE_SIZE (16 * 1024 * 1024)
+#define MAX_REDIRECTS 5
+#define MAX_PLAYLIST_SIZE (4 * 1024 * 1024)
+#define MAX_REQUEST_SIZE (16 * 1024)
+// idle keep-alive connection of the player
+#define CLIENT_TIMEOUT 30000
+// player gets error when the segment is not downloaded by then
+#define SEGMENT_TIMEOUT 30000
+// back-off of accept when descriptors or memory run out
+#define ACCEPT_RETRY 100
+
+static const char *defaultUserAgent = "Enigma2 HbbTV/1.1.1 (+PVR+RTSP+DL;OpenPLi;;;)";
+
+static int defaultPort(Url &purl)
+{
+    if (purl.port() != -1)
+        return purl.port();
+    if (purl.proto() == "http")
+        return 80;
+    if (purl.proto() == "https")
+        return 443;
+    return -1;
+}
+
+int HlsProxy::fetch(const std::string &url, const HeaderMap &headers, std::string &body, std::string &finalUrl,
+        size_t maxSize, const std::atomic<bool> *cancelled)
+{
+    std::string current = url;
+    ConnectionPool *pool = ConnectionPool::getInstance();
+    for (int redirect = 0; redirect <= MAX_REDIRECTS; redirect++)
+    {
+        if (cancelled && *cancelled)
+            return -1;
+        Url purl(current);
+        int port = defaultPort(purl);
+        if (port < 0)
+        {
+            fprintf(stderr, "[HlsProxy] unsupported url %s\n", current.c_str());
+            return -1;
+        }
+        std::string path = purl.path();
+        if (!purl.query().empty())
+            path += "?" + purl.query();
+        std::string request = "GET " + path + " HTTP/1.1\r\nHost: " + purl.host();
+        if (purl.port() > 0)
+            request += ":" + std::to_string(purl.port());
+        request += "\r\n";
+        HeaderMap::const_iterator it = headers.find("User-Agent");
+        request += "User-Agent: " + (it != headers.end() ? it->second : defaultUserAgent) + "\r\n";
+        request += "Accept: */*\r\n";
+        // ranges of the player refer to the content as it is
+        if (headers.find("Range") == headers.end() && headers.find("Accept-Encoding") == headers.end())
+            request += "Accept-Encoding: gzip, deflate\r\n";
+        for (it = headers.begin(); it != headers.end(); it++)
+        {
+            if (it->first != "User-Agent")
+                request += it->first + ": " + it->second + "\r\n";
+        }
+        request += "\r\n";
+
+        HttpConnection conn;
+        ConnectionReader *reader = NULL;
+        char *line = NULL;
+        ssize_t result = -1;
+        for (int attempt = 0; attempt < 2 && result < 0; attempt++)
+        {
+            if (pool->acquire(purl.proto(), purl.host(), port, conn, cancelled) < 0)
+            {
+                delete reader;
+                return -1;
+            }
+            delete reader;
+            reader = new ConnectionReader(conn.ssl, conn.fd);
+            if (writeAll(conn.ssl, conn.fd, request.c_str(), request.length()) == (ssize_t) request.length())
+                result = reader->readLine(&line);
+            if (result < 0)
+            {
+                // server may have closed idle connection in the meantime, try a new one
+                bool retry = conn.reused;
+                pool->release(conn, false);
+                if (!retry)
+                    break;
+            }
+        }
+        char protocol[64] = "";
+        int status = 0;
+        if (result < 0 || sscanf(line, "%63s %d", protocol, &status) != 2)
+        {
+            fprintf(stderr, "[HlsProxy] no response for %s\n", current.c_str());
+            delete reader;
+            pool->release(conn, false);
+            return -1;
+        }
+        bool keepAlive = !strcmp(protocol, "HTTP/1.1");
+        bool chunked = false;
+        long long contentLength = -1;
+        std::string contentEncoding;
+        std::string location;
+        while ((result = reader->readLine(&line)) > 0)
+        {
+            if (!strncasecmp(line, "Content-Length:", 15))
+                contentLength = atoll(&line[15]);
+            else if (!strncasecmp(line, "Transfer-Encoding:", 18) && strcasestr(&line[18], "chunked"))
+                chunked = true;
+            else if (!strncasecmp(line, "Content-Encoding:", 17))
+                contentEncoding = &line[17];
+            else if (!strncasecmp(line, "Connection:", 11) && strcasestr(&line[11], "close"))
+                keepAlive = false;
+            else if (!strncasecmp(line, "Location:", 9))
+                location = &line[9 + strspn(&line[9], " ")];
+        }
+        if (result < 0)
+        {
+            delete reader;
+            pool->release(conn, false);
+            return -1;
+        }
+        if (chunked)
+            reader->setChunked();
+        else if (contentLength >= 0)
+            reader->setBodyLength(contentLength);
+        else
+            keepAlive = false;
+
+        bool redirected = (status == 301 || status == 302 || status == 303 || status == 307 || status == 308) &&
+                !location.empty();
+        // partial content answers the range of the caller
+        if ((status != 200 && status != 206) || redirected)
+        {
+            if (keepAlive)
+            {
+                char discard[1024];
+                while (reader->read(discard, sizeof(discard)) > 0);
+            }
+            pool->release(conn, keepAlive && reader->bodyComplete());
+            delete reader;
+            if (!redirected)
+                return status;
+            current = resolveUrl(current, location);
+            continue;
+        }
+        body.clear();
+        if (!reader->setContentEncoding(contentEncoding.c_str()))
+        {
+            pool->release(conn, false);
+            delete reader;
+            return -1;
+        }
+        // limit applies to the inflated body as well
+        if (contentLength > (long long) maxSize)
+        {
+            fprintf(stderr, "[HlsProxy] %s: %lld bytes exceed the limit\n", current.c_str(), contentLength);
+            pool->release(conn, false);
+            delete reader;
+            return -1;
+        }
+        if (contentLength > 0)
+            body.reserve(contentLength);
+        char buf[16 * 1024];
+        while ((result = reader->read(buf, sizeof(buf))) > 0 && body.size() <= maxSize)
+        {
+            body.append(buf, result);
+            if (cancelled && *cancelled)
+                break;
+        }
+        bool complete = reader->bodyComplete() || (!chunked && contentLength < 0);
+        pool->release(conn, keepAlive && reader->bodyComplete());
+        delete reader;
+        if (!complete || body.size() > maxSize || (cancelled && *cancelled))
+        {
+            fprintf(stderr, "[HlsProxy] %s: incomplete body\n", current.c_str());
+            return -1;
+        }
+        finalUrl = current;
+        return status;
+    }
+    fprintf(stderr, "[HlsProxy] reached maximum number of %d redirects\n", MAX_REDIRECTS);
+    return -1;
+}
+
+static bool sendAll(int fd, const char *data, size_t size)
+{
+    while (size)
+    {
+        // player may close the connection anytime, no SIGPIPE in enigma2
+        ssize_t sent = send(fd, data, size, MSG_NOSIGNAL);
+        if (sent < 0 && errno == EINTR)
+            continue;
+        if (sent <= 0)
+            return false;
+        data += sent;
+        size -= sent;
+    }
+    return true;
+}
+
+static bool sendResponse(int fd, int status, const char *reason, const char *contentType, const char *body,
+        size_t size, bool keepAlive, const std::string &extraHeaders="")
+{
+    char head[512];
+    snprintf(head, sizeof(head), "HTTP/1.1 %d %s\r\nContent-Type: %s\r\nContent-Length: %zu\r\n%s%s\r\n",
+            status, reason, contentType, size, extraHeaders.c_str(), keepAlive ? "" : "Connection: close\r\n");
+    return sendAll(fd, head, strlen(head)) && sendAll(fd, body, size);
+}
+
+static bool sendError(int fd, int status, const char *reason)
+{
+    return sendResponse(fd, status, reason, "text/plain", reason, strlen(reason), true);
+}
+
+// extension of the origin segment, some players check it
+static std::string extension(const std::string &url)
+{
+    size_t end = url.find_first_of("?#");
+    std::string path = url.substr(0, end);
+    size_t slash = path.rfind('/');
+    size_t dot = path.rfind('.');
+    if (dot == std::string::npos || (slash != std::string::npos && dot < slash) || path.size() - dot > 6)
+        return "ts";
+    std::string ext = path.substr(dot + 1);
+    for (size_t i = 0; i < ext.size(); i++)
+    {
+        if (!isalnum((unsigned char) ext[i]))
+            return "ts";
+    }
+    return ext.empty() ? "ts" : ext;
+}
+
+static const char *contentType(const std::string &ext)
+{
+    if (ext == "ts")
+        return "video/mp2t";
+    if (ext == "aac")
+        return "audio/aac";
+    if (ext == "mp4" || ext == "m4s")
+        return "video/mp4";
+    return "application/octet-stream";
+}
+
+static std::string segmentKey(const std::string &session, size_t segment)
+{
+    return session + "/" + std::to_string(segment);
+}
+
+HlsProxy *HlsProxy::getInstance()
+{
+    static HlsProxy proxy;
+    return &proxy;
+}
+
+HlsProxy::HlsProxy():
+    mFd(-1),
+    mPort(0),
+    mCacheLimit(DEFAULT_CACHE_SIZE),
+    mCached(0),
+    mDepth(DEFAULT_DEPTH),
+    mWorkers(0),
+    mLoading(0),
+    mLoadStarts(0),
+    mHits(0),
+    mMisses(0),
+    mSerial(0)
+{
+    pthread_mutex_init(&mMutex, NULL);
+    pthread_condattr_t attr;
+    pthread_condattr_init(&attr);
+    pthread_condattr_setclock(&attr, CLOCK_MONOTONIC);
+    pthread_cond_init(&mCond, &attr);
+    pthread_condattr_destroy(&attr);
+}
+
+// detached threads may still run at exit, so mutex and condition stay
+HlsProxy::~HlsProxy()
+{
+    if (mFd >= 0)
+        ::close(mFd);
+}
+
+int HlsProxy::startServer()
+{
+    int fd = socket(AF_INET, SOCK_STREAM, 0);
+    struct sockaddr_in addr;
+    memset(&addr, 0, sizeof(addr));
+    addr.sin_family = AF_INET;
+    addr.sin_addr.s_addr = htonl(INADDR_LOOPBACK);
+    socklen_t len = sizeof(addr);
+    if (fd < 0 || bind(fd, (struct sockaddr *) &addr, len) < 0 || listen(fd, 16) < 0 ||
+            getsockname(fd, (struct sockaddr *) &addr, &len) < 0)
+    {
+        fprintf(stderr, "[HlsProxy] cannot listen: %m\n");
+        if (fd >= 0)
+            ::close(fd);
+        return -1;
+    }
+    pthread_t thread;
+    mFd = fd;
+    if (pthread_create(&thread, NULL, acceptThread, this))
+    {
+        ::close(fd);
+        mFd = -1;
+        return -1;
+    }
+    pthread_detach(thread);
+    mPort = ntohs(addr.sin_port);
+    fprintf(stderr, "[HlsProxy] listening on 127.0.0.1:%d\n", mPort);
+    return 0;
+}
+
+struct HlsProxyClient
+{
+    HlsProxy *proxy;
+    int fd;
+};
+
+void *HlsProxy::acceptThread(void *arg)
+{
+    HlsProxy *proxy = (HlsProxy *) arg;
+    int fd;
+    while ((fd = accept(proxy->mFd, NULL, NULL)) >= 0 || errno == EINTR || errno == ECONNABORTED ||
+            errno == EMFILE || errno == ENFILE || errno == ENOBUFS || errno == ENOMEM)
+    {
+        // out of descriptors or memory, clients finish meanwhile
+        if (fd < 0 && errno != EINTR && errno != ECONNABORTED)
+            usleep(ACCEPT_RETRY * 1000);
+        if (fd < 0)
+            continue;
+        HlsProxyClient *client = new HlsProxyClient();
+        client->proxy = proxy;
+        client->fd = fd;
+        pthread_t thread;
+        if (pthread_create(&thread, NULL, clientThread, client))
+        {
+            ::close(fd);
+            delete client;
+            continue;
+        }
+        pthread_detach(thread);
+    }
+    return NULL;
+}
+
+void *HlsProxy::clientThread(void *arg)
+{
+    HlsProxyClient *client = (HlsProxyClient *) arg;
+    client->proxy->serveClient(client->fd);
+    ::close(client->fd);
+    delete client;
+    return NULL;
+}
+
+void *HlsProxy::workerThread(void *arg)
+{
+    HlsProxy *proxy = (HlsProxy *) arg;
+    pthread_mutex_lock(&proxy->mMutex);
+    while (1)
+    {
+        while (proxy->mQueue.empty() && proxy->mWorkers <= proxy->workerLimit())
+            pthread_cond_wait(&proxy->mCond, &proxy->mMutex);
+        if (proxy->mWorkers > proxy->workerLimit())
+            break;
+        std::string key = proxy->mQueue.front();
+        proxy->mQueue.pop_front();
+        std::map<std::string, HlsSegment>::iterator it = proxy->mCache.find(key);
+        if (it != proxy->mCache.end() && it->second.state == HlsSegment::queued)
+            proxy->load(key);
+    }
+    proxy->mWorkers--;
+    pthread_mutex_unlock(&proxy->mMutex);
+    return NULL;
+}
+
+// called and returns with the mutex locked
+void HlsProxy::load(const std::string &key)
+{
+    std::string id = key.substr(0, key.find('/'));
+    size_t segment = strtoul(key.c_str() + id.size() + 1, NULL, 10);
+    std::shared_ptr<HlsProxySession> session = findSession(id);
+    std::map<size_t, HlsProxySegment>::const_iterator found;
+    if (!session || (found = session->segments.find(segment)) == session->segments.end())
+    {
+        mCache.erase(key);
+        return;
+    }
+    mCache[key].state = HlsSegment::loading;
+    std::string url = found->second.url;
+    size_t maxSize = mCacheLimit;
+    unsigned int starts = ++mLoadStarts;
+    bool alone = ++mLoading == 1;
+    pthread_mutex_unlock(&mMutex);
+
+    int64_t start = getMonotonicMs();
+    std::string body, finalUrl;
+    int status = fetch(url, session->headers, body, finalUrl, maxSize, &session->closed);
+    int64_t duration = getMonotonicMs() - start;
+
+    pthread_mutex_lock(&mMutex);
+    mLoading--;
+    // parallel downloads share the link, only lone one measures it
+    if (status == 200 && alone && starts == mLoadStarts)
+        BandwidthEstimator::getInstance()->addSample(Url(finalUrl).host(), body.size(), duration);
+    std::map<std::string, HlsSegment>::iterator it = mCache.find(key);
+    if (it == mCache.end())
+        return;
+    if (session->closed)
+    {
+        mCache.erase(it);
+        pthread_cond_broadcast(&mCond);
+        return;
+    }
+    if (status == 200)
+    {
+        it->second.state = HlsSegment::ready;
+        it->second.data = std::make_shared<const std::string>(body);
+        it->second.used = getMonotonicMs();
+        mCached += body.size();
+        evict();
+    }
+    else
+    {
+        fprintf(stderr, "[HlsProxy] segment %s failed (%d)\n", url.c_str(), status);
+        it->second.state = HlsSegment::failed;
+    }
+    pthread_cond_broadcast(&mCond);
+}
+
+// also disabled proxy serves open sessions with one worker
+unsigned int HlsProxy::workerLimit() const
+{
+    return std::max(mDepth, 1U);
+}
+
+void HlsProxy::startWorkers()
+{
+    while (mWorkers < workerLimit())
+    {
+        pthread_t thread;
+        if (pthread_create(&thread, NULL, workerThread, this))
+            break;
+        pthread_detach(thread);
+        mWorkers++;
+    }
+}
+
+// segments sent to the player go first, then the least recently loaded
+void HlsProxy::evict()
+{
+    while (mCached > mCacheLimit)
+    {
+        std::map<std::string, HlsSegment>::iterator victim = mCache.end();
+        for (std::map<std::string, HlsSegment>::iterator it(mCache.begin()); it != mCache.end(); it++)
+        {
+            const HlsSegment &entry = it->second;
+            if (entry.state != HlsSegment::ready || entry.waiters)
+                continue;
+            if (victim == mCache.end() || (entry.served && !victim->second.served) ||
+                    (entry.served == victim->second.served && entry.used < victim->second.used))
+                victim = it;
+        }
+        if (victim == mCache.end())
+            break;
+        mCached -= victim->second.data->size();
+        mCache.erase(victim);
+    }
+}
+
+void HlsProxy::prefetch(const std::shared_ptr<HlsProxySession> &session, size_t segment)
+{
+    std::map<size_t, HlsProxySegment>::const_iterator it = session->segments.find(segment);
+    if (it == session->segments.end())
+        return;
+    // next segments of the same playlist, renditions are interleaved
+    size_t playlist = it->second.playlist;
+    unsigned int queued = 0;
+    for (it++; it != session->segments.end() && queued < mDepth; it++)
+    {
+        if (it->second.playlist != playlist)
+            continue;
+        queued++;
+        std::string key = segmentKey(session->id, it->first);
+        if (mCache.find(key) != mCache.end())
+            continue;
+        mCache[key] = HlsSegment();
+        mQueue.push_back(key);
+    }
+    startWorkers();
+    pthread_cond_broadcast(&mCond);
+}
+
+std::shared_ptr<HlsProxySession> HlsProxy::findSession(const std::string &id)
+{
+    std::map<std::string, std::shared_ptr<HlsProxySession> >::iterator it = mSessions.find(id);
+    return it != mSessions.end() ? it->second : std::shared_ptr<HlsProxySession>();
+}
+
+// called with the mutex locked, loading one is left to its worker
+void HlsProxy::dropSegment(HlsProxySession &session, size_t segment)
+{
+    std::map<size_t, HlsProxySegment>::iterator it = session.segments.find(segment);
+    if (it == session.segments.end())
+        return;
+    session.segmentIds.erase(it->second.url);
+    session.segments.erase(it);
+    std::map<std::string, HlsSegment>::iterator cached = mCache.find(segmentKey(session.id, segment));
+    if (cached == mCache.end() || cached->second.state == HlsSegment::loading || cached->second.waiters)
+        return;
+    if (cached->second.state == HlsSegment::ready)
+        mCached -= cached->second.data->size();
+    mCache.erase(cached);
+}
+
+// URIs of variants and renditions lead to proxied playlists, of segments
+// to the segment cache, everything else is made absolute
+std::string HlsProxy::rewrite(HlsProxySession &session, size_t index, const std::string &url,
+        const std::string &playlist)
+{
+    bool master = playlist.find("#EXT-X-STREAM-INF") != std::string::npos;
+    bool byteRange = playlist.find("#EXT-X-BYTERANGE") != std::string::npos;
+    char prefix[64];
+    snprintf(prefix, sizeof(prefix), "http://127.0.0.1:%d/%s/", mPort, session.id.c_str());
+    std::string out;
+    out.reserve(playlist.size() * 2);
+    std::vector<size_t> listed;
+    size_t pos = 0;
+    if (!playlist.compare(0, 3, "\xef\xbb\xbf"))
+        pos = 3;
+    while (pos < playlist.size())
+    {
+        size_t end = playlist.find('\n', pos);
+        if (end == std::string::npos)
+            end = playlist.size();
+        std::string line = playlist.substr(pos, end - pos);
+        pos = end + 1;
+        if (!line.empty() && line[line.size() - 1] == '\r')
+            line.erase(line.size() - 1);
+        if (line.empty())
+            continue;
+        if (line[0] == '#')
+        {
+            size_t uri = line.find("URI=\"");
+            if (uri != std::string::npos)
+            {
+                uri += 5;
+                size_t uriEnd = line.find('"', uri);
+                if (uriEnd != std::string::npos)
+                {
+                    std::string absolute = resolveUrl(url, line.substr(uri, uriEnd - uri));
+                    if (!line.compare(0, 13, "#EXT-X-MEDIA:") || !line.compare(0, 26, "#EXT-X-I-FRAME-STREAM-INF:"))
+                        absolute = playlistUrl(session, absolute);
+                    line = line.substr(0, uri) + absolute + line.substr(uriEnd);
+                }
+            }
+        }
+        else
+        {
+            std::string absolute = resolveUrl(url, line);
+            if (master)
+                line = playlistUrl(session, absolute);
+            else if (!byteRange)
+            {
+                std::map<std::string, size_t>::iterator it = session.segmentIds.find(absolute);
+                size_t id = session.nextSegment;
+                if (it == session.segmentIds.end())
+                {
+                    session.segmentIds[absolute] = id;
+                    session.segments[id].url = absolute;
+                    session.segments[id].playlist = index;
+                    session.nextSegment++;
+                }
+                else
+                    id = it->second;
+                listed.push_back(id);
+                line = prefix + ("s" + std::to_string(id)) + "." + extension(absolute);
+            }
+            else
+                line = absolute;
+        }
+        out += line + "\n";
+    }
+    // segments of this playlist which left its window
+    if (!master && !byteRange)
+    {
+        std::sort(listed.begin(), listed.end());
+        std::vector<size_t> gone;
+        for (std::map<size_t, HlsProxySegment>::const_iterator it(session.segments.begin());
+                it != session.segments.end(); it++)
+        {
+            if (it->second.playlist == index && !std::binary_search(listed.begin(), listed.end(), it->first))
+                gone.push_back(it->first);
+        }
+        for (size_t i = 0; i < gone.size(); i++)
+            dropSegment(session, gone[i]);
+    }
+    return out;
+}
+
+void HlsProxy::serveClient(int fd)
+{
+    std::string buffer;
+    while (1)
+    {
+        size_t headerEnd;
+        while ((headerEnd = buffer.find("\r\n\r\n")) == std::string::npos)
+        {
+            struct pollfd pfd = {fd, POLLIN, 0};
+            if (buffer.size() > MAX_REQUEST_SIZE || poll(&pfd, 1, CLIENT_TIMEOUT) <= 0)
+                return;
+            char buf[4096];
+            ssize_t rd = recv(fd, buf, sizeof(buf), 0);
+            if (rd <= 0)
+                return;
+            buffer.append(buf, rd);
+        }
+        std::string request = buffer.substr(0, headerEnd);
+        buffer.erase(0, headerEnd + 4);
+
+        char method[16] = "", target[1024] = "", protocol[16] = "";
+        if (sscanf(request.c_str(), "%15s %1023s %15s", method, target, protocol) != 3)
+            return;
+        bool keepAlive = !strcmp(protocol, "HTTP/1.1") && !strcasestr(request.c_str(), "\nConnection: close");
+        size_t rangeStart = 0, rangeEnd = std::string::npos;
+        bool suffixRange = false;
+        const char *range = strcasestr(request.c_str(), "\nRange: bytes=");
+        // "bytes=-N" are the last N bytes, rangeEnd holds N then
+        if (range && range[14] == '-' && isdigit((unsigned char) range[15]))
+        {
+            suffixRange = true;
+            rangeEnd = strtoul(range + 15, NULL, 10);
+        }
+        else if (range)
+        {
+            char *next;
+            rangeStart = strtoul(range + 14, &next, 10);
+            if (*next == '-' && isdigit((unsigned char) next[1]))
+                rangeEnd = strtoul(next + 1, NULL, 10);
+        }
+        // /<session>/p<number>.m3u8 or /<session>/s<number>.<extension>
+        char id[33] = "", kind = 0;
+        unsigned int number = 0;
+        std::shared_ptr<HlsProxySession> session;
+        if (strcmp(method, "GET") || sscanf(target, "/%32[^/]/%c%u", id, &kind, &number) != 3)
+        {
+            if (!sendError(fd, 400, "Bad Request"))
+                return;
+            continue;
+        }
+        pthread_mutex_lock(&mMutex);
+        session = findSession(id);
+        bool known = session && ((kind == 'p' && number < session->playlists.size()) ||
+                (kind == 's' && session->segments.count(number)));
+        pthread_mutex_unlock(&mMutex);
+        if (!known)
+        {
+            if (!sendError(fd, 404, "Not Found"))
+                return;
+            continue;
+        }
+        if (kind == 'p')
+            servePlaylist(fd, session, number);
+        else
+            serveSegment(fd, session, number, rangeStart, rangeEnd, suffixRange);
+        if (!keepAlive)
+            return;
+    }
+}
+
+void HlsProxy::servePlaylist(int fd, const std::shared_ptr<HlsProxySession> &session, size_t index)
+{
+    pthread_mutex_lock(&mMutex);
+    std::string url = session->playlists[index];
+    pthread_mutex_unlock(&mMutex);
+    std::string body, finalUrl;
+    int status = fetch(url, session->headers, body, finalUrl, MAX_PLAYLIST_SIZE, &session->closed);
+    if (status != 200)
+    {
+        fprintf(stderr, "[HlsProxy] playlist %s failed (%d)\n", url.c_str(), status);
+        if (status == 404)
+            sendError(fd, 404, "Not Found");
+        else
+            sendError(fd, 502, "Bad Gateway");
+        return;
+    }
+    pthread_mutex_lock(&mMutex);
+    std::string playlist = rewrite(*session, index, finalUrl, body);
+    pthread_mutex_unlock(&mMutex);
+    sendResponse(fd, 200, "OK", "application/vnd.apple.mpegurl", playlist.c_str(), playlist.size(), true);
+}
+
+void HlsProxy::serveSegment(int fd, const std::shared_ptr<HlsProxySession> &session, size_t index,
+        size_t rangeStart, size_t rangeEnd, bool suffixRange)
+{
+    std::string key = segmentKey(session->id, index);
+    pthread_mutex_lock(&mMutex);
+    // segments of the session change with the next playlist meanwhile
+    std::map<size_t, HlsProxySegment>::const_iterator segment = session->segments.find(index);
+    if (segment == session->segments.end())
+    {
+        pthread_mutex_unlock(&mMutex);
+        sendError(fd, 404, "Not Found");
+        return;
+    }
+    const char *type = contentType(extension(segment->second.url));
+    std::map<std::string, HlsSegment>::iterator it = mCache.find(key);
+    if (it != mCache.end() && it->second.state == HlsSegment::ready)
+        mHits++;
+    else
+    {
+        mMisses++;
+        if (it == mCache.end() || it->second.state == HlsSegment::failed)
+        {
+            // player waits for it, so it goes before prefetched ones
+            mCache[key] = HlsSegment();
+            mQueue.push_front(key);
+        }
+    }
+    prefetch(session, index);
+    struct timespec deadline;
+    clock_gettime(CLOCK_MONOTONIC, &deadline);
+    deadline.tv_sec += SEGMENT_TIMEOUT / 1000;
+    std::shared_ptr<const std::string> data;
+    bool timedOut = false;
+    while (!session->closed && !timedOut)
+    {
+        it = mCache.find(key);
+        if (it == mCache.end() || it->second.state == HlsSegment::failed)
+            break;
+        if (it->second.state == HlsSegment::ready)
+        {
+            data = it->second.data;
+            it->second.served = true;
+            it->second.used = getMonotonicMs();
+            break;
+        }
+        it->second.waiters++;
+        timedOut = pthread_cond_timedwait(&mCond, &mMutex, &deadline) == ETIMEDOUT;
+        it = mCache.find(key);
+        if (it != mCache.end())
+            it->second.waiters--;
+    }
+    it = mCache.find(key);
+    // failed one is tried again on next request, closed session is dropped
+    if (!data && it != mCache.end() && !it->second.waiters &&
+            (it->second.state == HlsSegment::failed || (session->closed && it->second.state == HlsSegment::ready)))
+    {
+        if (it->second.state == HlsSegment::ready)
+            mCached -= it->second.data->size();
+        mCache.erase(it);
+    }
+    pthread_mutex_unlock(&mMutex);
+    if (!data)
+    {
+        sendError(fd, 502, "Bad Gateway");
+        return;
+    }
+    size_t size = data->size();
+    if (suffixRange)
+    {
+        rangeStart = rangeEnd < size ? size - rangeEnd : 0;
+        // "bytes=-0" is not satisfiable
+        rangeStart = rangeEnd ? rangeStart : size;
+        rangeEnd = std::string::npos;
+    }
+    if (rangeStart || rangeEnd != std::string::npos || suffixRange)
+    {
+        if (rangeStart >= size)
+        {
+            char header[64];
+            snprintf(header, sizeof(header), "Content-Range: bytes */%zu\r\n", size);
+            sendResponse(fd, 416, "Range Not Satisfiable", "text/plain", "", 0, true, header);
+            return;
+        }
+        rangeEnd = std::min(rangeEnd, size - 1);
+        char header[128];
+        snprintf(header, sizeof(header), "Content-Range: bytes %zu-%zu/%zu\r\n", rangeStart, rangeEnd, size);
+        sendResponse(fd, 206, "Partial Content", type, data->data() + rangeStart, rangeEnd - rangeStart + 1, true,
+                header);
+        return;
+    }
+    sendResponse(fd, 200, "OK", type, data->data(), size, true);
+}
+
+void HlsProxy::setLimits(unsigned int depth, size_t cacheSize)
+{
+    pthread_mutex_lock(&mMutex);
+    mDepth = depth;
+    mCacheLimit = cacheSize;
+    evict();
+    // extra workers exit
+    pthread_cond_broadcast(&mCond);
+    pthread_mutex_unlock(&mMutex);
+}
+
+bool HlsProxy::enabled()
+{
+    pthread_mutex_lock(&mMutex);
+    bool enabled = mDepth > 0;
+    pthread_mutex_unlock(&mMutex);
+    return enabled;
+}
+
+// 128 random bits as hex, other local processes would have to guess them
+// to get at the streams of the session, serial keeps it unique without
+// /dev/urandom
+static std::string sessionId(unsigned int serial)
+{
+    unsigned char bytes[16];
+    int fd = ::open("/dev/urandom", O_RDONLY | O_CLOEXEC);
+    bool random = fd >= 0 && read(fd, bytes, sizeof(bytes)) == (ssize_t) sizeof(bytes);
+    if (fd >= 0)
+        close(fd);
+    char id[33];
+    if (random)
+    {
+        for (size_t i = 0; i < sizeof(bytes); i++)
+            snprintf(id + i * 2, 3, "%02x", bytes[i]);
+    }
+    else
+    {
+        struct timespec ts;
+        clock_gettime(CLOCK_MONOTONIC, &ts);
+        snprintf(id, sizeof(id), "%08x%08x%08x%08x", serial, (unsigned int) getpid(),
+                (unsigned int) time(NULL), (unsigned int) ts.tv_nsec);
+    }
+    return id;
+}
+
+std::string HlsProxy::open(const HeaderMap &headers)
+{
+    pthread_mutex_lock(&mMutex);
+    if (mFd < 0 && startServer() < 0)
+    {
+        pthread_mutex_unlock(&mMutex);
+        return "";
+    }
+    std::shared_ptr<HlsProxySession> session = std::make_shared<HlsProxySession>();
+    session->id = sessionId(++mSerial);
+    session->headers = headers;
+    mSessions[session->id] = session;
+    pthread_mutex_unlock(&mMutex);
+    return session->id;
+}
+
+std::string HlsProxy::getUrl(const std::string &session, const std::string &url)
+{
+    pthread_mutex_lock(&mMutex);
+    std::shared_ptr<HlsProxySession> found = findSession(session);
+    std::string proxied = found ? playlistUrl(*found, url) : "";
+    pthread_mutex_unlock(&mMutex);
+    return proxied;
+}
+
+std::string HlsProxy::playlistUrl(HlsProxySession &session, const std::string &url)
+{
+    size_t index = std::find(session.playlists.begin(), session.playlists.end(), url) - session.playlists.begin();
+    if (index == session.playlists.size())
+        session.playlists.push_back(url);
+    char proxied[96];
+    snprintf(proxied, sizeof(proxied), "http://127.0.0.1:%d/%s/p%zu.m3u8", mPort, session.id.c_str(), index);
+    return proxied;
+}
+
+void HlsProxy::close(const std::string &id)
+{
+    pthread_mutex_lock(&mMutex);
+    std::shared_ptr<HlsProxySession> session = findSession(id);
+    if (session)
+    {
+        session->closed = true;
+        mSessions.erase(id);
+        std::string prefix = id + "/";
+        for (std::map<std::string, HlsSegment>::iterator it(mCache.lower_bound(prefix)); it != mCache.end() &&
+                !it->first.compare(0, prefix.size(), prefix);)
+        {
+            // loading ones are dropped by their worker
+            if (it->second.state == HlsSegment::loading || it->second.waiters)
+            {
+                it++;
+                continue;
+            }
+            if (it->second.state == HlsSegment::ready)
+                mCached -= it->second.data->size();
+            mCache.erase(it++);
+        }
+        pthread_cond_broadcast(&mCond);
+    }
+    pthread_mutex_unlock(&mMutex);
+}
+
+void HlsProxy::getStats(size_t &cached, unsigned int &depth, unsigned int &hits, unsigned int &misses)
+{
+    pthread_mutex_lock(&mMutex);
+    cached = mCached;
+    depth = mDepth;
+    hits = mHits;
+    misses = mMisses;
+    pthread_mutex_unlock(&mMutex);
+}
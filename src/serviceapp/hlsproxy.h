@@ -0,0 +1,121 @@
+#ifndef __hlsproxy_h
+#define __hlsproxy_h
+
+#include <pthread.h>
+#include <stdint.h>
+#include <atomic>
+#include <deque>
+#include <map>
+#include <memory>
+#include <string>
+#include <vector>
+
+#include "common.h"
+
+struct HlsProxySegment
+{
+    std::string url;
+    // playlist which lists it
+    size_t playlist;
+};
+
+struct HlsProxySession
+{
+    std::string id;
+    HeaderMap headers;
+    // origin urls of playlists and segments by their number in proxy urls,
+    // segments which left the window of live playlist are dropped
+    std::vector<std::string> playlists;
+    std::map<size_t, HlsProxySegment> segments;
+    std::map<std::string, size_t> segmentIds;
+    size_t nextSegment;
+    // set by close, transfers of the session give up
+    std::atomic<bool> closed;
+    HlsProxySession(): nextSegment(0), closed(false){}
+};
+
+struct HlsSegment
+{
+    enum {queued, loading, ready, failed};
+    int state;
+    std::shared_ptr<const std::string> data;
+    // already sent to the player, evicted first
+    bool served;
+    int64_t used;
+    // players waiting for it, not evicted meanwhile
+    int waiters;
+    HlsSegment(): state(queued), served(false), used(0), waiters(0){}
+};
+
+// Loopback HTTP proxy of HLS streams with segment prefetch.
+//
+// Playlists are fetched from the origin on every request of the player
+// and their URIs are rewritten to the proxy. Once the player asks for a
+// segment, next segments up to the prefetch depth are downloaded in
+// parallel into the memory-bounded cache, so jitter of the link is hidden
+// from the player and all backends get the same read-ahead.
+//
+// Keys and initialization sections are not proxied, their URIs are only
+// made absolute. Playlists with byte ranges are passed with absolute
+// URIs as well.
+class HlsProxy
+{
+    pthread_mutex_t mMutex;
+    pthread_cond_t mCond;
+    int mFd;
+    int mPort;
+    std::map<std::string, std::shared_ptr<HlsProxySession> > mSessions;
+    // keyed by "session/segment"
+    std::map<std::string, HlsSegment> mCache;
+    std::deque<std::string> mQueue;
+    size_t mCacheLimit;
+    size_t mCached;
+    unsigned int mDepth;
+    unsigned int mWorkers;
+    unsigned int mLoading;
+    unsigned int mLoadStarts;
+    unsigned int mHits;
+    unsigned int mMisses;
+    unsigned int mSerial;
+
+    int startServer();
+    unsigned int workerLimit() const;
+    void startWorkers();
+    void evict();
+    void prefetch(const std::shared_ptr<HlsProxySession> &session, size_t segment);
+    void load(const std::string &key);
+    std::shared_ptr<HlsProxySession> findSession(const std::string &id);
+    std::string playlistUrl(HlsProxySession &session, const std::string &url);
+    std::string rewrite(HlsProxySession &session, size_t index, const std::string &url, const std::string &playlist);
+    void dropSegment(HlsProxySession &session, size_t segment);
+    void serveClient(int fd);
+    void servePlaylist(int fd, const std::shared_ptr<HlsProxySession> &session, size_t index);
+    void serveSegment(int fd, const std::shared_ptr<HlsProxySession> &session, size_t index,
+            size_t rangeStart, size_t rangeEnd, bool suffixRange);
+    static void *acceptThread(void *arg);
+    static void *clientThread(void *arg);
+    static void *workerThread(void *arg);
+    HlsProxy();
+    ~HlsProxy();
+public:
+    static HlsProxy *getInstance();
+
+    // downloads of the origin with redirects, returns HTTP status or -1
+    static int fetch(const std::string &url, const HeaderMap &headers, std::string &body, std::string &finalUrl,
+            size_t maxSize, const std::atomic<bool> *cancelled=NULL);
+
+    // prefetch depth in segments, 0 disables the proxy, cache in bytes
+    void setLimits(unsigned int depth, size_t cacheSize);
+    bool enabled();
+    // returns session id, empty when the proxy cannot be started
+    std::string open(const HeaderMap &headers);
+    // proxy url of the playlist within the session, empty on failure
+    std::string getUrl(const std::string &session, const std::string &url);
+    // cached segments of the session are dropped
+    void close(const std::string &session);
+    // cached bytes, prefetch depth, segments served from prefetch and
+    // segments the player had to wait for
+    void getStats(size_t &cached, unsigned int &depth, unsigned int &hits, unsigned int &misses);
+};
+
+#endif
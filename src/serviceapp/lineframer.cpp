@@ -0,0 +1,69 @@
+#include <string.h>
+
+#include "lineframer.h"
+
+void LineFramer::emit(iLineHandler &handler, const char *data, size_t len)
+{
+	if (len && data[len - 1] == '\r')
+		len--;
+	if (len)
+		handler.handleLine(data, len);
+}
+
+void LineFramer::feed(const char *data, size_t len, iLineHandler &handler)
+{
+	const char *end = data + len;
+	while (data < end)
+	{
+		const char *nl = (const char *) memchr(data, '\n', end - data);
+		if (nl == NULL)
+		{
+			// unterminated tail, keep it for next read
+			size_t tail = end - data;
+			if (mOverflow || mPending.size() + tail > mMaxLineLength)
+			{
+				mPending.clear();
+				mOverflow = true;
+				return;
+			}
+			mPending.insert(mPending.end(), data, end);
+			return;
+		}
+		if (mOverflow)
+		{
+			// end of line which was too long, drop it
+			mOverflow = false;
+			mDiscarded++;
+		}
+		else if (mPending.empty())
+		{
+			// whole line is in the chunk, no need to copy it
+			emit(handler, data, nl - data);
+		}
+		else
+		{
+			mPending.insert(mPending.end(), data, nl);
+			// keep the line terminated, as it is in caller's buffer
+			mPending.push_back('\0');
+			emit(handler, &mPending[0], mPending.size() - 1);
+			mPending.clear();
+		}
+		data = nl + 1;
+	}
+}
+
+void LineFramer::flush(iLineHandler &handler)
+{
+	if (!mOverflow && !mPending.empty())
+	{
+		mPending.push_back('\0');
+		emit(handler, &mPending[0], mPending.size() - 1);
+	}
+	reset();
+}
+
+void LineFramer::reset()
+{
+	mPending.clear();
+	mOverflow = false;
+}
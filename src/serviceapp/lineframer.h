@@ -0,0 +1,43 @@
+#ifndef __lineframer_h
+#define __lineframer_h
+
+#include <stddef.h>
+#include <vector>
+
+class iLineHandler
+{
+public:
+	virtual ~iLineHandler(){}
+	// '\n' and trailing '\r' are not part of the line, the line is
+	// still followed by its delimiter or by '\0' in memory
+	virtual void handleLine(const char *data, size_t len) = 0;
+};
+
+// Splits output of console application into lines.
+//
+// Complete lines found in the passed chunk are handed directly
+// to the handler as slices of the caller's buffer, only unterminated
+// tail of the chunk is copied to internal buffer, where it waits
+// for the rest of the line from following reads.
+class LineFramer
+{
+	std::vector<char> mPending;
+	size_t mMaxLineLength;
+	bool mOverflow;
+	unsigned int mDiscarded;
+	void emit(iLineHandler &handler, const char *data, size_t len);
+public:
+	LineFramer(size_t maxLineLength=1024*1024):
+		mMaxLineLength(maxLineLength),
+		mOverflow(false),
+		mDiscarded(0){}
+	void feed(const char *data, size_t len, iLineHandler &handler);
+	// hand over unterminated tail, i.e. when application has exited
+	void flush(iLineHandler &handler);
+	void reset();
+	size_t pending() const {return mPending.size();}
+	// number of lines dropped, because they exceeded maxLineLength
+	unsigned int discarded() const {return mDiscarded;}
+};
+
+#endif
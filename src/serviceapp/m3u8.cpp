@@ -1,10 +1,16 @@
+#include "bandwidthestimator.h"
+#include "connectionpool.h"
 #include "m3u8.h"
+#include "playlistcache.h"
 #include <cstring>
 
 #define M3U8_HEADER "#EXTM3U"
 #define M3U8_HEADER_MAX_LINE 5
+#define M3U8_LINE_MAX (1024 * 1024)
 
 #define M3U8_STREAM_INFO "#EXT-X-STREAM-INF"
+#define M3U8_IFRAME_STREAM_INFO "#EXT-X-I-FRAME-STREAM-INF"
+#define M3U8_MEDIA "#EXT-X-MEDIA"
 #define M3U8_MEDIA_SEQUENCE "#EXT-X-MEDIA-SEQUENCE"
 
 bool isM3U8Url(const std::string &url)
@@ -19,66 +25,355 @@ bool isM3U8Url(const std::string &url)
     return false;
 }
 
-int parse_attribute(char **ptr, char **key, char **value)
+// attribute list of the tag, quoted values are returned without quotes
+class AttributeReader
 {
-    if (ptr == NULL || *ptr == NULL || key == NULL || value == NULL)
-        return -1;
-
-    char *end; 
-    char *p;
-    p = end = strchr(*ptr, ',');
-    if (end)
+    const char *p;
+    const char *end;
+public:
+    AttributeReader(const char *attributes, size_t len):
+        p(attributes),
+        end(attributes + len){}
+    bool next(std::string &key, std::string &value)
     {
-        char *q = strchr(*ptr, '"');
-        if (q && q < end)
+        while (p < end && (*p == ',' || *p == ' '))
+            p++;
+        const char *eq = (const char *) memchr(p, '=', end - p);
+        if (p >= end || eq == NULL)
+            return false;
+        key.assign(p, eq - p);
+        p = eq + 1;
+        if (p < end && *p == '"')
         {
-            q = strchr(++q, '"');
-            if (q)
-            {
-                p = end = strchr(++q, ',');
-            }
+            p++;
+            const char *q = (const char *) memchr(p, '"', end - p);
+            if (q == NULL)
+                q = end;
+            value.assign(p, q - p);
+            p = q < end ? q + 1 : end;
+        }
+        else
+        {
+            const char *comma = (const char *) memchr(p, ',', end - p);
+            if (comma == NULL)
+                comma = end;
+            value.assign(p, comma - p);
+            p = comma;
         }
+        return true;
     }
-    if (end)
+};
+
+static bool startsWith(const char *line, size_t len, const char *prefix, size_t prefixLen)
+{
+    return len >= prefixLen && !memcmp(line, prefix, prefixLen);
+}
+
+#define TAG(line, len, tag) startsWith(line, len, tag, sizeof(tag) - 1)
+
+std::string resolveUrl(const std::string &base, const std::string &reference)
+{
+    if (reference.find("://") != std::string::npos)
+        return reference;
+    size_t scheme = base.find("://");
+    if (scheme == std::string::npos)
+        return reference;
+    if (!reference.compare(0, 2, "//"))
+        return base.substr(0, scheme + 1) + reference;
+    // keep the port of the base
+    size_t path = base.find_first_of("/?#", scheme + 3);
+    if (!reference.empty() && reference[0] == '/')
+        return base.substr(0, path) + reference;
+    if (path == std::string::npos || base[path] != '/')
+        return base.substr(0, path) + "/" + reference;
+    size_t dirEnd = base.find_first_of("?#", path);
+    dirEnd = base.rfind('/', dirEnd == std::string::npos ? std::string::npos : dirEnd - 1);
+    return base.substr(0, dirEnd + 1) + reference;
+}
+
+// https://tools.ietf.org/html/rfc8216#section-4.3.4.2
+void M3U8Parser::parseStreamInfo(const char *attributes, size_t len, M3U8StreamInfo &info, bool iframe)
+{
+    AttributeReader reader(attributes, len);
+    std::string key, value;
+    while (reader.next(key, value))
     {
-        do
+        if (!strcasecmp(key.c_str(), "BANDWIDTH"))
+            info.bitrate = strtoul(value.c_str(), NULL, 10);
+        else if (!strcasecmp(key.c_str(), "AVERAGE-BANDWIDTH"))
+            info.averageBitrate = strtoul(value.c_str(), NULL, 10);
+        else if (!strcasecmp(key.c_str(), "RESOLUTION"))
+            info.resolution = value;
+        else if (!strcasecmp(key.c_str(), "CODECS"))
+            info.codecs = value;
+        else if (!strcasecmp(key.c_str(), "FRAME-RATE"))
+            info.frameRate = strtod(value.c_str(), NULL);
+        else if (!strcasecmp(key.c_str(), "HDCP-LEVEL"))
+            info.hdcpLevel = value;
+        else if (!strcasecmp(key.c_str(), "AUDIO"))
+            info.audioGroup = value;
+        else if (!strcasecmp(key.c_str(), "VIDEO"))
+            info.videoGroup = value;
+        else if (!strcasecmp(key.c_str(), "SUBTITLES"))
+            info.subtitlesGroup = value;
+        else if (!strcasecmp(key.c_str(), "CLOSED-CAPTIONS"))
+            info.closedCaptionsGroup = value;
+        else if (iframe && !strcasecmp(key.c_str(), "URI"))
+            info.url = resolveUrl(baseUrl, value);
+    }
+}
+
+// https://tools.ietf.org/html/rfc8216#section-4.3.4.1
+void M3U8Parser::parseMedia(const char *attributes, size_t len)
+{
+    M3U8Rendition rendition;
+    AttributeReader reader(attributes, len);
+    std::string key, value;
+    bool known = false;
+    while (reader.next(key, value))
+    {
+        if (!strcasecmp(key.c_str(), "TYPE"))
         {
-            end++;
+            known = true;
+            if (value == "AUDIO")
+                rendition.type = M3U8Rendition::audio;
+            else if (value == "VIDEO")
+                rendition.type = M3U8Rendition::video;
+            else if (value == "SUBTITLES")
+                rendition.type = M3U8Rendition::subtitles;
+            else if (value == "CLOSED-CAPTIONS")
+                rendition.type = M3U8Rendition::closedCaptions;
+            else
+                known = false;
         }
-        while(*end && *end == ' ');
-        *p = '\0';
+        else if (!strcasecmp(key.c_str(), "GROUP-ID"))
+            rendition.groupId = value;
+        else if (!strcasecmp(key.c_str(), "NAME"))
+            rendition.name = value;
+        else if (!strcasecmp(key.c_str(), "LANGUAGE"))
+            rendition.language = value;
+        else if (!strcasecmp(key.c_str(), "URI"))
+            rendition.url = resolveUrl(baseUrl, value);
+        else if (!strcasecmp(key.c_str(), "INSTREAM-ID"))
+            rendition.instreamId = value;
+        else if (!strcasecmp(key.c_str(), "CHANNELS"))
+            rendition.channels = value;
+        else if (!strcasecmp(key.c_str(), "DEFAULT"))
+            rendition.isDefault = value == "YES";
+        else if (!strcasecmp(key.c_str(), "AUTOSELECT"))
+            rendition.autoselect = value == "YES";
+        else if (!strcasecmp(key.c_str(), "FORCED"))
+            rendition.forced = value == "YES";
+    }
+    if (!known)
+    {
+        fprintf(stderr, "[%s] - skipping rendition of unknown type\n", __func__);
+        return;
     }
+    playlist.renditions.push_back(rendition);
+}
 
-    *key = *ptr;
-    p = strchr(*ptr, '=');
-    if (!p)
+int M3U8Parser::parseLine(const char *line, size_t len)
+{
+    if (state == error)
         return -1;
-    *p++ = '\0';
-    *value = p;
-    *ptr = end;
+    lines++;
+    if (state == header)
+    {
+        // byte order mark
+        if (lines == 1 && TAG(line, len, "\xef\xbb\xbf"))
+        {
+            line += 3;
+            len -= 3;
+        }
+        if (TAG(line, len, M3U8_HEADER))
+            state = tags;
+        else if (lines >= M3U8_HEADER_MAX_LINE)
+        {
+            fprintf(stderr, "[%s] - invalid M3U8 playlist, '%s' header is not in first %d lines\n",
+                    __func__, M3U8_HEADER, M3U8_HEADER_MAX_LINE);
+            state = error;
+            return -1;
+        }
+        return 0;
+    }
+    // trailing whitespace, carriage return of crlf when line comes unstripped
+    while (len && (line[len - 1] == ' ' || line[len - 1] == '\t' || line[len - 1] == '\r'))
+        len--;
+    if (!len)
+        return 0;
+    if (line[0] != '#')
+    {
+        if (state == uri)
+        {
+            pending.url = resolveUrl(baseUrl, std::string(line, len));
+            playlist.variants.push_back(pending);
+            state = tags;
+        }
+        else
+            fprintf(stderr, "[%s] - skipping uri without stream info\n", __func__);
+        return 0;
+    }
+    // comment
+    if (!TAG(line, len, "#EXT"))
+        return 0;
+    if (state == uri)
+    {
+        fprintf(stderr, "[%s] - stream info without uri\n", __func__);
+        state = tags;
+    }
+    if (TAG(line, len, M3U8_STREAM_INFO ":"))
+    {
+        pending = M3U8StreamInfo();
+        parseStreamInfo(line + sizeof(M3U8_STREAM_INFO), len - sizeof(M3U8_STREAM_INFO), pending, false);
+        state = uri;
+    }
+    else if (TAG(line, len, M3U8_IFRAME_STREAM_INFO ":"))
+    {
+        M3U8StreamInfo info;
+        parseStreamInfo(line + sizeof(M3U8_IFRAME_STREAM_INFO), len - sizeof(M3U8_IFRAME_STREAM_INFO), info, true);
+        if (!info.url.empty())
+            playlist.iframeStreams.push_back(info);
+    }
+    else if (TAG(line, len, M3U8_MEDIA ":"))
+    {
+        parseMedia(line + sizeof(M3U8_MEDIA), len - sizeof(M3U8_MEDIA));
+    }
+    else if (TAG(line, len, "#EXT-X-VERSION:"))
+    {
+        playlist.version = atoi(std::string(line + 15, len - 15).c_str());
+    }
+    else if (TAG(line, len, "#EXT-X-INDEPENDENT-SEGMENTS"))
+    {
+        playlist.independentSegments = true;
+    }
+    else if (TAG(line, len, M3U8_MEDIA_SEQUENCE) || TAG(line, len, "#EXT-X-TARGETDURATION") || TAG(line, len, "#EXTINF"))
+    {
+        fprintf(stderr, "[%s] - we need master playlist not media playlist!\n", __func__);
+        state = error;
+        return -1;
+    }
     return 0;
 }
 
-//https://tools.ietf.org/html/draft-pantos-http-live-streaming-13#section-3.4.10
-int M3U8VariantsExplorer::parseStreamInfoAttributes(const char *attributes, M3U8StreamInfo& info)
+int M3U8Parser::feed(const char *data, size_t len)
 {
-    char *myline = strdup(attributes);
-    char *ptr = myline;
-    char *key = NULL;
-    char *value = NULL;
-    while (!parse_attribute(&ptr, &key, &value))
-    {
-        if (!strcasecmp(key, "bandwidth"))
-            info.bitrate = atoi(value);
-        if (!strcasecmp(key, "resolution"))
-            info.resolution = value;
-        if (!strcasecmp(key, "codecs"))
-            info.codecs = value;
+    const char *end = data + len;
+    while (data < end && state != error)
+    {
+        const char *nl = (const char *) memchr(data, '\n', end - data);
+        if (!nl)
+        {
+            if (partial.size() + (end - data) > M3U8_LINE_MAX)
+            {
+                fprintf(stderr, "[%s] - line exceeds %d bytes\n", __func__, M3U8_LINE_MAX);
+                state = error;
+                break;
+            }
+            partial.append(data, end - data);
+            break;
+        }
+        if (partial.empty())
+            parseLine(data, nl - data);
+        else
+        {
+            partial.append(data, nl - data);
+            parseLine(partial.data(), partial.size());
+            partial.clear();
+        }
+        data = nl + 1;
     }
-    free(myline);
-    return 0;
+    return state == error ? -1 : 0;
 }
 
+int M3U8Parser::finish()
+{
+    // last line without newline
+    if (!partial.empty())
+    {
+        parseLine(partial.data(), partial.size());
+        partial.clear();
+    }
+    if (state == uri)
+        fprintf(stderr, "[%s] - stream info without uri\n", __func__);
+    if (state != error)
+        state = tags;
+    return playlist.variants.empty() ? -1 : 0;
+}
+
+static bool isVideoCodec(const std::string &codec)
+{
+    static const char *video[] = {"avc1", "avc3", "hvc1", "hev1", "dvh1", "dvhe", "vp09", "vp8", "av01", "mp4v"};
+    for (size_t i = 0; i < sizeof(video) / sizeof(video[0]); i++)
+    {
+        if (!codec.compare(0, strlen(video[i]), video[i]))
+            return true;
+    }
+    return false;
+}
+
+bool M3U8StreamInfo::hasVideo() const
+{
+    if (codecs.empty() || !resolution.empty())
+        return true;
+    size_t start = 0;
+    while (start < codecs.size())
+    {
+        size_t end = codecs.find(',', start);
+        if (end == std::string::npos)
+            end = codecs.size();
+        while (start < end && codecs[start] == ' ')
+            start++;
+        if (isVideoCodec(codecs.substr(start, end - start)))
+            return true;
+        start = end + 1;
+    }
+    return false;
+}
+
+const M3U8Rendition *M3U8MasterPlaylist::selectAudio(const M3U8StreamInfo &variant, const std::string &language) const
+{
+    const M3U8Rendition *selected = NULL;
+    if (variant.audioGroup.empty())
+        return NULL;
+    for (std::vector<M3U8Rendition>::const_iterator it(renditions.begin()); it != renditions.end(); it++)
+    {
+        if (it->type != M3U8Rendition::audio || it->groupId != variant.audioGroup)
+            continue;
+        if (!language.empty() && !strncasecmp(it->language.c_str(), language.c_str(), language.size()))
+            return &(*it);
+        if (selected == NULL || (it->isDefault && !selected->isDefault))
+            selected = &(*it);
+    }
+    return selected;
+}
+
+// video and audio are selected independently, variant with video which fits
+// to the bitrate is preferred, audio-only variant is used only when the link
+// is too slow for any video
+const M3U8StreamInfo *selectVariant(const std::vector<M3U8StreamInfo> &variants, unsigned long int bitrate)
+{
+    const M3U8StreamInfo *video = NULL, *lowestVideo = NULL, *audio = NULL, *lowest = NULL;
+    for (std::vector<M3U8StreamInfo>::const_iterator it(variants.begin()); it != variants.end(); it++)
+    {
+        if (lowest == NULL || it->bitrate < lowest->bitrate)
+            lowest = &(*it);
+        if (it->hasVideo())
+        {
+            if (lowestVideo == NULL || it->bitrate < lowestVideo->bitrate)
+                lowestVideo = &(*it);
+            if (it->bitrate <= bitrate && (video == NULL || it->bitrate > video->bitrate))
+                video = &(*it);
+        }
+        else if (it->bitrate <= bitrate && (audio == NULL || it->bitrate > audio->bitrate))
+            audio = &(*it);
+    }
+    if (video)
+        return video;
+    if (audio)
+        return audio;
+    return lowestVideo ? lowestVideo : lowest;
+}
 
 int M3U8VariantsExplorer::getVariantsFromMasterUrl(const std::string& url, HeaderMap& headers, unsigned int redirect)
 {
@@ -87,6 +382,11 @@ int M3U8VariantsExplorer::getVariantsFromMasterUrl(const std::string& url, Heade
         fprintf(stderr, "[%s] - reached maximum number of %d - redirects\n", __func__, redirectLimit);
         return -1;
     }
+    if (cancelled && *cancelled)
+    {
+        fprintf(stderr, "[%s] - cancelled\n", __func__);
+        return -1;
+    }
     Url purl(url);
 
     int port = purl.port();
@@ -102,33 +402,6 @@ int M3U8VariantsExplorer::getVariantsFromMasterUrl(const std::string& url, Heade
             return -1;
         }
     }
-    int sd;
-    if((sd = Connect(purl.host().c_str(), port, 5)) < 0)
-    {
-        fprintf(stderr, "[%s] - Error in Connect\n", __func__);
-        return -1;
-    }
-
-    SSL *ssl = NULL;
-    SSL_CTX *ssl_ctx = NULL;
-
-    if (purl.proto() == "https")
-    {
-        if (SSLConnect(purl.host().c_str(), sd, &ssl, &ssl_ctx) < 0)
-        {
-            ::close(sd);
-            return -1;
-        }
-        fprintf(stderr, "[%s] - (SSL) Connected with %s encryption\n",
-                __func__, SSL_get_cipher(ssl));
-
-        // just inform about verification error but continue to work
-        if (SSL_get_verify_result(ssl) != X509_V_OK)
-        {
-            fprintf(stderr, "[%s] - (SSL) Error in certificate verification: %s\n",
-                    __func__, X509_verify_cert_error_string(SSL_get_verify_result(ssl)));
-        }
-    }
     std::string userAgent = "Enigma2 HbbTV/1.1.1 (+PVR+RTSP+DL;OpenPLi;;;)";
     HeaderMap::const_iterator it;
     if ((it = headers.find("User-Agent")) != headers.end())
@@ -151,213 +424,257 @@ int M3U8VariantsExplorer::getVariantsFromMasterUrl(const std::string& url, Heade
     request.append("\r\n");
     request.append("User-Agent: ").append(userAgent).append("\r\n");
     request.append("Accept: */*\r\n");
+    // big master playlists are often compressed by CDNs
+    request.append("Accept-Encoding: gzip, deflate\r\n");
     for (HeaderMap::const_iterator it(headers.begin()); it != headers.end(); it++)
     {
-        if ((it->first).compare("User-Agent"))
+        if ((it->first).compare("User-Agent") && (it->first).compare("Accept-Encoding"))
         {
             request.append(it->first + ": ").append(it->second).append("\r\n");
         }
     }
-    request.append("Connection: close\r\n");
+    // cached playlist is sent back only when it changed
+    if (!ifNoneMatch.empty())
+    {
+        request.append("If-None-Match: ").append(ifNoneMatch).append("\r\n");
+    }
+    if (!ifModifiedSince.empty())
+    {
+        request.append("If-Modified-Since: ").append(ifModifiedSince).append("\r\n");
+    }
+    // connection is kept open for redirects and next requests to the same server
     request.append("\r\n");
 
     fprintf(stderr, "[%s] - Request:\n", __func__);
     fprintf(stderr, "%s\n", request.c_str());
 
-    if (writeAll(ssl, sd, request.c_str(), request.length()) < (signed long) request.length())
-    {
-        fprintf(stderr, "[%s] - writeAll, didn't write everything\n", __func__);
-        ::close(sd);
-        if (ssl)
-        {
-            SSL_free(ssl);
-            SSL_CTX_free(ssl_ctx);
-        }
-        return -1;
-    }
+    ConnectionPool *pool = ConnectionPool::getInstance();
+    HttpConnection conn;
     int lines = 0;
-    int contentLines = 0;
 
-    int contentLength = 0;
-    int contentSize = 0;
+    int contentLength = -1;
+    bool chunked = false;
+    std::string contentEncoding;
+    bool keepAlive = false;
     bool contentStarted = false;
     bool contentTypeParsed = false;
-    bool m3u8HeaderParsed = false;
-    bool m3u8StreamInfoParsing = false;
-    M3U8StreamInfo m3u8StreamInfo;
+    M3U8Parser parser(url);
 
-    size_t bufferSize = 1024;
-    char *lineBuffer = (char *) malloc(bufferSize);
+    // header lines and content are read from the same buffer
+    ConnectionReader *reader = NULL;
+    char *lineBuffer = NULL;
 
-    int statusCode;
-    char protocol[64], statusMessage[64];
+    int statusCode = 0;
+    char protocol[64] = "", statusMessage[64] = "";
 
-    int result = readLine(ssl, sd, &lineBuffer, &bufferSize);
-    fprintf(stderr, "[%s] Response[%d](size=%d): %s\n", __func__, lines++, result, lineBuffer);
-    result = sscanf(lineBuffer, "%99s %d %99s", protocol, &statusCode, statusMessage);
-    if (result != 3 || (statusCode != 200 && statusCode != 301 && statusCode != 302))
+    int result = -1;
+    // download of the body measures throughput from the server
+    int64_t requestTime = 0;
+    size_t bodyBytes = 0;
+    for (int attempt = 0; attempt < 2 && result < 0; attempt++)
+    {
+        if (pool->acquire(purl.proto(), purl.host(), port, conn, cancelled) < 0)
+        {
+            fprintf(stderr, "[%s] - Error in Connect\n", __func__);
+            delete reader;
+            return -1;
+        }
+        delete reader;
+        reader = new ConnectionReader(conn.ssl, conn.fd);
+        requestTime = getMonotonicMs();
+        if (writeAll(conn.ssl, conn.fd, request.c_str(), request.length()) == (signed long) request.length())
+            result = reader->readLine(&lineBuffer);
+        else
+            fprintf(stderr, "[%s] - writeAll, didn't write everything\n", __func__);
+        if (result < 0)
+        {
+            // server may have closed idle connection in the meantime, try a new one
+            bool retry = conn.reused;
+            pool->release(conn, false);
+            if (!retry)
+                break;
+        }
+    }
+    if (result >= 0)
+    {
+        fprintf(stderr, "[%s] Response[%d](size=%d): %s\n", __func__, lines++, result, lineBuffer);
+        result = sscanf(lineBuffer, "%63s %d %63s", protocol, &statusCode, statusMessage);
+        // keep-alive is default since HTTP/1.1
+        keepAlive = !strcmp(protocol, "HTTP/1.1");
+    }
+    if (result != 3 || (statusCode != 200 && statusCode != 301 && statusCode != 302 && statusCode != 304))
     {
             fprintf(stderr, "[%s] - wrong http response code: %d\n", __func__, statusCode);
-            free(lineBuffer);
-            if (ssl)
-            {
-                SSL_free(ssl);
-                SSL_CTX_free(ssl_ctx);
-            }
-            ::close(sd);
+            delete reader;
+            pool->release(conn, false);
             return -1;
     }
     int ret = -1;
     std::string redirectUrl;
     while(1)
     {
-        result = readLine(ssl, sd, &lineBuffer, &bufferSize);
-        fprintf(stderr, "[%s] Response[%d](size=%d): %s\n", __func__, lines++, result, lineBuffer);
+        result = reader->readLine(&lineBuffer);
         if (result < 0)
         {
             fprintf(stderr, "[%s] - end of read, nothing was read\n", __func__);
             break;
         }
+        fprintf(stderr, "[%s] Response[%d](size=%d): %s\n", __func__, lines++, result, lineBuffer);
 
-        if (!contentStarted)
+        if (!strncasecmp(lineBuffer, "Content-Length:", 15))
         {
-            if (!contentLength)
-            {
-                sscanf(lineBuffer, "Content-Length: %d", &contentLength);
-            }
-            if (!contentTypeParsed)
+            contentLength = atoi(&lineBuffer[15]);
+        }
+        if (!strncasecmp(lineBuffer, "Transfer-Encoding:", 18) && strcasestr(&lineBuffer[18], "chunked"))
+        {
+            chunked = true;
+        }
+        if (!strncasecmp(lineBuffer, "Content-Encoding:", 17))
+        {
+            contentEncoding = &lineBuffer[17];
+        }
+        if (!strncasecmp(lineBuffer, "Connection:", 11) && strcasestr(&lineBuffer[11], "close"))
+        {
+            keepAlive = false;
+        }
+        if (statusCode == 200 && !strncasecmp(lineBuffer, "ETag:", 5))
+        {
+            etag = &lineBuffer[5 + strspn(&lineBuffer[5], " ")];
+        }
+        if (statusCode == 200 && !strncasecmp(lineBuffer, "Last-Modified:", 14))
+        {
+            lastModified = &lineBuffer[14 + strspn(&lineBuffer[14], " ")];
+        }
+        if (!contentTypeParsed)
+        {
+            char contenttype[33];
+            if (sscanf(lineBuffer, "Content-Type: %32s", contenttype) == 1)
             {
-                char contenttype[33];
-                if (sscanf(lineBuffer, "Content-Type: %32s", contenttype) == 1)
+                contentTypeParsed = true;
+                if (!(!strncasecmp(contenttype, "application/text", 16)
+                        || !strncasecmp(contenttype, "text/plain", 10)
+                        || !strncasecmp(contenttype, "audio/x-mpegurl", 15)
+                        || !strncasecmp(contenttype, "application/x-mpegurl", 21)
+                        || !strncasecmp(contenttype, "application/vnd.apple.mpegurl", 29)
+                        || !strncasecmp(contenttype, "audio/mpegurl", 13)
+                        || !strncasecmp(contenttype, "application/m3u", 15)))
                 {
-                    contentTypeParsed = true;
-                    if (!(!strncasecmp(contenttype, "application/text", 16)
-                            || !strncasecmp(contenttype, "text/plain", 10)
-                            || !strncasecmp(contenttype, "audio/x-mpegurl", 15)
-                            || !strncasecmp(contenttype, "application/x-mpegurl", 21)
-                            || !strncasecmp(contenttype, "application/vnd.apple.mpegurl", 29)
-                            || !strncasecmp(contenttype, "audio/mpegurl", 13)
-                            || !strncasecmp(contenttype, "application/m3u", 15)))
+                    if (statusCode == 200)
                     {
-                        if (statusCode == 200)
-                        {
-                            fprintf(stderr, "[%s] - not supported contenttype detected: %s!\n", __func__, contenttype);
-                            break;
-                        }
+                        fprintf(stderr, "[%s] - not supported contenttype detected: %s!\n", __func__, contenttype);
+                        break;
                     }
                 }
             }
-            if ((statusCode == 301 || statusCode == 302) && strncasecmp(lineBuffer, "location: ", 10) == 0)
-            {
-                redirectUrl = &lineBuffer[10];
-            }
-            if (!strncmp(lineBuffer, "Set-Cookie: ", 12))
-            {
-                if (headers.find("Cookie") == headers.end())
-                    headers["Cookie"] = &lineBuffer[12];
-                else
-                    headers["Cookie"].append(";").append(&lineBuffer[12]);
-            }
-            if (!result)
-            {
-                contentStarted = true;
-                fprintf(stderr, "[%s] - content part started\n", __func__);
-                if (!redirectUrl.empty())
-                {
-                    fprintf(stderr, "[%s] - redirecting to: %s\n", __func__, redirectUrl.c_str());
-                    ret = getVariantsFromMasterUrl(redirectUrl, headers, ++redirect);
-                    break;
-                }
-            }
         }
-        else
+        if ((statusCode == 301 || statusCode == 302) && strncasecmp(lineBuffer, "location: ", 10) == 0)
         {
-            contentLines++;
-            contentSize += result + 1; // newline char
-            if (!m3u8HeaderParsed)
-            {
-                if (contentLines > M3U8_HEADER_MAX_LINE)
-                {
-                    fprintf(stderr, "[%s] - invalid M3U8 playlist, '%s' header is not in first %d lines\n",
-                            __func__, M3U8_HEADER, M3U8_HEADER_MAX_LINE);
-                    break;
-                }
-
-                // find M3U8 header
-                if (result && !strncmp(lineBuffer, M3U8_HEADER, strlen(M3U8_HEADER)))
-                {
-                    m3u8HeaderParsed = true;
-                }
-                continue;
-            }
-
-            if (!strncmp(lineBuffer, M3U8_MEDIA_SEQUENCE, strlen(M3U8_MEDIA_SEQUENCE)))
+            redirectUrl = &lineBuffer[10];
+        }
+        if (!strncmp(lineBuffer, "Set-Cookie: ", 12))
+        {
+            if (headers.find("Cookie") == headers.end())
+                headers["Cookie"] = &lineBuffer[12];
+            else
+                headers["Cookie"].append(";").append(&lineBuffer[12]);
+        }
+        if (!result)
+        {
+            contentStarted = true;
+            fprintf(stderr, "[%s] - content part started\n", __func__);
+            // reader stops at the end of the body, connection can be reused then
+            if (statusCode == 304)
+                reader->setBodyLength(0);
+            else if (chunked)
+                reader->setChunked();
+            else if (contentLength >= 0)
+                reader->setBodyLength(contentLength);
+            else
+                keepAlive = false;
+            if (statusCode == 304)
             {
-                fprintf(stderr, "[%s] - we need master playlist not media sequence!\n", __func__);
+                fprintf(stderr, "[%s] - playlist not modified\n", __func__);
+                notModified = true;
+                ret = 0;
                 break;
             }
-
-            if (m3u8StreamInfoParsing)
+            if (!redirectUrl.empty())
             {
-                // there shouldn't be any empty line
-                if (!result)
+                if (keepAlive)
                 {
-                    m3u8StreamInfoParsing = false;
-                    continue;
+                    char discard[1024];
+                    while (reader->read(discard, sizeof(discard)) > 0);
                 }
-
-                fprintf(stderr, "[%s] - continue parsing m3u8 stream info\n", __func__);
-                if (!strncmp(lineBuffer, "http", 4))
-                {
-                    m3u8StreamInfo.url = lineBuffer;
-                }
-                else
-                {
-                    if (strlen(lineBuffer) > 0 && lineBuffer[0] == '/')
-                        m3u8StreamInfo.url = purl.proto().append("://").append(purl.host()).append(lineBuffer);
-                    else
-                        m3u8StreamInfo.url = url.substr(0, url.rfind('/') + 1) + lineBuffer;
-                }
-                m3u8StreamInfo.headers = headers;
-                streams.push_back(m3u8StreamInfo);
-                m3u8StreamInfoParsing = false;
+                // redirect may go to the same server
+                pool->release(conn, keepAlive && reader->bodyComplete());
+                fprintf(stderr, "[%s] - redirecting to: %s\n", __func__, redirectUrl.c_str());
+                ret = getVariantsFromMasterUrl(redirectUrl, headers, ++redirect);
+                break;
             }
-            else
+            if (!reader->setContentEncoding(contentEncoding.c_str()))
             {
-                if (!strncmp(lineBuffer, M3U8_STREAM_INFO, 17))
-                {
-                    m3u8StreamInfoParsing = true;
-                    std::string parsed(lineBuffer);
-                    parseStreamInfoAttributes(parsed.substr(18).c_str(), m3u8StreamInfo);
-                }
-                else
-                {
-                    fprintf(stderr, "[%s] - skipping unrecognised data\n", __func__);
-                }
+                keepAlive = false;
+                break;
             }
-
-            if (contentLength && contentLength <= contentSize)
+            // body is parsed as a stream, regardless of its transfer and content coding
+            char buffer[4096];
+            ssize_t len;
+            while ((len = reader->read(buffer, sizeof(buffer))) > 0)
             {
-                fprintf(stderr, "[%s] - end of read, Content-Length reached\n", __func__);
-                break;
+                if (parser.feed(buffer, len) < 0)
+                    break;
             }
+            bodyBytes = reader->bodyReceived();
+            break;
         }
     }
-    if (!streams.empty())
-        ret = 0;
-    free(lineBuffer);
-    ::close(sd);
-    if (ssl)
+    if (contentStarted && statusCode == 200 && bodyBytes)
+        BandwidthEstimator::getInstance()->addSample(purl.host(), bodyBytes, getMonotonicMs() - requestTime);
+    if (contentStarted && statusCode == 200 && parser.finish() == 0)
     {
-        SSL_free(ssl);
-        SSL_CTX_free(ssl_ctx);
+        playlist = parser.getPlaylist();
+        for (size_t i = 0; i < playlist.variants.size(); i++)
+            playlist.variants[i].headers = headers;
+        for (size_t i = 0; i < playlist.iframeStreams.size(); i++)
+            playlist.iframeStreams[i].headers = headers;
     }
+    if (!playlist.variants.empty())
+        ret = 0;
+    pool->release(conn, keepAlive && reader->bodyComplete());
+    delete reader;
     return ret;
 }
 
 std::vector<M3U8StreamInfo> M3U8VariantsExplorer::getStreams()
 {
-    streams.clear();
+    return getPlaylist().variants;
+}
+
+M3U8MasterPlaylist M3U8VariantsExplorer::getPlaylist()
+{
+    playlist = M3U8MasterPlaylist();
+    etag.clear();
+    lastModified.clear();
+    notModified = false;
+
+    PlaylistCache *cache = PlaylistCache::getInstance();
+    std::string cacheKey = PlaylistCache::key(url, headers);
+    PlaylistCacheEntry cached;
+    int cacheState = cache->lookup(cacheKey, cached);
+    if (cacheState == PlaylistCache::fresh)
+    {
+        fprintf(stderr, "[%s] - using cached playlist of %s\n", __func__, url.c_str());
+        playlist = cached.playlist;
+        return playlist;
+    }
+    ifNoneMatch.clear();
+    ifModifiedSince.clear();
+    if (cacheState == PlaylistCache::stale)
+    {
+        ifNoneMatch = cached.etag;
+        ifModifiedSince = cached.lastModified;
+    }
+
     std::vector<std::string> masterUrl;
     masterUrl.push_back(url);
     // try also some common master playlist filenames
@@ -365,11 +682,25 @@ std::vector<M3U8StreamInfo> M3U8VariantsExplorer::getStreams()
     // masterUrl.push_back(url.substr(0, url.rfind('/') + 1) + "playlist.m3u8");
     for (std::vector<std::string>::const_iterator it(masterUrl.begin()); it != masterUrl.end(); it++)
     {
+        if (cancelled && *cancelled)
+            break;
         int ret = getVariantsFromMasterUrl(*it, headers, 0);
         if (ret < 0)
             continue;
         break;
     }
-    return streams;
+    if (notModified)
+    {
+        playlist = cached.playlist;
+        cache->revalidated(cacheKey);
+    }
+    else if (!playlist.variants.empty())
+    {
+        cached.playlist = playlist;
+        cached.etag = etag;
+        cached.lastModified = lastModified;
+        cache->store(cacheKey, cached);
+    }
+    return playlist;
 }
 
@@ -1,5 +1,6 @@
 #ifndef __m3u8variant__h
 #define __m3u8variant__h
+#include <atomic>
 #include <map>
 #include <vector>
 #include <string>
@@ -8,14 +9,30 @@
 #include "wrappers.h"
 #include "common.h"
 
+// variant of the master playlist, EXT-X-STREAM-INF or EXT-X-I-FRAME-STREAM-INF
 struct M3U8StreamInfo
 {
     std::string url;
     HeaderMap headers;
     std::string codecs;
     std::string resolution;
-    // TODO audio/video/subtitles..
+    // BANDWIDTH, peak bitrate of the variant
     unsigned long int bitrate;
+    unsigned long int averageBitrate;
+    double frameRate;
+    std::string hdcpLevel;
+    // groups of EXT-X-MEDIA renditions
+    std::string audioGroup;
+    std::string videoGroup;
+    std::string subtitlesGroup;
+    std::string closedCaptionsGroup;
+
+    M3U8StreamInfo():
+        bitrate(0),
+        averageBitrate(0),
+        frameRate(0){}
+    // without CODECS it's not known, so it's expected
+    bool hasVideo() const;
 
     bool operator<(const M3U8StreamInfo& m) const
     {
@@ -23,20 +40,120 @@ struct M3U8StreamInfo
     }
 };
 
+// EXT-X-MEDIA
+struct M3U8Rendition
+{
+    enum
+    {
+        audio,
+        video,
+        subtitles,
+        closedCaptions,
+    };
+    int type;
+    std::string groupId;
+    std::string name;
+    std::string language;
+    // empty when rendition is in the variant stream
+    std::string url;
+    std::string instreamId;
+    std::string channels;
+    bool isDefault;
+    bool autoselect;
+    bool forced;
+
+    M3U8Rendition():
+        type(audio),
+        isDefault(false),
+        autoselect(false),
+        forced(false){}
+};
+
+struct M3U8MasterPlaylist
+{
+    int version;
+    bool independentSegments;
+    std::vector<M3U8StreamInfo> variants;
+    std::vector<M3U8StreamInfo> iframeStreams;
+    std::vector<M3U8Rendition> renditions;
+
+    M3U8MasterPlaylist():
+        version(1),
+        independentSegments(false){}
+    // audio rendition of the variant, DEFAULT one unless there is
+    // one in preferred language, NULL when variant has no audio group
+    const M3U8Rendition *selectAudio(const M3U8StreamInfo &variant, const std::string &language = "") const;
+};
+
+// Single pass parser of the master playlist, lines are parsed as they come.
+// Relative uris are resolved against the url of the playlist.
+class M3U8Parser
+{
+    std::string baseUrl;
+    M3U8MasterPlaylist playlist;
+    M3U8StreamInfo pending;
+    int state;
+    unsigned int lines;
+    // line of the stream which is not complete yet
+    std::string partial;
+
+    void parseStreamInfo(const char *attributes, size_t len, M3U8StreamInfo &info, bool iframe);
+    void parseMedia(const char *attributes, size_t len);
+public:
+    enum
+    {
+        header,
+        tags,
+        uri,
+        error,
+    };
+    M3U8Parser(const std::string &baseUrl):
+        baseUrl(baseUrl),
+        state(header),
+        lines(0){}
+    // line without line terminator, returns -1 when the content is not
+    // a master playlist and parsing should stop
+    int parseLine(const char *line, size_t len);
+    // next part of the stream, split at any position, returns -1 when
+    // parsing should stop
+    int feed(const char *data, size_t len);
+    // returns -1 when no variant was found
+    int finish();
+    const M3U8MasterPlaylist &getPlaylist() const { return playlist; }
+};
+
+// the best variant which fits to the bitrate, with video when possible
+const M3U8StreamInfo *selectVariant(const std::vector<M3U8StreamInfo> &variants, unsigned long int bitrate);
+// reference from the playlist to absolute url
+std::string resolveUrl(const std::string &base, const std::string &reference);
+
 class M3U8VariantsExplorer
 {
     std::string url;
     HeaderMap headers;
-    std::vector<M3U8StreamInfo> streams;
+    M3U8MasterPlaylist playlist;
     const unsigned int redirectLimit;
-    int parseStreamInfoAttributes(const char *line, M3U8StreamInfo& info);
+    const std::atomic<bool> *cancelled;
+    // validators sent with the request and received with the playlist
+    std::string ifNoneMatch;
+    std::string ifModifiedSince;
+    std::string etag;
+    std::string lastModified;
+    bool notModified;
     int getVariantsFromMasterUrl(const std::string& url, HeaderMap& headers, unsigned int redirect);
 public:
     M3U8VariantsExplorer(const std::string& url, const HeaderMap& headers):
         url(url),
         headers(headers),
-        redirectLimit(5){};
+        redirectLimit(5),
+        cancelled(NULL),
+        notModified(false){};
+    // exploration running in other thread gives up at next request once set
+    void setCancelFlag(const std::atomic<bool> *flag){ cancelled = flag; }
+    // variants of the master playlist
     std::vector<M3U8StreamInfo> getStreams();
+    // whole master playlist, variants and renditions
+    M3U8MasterPlaylist getPlaylist();
 
 };
 
@@ -9,58 +9,20 @@
 #include <fcntl.h>
 #include "myconsole.h"
 
-int bidirpipe(int pfd[], const char *cmd , const char * const argv[], const char *cwd )
-{
-    int pfdin[2];  /* from child to parent */
-    int pfdout[2]; /* from parent to child */
-    int pfderr[2]; /* stderr from child to parent */
-    int pid;       /* child's pid */
-
-    if ( pipe(pfdin) == -1 || pipe(pfdout) == -1 || pipe(pfderr) == -1)
-        return(-1);
-
-    if ( ( pid = vfork() ) == -1 )
-        return(-1);
-    else if (pid == 0) /* child process */
-    {
-        setsid();
-        if ( close(0) == -1 || close(1) == -1 || close(2) == -1 )
-            _exit(0);
-
-        if (dup(pfdout[0]) != 0 || dup(pfdin[1]) != 1 || dup(pfderr[1]) != 2 )
-            _exit(0);
-
-        if (close(pfdout[0]) == -1 || close(pfdout[1]) == -1 ||
-                close(pfdin[0]) == -1 || close(pfdin[1]) == -1 ||
-                close(pfderr[0]) == -1 || close(pfderr[1]) == -1 )
-            _exit(0);
-
-        for (unsigned int i=3; i < 90; ++i )
-            close(i);
-
-        if (cwd)
-            chdir(cwd);
-
-        execvp(cmd, (char * const *)argv); 
-                /* the vfork will actually suspend the parent thread until execvp is called. thus it's ok to use the shared arg/cmdline pointers here. */
-        _exit(0);
-    }
-    if (close(pfdout[0]) == -1 || close(pfdin[1]) == -1 || close(pfderr[1]) == -1)
-            return(-1);
-
-    pfd[0] = pfdin[0];
-    pfd[1] = pfdout[1];
-    pfd[2] = pfderr[0];
-
-    return(pid);
-}
+// read buffer grows from min to max, when output comes in bursts
+#define READ_BUFFER_MIN 4096
+#define READ_BUFFER_MAX (64 * 1024)
+#define READ_LIMIT (1024 * 1024)
+// partially written out buffer is compacted when that much of it is sent
+#define OUTBUF_COMPACT (64 * 1024)
 
 DEFINE_REF(eConsoleContainer);
 
 eConsoleContainer::eConsoleContainer():
     pid(-1),
     killstate(0),
-    buffer(2049)
+    outbufSent(0),
+    buffer(READ_BUFFER_MIN + 1)
 {
     for (int i=0; i < 3; ++i)
     {
@@ -111,6 +73,46 @@ int eConsoleContainer::execute(eMainloop *context, const char *cmdline, const ch
 
 //  eDebug("pipe in = %d, out = %d, err = %d", fd[0], fd[1], fd[2]);
 
+    createNotifiers(context);
+    return 0;
+}
+
+int eConsoleContainer::execute(eMainloop *context, const std::vector<std::string> &args)
+{
+    if (args.empty())
+        return -1;
+    std::vector<const char*> cargs;
+    eDebugNoNewLine("eConsoleContainer::execute: ");
+    for (size_t i = 0; i < args.size(); i++)
+    {
+        cargs.push_back(args[i].c_str());
+        if (i != 0 && args[i][0] != '-')
+            eDebugNoNewLine("\"%s\" ", cargs[i]);
+        else
+            eDebugNoNewLine("%s ", cargs[i]);
+    }
+    eDebugNoNewLine("\n");
+    // execvp needs args array terminated with NULL
+    cargs.push_back(NULL);
+    return execute(context, cargs[0], &cargs[0]);
+}
+
+int eConsoleContainer::attach(eMainloop *context, int pid, const int fd[])
+{
+    if (running())
+        return -1;
+
+    this->pid = pid;
+    killstate = 0;
+    for (int i=0; i < 3; ++i)
+        this->fd[i] = fd[i];
+
+    createNotifiers(context);
+    return 0;
+}
+
+void eConsoleContainer::createNotifiers(eMainloop *context)
+{
     ::fcntl(fd[0], F_SETFL, O_NONBLOCK);
     ::fcntl(fd[1], F_SETFL, O_NONBLOCK);
     ::fcntl(fd[2], F_SETFL, O_NONBLOCK);
@@ -123,8 +125,6 @@ int eConsoleContainer::execute(eMainloop *context, const char *cmdline, const ch
     in->m_clients.push_back(this);
     out->m_clients.push_back(this);
     err->m_clients.push_back(this);
-
-    return 0;
 }
 
 eConsoleContainer::~eConsoleContainer()
@@ -145,12 +145,9 @@ void eConsoleContainer::kill()
         ::kill(-pid, SIGKILL);
         closePipes();
     }
-    while( !outbuf.empty() ) // cleanup out buffer
-    {
-        queue_data d = outbuf.front();
-        outbuf.pop();
-        delete [] d.data;
-    }
+    // cleanup out buffer
+    outbuf.clear();
+    outbufSent = 0;
     in = 0;
     out = 0;
     err = 0;
@@ -209,38 +206,58 @@ void eConsoleContainer::closePipes()
         ::close(fd[2]);
         fd[2]=-1;
     }
-    while( outbuf.size() ) // cleanup out buffer
-    {
-        queue_data d = outbuf.front();
-        outbuf.pop();
-        delete [] d.data;
-    }
+    // cleanup out buffer
+    outbuf.clear();
+    outbufSent = 0;
     in = 0; out = 0; err = 0;
     pid = -1;
 }
 
+// reads what is available in the pipe of child's stdout (num = 1) or stderr (num = 2),
+// returns number of bytes read
+size_t eConsoleContainer::readOutput(int num)
+{
+    size_t total = 0;
+    int rfd = num == 1 ? fd[0] : fd[2];
+    while (rfd != -1)
+    {
+        char* buf = &buffer[0];
+        ssize_t rd = ::read(rfd, buf, buffer.size() - 1);
+        if (rd <= 0)
+            break;
+        buf[rd]=0;
+        /*emit*/ dataAvail(buf, rd);
+        if (num == 1)
+            stdoutAvail(buf, rd);
+        else
+            stderrAvail(buf, rd);
+        if (num == 1 && filefd[1] >= 0)
+            ::write(filefd[1], buf, rd);
+        total += rd;
+        // listeners may have closed us
+        rfd = num == 1 ? fd[0] : fd[2];
+        // burst of output, read more at once next time
+        if ((size_t)rd == buffer.size() - 1 && buffer.size() < READ_BUFFER_MAX + 1)
+            buffer.resize((buffer.size() - 1) * 2 + 1);
+        // rest on next event, don't starve other sources of the mainloop
+        if (total >= READ_LIMIT)
+            break;
+    }
+    return total;
+}
+
 void eConsoleContainer::readyRead(int what)
 {
     bool hungup = what & eSocketNotifier::Hungup;
     if (what & (eSocketNotifier::Priority|eSocketNotifier::Read))
     {
-//      eDebug("what = %d");
-        char* buf = &buffer[0];
-        int rd;
-        while((rd = read(fd[0], buf, 2048)) > 0)
-        {
-            buf[rd]=0;
-            /*emit*/ dataAvail(buf);
-            stdoutAvail(buf);
-            if ( filefd[1] >= 0 )
-                ::write(filefd[1], buf, rd);
-            if (!hungup)
-                break;
-        }
+        readOutput(1);
     }
     readyErrRead(eSocketNotifier::Priority|eSocketNotifier::Read); /* be sure to flush all data which might be already written */
     if (hungup)
     {
+        // nothing comes anymore, read everything what's left
+        while (readOutput(1) >= READ_LIMIT);
         int childstatus;
         int retval = killstate;
         /*
@@ -263,53 +280,48 @@ void eConsoleContainer::readyErrRead(int what)
 {
     if (what & (eSocketNotifier::Priority|eSocketNotifier::Read))
     {
-//      eDebug("what = %d");
-        char* buf = &buffer[0];
-        int rd;
-        while((rd = read(fd[2], buf, 2048)) > 0)
-        {
-/*          for ( int i = 0; i < rd; i++ )
-                eDebug("%d = %c (%02x)", i, buf[i], buf[i] );*/
-            buf[rd]=0;
-            /*emit*/ dataAvail(buf);
-            stderrAvail(buf);
-        }
+        readOutput(2);
     }
 }
 
 void eConsoleContainer::write( const char *data, int len )
 {
-    char *tmp = new char[len];
-    memcpy(tmp, data, len);
-    outbuf.push(queue_data(tmp,len));
+    // appended to what's pending, capacity is kept so there is no allocation
+    // per command, everything is sent at once on next write event
+    outbuf.insert(outbuf.end(), data, data + len);
     if (out)
         out->start();
 }
 
 void eConsoleContainer::readyWrite(int what)
 {
-    if (what&eSocketNotifier::Write && outbuf.size() )
+    if (what&eSocketNotifier::Write && outbufSent < outbuf.size())
     {
-        queue_data &d = outbuf.front();
-        int wr = ::write( fd[1], d.data+d.dataSent, d.len-d.dataSent );
+        int wr = ::write( fd[1], &outbuf[outbufSent], outbuf.size() - outbufSent );
         if (wr < 0)
             eDebug("eConsoleContainer write failed (%m)");
         else
-            d.dataSent += wr;
-        if (d.dataSent == d.len)
+            outbufSent += wr;
+        if (outbufSent == outbuf.size())
         {
-            outbuf.pop();
-            delete [] d.data;
+            outbuf.clear();
+            outbufSent = 0;
             if ( filefd[0] == -1 )
             /* emit */ dataSent(0);
         }
+        else if (outbufSent >= OUTBUF_COMPACT)
+        {
+            // app doesn't keep up, don't let sent data pile up in front
+            outbuf.erase(outbuf.begin(), outbuf.begin() + outbufSent);
+            outbufSent = 0;
+        }
     }
-    if ( !outbuf.size() )
+    if ( outbuf.empty() )
     {
         if ( filefd[0] >= 0 )
         {
             char* buf = &buffer[0];
-            int rsize = read(filefd[0], buf, 2048);
+            int rsize = read(filefd[0], buf, buffer.size() - 1);
             if ( rsize > 0 )
                 write(buf, rsize);
             else
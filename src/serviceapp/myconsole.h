@@ -4,19 +4,8 @@
 #include <string>
 #include <lib/base/ebase.h>
 #include <lib/python/connections.h>
-#include <queue>
 #include <vector>
-
-struct queue_data
-{
-    queue_data( char *data, int len )
-        :data(data), len(len), dataSent(0)
-    {
-    }
-    char *data;
-    int len;
-    int dataSent;
-};
+#include "spawn.h"
 
 #if SIGCXX_MAJOR_VERSION == 2
 class eConsoleContainer: public sigc::trackable, public iObject
@@ -30,19 +19,26 @@ class eConsoleContainer: public Object, public iObject
     int pid;
     int killstate;
     std::string m_cwd;
-    std::queue<struct queue_data> outbuf;
+    // commands not yet written to stdin of the app, outbuf[0..outbufSent) is already sent
+    std::vector<char> outbuf;
+    size_t outbufSent;
     ePtr<eSocketNotifier> in, out, err;
     std::vector<char> buffer;
+    size_t readOutput(int num);
     void readyRead(int what);
     void readyErrRead(int what);
     void readyWrite(int what);
     void closePipes();
+    void createNotifiers(eMainloop *context);
 public:
     eConsoleContainer();
     ~eConsoleContainer();
     int setCWD( const char *path );
     int execute( eMainloop * context, const char *str );
     int execute( eMainloop * context, const char *cmdline, const char *const argv[] );
+    int execute( eMainloop * context, const std::vector<std::string> &args );
+    // take over already running process, fd as returned by bidirpipe
+    int attach( eMainloop * context, int pid, const int fd[] );
     int getPID() { return pid; }
     void kill();
     void sendCtrlC();
@@ -50,9 +46,10 @@ public:
     void write( const char *data, int len );
     void setFileFD(int num, int fd) { if (num >= 0 && num <= 2) filefd[num] = fd; }
     bool running() { return (fd[0]!=-1) && (fd[1]!=-1) && (fd[2]!=-1); }
-    PSignal1<void, const char*> dataAvail;
-    PSignal1<void, const char*> stdoutAvail;
-    PSignal1<void, const char*> stderrAvail;
+    // data are followed by '\0', but may contain it as well
+    PSignal2<void, const char*, int> dataAvail;
+    PSignal2<void, const char*, int> stdoutAvail;
+    PSignal2<void, const char*, int> stderrAvail;
     PSignal1<void,int> dataSent;
     PSignal1<void,int> appClosed;
 };
@@ -0,0 +1,482 @@
+#include <stdlib.h>
+#include <string.h>
+
+#include "playerevent.h"
+
+struct playerEventKey
+{
+	const char *name;
+	int type;
+};
+
+static const playerEventKey eventKeys[] =
+{
+	{"PLAYBACK_PLAY",        PlayerEvent::playbackPlay},
+	{"PLAYBACK_STOP",        PlayerEvent::playbackStop},
+	{"PLAYBACK_PAUSE",       PlayerEvent::playbackPause},
+	{"PLAYBACK_CONTINUE",    PlayerEvent::playbackContinue},
+	{"PLAYBACK_FASTFORWARD", PlayerEvent::playbackFastForward},
+	{"PLAYBACK_SEEK_ABS",    PlayerEvent::playbackSeekAbs},
+	{"PLAYBACK_SEEK",        PlayerEvent::playbackSeek},
+	{"PLAYBACK_LENGTH",      PlayerEvent::playbackLength},
+	{"PLAYBACK_INFO",        PlayerEvent::playbackInfo},
+	{"PLAYBACK_SUBTITLE",    PlayerEvent::playbackSubtitle},
+	{"PLAYBACK_STANDBY",     PlayerEvent::playbackStandby},
+	{"J",                    PlayerEvent::position},
+	{"v_c",                  PlayerEvent::videoCurrent},
+	{"a_s",                  PlayerEvent::audioSelected},
+	{"a_c",                  PlayerEvent::audioCurrent},
+	{"a_l",                  PlayerEvent::audioList},
+	{"s_s",                  PlayerEvent::subtitleSelected},
+	{"s_c",                  PlayerEvent::subtitleCurrent},
+	{"s_l",                  PlayerEvent::subtitleList},
+	{"s_a",                  PlayerEvent::subtitleAdd},
+	{"GST_ERROR",            PlayerEvent::gstError},
+	{"GST_MISSING_PLUGIN",   PlayerEvent::gstMissingPlugin},
+};
+
+#define EVENT_KEYS_NUM (sizeof(eventKeys) / sizeof(eventKeys[0]))
+#define EVENT_HASH_SIZE 64
+
+static inline unsigned int hashKey(const char *key, size_t len)
+{
+	return (len * 7 + (unsigned char)key[0] * 3 + (unsigned char)key[len - 1] * 5 + (unsigned char)key[len / 2]) & (EVENT_HASH_SIZE - 1);
+}
+
+// open addressing table of indexes to eventKeys (+1, 0 is empty slot)
+static unsigned char eventHash[EVENT_HASH_SIZE];
+
+static bool initEventHash()
+{
+	for (size_t i = 0; i < EVENT_KEYS_NUM; i++)
+	{
+		unsigned int h = hashKey(eventKeys[i].name, strlen(eventKeys[i].name));
+		while (eventHash[h])
+			h = (h + 1) & (EVENT_HASH_SIZE - 1);
+		eventHash[h] = i + 1;
+	}
+	return true;
+}
+
+static const bool eventHashInitialized = initEventHash();
+
+static int lookupEventType(const char *key, size_t len)
+{
+	if (!len)
+		return PlayerEvent::unknown;
+	unsigned int h = hashKey(key, len);
+	while (eventHash[h])
+	{
+		const playerEventKey &k = eventKeys[eventHash[h] - 1];
+		if (!strncmp(k.name, key, len) && k.name[len] == '\0')
+			return k.type;
+		h = (h + 1) & (EVENT_HASH_SIZE - 1);
+	}
+	return PlayerEvent::unknown;
+}
+
+static int lookupField(const char *key, size_t len)
+{
+	switch (len)
+	{
+		case 1:
+			switch (key[0])
+			{
+				case 's': return PlayerEvent::fS;
+				case 'e': return PlayerEvent::fE;
+				case 't': return PlayerEvent::fT;
+				case 'n': return PlayerEvent::fN;
+				case 'w': return PlayerEvent::fW;
+				case 'h': return PlayerEvent::fH;
+				case 'f': return PlayerEvent::fF;
+				case 'p': return PlayerEvent::fP;
+			}
+			break;
+		case 2:
+			if (key[0] == 'i' && key[1] == 'd') return PlayerEvent::fId;
+			if (key[0] == 'm' && key[1] == 's') return PlayerEvent::fMs;
+			break;
+		case 3:
+			if (!memcmp(key, "sts", 3)) return PlayerEvent::fSts;
+			if (!memcmp(key, "msg", 3)) return PlayerEvent::fMsg;
+			break;
+		case 4:
+			if (!memcmp(key, "text", 4)) return PlayerEvent::fText;
+			if (!memcmp(key, "code", 4)) return PlayerEvent::fCode;
+			break;
+		case 5:
+			if (!memcmp(key, "start", 5)) return PlayerEvent::fStart;
+			break;
+		case 6:
+			if (!memcmp(key, "length", 6)) return PlayerEvent::fLength;
+			break;
+		case 8:
+			if (!memcmp(key, "duration", 8)) return PlayerEvent::fDuration;
+			break;
+	}
+	return -1;
+}
+
+static inline const char *skipWhitespace(const char *p, const char *end)
+{
+	while (p < end && (*p == ' ' || *p == '\t' || *p == '\r' || *p == '\n'))
+		p++;
+	return p;
+}
+
+// p points after opening quote, returns pointer to closing quote
+static const char *scanString(const char *p, const char *end)
+{
+	while (p < end)
+	{
+		if (*p == '"')
+			return p;
+		if (*p == '\\')
+			p++;
+		p++;
+	}
+	return NULL;
+}
+
+// skips object, array or scalar value
+static const char *skipValue(const char *p, const char *end)
+{
+	int depth = 0;
+	while (p < end)
+	{
+		switch (*p)
+		{
+			case '"':
+				p = scanString(p + 1, end);
+				if (!p)
+					return NULL;
+				break;
+			case '{':
+			case '[':
+				depth++;
+				break;
+			case '}':
+			case ']':
+				if (!depth)
+					return p;
+				if (!--depth)
+					return p + 1;
+				break;
+			case ',':
+				if (!depth)
+					return p;
+				break;
+		}
+		p++;
+	}
+	return depth ? NULL : p;
+}
+
+static const char *parseNumber(const char *p, const char *end, double &number)
+{
+	const char *start = p;
+	bool negative = false;
+	if (p < end && *p == '-')
+	{
+		negative = true;
+		p++;
+	}
+	long long value = 0;
+	while (p < end && *p >= '0' && *p <= '9')
+		value = value * 10 + (*p++ - '0');
+	if (p < end && (*p == '.' || *p == 'e' || *p == 'E'))
+	{
+		// not an integer, leave it to strtod, the line need not be
+		// terminated, so it gets a terminated copy of the number
+		char buf[64];
+		size_t len = 0;
+		for (const char *q = start; q < end && len < sizeof(buf) - 1 && *q && strchr("+-.0123456789eE", *q); q++)
+			buf[len++] = *q;
+		buf[len] = '\0';
+		char *numend;
+		number = strtod(buf, &numend);
+		if (numend == buf)
+			return NULL;
+		return start + (numend - buf);
+	}
+	if (p == start || (negative && p == start + 1))
+		return NULL;
+	number = negative ? -value : value;
+	return p;
+}
+
+// parses members of object, p points after '{', returns pointer after '}'
+static const char *parseObject(const char *p, const char *end, PlayerEvent::Field *fields)
+{
+	while (1)
+	{
+		p = skipWhitespace(p, end);
+		if (p >= end)
+			return NULL;
+		if (*p == '}')
+			return p + 1;
+		if (*p == ',')
+		{
+			p++;
+			continue;
+		}
+		if (*p != '"')
+			return NULL;
+		const char *key = p + 1;
+		const char *keyend = scanString(key, end);
+		if (!keyend)
+			return NULL;
+		p = skipWhitespace(keyend + 1, end);
+		if (p >= end || *p != ':')
+			return NULL;
+		p = skipWhitespace(p + 1, end);
+		if (p >= end)
+			return NULL;
+
+		int f = lookupField(key, keyend - key);
+		PlayerEvent::Field dummy;
+		PlayerEvent::Field &field = f < 0 ? dummy : fields[f];
+		if (*p == '"')
+		{
+			const char *valend = scanString(p + 1, end);
+			if (!valend)
+				return NULL;
+			field.data = p + 1;
+			field.len = valend - p - 1;
+			field.isString = true;
+			field.set = true;
+			p = valend + 1;
+		}
+		else if (*p == '-' || (*p >= '0' && *p <= '9'))
+		{
+			p = parseNumber(p, end, field.number);
+			if (!p)
+				return NULL;
+			field.isString = false;
+			field.set = true;
+		}
+		else if (*p == 't' || *p == 'f')
+		{
+			field.number = *p == 't';
+			field.isString = false;
+			field.set = true;
+			p = skipValue(p, end);
+		}
+		else
+		{
+			// null, nested objects and arrays are not used by any message we handle
+			p = skipValue(p, end);
+		}
+		if (!p)
+			return NULL;
+	}
+}
+
+void PlayerEvent::clear()
+{
+	type = unknown;
+	key = NULL;
+	keyLen = 0;
+	items = NULL;
+	itemsLen = 0;
+	for (int i = 0; i < fCount; i++)
+	{
+		fields[i].set = false;
+		fields[i].isString = false;
+		fields[i].data = NULL;
+		fields[i].len = 0;
+		fields[i].number = 0;
+	}
+}
+
+int decodePlayerEvent(const char *data, size_t len, PlayerEvent &event)
+{
+	const char *p = data;
+	const char *end = data + len;
+
+	event.clear();
+	p = skipWhitespace(p, end);
+	if (p >= end || *p != '{')
+		return -1;
+	p = skipWhitespace(p + 1, end);
+	if (p >= end || *p != '"')
+		return -1;
+	event.key = p + 1;
+	p = scanString(event.key, end);
+	if (!p)
+		return -1;
+	event.keyLen = p - event.key;
+	event.type = lookupEventType(event.key, event.keyLen);
+	p = skipWhitespace(p + 1, end);
+	if (p >= end || *p != ':')
+		return -1;
+	p = skipWhitespace(p + 1, end);
+	if (p >= end)
+		return -1;
+	if (*p == '{')
+	{
+		if (!parseObject(p + 1, end, event.fields))
+			return -1;
+	}
+	else if (*p == '[')
+	{
+		const char *itemsend = skipValue(p, end);
+		if (!itemsend)
+			return -1;
+		event.items = p + 1;
+		event.itemsLen = itemsend - p - 2;
+	}
+	return 0;
+}
+
+PlayerEventItems::PlayerEventItems(const PlayerEvent &event):
+	pos(event.items),
+	end(event.items + event.itemsLen)
+{
+}
+
+bool PlayerEventItems::next(PlayerEvent &item)
+{
+	if (!pos)
+		return false;
+	item.clear();
+	while (1)
+	{
+		pos = skipWhitespace(pos, end);
+		if (pos >= end)
+			return false;
+		if (*pos == ',')
+		{
+			pos++;
+			continue;
+		}
+		if (*pos != '{')
+		{
+			pos = skipValue(pos, end);
+			if (!pos)
+				return false;
+			continue;
+		}
+		pos = parseObject(pos + 1, end, item.fields);
+		return pos != NULL;
+	}
+}
+
+int PlayerEvent::Field::toInt(int def) const
+{
+	if (!set)
+		return def;
+	if (isString)
+		return atoi(toString().c_str());
+	return (int) number;
+}
+
+double PlayerEvent::Field::toDouble(double def) const
+{
+	if (!set)
+		return def;
+	if (isString)
+		return atof(toString().c_str());
+	return number;
+}
+
+static int hexValue(char c)
+{
+	if (c >= '0' && c <= '9') return c - '0';
+	if (c >= 'a' && c <= 'f') return c - 'a' + 10;
+	if (c >= 'A' && c <= 'F') return c - 'A' + 10;
+	return -1;
+}
+
+static unsigned int parseHex4(const char *p, const char *end)
+{
+	if (end - p < 4)
+		return 0;
+	unsigned int code = 0;
+	for (int i = 0; i < 4; i++)
+	{
+		int v = hexValue(p[i]);
+		if (v < 0)
+			return 0;
+		code = (code << 4) | v;
+	}
+	return code;
+}
+
+static void appendUTF8(std::string &out, unsigned int code)
+{
+	if (code < 0x80)
+		out += (char) code;
+	else if (code < 0x800)
+	{
+		out += (char) (0xC0 | (code >> 6));
+		out += (char) (0x80 | (code & 0x3F));
+	}
+	else if (code < 0x10000)
+	{
+		out += (char) (0xE0 | (code >> 12));
+		out += (char) (0x80 | ((code >> 6) & 0x3F));
+		out += (char) (0x80 | (code & 0x3F));
+	}
+	else
+	{
+		out += (char) (0xF0 | (code >> 18));
+		out += (char) (0x80 | ((code >> 12) & 0x3F));
+		out += (char) (0x80 | ((code >> 6) & 0x3F));
+		out += (char) (0x80 | (code & 0x3F));
+	}
+}
+
+std::string PlayerEvent::Field::toString() const
+{
+	if (!set || !isString)
+		return std::string();
+	const char *p = data;
+	const char *end = data + len;
+	const char *esc = (const char *) memchr(p, '\\', len);
+	if (!esc)
+		return std::string(data, len);
+
+	std::string out(p, esc);
+	p = esc;
+	while (p < end)
+	{
+		if (*p != '\\' || p + 1 >= end)
+		{
+			out += *p++;
+			continue;
+		}
+		p++;
+		switch (*p)
+		{
+			case 'b': out += '\b'; break;
+			case 'f': out += '\f'; break;
+			case 'n': out += '\n'; break;
+			case 'r': out += '\r'; break;
+			case 't': out += '\t'; break;
+			case 'u':
+			{
+				unsigned int code = parseHex4(p + 1, end);
+				p += 4;
+				// surrogate pair
+				if (code >= 0xD800 && code <= 0xDBFF && end - p > 6 && p[1] == '\\' && p[2] == 'u')
+				{
+					unsigned int low = parseHex4(p + 3, end);
+					if (low >= 0xDC00 && low <= 0xDFFF)
+					{
+						code = 0x10000 + (((code & 0x3FF) << 10) | (low & 0x3FF));
+						p += 6;
+					}
+				}
+				if (code)
+					appendUTF8(out, code);
+				break;
+			}
+			default:
+				out += *p;
+				break;
+		}
+		p++;
+	}
+	return out;
+}
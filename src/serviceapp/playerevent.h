@@ -0,0 +1,102 @@
+#ifndef __playerevent_h
+#define __playerevent_h
+
+#include <stddef.h>
+#include <string>
+
+// Decoder of json messages, which are reported by exteplayer3 and gstplayer,
+// i.e. {"J":{"ms":1000}} or {"a_l":[{"id":0,"e":"A_AAC","n":"eng"}]}
+//
+// Message is decoded in one pass directly from the output line, no tree
+// is built and strings are kept as slices of the line until they are needed.
+
+struct PlayerEvent
+{
+	enum
+	{
+		unknown,
+		playbackPlay,
+		playbackStop,
+		playbackPause,
+		playbackContinue,
+		playbackFastForward,
+		playbackSeekAbs,
+		playbackSeek,
+		playbackLength,
+		playbackInfo,
+		playbackSubtitle,
+		playbackStandby,
+		position,
+		videoCurrent,
+		audioSelected,
+		audioCurrent,
+		audioList,
+		subtitleSelected,
+		subtitleCurrent,
+		subtitleList,
+		subtitleAdd,
+		gstError,
+		gstMissingPlugin,
+	};
+	enum
+	{
+		fId,
+		fMs,
+		fSts,
+		fS,
+		fE,
+		fT,
+		fN,
+		fW,
+		fH,
+		fF,
+		fP,
+		fLength,
+		fStart,
+		fDuration,
+		fText,
+		fMsg,
+		fCode,
+		fCount,
+	};
+
+	struct Field
+	{
+		const char *data; // string without quotes, still escaped
+		size_t len;
+		double number;
+		bool set;
+		bool isString;
+		int toInt(int def=0) const;
+		double toDouble(double def=0) const;
+		std::string toString() const;
+	};
+
+	int type;
+	const char *key;
+	size_t keyLen;
+	Field fields[fCount];
+	// items of array value, i.e. a_l, s_l
+	const char *items;
+	size_t itemsLen;
+
+	const Field &operator[](int f) const {return fields[f];}
+	bool has(int f) const {return fields[f].set;}
+	void clear();
+};
+
+// returns 0 when line contains player message
+int decodePlayerEvent(const char *data, size_t len, PlayerEvent &event);
+
+// iterates over objects of array value of the event
+class PlayerEventItems
+{
+	const char *pos;
+	const char *end;
+public:
+	PlayerEventItems(const PlayerEvent &event);
+	// fills only fields of item, returns false when there are no more items
+	bool next(PlayerEvent &item);
+};
+
+#endif
@@ -0,0 +1,296 @@
+#include <ctype.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include <unistd.h>
+
+#include "playerhistory.h"
+
+// backend is avoided after this many failures in a row
+#define FAIL_LIMIT 2
+#define MAX_ENTRIES 256
+
+#define SNAPSHOT_HEADER "SERVICEAPP_PLAYERS 1"
+#define SNAPSHOT_MAX_AGE (30 * 24 * 3600)
+
+bool PlayerHistoryBackend::usable() const
+{
+    return starts && failStreak < FAIL_LIMIT;
+}
+
+PlayerHistory *PlayerHistory::getInstance()
+{
+    static PlayerHistory history;
+    return &history;
+}
+
+PlayerHistory::PlayerHistory():
+    SnapshotStore("PlayerHistory", SNAPSHOT_HEADER),
+    mLookups(0),
+    mHits(0)
+{
+}
+
+PlayerHistory::~PlayerHistory()
+{
+    saveLocked(true);
+}
+
+std::string PlayerHistory::getPattern(const std::string &url)
+{
+    Url purl(url);
+    if (purl.host().empty())
+        return "";
+    std::string path = purl.path();
+    std::string pattern = purl.host();
+    if (path.empty() || path[0] != '/')
+        pattern += '/';
+    size_t i = 0;
+    while (i < path.size())
+    {
+        size_t digits = 0;
+        while (i + digits < path.size() && isdigit((unsigned char)path[i + digits]))
+            digits++;
+        // single digits are mostly part of names, i.e. "m3u8" or "mp4"
+        if (digits > 1)
+        {
+            pattern += '#';
+            i += digits;
+        }
+        else
+            pattern += path[i++];
+    }
+    return pattern;
+}
+
+void PlayerHistory::update(const std::string &key, int backend, bool started, unsigned int startMs,
+        const HeaderMap &options, unsigned long int bitrate)
+{
+    PlayerHistoryEntry &entry = mEntries[key];
+    PlayerHistoryBackend &b = entry.backends[backend];
+    if (started)
+    {
+        b.startMs = b.starts ? (b.startMs * 3 + startMs) / 4 : startMs;
+        b.starts++;
+        b.failStreak = 0;
+        b.options = options;
+        if (bitrate)
+            b.bitrate = bitrate;
+    }
+    else
+    {
+        b.failures++;
+        b.failStreak++;
+    }
+    entry.updated = getMonotonicMs();
+}
+
+void PlayerHistory::addStart(const std::string &url, int backend, unsigned int startMs, const HeaderMap &options,
+        unsigned long int bitrate)
+{
+    std::string pattern = getPattern(url);
+    if (pattern.empty() || backend < 0 || backend >= PLAYER_HISTORY_BACKENDS)
+        return;
+    pthread_mutex_lock(&mMutex);
+    update(pattern, backend, true, startMs, options, bitrate);
+    update(Url(url).host(), backend, true, startMs, options, bitrate);
+    fprintf(stderr, "[PlayerHistory] %s: backend %d started in %ums\n", pattern.c_str(), backend, startMs);
+    trim();
+    setDirty(true);
+    saveLocked(false);
+    pthread_mutex_unlock(&mMutex);
+}
+
+void PlayerHistory::addFailure(const std::string &url, int backend)
+{
+    std::string pattern = getPattern(url);
+    if (pattern.empty() || backend < 0 || backend >= PLAYER_HISTORY_BACKENDS)
+        return;
+    pthread_mutex_lock(&mMutex);
+    update(pattern, backend, false, 0, HeaderMap(), 0);
+    update(Url(url).host(), backend, false, 0, HeaderMap(), 0);
+    fprintf(stderr, "[PlayerHistory] %s: backend %d failed %u times in a row\n", pattern.c_str(), backend,
+            mEntries[pattern].backends[backend].failStreak);
+    trim();
+    setDirty(true);
+    saveLocked(false);
+    pthread_mutex_unlock(&mMutex);
+}
+
+int PlayerHistory::getBackend(const std::string &url, int preferred, int &backend, HeaderMap &options,
+        unsigned long int &bitrate)
+{
+    backend = preferred;
+    if (preferred < 0 || preferred >= PLAYER_HISTORY_BACKENDS)
+        return -1;
+    PlayerHistoryEntry entry;
+    if (getEntry(url, entry) < 0)
+        return -1;
+    const PlayerHistoryBackend &pref = entry.backends[preferred];
+    int alternative = (preferred + 1) % PLAYER_HISTORY_BACKENDS;
+    const PlayerHistoryBackend &other = entry.backends[alternative];
+    if (pref.usable())
+    {
+        // other one has to be clearly faster
+        if (other.usable() && (uint64_t)other.startMs * 4 < (uint64_t)pref.startMs * 3)
+            backend = alternative;
+    }
+    else if (other.usable())
+        backend = alternative;
+    // failing backend gives way to the one which didn't fail yet
+    else if (pref.failStreak >= FAIL_LIMIT && !other.failStreak)
+        backend = alternative;
+    options = entry.backends[backend].options;
+    bitrate = entry.backends[backend].bitrate;
+    return 0;
+}
+
+int PlayerHistory::getEntry(const std::string &url, PlayerHistoryEntry &entry)
+{
+    std::string pattern = getPattern(url);
+    if (pattern.empty())
+        return -1;
+    int ret = -1;
+    pthread_mutex_lock(&mMutex);
+    mLookups++;
+    std::map<std::string, PlayerHistoryEntry>::const_iterator it = mEntries.find(pattern);
+    if (it == mEntries.end())
+        it = mEntries.find(Url(url).host());
+    if (it != mEntries.end())
+    {
+        entry = it->second;
+        mHits++;
+        ret = 0;
+    }
+    pthread_mutex_unlock(&mMutex);
+    return ret;
+}
+
+// snapshot is kept, see setSnapshot
+void PlayerHistory::clear()
+{
+    pthread_mutex_lock(&mMutex);
+    mEntries.clear();
+    setDirty(false);
+    pthread_mutex_unlock(&mMutex);
+}
+
+void PlayerHistory::getStats(unsigned int &lookups, unsigned int &hits)
+{
+    pthread_mutex_lock(&mMutex);
+    lookups = mLookups;
+    hits = mHits;
+    pthread_mutex_unlock(&mMutex);
+}
+
+// least recently updated entries are dropped
+void PlayerHistory::trim()
+{
+    while (mEntries.size() > MAX_ENTRIES)
+    {
+        std::map<std::string, PlayerHistoryEntry>::iterator oldest = mEntries.begin();
+        for (std::map<std::string, PlayerHistoryEntry>::iterator it(mEntries.begin()); it != mEntries.end(); it++)
+        {
+            if (it->second.updated < oldest->second.updated)
+                oldest = it;
+        }
+        mEntries.erase(oldest);
+    }
+}
+
+// options as "name=value&name=value", "-" when there are none
+static std::string formatOptions(const HeaderMap &options)
+{
+    std::string result;
+    for (HeaderMap::const_iterator it(options.begin()); it != options.end(); it++)
+    {
+        // such options wouldn't be parsed back
+        if (it->first.find_first_of(" \t\n=&") != std::string::npos ||
+                it->second.find_first_of(" \t\n&") != std::string::npos)
+            continue;
+        if (!result.empty())
+            result += '&';
+        result += it->first + "=" + it->second;
+    }
+    return result.empty() ? "-" : result;
+}
+
+static HeaderMap parseOptions(const std::string &str)
+{
+    HeaderMap options;
+    size_t start = 0;
+    while (str != "-" && start < str.size())
+    {
+        size_t end = str.find('&', start);
+        if (end == std::string::npos)
+            end = str.size();
+        size_t eq = str.find('=', start);
+        if (eq != std::string::npos && eq > start && eq < end)
+            options[str.substr(start, eq - start)] = str.substr(eq + 1, end - eq - 1);
+        start = end + 1;
+    }
+    return options;
+}
+
+void PlayerHistory::writeSnapshot(FILE *f)
+{
+    int64_t now = getMonotonicMs();
+    time_t wallNow = time(NULL);
+    for (std::map<std::string, PlayerHistoryEntry>::const_iterator it(mEntries.begin()); it != mEntries.end(); it++)
+    {
+        for (int i = 0; i < PLAYER_HISTORY_BACKENDS; i++)
+        {
+            const PlayerHistoryBackend &b = it->second.backends[i];
+            // urls don't contain whitespace
+            if (b.starts || b.failures)
+                fprintf(f, "%s %d %u %u %u %u %lu %lld %s\n", it->first.c_str(), i, b.starts, b.failures,
+                        b.failStreak, b.startMs, b.bitrate,
+                        (long long)(wallNow - (now - it->second.updated) / 1000), formatOptions(b.options).c_str());
+        }
+    }
+}
+
+bool PlayerHistory::readSnapshot(FILE *f, size_t &loaded)
+{
+    char line[4096];
+    bool valid = true;
+    int64_t now = getMonotonicMs();
+    time_t wallNow = time(NULL);
+    while (fgets(line, sizeof(line), f))
+    {
+        char key[1024], options[2048];
+        int backend;
+        unsigned int starts, failures, failStreak, startMs;
+        unsigned long int bitrate;
+        long long updated;
+        if (sscanf(line, "%1023s %d %u %u %u %u %lu %lld %2047s", key, &backend, &starts, &failures, &failStreak,
+                &startMs, &bitrate, &updated, options) != 9 || backend < 0 || backend >= PLAYER_HISTORY_BACKENDS)
+        {
+            valid = false;
+            break;
+        }
+        // updated in the future, clock was changed
+        if (updated > wallNow)
+            updated = wallNow;
+        if (wallNow - updated > SNAPSHOT_MAX_AGE)
+            continue;
+        PlayerHistoryEntry &entry = mEntries[key];
+        PlayerHistoryBackend &b = entry.backends[backend];
+        // recorded since the start wins
+        if (b.starts || b.failures)
+            continue;
+        b.starts = starts;
+        b.failures = failures;
+        b.failStreak = failStreak;
+        b.startMs = startMs;
+        b.bitrate = bitrate;
+        b.options = parseOptions(options);
+        int64_t restored = now - (int64_t)(wallNow - updated) * 1000;
+        if (!entry.updated || restored > entry.updated)
+            entry.updated = restored;
+        loaded++;
+    }
+    trim();
+    return valid;
+}
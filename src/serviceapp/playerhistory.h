@@ -0,0 +1,82 @@
+#ifndef __playerhistory_h
+#define __playerhistory_h
+
+#include <pthread.h>
+#include <stdint.h>
+#include <map>
+#include <string>
+
+#include "common.h"
+#include "snapshot.h"
+
+#define PLAYER_HISTORY_BACKENDS 2
+
+struct PlayerHistoryBackend
+{
+    unsigned int starts;
+    unsigned int failures;
+    // failures since the last start, backend is avoided after a few
+    unsigned int failStreak;
+    // average time to the first frame of successful starts in ms
+    unsigned int startMs;
+    // sapp_ options and variant bits/s of the last successful start
+    HeaderMap options;
+    unsigned long int bitrate;
+    PlayerHistoryBackend(): starts(0), failures(0), failStreak(0), startMs(0), bitrate(0){}
+    bool usable() const;
+};
+
+struct PlayerHistoryEntry
+{
+    PlayerHistoryBackend backends[PLAYER_HISTORY_BACKENDS];
+    int64_t updated;
+    PlayerHistoryEntry(): updated(0){}
+};
+
+// Process-wide record of how the players coped with streams.
+//
+// Every start and failure of a player is recorded for the url pattern,
+// host and path with numbers masked, and for the host alone. Backend for
+// the next stream of the same pattern, or at least of the same host, is
+// the one which started fastest without failing, backend which failed
+// repeatedly is avoided while the other one wasn't tried yet.
+//
+// History can be saved to a snapshot file, so it survives restart of the
+// enigma2.
+class PlayerHistory: public SnapshotStore
+{
+    std::map<std::string, PlayerHistoryEntry> mEntries;
+    unsigned int mLookups;
+    unsigned int mHits;
+
+    void trim();
+    void update(const std::string &key, int backend, bool started, unsigned int startMs,
+            const HeaderMap &options, unsigned long int bitrate);
+    void writeSnapshot(FILE *f);
+    bool readSnapshot(FILE *f, size_t &loaded);
+    PlayerHistory();
+    ~PlayerHistory();
+public:
+    static PlayerHistory *getInstance();
+
+    // "host/path" with numbers of two and more digits replaced by '#',
+    // empty for urls without host
+    static std::string getPattern(const std::string &url);
+
+    // backend reported first frame startMs after it was started
+    void addStart(const std::string &url, int backend, unsigned int startMs, const HeaderMap &options,
+            unsigned long int bitrate);
+    // backend reported error or ended before the first frame
+    void addFailure(const std::string &url, int backend);
+    // returns -1 when nothing is known about the url, backend is left as
+    // preferred when it's not worse than the other one
+    int getBackend(const std::string &url, int preferred, int &backend, HeaderMap &options,
+            unsigned long int &bitrate);
+    // copy of the entry of the pattern or host, -1 when there is none
+    int getEntry(const std::string &url, PlayerHistoryEntry &entry);
+    void clear();
+    // number of lookups and how many of them found history
+    void getStats(unsigned int &lookups, unsigned int &hits);
+};
+
+#endif
@@ -0,0 +1,331 @@
+#include <errno.h>
+#include <fcntl.h>
+#include <poll.h>
+#include <signal.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include <unistd.h>
+#include <sys/wait.h>
+
+#include <algorithm>
+
+#include <lib/base/eerror.h>
+#include "playerevent.h"
+#include "playerpool.h"
+#include "spawn.h"
+
+// looks for standby report in the player messages, everything
+// what follows is kept for the one who takes over the process
+class StandbyHandler: public iLineHandler
+{
+public:
+	bool &ready;
+	std::string &output;
+	StandbyHandler(bool &ready, std::string &output):
+		ready(ready), output(output){}
+	void handleLine(const char *data, size_t len)
+	{
+		if (ready)
+		{
+			if (output.size() + len + 1 > PlayerPool::MAX_OUTPUT)
+				return;
+			output.append(data, len);
+			output.push_back('\n');
+			return;
+		}
+		PlayerEvent event;
+		if (data[0] == '{' && !decodePlayerEvent(data, len, event) && event.type == PlayerEvent::playbackStandby)
+			ready = !event[PlayerEvent::fSts].toInt();
+	}
+};
+
+PlayerPool *PlayerPool::getInstance()
+{
+	static PlayerPool pool;
+	return &pool;
+}
+
+PlayerPool::PlayerPool():
+	mThreadStarted(false),
+	mQuit(false),
+	mEnabled(false),
+	mReady(false)
+{
+	pthread_mutex_init(&mMutex, NULL);
+	pthread_cond_init(&mCond, NULL);
+}
+
+PlayerPool::~PlayerPool()
+{
+	pthread_mutex_lock(&mMutex);
+	mQuit = true;
+	pthread_cond_signal(&mCond);
+	pthread_mutex_unlock(&mMutex);
+	if (mThreadStarted)
+		pthread_join(mThread, NULL);
+	release();
+	pthread_cond_destroy(&mCond);
+	pthread_mutex_destroy(&mMutex);
+}
+
+void *PlayerPool::threadMain(void *arg)
+{
+	((PlayerPool *) arg)->run();
+	return NULL;
+}
+
+// drains pipes of the standby player until the pool is destroyed
+void PlayerPool::run()
+{
+	pthread_mutex_lock(&mMutex);
+	while (!mQuit)
+	{
+		if (mProcess.pid == -1)
+		{
+			pthread_cond_wait(&mCond, &mMutex);
+			continue;
+		}
+		// process can be taken over or released while the lock is not
+		// held, update() looks at the one which is in the pool then
+		struct pollfd pfd[2] = {{mProcess.fd[0], POLLIN, 0}, {mProcess.fd[2], POLLIN, 0}};
+		pthread_mutex_unlock(&mMutex);
+		bool hangup = poll(pfd, 2, 100) > 0 && ((pfd[0].revents | pfd[1].revents) & (POLLHUP | POLLERR | POLLNVAL));
+		pthread_mutex_lock(&mMutex);
+		update();
+		if (hangup && !mQuit && mProcess.pid != -1)
+		{
+			// closed pipe of the process which didn't exit yet would
+			// wake up the poll right away
+			struct timespec ts;
+			clock_gettime(CLOCK_REALTIME, &ts);
+			ts.tv_nsec += 100 * 1000000;
+			if (ts.tv_nsec >= 1000000000)
+			{
+				ts.tv_sec++;
+				ts.tv_nsec -= 1000000000;
+			}
+			pthread_cond_timedwait(&mCond, &mMutex, &ts);
+		}
+	}
+	pthread_mutex_unlock(&mMutex);
+}
+
+bool PlayerPool::probeStandby(const std::string &binary)
+{
+	std::string path = binary;
+	if (binary.find('/') == std::string::npos)
+	{
+		const char *env = getenv("PATH");
+		std::string dirs = env ? env : "/usr/bin:/bin";
+		path.clear();
+		size_t pos = 0;
+		while (pos <= dirs.size())
+		{
+			size_t end = dirs.find(':', pos);
+			if (end == std::string::npos)
+				end = dirs.size();
+			std::string candidate = (end > pos ? dirs.substr(pos, end - pos) : ".") + "/" + binary;
+			if (!access(candidate.c_str(), X_OK))
+			{
+				path = candidate;
+				break;
+			}
+			pos = end + 1;
+		}
+		if (path.empty())
+			return false;
+	}
+
+	int fd = open(path.c_str(), O_RDONLY | O_CLOEXEC);
+	if (fd < 0)
+		return false;
+	static const char option[] = "--standby";
+	const size_t len = sizeof(option) - 1;
+	// end of the previous chunk is kept for the option split between chunks
+	char buf[64 * 1024 + len];
+	size_t kept = 0;
+	bool found = false;
+	ssize_t rd;
+	while (!found && (rd = read(fd, buf + kept, sizeof(buf) - kept)) > 0)
+	{
+		size_t size = kept + rd;
+		found = memmem(buf, size, option, len) != NULL;
+		kept = std::min(size, len - 1);
+		memmove(buf, buf + size - kept, kept);
+	}
+	close(fd);
+	return found;
+}
+
+bool PlayerPool::isSupported(const std::string &binary)
+{
+	if (mUnsupported.count(binary))
+		return false;
+	std::map<std::string, bool>::iterator it = mProbed.find(binary);
+	if (it == mProbed.end())
+	{
+		it = mProbed.insert(std::make_pair(binary, probeStandby(binary))).first;
+		if (!it->second)
+			eWarning("PlayerPool::isSupported - %s doesn't know --standby option, standby mode is not supported", binary.c_str());
+	}
+	return it->second;
+}
+
+void PlayerPool::setEnabled(bool enabled)
+{
+	pthread_mutex_lock(&mMutex);
+	eDebug("PlayerPool::setEnabled - %s", enabled ? "enabled" : "disabled");
+	mEnabled = enabled;
+	if (!enabled)
+		release();
+	pthread_mutex_unlock(&mMutex);
+}
+
+bool PlayerPool::isEnabled()
+{
+	pthread_mutex_lock(&mMutex);
+	bool enabled = mEnabled;
+	pthread_mutex_unlock(&mMutex);
+	return enabled;
+}
+
+int PlayerPool::spawn(const std::vector<std::string> &args)
+{
+	std::vector<const char *> cargs;
+	for (size_t i = 0; i < args.size(); i++)
+		cargs.push_back(args[i].c_str());
+	cargs.push_back(NULL);
+
+	if (!mThreadStarted)
+	{
+		int ret = pthread_create(&mThread, NULL, threadMain, this);
+		if (ret)
+		{
+			eWarning("PlayerPool::spawn - cannot create thread: %s", strerror(ret));
+			return -1;
+		}
+		mThreadStarted = true;
+	}
+	int pid = bidirpipe(mProcess.fd, cargs[0], &cargs[0], NULL);
+	if (pid == -1)
+	{
+		eWarning("PlayerPool::spawn - cannot start %s: %m", cargs[0]);
+		return -1;
+	}
+	mProcess.pid = pid;
+	reset();
+	mArgs = args;
+	pthread_cond_signal(&mCond);
+	eDebug("PlayerPool::spawn - %s started in standby, pid = %d", cargs[0], pid);
+	return 0;
+}
+
+// reads what player has reported since the last update and checks if it
+// is still alive
+void PlayerPool::update()
+{
+	if (mProcess.pid == -1)
+		return;
+
+	char buf[4096];
+	ssize_t rd;
+	// nobody else reads stdout, don't let player block on full pipe
+	while ((rd = read(mProcess.fd[0], buf, sizeof(buf))) > 0);
+	StandbyHandler handler(mReady, mProcess.output);
+	while ((rd = read(mProcess.fd[2], buf, sizeof(buf))) > 0)
+	{
+		mFramer.feed(buf, rd, handler);
+		const char *nl = (const char *) memrchr(buf, '\n', rd);
+		if (nl)
+			mStderr.assign(nl + 1, buf + rd - nl - 1);
+		else if (mStderr.size() + rd <= MAX_OUTPUT)
+			mStderr.append(buf, rd);
+	}
+
+	if (waitpid(mProcess.pid, NULL, WNOHANG) == mProcess.pid)
+	{
+		if (!mReady)
+		{
+			eWarning("PlayerPool::update - %s exited without standby report, standby mode is not supported", mArgs[0].c_str());
+			mUnsupported.insert(mArgs[0]);
+		}
+		else
+		{
+			eWarning("PlayerPool::update - %s exited in standby", mArgs[0].c_str());
+		}
+		// already reaped
+		mProcess.pid = -1;
+		release();
+	}
+}
+
+void PlayerPool::reset()
+{
+	mProcess.output.clear();
+	mFramer.reset();
+	mStderr.clear();
+	mReady = false;
+}
+
+void PlayerPool::release()
+{
+	if (mProcess.pid != -1)
+	{
+		eDebug("PlayerPool::release - terminating standby player, pid = %d", mProcess.pid);
+		::kill(-mProcess.pid, SIGKILL);
+		waitpid(mProcess.pid, NULL, 0);
+	}
+	for (int i = 0; i < 3; i++)
+	{
+		if (mProcess.fd[i] != -1)
+			close(mProcess.fd[i]);
+	}
+	mProcess = Process();
+	mArgs.clear();
+	reset();
+}
+
+bool PlayerPool::acquire(const std::vector<std::string> &args, Process &process)
+{
+	bool ret = false;
+	pthread_mutex_lock(&mMutex);
+	if (mEnabled && mProcess.pid != -1 && mArgs == args)
+	{
+		update();
+		if (mReady)
+		{
+			eDebug("PlayerPool::acquire - taking over standby player, pid = %d", mProcess.pid);
+			// unterminated line is handed over as well
+			if (mFramer.pending() && mProcess.output.size() + mStderr.size() <= MAX_OUTPUT)
+				mProcess.output += mStderr;
+			process = mProcess;
+			// now owned by the caller
+			mProcess = Process();
+			mArgs.clear();
+			reset();
+			ret = true;
+		}
+		else if (mProcess.pid != -1)
+		{
+			eDebug("PlayerPool::acquire - standby player is not ready yet");
+		}
+	}
+	pthread_mutex_unlock(&mMutex);
+	return ret;
+}
+
+void PlayerPool::prepare(const std::vector<std::string> &args)
+{
+	pthread_mutex_lock(&mMutex);
+	if (mEnabled && !args.empty() && isSupported(args[0]))
+	{
+		update();
+		if (mProcess.pid == -1 || mArgs != args)
+		{
+			release();
+			spawn(args);
+		}
+	}
+	pthread_mutex_unlock(&mMutex);
+}
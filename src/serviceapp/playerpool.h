@@ -0,0 +1,79 @@
+#ifndef __playerpool_h
+#define __playerpool_h
+
+#include <pthread.h>
+#include <map>
+#include <set>
+#include <string>
+#include <vector>
+
+#include "lineframer.h"
+
+// Pool of warm player processes for faster start of the playback.
+//
+// Player is started in standby mode, without url, it loads its libraries,
+// reports {"PLAYBACK_STANDBY":{"sts":0}} and waits on stdin for the url of
+// the stream, it must not open any decoder before it gets one. Processes are
+// kept per standby command line, so they are started with the same options
+// and http headers as the player which would be started from scratch.
+//
+// Binary is probed for the "--standby" option before it's started in this
+// mode, unknown player would take it for url of the stream. Binary which
+// exits before reporting standby doesn't support this mode either and is
+// not used for the pool anymore.
+//
+// Pipes of the standby player are drained by the pool thread, so the player
+// never blocks on them while it waits, output after the standby report is
+// kept up to MAX_OUTPUT bytes.
+class PlayerPool
+{
+public:
+	struct Process
+	{
+		int pid;
+		int fd[3]; // stdout, stdin, stderr as returned by bidirpipe
+		std::string output; // output of the player after standby report
+		Process(): pid(-1) { fd[0] = fd[1] = fd[2] = -1; }
+	};
+	static const size_t MAX_OUTPUT = 64 * 1024;
+private:
+	pthread_mutex_t mMutex;
+	pthread_cond_t mCond;
+	pthread_t mThread;
+	bool mThreadStarted;
+	bool mQuit;
+	bool mEnabled;
+	std::vector<std::string> mArgs;
+	Process mProcess;
+	LineFramer mFramer;
+	// unterminated tail of stderr, handed over with the output
+	std::string mStderr;
+	bool mReady;
+	std::set<std::string> mUnsupported;
+	std::map<std::string, bool> mProbed;
+
+	static void *threadMain(void *arg);
+	void run();
+	bool isSupported(const std::string &binary);
+	int spawn(const std::vector<std::string> &args);
+	void update();
+	void reset();
+	void release();
+	PlayerPool();
+	~PlayerPool();
+public:
+	static PlayerPool *getInstance();
+	// looks for the "--standby" option in the binary, which is found in
+	// PATH when it's not a path
+	static bool probeStandby(const std::string &binary);
+
+	void setEnabled(bool enabled);
+	bool isEnabled();
+	// takes over ready process started with standby command args
+	bool acquire(const std::vector<std::string> &args, Process &process);
+	// starts new process with standby command args in the background, if there is
+	// no such process already, any other process in the pool is terminated
+	void prepare(const std::vector<std::string> &args);
+};
+
+#endif
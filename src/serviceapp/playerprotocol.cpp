@@ -0,0 +1,183 @@
+#include <stdio.h>
+#include <string.h>
+
+#include "playerprotocol.h"
+
+const PlayerTraits PlayerTraits::eplayer =
+{
+	{
+		"q",   // stop
+		"p",   // pause
+		"c",   // resume
+		"l",   // updateLength
+		"j",   // updatePosition
+		NULL,  // positionSubscribe
+		"al",  // audioList
+		"ac",  // audioCurrent
+		"a",   // audioSelect
+		"sl",  // subtitleList
+		"sc",  // subtitleCurrent
+		"s",   // subtitleSelect
+		"gc",  // seekTo
+		"kc",  // seekRelative
+		"u",   // handover
+	},
+	false,
+};
+
+void FrameDecoder::feed(const char *data, size_t len, iLineHandler &handler)
+{
+	const char *end = data + len;
+	while (data < end)
+	{
+		if (!mNeeded)
+		{
+			// looking for the header, it may be split as well
+			if (mPending.empty())
+			{
+				const char *magic = (const char *) memchr(data, PlayerProtocol::frameMagic, end - data);
+				if (magic == NULL)
+				{
+					mDiscarded += end - data;
+					return;
+				}
+				mDiscarded += magic - data;
+				data = magic;
+			}
+			while (data < end && mPending.size() < PlayerProtocol::frameHeader)
+				mPending.push_back(*data++);
+			if (mPending.size() < PlayerProtocol::frameHeader)
+				return;
+			mNeeded = ((unsigned char) mPending[1] << 8) | (unsigned char) mPending[2];
+			mPending.clear();
+			if (!mNeeded)
+				continue;
+		}
+		size_t avail = end - data;
+		if (mPending.empty() && avail >= mNeeded)
+		{
+			// whole payload is in the chunk, no need to copy it
+			const char *payload = data;
+			data += mNeeded;
+			size_t payloadLen = mNeeded;
+			mNeeded = 0;
+			handler.handleLine(payload, payloadLen);
+			continue;
+		}
+		size_t missing = mNeeded - mPending.size();
+		size_t take = avail < missing ? avail : missing;
+		mPending.insert(mPending.end(), data, data + take);
+		data += take;
+		if (mPending.size() == mNeeded)
+		{
+			// keep the payload terminated, as it is in caller's buffer
+			mPending.push_back('\0');
+			handler.handleLine(&mPending[0], mNeeded);
+			mPending.clear();
+			mNeeded = 0;
+		}
+	}
+}
+
+void FrameDecoder::reset()
+{
+	mPending.clear();
+	mNeeded = 0;
+}
+
+PlayerProtocol::PlayerProtocol(const PlayerTraits &traits):
+	mTraits(traits),
+	mHandler(NULL)
+{
+}
+
+bool PlayerProtocol::supports(int command) const
+{
+	return command >= 0 && command < PlayerCommand::count && mTraits.commands[command];
+}
+
+int PlayerProtocol::encode(int command, const char *arg, size_t argLen, std::string &out) const
+{
+	if (!supports(command))
+		return -1;
+	const char *prefix = mTraits.commands[command];
+	size_t prefixLen = strlen(prefix);
+	size_t len = prefixLen + argLen;
+	out.clear();
+	if (mTraits.framed)
+	{
+		if (len > frameMaxPayload)
+			return -1;
+		out.reserve(frameHeader + len);
+		out.push_back((char) frameMagic);
+		out.push_back((char) (len >> 8));
+		out.push_back((char) (len & 0xff));
+	}
+	else
+	{
+		// command would be split into more lines
+		if (memchr(arg, '\n', argLen))
+			return -1;
+		out.reserve(len + 1);
+	}
+	out.append(prefix, prefixLen);
+	out.append(arg, argLen);
+	if (!mTraits.framed)
+		out.push_back('\n');
+	return 0;
+}
+
+int PlayerProtocol::encode(int command, std::string &out) const
+{
+	return encode(command, "", 0, out);
+}
+
+int PlayerProtocol::encode(int command, int arg, std::string &out) const
+{
+	char buf[16];
+	int len = snprintf(buf, sizeof(buf), "%d", arg);
+	return encode(command, buf, len, out);
+}
+
+int PlayerProtocol::encode(int command, const std::string &arg, std::string &out) const
+{
+	return encode(command, arg.c_str(), arg.size(), out);
+}
+
+void PlayerProtocol::handleLine(const char *data, size_t len)
+{
+	// skip logging messages of the application
+	if (!mTraits.framed && (data[0] != '{' || data[len - 1] != '}'))
+		return;
+	PlayerEvent event;
+	if (decodePlayerEvent(data, len, event) < 0)
+	{
+		mHandler->handleUndecodable(data, len);
+		return;
+	}
+	mHandler->handleEvent(event);
+}
+
+void PlayerProtocol::feed(const char *data, size_t len, iPlayerEventHandler &handler)
+{
+	mHandler = &handler;
+	if (mTraits.framed)
+		mFrames.feed(data, len, *this);
+	else
+		mFramer.feed(data, len, *this);
+}
+
+void PlayerProtocol::flush(iPlayerEventHandler &handler)
+{
+	mHandler = &handler;
+	// unfinished frame is useless
+	if (!mTraits.framed)
+		mFramer.flush(*this);
+	reset();
+}
+
+void PlayerProtocol::reset()
+{
+	mFramer.reset();
+	mFrames.reset();
+}
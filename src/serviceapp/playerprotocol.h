@@ -0,0 +1,111 @@
+#ifndef __playerprotocol_h
+#define __playerprotocol_h
+
+#include <stddef.h>
+#include <stdint.h>
+#include <string>
+#include <vector>
+
+#include "lineframer.h"
+#include "playerevent.h"
+
+// Control protocol of the players, commands are encoded and player's
+// messages are decoded in one place, backends differ only in PlayerTraits.
+//
+// Text protocol: commands are single lines, i.e. "gc120\n", messages are
+// json lines mixed with logging of the player on the same output.
+//
+// Framed protocol: commands and messages are sent in frames
+//   0xfe | length of the payload (2 bytes, big endian) | payload
+// payload of the message is the same json as in text protocol, payload
+// of the command is the command line without '\n'. Player sends frames
+// on stdout and keeps stderr for logging, so messages don't have to be
+// searched for in the output.
+
+struct PlayerCommand
+{
+	enum
+	{
+		stop,
+		pause,
+		resume,
+		updateLength,
+		updatePosition,
+		positionSubscribe,
+		audioList,
+		audioCurrent,
+		audioSelect,
+		subtitleList,
+		subtitleCurrent,
+		subtitleSelect,
+		seekTo,
+		seekRelative,
+		handover,
+		count,
+	};
+};
+
+struct PlayerTraits
+{
+	// command prefix, argument is appended, NULL when not supported
+	const char *commands[PlayerCommand::count];
+	bool framed;
+
+	// protocol of exteplayer3 and gstplayer
+	static const PlayerTraits eplayer;
+};
+
+class iPlayerEventHandler
+{
+public:
+	virtual ~iPlayerEventHandler(){}
+	// event refers to the data of the player's output, it's valid only
+	// during the call
+	virtual void handleEvent(const PlayerEvent &event) = 0;
+	// message which looked like player's one, but cannot be decoded
+	virtual void handleUndecodable(const char * /*data*/, size_t /*len*/){}
+};
+
+// Splits the stream into frames of the framed protocol, frame which is
+// not complete in the passed chunk is copied to internal buffer, garbage
+// before the frame header is skipped.
+class FrameDecoder
+{
+	std::vector<char> mPending;
+	size_t mNeeded;
+	unsigned int mDiscarded;
+public:
+	FrameDecoder(): mNeeded(0), mDiscarded(0){}
+	// payload is followed by '\0' or by next data in memory
+	void feed(const char *data, size_t len, iLineHandler &handler);
+	void reset();
+	// number of bytes skipped while looking for frame header
+	unsigned int discarded() const {return mDiscarded;}
+};
+
+class PlayerProtocol: private iLineHandler
+{
+	const PlayerTraits &mTraits;
+	LineFramer mFramer;
+	FrameDecoder mFrames;
+	iPlayerEventHandler *mHandler;
+	void handleLine(const char *data, size_t len);
+	int encode(int command, const char *arg, size_t argLen, std::string &out) const;
+public:
+	enum {frameMagic = 0xfe, frameHeader = 3, frameMaxPayload = 0xffff};
+
+	PlayerProtocol(const PlayerTraits &traits);
+	bool framed() const {return mTraits.framed;}
+	bool supports(int command) const;
+	// returns -1 when the player doesn't support the command
+	int encode(int command, std::string &out) const;
+	int encode(int command, int arg, std::string &out) const;
+	int encode(int command, const std::string &arg, std::string &out) const;
+	// output of the player, which carries its messages
+	void feed(const char *data, size_t len, iPlayerEventHandler &handler);
+	// hand over unterminated message, i.e. when player has exited
+	void flush(iPlayerEventHandler &handler);
+	void reset();
+};
+
+#endif
@@ -0,0 +1,126 @@
+#include <errno.h>
+#include <time.h>
+
+#include <lib/base/eerror.h>
+#include "common.h"
+#include "playerrequests.h"
+
+PlayerRequests::PlayerRequests(int abandonMs):
+	mSeq(0),
+	mAbandonMs(abandonMs)
+{
+	pthread_condattr_t attr;
+	pthread_condattr_init(&attr);
+	pthread_condattr_setclock(&attr, CLOCK_MONOTONIC);
+	pthread_mutex_init(&mMutex, NULL);
+	pthread_cond_init(&mCond, &attr);
+	pthread_condattr_destroy(&attr);
+}
+
+PlayerRequests::~PlayerRequests()
+{
+	pthread_mutex_destroy(&mMutex);
+	pthread_cond_destroy(&mCond);
+}
+
+unsigned int PlayerRequests::add(const int *types, int count)
+{
+	int64_t now = getMonotonicMs();
+	pthread_mutex_lock(&mMutex);
+	for (std::list<Request>::iterator it(mRequests.begin()); it != mRequests.end();)
+	{
+		if (it->abandoned && now - it->sent > mAbandonMs)
+			it = mRequests.erase(it);
+		else
+			++it;
+	}
+	unsigned int first = mSeq + 1;
+	for (int i = 0; i < count; i++)
+		mRequests.push_back(Request(++mSeq, types[i], now));
+	pthread_mutex_unlock(&mMutex);
+	return first;
+}
+
+int PlayerRequests::wait(unsigned int first, int count, int timeout)
+{
+	unsigned int last = first + count - 1;
+	struct timespec ts;
+	clock_gettime(CLOCK_MONOTONIC, &ts);
+	ts.tv_sec += timeout / 1000;
+	ts.tv_nsec += (timeout % 1000) * 1000000;
+	if (ts.tv_nsec >= 1000000000)
+	{
+		ts.tv_sec++;
+		ts.tv_nsec -= 1000000000;
+	}
+
+	int ret = 0;
+	pthread_mutex_lock(&mMutex);
+	for (;;)
+	{
+		int pending = 0;
+		for (std::list<Request>::const_iterator it(mRequests.begin()); it != mRequests.end(); ++it)
+		{
+			if (!it->done && it->seq >= first && it->seq <= last)
+				pending++;
+		}
+		if (!pending)
+			break;
+		if (timeout <= 0 || pthread_cond_timedwait(&mCond, &mMutex, &ts) == ETIMEDOUT)
+		{
+			if (timeout > 0)
+				eDebug("PlayerRequests::wait - timed out after %dms, %d requests pending", timeout, pending);
+			ret = -1;
+			break;
+		}
+	}
+	for (std::list<Request>::iterator it(mRequests.begin()); it != mRequests.end();)
+	{
+		if (it->seq >= first && it->seq <= last)
+		{
+			if (it->done)
+			{
+				it = mRequests.erase(it);
+				continue;
+			}
+			it->abandoned = true;
+		}
+		++it;
+	}
+	pthread_mutex_unlock(&mMutex);
+	return ret;
+}
+
+void PlayerRequests::complete(int type, bool all)
+{
+	pthread_mutex_lock(&mMutex);
+	for (std::list<Request>::iterator it(mRequests.begin()); it != mRequests.end();)
+	{
+		if (!it->done && (all || it->type == type))
+		{
+			if (it->abandoned)
+				it = mRequests.erase(it);
+			else
+				(it++)->done = true;
+			if (!all)
+				break;
+			continue;
+		}
+		++it;
+	}
+	pthread_cond_broadcast(&mCond);
+	pthread_mutex_unlock(&mMutex);
+}
+
+size_t PlayerRequests::pending()
+{
+	pthread_mutex_lock(&mMutex);
+	size_t pending = 0;
+	for (std::list<Request>::const_iterator it(mRequests.begin()); it != mRequests.end(); ++it)
+	{
+		if (!it->done)
+			pending++;
+	}
+	pthread_mutex_unlock(&mMutex);
+	return pending;
+}
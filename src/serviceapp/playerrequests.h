@@ -0,0 +1,50 @@
+#ifndef __playerrequests_h
+#define __playerrequests_h
+
+#include <pthread.h>
+#include <stdint.h>
+#include <list>
+
+// Requests which wait for reply of the player.
+//
+// Player doesn't tag its replies, so reply completes the oldest pending
+// request of the same type. Requests added together are sent in one
+// round trip and waited for together. Requests which were not completed
+// in time are left for the late replies, so they don't complete requests
+// sent after them, abandoned requests which got no reply for abandonMs
+// are dropped, player may never reply to some.
+class PlayerRequests
+{
+	struct Request
+	{
+		unsigned int seq;
+		int type;
+		bool done;
+		bool abandoned;
+		int64_t sent;
+		Request(unsigned int seq, int type, int64_t sent)
+			:seq(seq), type(type), done(false), abandoned(false), sent(sent) {}
+	};
+	std::list<Request> mRequests;
+	unsigned int mSeq;
+	int mAbandonMs;
+	pthread_mutex_t mMutex;
+	pthread_cond_t mCond;
+
+	PlayerRequests(const PlayerRequests&);
+	PlayerRequests& operator=(const PlayerRequests&);
+public:
+	PlayerRequests(int abandonMs=30000);
+	~PlayerRequests();
+	// adds requests of given types, returns sequence of the first one
+	unsigned int add(const int *types, int count);
+	// waits for count requests added from the first one to be completed,
+	// returns -1 when timed out
+	int wait(unsigned int first, int count, int timeout);
+	// completes the oldest pending request of given type or all pending requests
+	void complete(int type, bool all=false);
+	// requests which were neither completed nor dropped yet
+	size_t pending();
+};
+
+#endif
@@ -0,0 +1,393 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <strings.h>
+#include <time.h>
+#include <unistd.h>
+
+#include "common.h"
+#include "playlistcache.h"
+
+#define SNAPSHOT_HEADER "SERVICEAPP_PLAYLIST_CACHE 2"
+
+PlaylistCache *PlaylistCache::getInstance()
+{
+    static PlaylistCache cache;
+    return &cache;
+}
+
+PlaylistCache::PlaylistCache():
+    SnapshotStore("PlaylistCache", SNAPSHOT_HEADER),
+    mMaxEntries(256),
+    mTtl(0),
+    mHits(0),
+    mRevalidations(0),
+    mMisses(0)
+{
+}
+
+PlaylistCache::~PlaylistCache()
+{
+    saveLocked(true);
+}
+
+// cookies, user agent or authorization may change the playlist, so all
+// headers are part of the key
+std::string PlaylistCache::key(const std::string &url, const HeaderMap &headers)
+{
+    std::string key(url);
+    for (HeaderMap::const_iterator it(headers.begin()); it != headers.end(); it++)
+        key.append("\n").append(it->first).append(": ").append(it->second);
+    return key;
+}
+
+int PlaylistCache::lookup(const std::string &key, PlaylistCacheEntry &entry)
+{
+    int ret = miss;
+    pthread_mutex_lock(&mMutex);
+    std::map<std::string, std::list<Item>::iterator>::iterator it = mIndex.find(key);
+    if (mTtl > 0 && it != mIndex.end())
+    {
+        mItems.splice(mItems.begin(), mItems, it->second);
+        entry = it->second->second;
+        if (getMonotonicMs() - entry.validated < mTtl)
+        {
+            ret = fresh;
+            mHits++;
+        }
+        else
+            ret = stale;
+    }
+    if (ret == miss)
+        mMisses++;
+    pthread_mutex_unlock(&mMutex);
+    return ret;
+}
+
+void PlaylistCache::store(const std::string &key, const PlaylistCacheEntry &entry)
+{
+    pthread_mutex_lock(&mMutex);
+    if (mTtl > 0)
+    {
+        std::map<std::string, std::list<Item>::iterator>::iterator it = mIndex.find(key);
+        if (it != mIndex.end())
+        {
+            mItems.erase(it->second);
+            mIndex.erase(it);
+        }
+        mItems.push_front(Item(key, entry));
+        mItems.front().second.validated = getMonotonicMs();
+        mIndex[key] = mItems.begin();
+        trim();
+        setDirty(true);
+        saveLocked(false);
+    }
+    pthread_mutex_unlock(&mMutex);
+}
+
+void PlaylistCache::revalidated(const std::string &key)
+{
+    pthread_mutex_lock(&mMutex);
+    std::map<std::string, std::list<Item>::iterator>::iterator it = mIndex.find(key);
+    if (it != mIndex.end())
+    {
+        it->second->second.validated = getMonotonicMs();
+        mRevalidations++;
+        setDirty(true);
+        saveLocked(false);
+    }
+    pthread_mutex_unlock(&mMutex);
+}
+
+void PlaylistCache::remove(const std::string &key)
+{
+    pthread_mutex_lock(&mMutex);
+    std::map<std::string, std::list<Item>::iterator>::iterator it = mIndex.find(key);
+    if (it != mIndex.end())
+    {
+        mItems.erase(it->second);
+        mIndex.erase(it);
+        setDirty(true);
+    }
+    pthread_mutex_unlock(&mMutex);
+}
+
+// snapshot is kept, see setSnapshot
+void PlaylistCache::clear()
+{
+    pthread_mutex_lock(&mMutex);
+    mItems.clear();
+    mIndex.clear();
+    setDirty(false);
+    pthread_mutex_unlock(&mMutex);
+}
+
+void PlaylistCache::trim()
+{
+    while (mItems.size() > mMaxEntries)
+    {
+        mIndex.erase(mItems.back().first);
+        mItems.pop_back();
+    }
+}
+
+void PlaylistCache::setLimits(size_t maxEntries, int ttlMs)
+{
+    pthread_mutex_lock(&mMutex);
+    mMaxEntries = maxEntries;
+    mTtl = ttlMs;
+    trim();
+    pthread_mutex_unlock(&mMutex);
+}
+
+void PlaylistCache::getStats(unsigned int &hits, unsigned int &revalidations, unsigned int &misses)
+{
+    pthread_mutex_lock(&mMutex);
+    hits = mHits;
+    revalidations = mRevalidations;
+    misses = mMisses;
+    pthread_mutex_unlock(&mMutex);
+}
+
+// fields of the snapshot are tab separated, one record per line
+static std::string escape(const std::string &value)
+{
+    std::string out;
+    out.reserve(value.size());
+    for (size_t i = 0; i < value.size(); i++)
+    {
+        switch (value[i])
+        {
+            case '\\': out += "\\\\"; break;
+            case '\t': out += "\\t"; break;
+            case '\n': out += "\\n"; break;
+            case '\r': out += "\\r"; break;
+            default: out += value[i]; break;
+        }
+    }
+    return out;
+}
+
+static std::vector<std::string> split(const std::string &line)
+{
+    std::vector<std::string> fields(1);
+    for (size_t i = 0; i < line.size(); i++)
+    {
+        if (line[i] == '\t')
+            fields.push_back(std::string());
+        else if (line[i] == '\\' && i + 1 < line.size())
+        {
+            char c = line[++i];
+            fields.back() += c == 't' ? '\t' : c == 'n' ? '\n' : c == 'r' ? '\r' : c;
+        }
+        else
+            fields.back() += line[i];
+    }
+    return fields;
+}
+
+static void writeStream(FILE *f, char type, const M3U8StreamInfo &s)
+{
+    fprintf(f, "%c\t%lu\t%lu\t%g\t%s\t%s\t%s\t%s\t%s\t%s\t%s\t%s", type, s.bitrate, s.averageBitrate, s.frameRate,
+            escape(s.url).c_str(), escape(s.codecs).c_str(), escape(s.resolution).c_str(), escape(s.hdcpLevel).c_str(),
+            escape(s.audioGroup).c_str(), escape(s.videoGroup).c_str(), escape(s.subtitlesGroup).c_str(),
+            escape(s.closedCaptionsGroup).c_str());
+    for (HeaderMap::const_iterator h(s.headers.begin()); h != s.headers.end(); h++)
+        fprintf(f, "\t%s\t%s", escape(h->first).c_str(), escape(h->second).c_str());
+    fprintf(f, "\n");
+}
+
+static bool readStream(const std::vector<std::string> &fields, M3U8StreamInfo &s)
+{
+    if (fields.size() < 12 || (fields.size() - 12) % 2)
+        return false;
+    s.bitrate = strtoul(fields[1].c_str(), NULL, 10);
+    s.averageBitrate = strtoul(fields[2].c_str(), NULL, 10);
+    s.frameRate = strtod(fields[3].c_str(), NULL);
+    s.url = fields[4];
+    s.codecs = fields[5];
+    s.resolution = fields[6];
+    s.hdcpLevel = fields[7];
+    s.audioGroup = fields[8];
+    s.videoGroup = fields[9];
+    s.subtitlesGroup = fields[10];
+    s.closedCaptionsGroup = fields[11];
+    for (size_t i = 12; i + 1 < fields.size(); i += 2)
+        s.headers[fields[i]] = fields[i + 1];
+    return true;
+}
+
+static void writeRendition(FILE *f, const M3U8Rendition &r)
+{
+    fprintf(f, "M\t%d\t%s\t%s\t%s\t%s\t%s\t%s\t%d\t%d\t%d\n", r.type, escape(r.groupId).c_str(),
+            escape(r.name).c_str(), escape(r.language).c_str(), escape(r.url).c_str(),
+            escape(r.instreamId).c_str(), escape(r.channels).c_str(), r.isDefault, r.autoselect, r.forced);
+}
+
+static bool readRendition(const std::vector<std::string> &fields, M3U8Rendition &r)
+{
+    if (fields.size() != 11)
+        return false;
+    r.type = atoi(fields[1].c_str());
+    r.groupId = fields[2];
+    r.name = fields[3];
+    r.language = fields[4];
+    r.url = fields[5];
+    r.instreamId = fields[6];
+    r.channels = fields[7];
+    r.isDefault = fields[8] == "1";
+    r.autoselect = fields[9] == "1";
+    r.forced = fields[10] == "1";
+    return true;
+}
+
+// credentials of the user are not written to the snapshot file, playlist
+// fetched with them is explored again after restart
+static bool isCredential(const char *name, size_t len)
+{
+    static const char *names[] = {"Cookie", "Authorization", "Proxy-Authorization"};
+    for (size_t i = 0; i < sizeof(names) / sizeof(names[0]); i++)
+    {
+        if (len == strlen(names[i]) && !strncasecmp(name, names[i], len))
+            return true;
+    }
+    return false;
+}
+
+static bool hasCredentials(const HeaderMap &headers)
+{
+    for (HeaderMap::const_iterator it(headers.begin()); it != headers.end(); it++)
+    {
+        if (isCredential(it->first.c_str(), it->first.size()))
+            return true;
+    }
+    return false;
+}
+
+// headers of the request are in the key, see key()
+static bool hasCredentials(const std::string &key)
+{
+    size_t pos = 0;
+    while ((pos = key.find('\n', pos)) != std::string::npos)
+    {
+        size_t colon = key.find(": ", ++pos);
+        if (colon != std::string::npos && isCredential(key.c_str() + pos, colon - pos))
+            return true;
+    }
+    return false;
+}
+
+static bool hasCredentials(const std::string &key, const M3U8MasterPlaylist &playlist)
+{
+    if (hasCredentials(key))
+        return true;
+    for (size_t i = 0; i < playlist.variants.size(); i++)
+    {
+        if (hasCredentials(playlist.variants[i].headers))
+            return true;
+    }
+    for (size_t i = 0; i < playlist.iframeStreams.size(); i++)
+    {
+        if (hasCredentials(playlist.iframeStreams[i].headers))
+            return true;
+    }
+    return false;
+}
+
+void PlaylistCache::writeSnapshot(FILE *f)
+{
+    int64_t now = getMonotonicMs();
+    time_t wallNow = time(NULL);
+    // least recently used first, so loading keeps the order
+    for (std::list<Item>::reverse_iterator it(mItems.rbegin()); it != mItems.rend(); it++)
+    {
+        const PlaylistCacheEntry &entry = it->second;
+        const M3U8MasterPlaylist &playlist = entry.playlist;
+        if (hasCredentials(it->first, playlist))
+            continue;
+        size_t records = playlist.variants.size() + playlist.iframeStreams.size() + playlist.renditions.size();
+        fprintf(f, "P\t%lld\t%s\t%s\t%d\t%d\t%zu\t%s\n", (long long)(wallNow - (now - entry.validated) / 1000),
+                escape(entry.etag).c_str(), escape(entry.lastModified).c_str(), playlist.version,
+                playlist.independentSegments, records, escape(it->first).c_str());
+        for (size_t i = 0; i < playlist.variants.size(); i++)
+            writeStream(f, 'V', playlist.variants[i]);
+        for (size_t i = 0; i < playlist.iframeStreams.size(); i++)
+            writeStream(f, 'I', playlist.iframeStreams[i]);
+        for (size_t i = 0; i < playlist.renditions.size(); i++)
+            writeRendition(f, playlist.renditions[i]);
+    }
+}
+
+bool PlaylistCache::readSnapshot(FILE *f, size_t &loaded)
+{
+    char *line = NULL;
+    size_t lineSize = 0;
+    ssize_t len;
+    bool valid = true;
+    int64_t now = getMonotonicMs();
+    time_t wallNow = time(NULL);
+    Item item;
+    size_t expected = 0;
+    size_t records = 0;
+    while ((len = getline(&line, &lineSize, f)) > 0)
+    {
+        if (line[len - 1] == '\n')
+            line[--len] = '\0';
+        std::vector<std::string> fields = split(std::string(line, len));
+        M3U8MasterPlaylist &playlist = item.second.playlist;
+        M3U8StreamInfo info;
+        M3U8Rendition rendition;
+        if (fields[0] == "P" && fields.size() == 8)
+        {
+            time_t validated = strtoll(fields[1].c_str(), NULL, 10);
+            // validated in the future, clock was changed
+            if (validated > wallNow)
+                validated = 0;
+            item = Item(fields[7], PlaylistCacheEntry());
+            item.second.validated = now - (int64_t)(wallNow - validated) * 1000;
+            item.second.etag = fields[2];
+            item.second.lastModified = fields[3];
+            item.second.playlist.version = atoi(fields[4].c_str());
+            item.second.playlist.independentSegments = fields[5] == "1";
+            expected = strtoul(fields[6].c_str(), NULL, 10);
+            records = 0;
+        }
+        else if (records < expected && fields[0] == "V" && readStream(fields, info))
+        {
+            playlist.variants.push_back(info);
+            records++;
+        }
+        else if (records < expected && fields[0] == "I" && readStream(fields, info))
+        {
+            playlist.iframeStreams.push_back(info);
+            records++;
+        }
+        else if (records < expected && fields[0] == "M" && readRendition(fields, rendition))
+        {
+            playlist.renditions.push_back(rendition);
+            records++;
+        }
+        else
+        {
+            valid = false;
+            break;
+        }
+        if (expected && records == expected)
+        {
+            std::map<std::string, std::list<Item>::iterator>::iterator it = mIndex.find(item.first);
+            if (it != mIndex.end())
+            {
+                mItems.erase(it->second);
+                mIndex.erase(it);
+            }
+            mItems.push_front(item);
+            mIndex[item.first] = mItems.begin();
+            item = Item();
+            expected = 0;
+            loaded++;
+        }
+    }
+    free(line);
+    trim();
+    return valid;
+}
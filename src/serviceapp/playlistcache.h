@@ -0,0 +1,75 @@
+#ifndef __playlistcache_h
+#define __playlistcache_h
+
+#include <pthread.h>
+#include <stdint.h>
+#include <list>
+#include <map>
+#include <string>
+#include <vector>
+
+#include "m3u8.h"
+#include "snapshot.h"
+
+struct PlaylistCacheEntry
+{
+    M3U8MasterPlaylist playlist;
+    // validators of the response, sent back on revalidation
+    std::string etag;
+    std::string lastModified;
+    int64_t validated;
+    PlaylistCacheEntry(): validated(0){}
+};
+
+// Process-wide LRU cache of explored master playlists.
+//
+// Entry is keyed by url and request headers. Within ttl it's used without
+// any request, afterwards it's revalidated with If-None-Match and
+// If-Modified-Since when server gave ETag or Last-Modified, so unchanged
+// playlist costs one round trip without download and parsing.
+//
+// Cache can be saved to a snapshot file, so it survives restart of the
+// enigma2. It's written at most once a minute and when snapshot is changed.
+// Playlists fetched with cookies or authorization are not written to it.
+class PlaylistCache: public SnapshotStore
+{
+    typedef std::pair<std::string, PlaylistCacheEntry> Item;
+
+    // most recently used first
+    std::list<Item> mItems;
+    std::map<std::string, std::list<Item>::iterator> mIndex;
+    size_t mMaxEntries;
+    int mTtl;
+    unsigned int mHits;
+    unsigned int mRevalidations;
+    unsigned int mMisses;
+
+    void trim();
+    void writeSnapshot(FILE *f);
+    bool readSnapshot(FILE *f, size_t &loaded);
+    PlaylistCache();
+    ~PlaylistCache();
+public:
+    enum
+    {
+        miss,
+        stale,
+        fresh,
+    };
+    static PlaylistCache *getInstance();
+    static std::string key(const std::string &url, const HeaderMap &headers);
+
+    // returns miss, stale or fresh, entry is filled unless miss
+    int lookup(const std::string &key, PlaylistCacheEntry &entry);
+    void store(const std::string &key, const PlaylistCacheEntry &entry);
+    // server confirmed that the playlist didn't change
+    void revalidated(const std::string &key);
+    void remove(const std::string &key);
+    void clear();
+
+    // ttl 0 disables the cache
+    void setLimits(size_t maxEntries, int ttlMs);
+    void getStats(unsigned int &hits, unsigned int &revalidations, unsigned int &misses);
+};
+
+#endif
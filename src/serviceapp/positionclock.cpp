@@ -0,0 +1,121 @@
+#include <algorithm>
+
+#include <lib/base/eerror.h>
+#include "positionclock.h"
+
+const unsigned int PositionClock::pollFast;
+const unsigned int PositionClock::pollSlow;
+const int PositionClock::maxDrift;
+
+PositionClock::PositionClock():
+	mPosition(0),
+	mTime(0),
+	mLocked(false),
+	mPaused(false),
+	mPushed(false),
+	mPollDelay(0),
+	mStallTime(0)
+{
+}
+
+// stop interpolating until player reports progressing position again
+void PositionClock::unlock(int64_t now)
+{
+	if (mLocked)
+	{
+		mPosition += now - mTime;
+		mTime = now;
+	}
+	mLocked = false;
+	// position stops on seek and pause on purpose
+	mStallTime = 0;
+}
+
+void PositionClock::poll(unsigned int delay)
+{
+	if (mPushed && delay)
+		return;
+	mPollDelay = delay;
+}
+
+void PositionClock::start(bool pushed)
+{
+	mPushed = pushed;
+	poll(pollFast);
+}
+
+void PositionClock::stop()
+{
+	poll(0);
+}
+
+void PositionClock::seek(int64_t now)
+{
+	unlock(now);
+	poll(pollFast);
+}
+
+void PositionClock::pause(int64_t now)
+{
+	unlock(now);
+	mPaused = true;
+	poll(0);
+}
+
+void PositionClock::resume()
+{
+	mPaused = false;
+	poll(pollFast);
+}
+
+int64_t PositionClock::received(int ms, int64_t now)
+{
+	int64_t stalled = 0;
+	bool moved = ms != mPosition;
+	int64_t drift = mPosition + (now - mTime) - ms;
+	// playback was running and the position fell behind the wall clock,
+	// player ran out of data when it got to ms, it's underrun once the
+	// position moves again
+	if (mLocked && !mPaused && (!moved || drift > maxDrift))
+		mStallTime = mTime + std::max(ms - mPosition, 0);
+	else if (moved && mStallTime)
+	{
+		stalled = now - mStallTime;
+		mStallTime = 0;
+	}
+	// lock only when position moves forward along with the wall clock,
+	// so we don't interpolate while player is still seeking or buffering
+	bool locked = !mPaused && mTime && ms > mPosition && drift <= maxDrift && drift >= -maxDrift;
+	if (mLocked && !locked)
+		eDebug("PositionClock::received - unlocked, drift %lldms", (long long)drift);
+	mLocked = locked;
+	mPosition = ms;
+	mTime = now;
+
+	if (mPushed || !mPollDelay)
+		return stalled;
+	// seek while paused, poll until position settles
+	if (mPaused)
+	{
+		if (!moved)
+			poll(0);
+	}
+	else if (locked)
+		poll(std::min(mPollDelay * 2, pollSlow));
+	else
+		poll(pollFast);
+	return stalled;
+}
+
+bool PositionClock::position(int64_t now, int &ms) const
+{
+	if (!mPosition)
+		return false;
+	ms = mPosition;
+	if (mLocked)
+	{
+		// don't run away too far when player stalls between polls
+		ms += std::min(now - mTime, (int64_t)(2 * pollSlow));
+	}
+	return true;
+}
@@ -0,0 +1,49 @@
+#ifndef __positionclock_h
+#define __positionclock_h
+
+#include <stdint.h>
+
+// Play position interpolated from the last position reported by the player.
+//
+// Clock locks to the playback once the reported position moves forward
+// along with the wall clock, then the player is polled less and less often
+// up to pollSlow. It's polled fast again when the clock unlocks (start, seek,
+// resume, buffering, drift over maxDrift), not at all while paused or when
+// the player pushes its position by itself. Times are monotonic ms, passed
+// by the caller, which also serializes the calls.
+class PositionClock
+{
+public:
+	static const unsigned int pollFast = 100;
+	static const unsigned int pollSlow = 2000;
+	static const int maxDrift = 200;
+private:
+	int mPosition;
+	int64_t mTime;
+	bool mLocked;
+	bool mPaused;
+	bool mPushed;
+	unsigned int mPollDelay;
+	// position stopped moving during playback, player ran out of data
+	int64_t mStallTime;
+
+	void unlock(int64_t now);
+	void poll(unsigned int delay);
+public:
+	PositionClock();
+	// playback has started, pushed when the player reports position by itself
+	void start(bool pushed);
+	void stop();
+	void seek(int64_t now);
+	void pause(int64_t now);
+	void resume();
+	// position reported by the player, returns for how long the playback
+	// was stalled before, 0 when it wasn't
+	int64_t received(int ms, int64_t now);
+	// false when there is no position yet
+	bool position(int64_t now, int &ms) const;
+	// delay of the polls of the player, 0 when it isn't polled
+	unsigned int pollDelay() const { return mPollDelay; }
+};
+
+#endif
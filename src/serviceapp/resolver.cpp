@@ -0,0 +1,612 @@
+#include <ctype.h>
+#include <errno.h>
+#include <fcntl.h>
+#include <netdb.h>
+#include <poll.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include <unistd.h>
+#include <arpa/inet.h>
+#include <netinet/in.h>
+#include <sys/stat.h>
+#include <algorithm>
+
+#include "common.h"
+#include "resolver.h"
+
+#define RESOLV_CONF "/etc/resolv.conf"
+#define HOSTS_FILE "/etc/hosts"
+#define MAX_NAMESERVERS 3
+#define DNS_PORT 53
+// per nameserver, all of them are asked twice at most
+#define QUERY_TIMEOUT 2000
+#define QUERY_ATTEMPTS 2
+// how long to wait for AAAA answer once A answer is there (RFC 8305)
+#define RESOLUTION_DELAY 50
+// cancel flag is checked this often while waiting for the answer
+#define CANCEL_INTERVAL 100
+#define MAX_TTL 3600
+#define NEGATIVE_TTL 10
+// getaddrinfo doesn't tell the TTL
+#define FALLBACK_TTL 60
+#define MAX_ENTRIES 64
+
+#define DNS_TYPE_A 1
+#define DNS_TYPE_AAAA 28
+#define DNS_CLASS_IN 1
+#define DNS_RCODE_NXDOMAIN 3
+
+void SocketAddress::setPort(int port)
+{
+    if (addr.ss_family == AF_INET)
+        ((struct sockaddr_in *) &addr)->sin_port = htons(port);
+    else if (addr.ss_family == AF_INET6)
+        ((struct sockaddr_in6 *) &addr)->sin6_port = htons(port);
+}
+
+std::string SocketAddress::toString() const
+{
+    char buf[INET6_ADDRSTRLEN] = "";
+    if (addr.ss_family == AF_INET)
+        inet_ntop(AF_INET, &((const struct sockaddr_in *) &addr)->sin_addr, buf, sizeof(buf));
+    else if (addr.ss_family == AF_INET6)
+        inet_ntop(AF_INET6, &((const struct sockaddr_in6 *) &addr)->sin6_addr, buf, sizeof(buf));
+    return buf;
+}
+
+static bool parseAddress(const std::string &text, int port, SocketAddress &address)
+{
+    memset(&address.addr, 0, sizeof(address.addr));
+    struct sockaddr_in *in = (struct sockaddr_in *) &address.addr;
+    struct sockaddr_in6 *in6 = (struct sockaddr_in6 *) &address.addr;
+    if (inet_pton(AF_INET, text.c_str(), &in->sin_addr) == 1)
+    {
+        in->sin_family = AF_INET;
+        address.len = sizeof(*in);
+    }
+    else if (inet_pton(AF_INET6, text.c_str(), &in6->sin6_addr) == 1)
+    {
+        in6->sin6_family = AF_INET6;
+        address.len = sizeof(*in6);
+    }
+    else
+        return false;
+    address.setPort(port);
+    return true;
+}
+
+// "address", "address:port" or "[address]:port"
+static bool parseServer(const std::string &text, SocketAddress &address)
+{
+    std::string host = text;
+    int port = DNS_PORT;
+    size_t colon = text.rfind(':');
+    if (text[0] == '[')
+    {
+        size_t end = text.find(']');
+        if (end == std::string::npos)
+            return false;
+        host = text.substr(1, end - 1);
+        if (end + 1 < text.size())
+        {
+            if (text[end + 1] != ':')
+                return false;
+            port = atoi(text.c_str() + end + 2);
+        }
+    }
+    else if (colon != std::string::npos && text.find(':') == colon)
+    {
+        host = text.substr(0, colon);
+        port = atoi(text.c_str() + colon + 1);
+    }
+    return port > 0 && port < 65536 && parseAddress(host, port, address);
+}
+
+void interleaveFamilies(std::vector<SocketAddress> &addresses)
+{
+    if (addresses.empty())
+        return;
+    int first = addresses[0].family();
+    std::vector<SocketAddress> preferred, other;
+    for (size_t i = 0; i < addresses.size(); i++)
+        (addresses[i].family() == first ? preferred : other).push_back(addresses[i]);
+    addresses.clear();
+    for (size_t i = 0; i < preferred.size() || i < other.size(); i++)
+    {
+        if (i < preferred.size())
+            addresses.push_back(preferred[i]);
+        if (i < other.size())
+            addresses.push_back(other[i]);
+    }
+}
+
+static std::string lowercase(const std::string &s)
+{
+    std::string lower(s);
+    std::transform(lower.begin(), lower.end(), lower.begin(), ::tolower);
+    return lower;
+}
+
+// unpredictable ids, so spoofed answers have to guess them (RFC 5452)
+static unsigned int nextQueryId()
+{
+    static int fd = open("/dev/urandom", O_RDONLY | O_CLOEXEC);
+    unsigned char id[2];
+    if (fd >= 0 && read(fd, id, sizeof(id)) == (ssize_t) sizeof(id))
+        return (id[0] << 8) | id[1];
+    static std::atomic<unsigned int> counter((unsigned int) time(NULL) ^ ((unsigned int) getpid() << 16));
+    return (counter++ * 40503U) & 0xffff;
+}
+
+// query with recursion desired for one question
+static int buildQuery(const std::string &host, unsigned int id, int type, unsigned char *buf, size_t size)
+{
+    if (host.size() + 18 > size)
+        return -1;
+    unsigned char header[12] = {(unsigned char)(id >> 8), (unsigned char) id, 0x01, 0x00, 0, 1, 0, 0, 0, 0, 0, 0};
+    memcpy(buf, header, sizeof(header));
+    size_t pos = sizeof(header);
+    size_t start = 0;
+    while (start < host.size())
+    {
+        size_t end = host.find('.', start);
+        if (end == std::string::npos)
+            end = host.size();
+        size_t len = end - start;
+        if (len == 0 || len > 63)
+            return -1;
+        buf[pos++] = len;
+        memcpy(buf + pos, host.c_str() + start, len);
+        pos += len;
+        start = end + 1;
+    }
+    buf[pos++] = 0;
+    buf[pos++] = type >> 8;
+    buf[pos++] = type;
+    buf[pos++] = 0;
+    buf[pos++] = DNS_CLASS_IN;
+    return pos;
+}
+
+static bool skipName(const unsigned char *buf, size_t len, size_t &pos)
+{
+    while (pos < len)
+    {
+        unsigned char c = buf[pos];
+        if ((c & 0xc0) == 0xc0)
+        {
+            pos += 2;
+            return pos <= len;
+        }
+        if (c & 0xc0)
+            return false;
+        pos += c + 1;
+        if (c == 0)
+            return pos <= len;
+    }
+    return false;
+}
+
+static unsigned int get16(const unsigned char *p)
+{
+    return (p[0] << 8) | p[1];
+}
+
+struct DnsAnswer
+{
+    unsigned int id;
+    int type;
+    // question section of the query, name, type and class
+    const unsigned char *question;
+    size_t questionLength;
+    bool done;
+    int rcode;
+    std::vector<SocketAddress> addresses;
+    unsigned int ttl;
+};
+
+// returns false when the response doesn't belong to the query
+static bool parseResponse(const unsigned char *buf, size_t len, DnsAnswer &answer)
+{
+    if (len < 12 || get16(buf) != answer.id || !(buf[2] & 0x80) || get16(buf + 4) != 1)
+        return false;
+    unsigned int ancount = get16(buf + 6);
+    // echoed question, nameserver may change case of the name
+    size_t pos = 12;
+    if (pos + answer.questionLength > len)
+        return false;
+    for (size_t i = 0; i < answer.questionLength; i++)
+    {
+        if (tolower(buf[pos + i]) != tolower(answer.question[i]))
+            return false;
+    }
+    pos += answer.questionLength;
+    answer.rcode = buf[3] & 0x0f;
+    answer.ttl = MAX_TTL;
+    for (unsigned int i = 0; i < ancount; i++)
+    {
+        if (!skipName(buf, len, pos) || pos + 10 > len)
+            break;
+        int type = get16(buf + pos);
+        int rclass = get16(buf + pos + 2);
+        unsigned int ttl = ((unsigned int) get16(buf + pos + 4) << 16) | get16(buf + pos + 6);
+        size_t rdlength = get16(buf + pos + 8);
+        pos += 10;
+        if (pos + rdlength > len)
+            break;
+        // also CNAMEs which lead to the addresses limit the TTL
+        answer.ttl = std::min(answer.ttl, ttl);
+        if (rclass == DNS_CLASS_IN && type == answer.type)
+        {
+            SocketAddress address;
+            memset(&address.addr, 0, sizeof(address.addr));
+            if (type == DNS_TYPE_A && rdlength == 4)
+            {
+                struct sockaddr_in *in = (struct sockaddr_in *) &address.addr;
+                in->sin_family = AF_INET;
+                memcpy(&in->sin_addr, buf + pos, 4);
+                address.len = sizeof(*in);
+                answer.addresses.push_back(address);
+            }
+            else if (type == DNS_TYPE_AAAA && rdlength == 16)
+            {
+                struct sockaddr_in6 *in6 = (struct sockaddr_in6 *) &address.addr;
+                in6->sin6_family = AF_INET6;
+                memcpy(&in6->sin6_addr, buf + pos, 16);
+                address.len = sizeof(*in6);
+                answer.addresses.push_back(address);
+            }
+        }
+        pos += rdlength;
+    }
+    answer.done = true;
+    return true;
+}
+
+Resolver *Resolver::getInstance()
+{
+    static Resolver resolver;
+    return &resolver;
+}
+
+Resolver::Resolver():
+    mNameserversSet(false),
+    mResolvConfTime(0),
+    mHostsLoaded(false),
+    mLookups(0),
+    mHits(0)
+{
+    pthread_mutex_init(&mMutex, NULL);
+}
+
+Resolver::~Resolver()
+{
+    pthread_mutex_destroy(&mMutex);
+}
+
+void Resolver::loadHosts()
+{
+    if (mHostsLoaded)
+        return;
+    mHostsLoaded = true;
+    FILE *f = fopen(HOSTS_FILE, "r");
+    if (f == NULL)
+        return;
+    char line[512];
+    while (fgets(line, sizeof(line), f))
+    {
+        char *comment = strchr(line, '#');
+        if (comment)
+            *comment = '\0';
+        char *saveptr = NULL;
+        char *token = strtok_r(line, " \t\r\n", &saveptr);
+        SocketAddress address;
+        if (token == NULL || !parseAddress(token, 0, address))
+            continue;
+        while ((token = strtok_r(NULL, " \t\r\n", &saveptr)) != NULL)
+            mHosts[lowercase(token)].push_back(address);
+    }
+    fclose(f);
+}
+
+// resolv.conf is read again when it changes, i.e. after DHCP renewal
+void Resolver::loadNameservers()
+{
+    if (mNameserversSet)
+        return;
+    struct stat st;
+    if (stat(RESOLV_CONF, &st) < 0)
+    {
+        mNameservers.clear();
+        return;
+    }
+    if (st.st_mtime == mResolvConfTime)
+        return;
+    mResolvConfTime = st.st_mtime;
+    mNameservers.clear();
+    FILE *f = fopen(RESOLV_CONF, "r");
+    if (f == NULL)
+        return;
+    char line[256];
+    while (fgets(line, sizeof(line), f) && mNameservers.size() < MAX_NAMESERVERS)
+    {
+        char server[INET6_ADDRSTRLEN + 16];
+        SocketAddress address;
+        // link-local IPv6 with zone index is left for getaddrinfo
+        if (sscanf(line, " nameserver %63s", server) == 1 && parseAddress(server, DNS_PORT, address))
+            mNameservers.push_back(address);
+    }
+    fclose(f);
+}
+
+void Resolver::store(const std::string &host, const std::vector<SocketAddress> &addresses, unsigned int ttl)
+{
+    if (!ttl)
+        return;
+    int64_t now = getMonotonicMs();
+    pthread_mutex_lock(&mMutex);
+    ResolverEntry &entry = mCache[host];
+    entry.addresses = addresses;
+    entry.expires = now + (int64_t) std::min(ttl, (unsigned int) MAX_TTL) * 1000;
+    for (std::map<std::string, ResolverEntry>::iterator it(mCache.begin()); it != mCache.end();)
+    {
+        if (it->second.expires <= now)
+            mCache.erase(it++);
+        else
+            it++;
+    }
+    // the soonest expiring entries are dropped
+    while (mCache.size() > MAX_ENTRIES)
+    {
+        std::map<std::string, ResolverEntry>::iterator oldest = mCache.begin();
+        for (std::map<std::string, ResolverEntry>::iterator it(mCache.begin()); it != mCache.end(); it++)
+        {
+            if (it->second.expires < oldest->second.expires)
+                oldest = it;
+        }
+        mCache.erase(oldest);
+    }
+    pthread_mutex_unlock(&mMutex);
+}
+
+// AAAA and A questions are sent together to one nameserver after another,
+// returns 0 with addresses, 1 when the name has no addresses, -1 when no
+// nameserver answered and -2 when cancelled or out of time
+int Resolver::query(const std::string &host, const std::vector<SocketAddress> &servers,
+        std::vector<SocketAddress> &addresses, unsigned int &ttl, int64_t deadline,
+        const std::atomic<bool> *cancelled)
+{
+    const int types[2] = {DNS_TYPE_AAAA, DNS_TYPE_A};
+    unsigned char queries[2][512];
+    int lengths[2];
+    for (int i = 0; i < 2; i++)
+    {
+        lengths[i] = buildQuery(host, 0, types[i], queries[i], sizeof(queries[i]));
+        if (lengths[i] < 0)
+            return 1;
+    }
+    for (int attempt = 0; attempt < QUERY_ATTEMPTS; attempt++)
+    {
+        for (size_t s = 0; s < servers.size(); s++)
+        {
+            int64_t now = getMonotonicMs();
+            if (now >= deadline)
+                return -2;
+            int fd = socket(servers[s].family(), SOCK_DGRAM, 0);
+            if (fd < 0)
+                continue;
+            // connected socket gets only answers of the nameserver
+            if (connect(fd, (const struct sockaddr *) &servers[s].addr, servers[s].len) < 0)
+            {
+                close(fd);
+                continue;
+            }
+            DnsAnswer answers[2];
+            bool failed = false;
+            for (int i = 0; i < 2; i++)
+            {
+                answers[i].id = nextQueryId();
+                answers[i].type = types[i];
+                answers[i].question = queries[i] + 12;
+                answers[i].questionLength = lengths[i] - 12;
+                answers[i].done = false;
+                answers[i].rcode = 0;
+                answers[i].ttl = 0;
+                queries[i][0] = answers[i].id >> 8;
+                queries[i][1] = answers[i].id;
+                if (send(fd, queries[i], lengths[i], 0) != lengths[i])
+                    failed = true;
+            }
+            int64_t until = std::min(now + QUERY_TIMEOUT, deadline);
+            while (!failed && !(answers[0].done && answers[1].done))
+            {
+                now = getMonotonicMs();
+                if (cancelled && *cancelled)
+                {
+                    close(fd);
+                    return -2;
+                }
+                if (now >= until)
+                    break;
+                int wait = until - now;
+                if (cancelled)
+                    wait = std::min(wait, CANCEL_INTERVAL);
+                struct pollfd pfd = {fd, POLLIN, 0};
+                int ret = poll(&pfd, 1, wait);
+                if (ret < 0 && errno == EINTR)
+                    continue;
+                if (ret <= 0)
+                    continue;
+                unsigned char buf[4096];
+                ssize_t len = recv(fd, buf, sizeof(buf), 0);
+                if (len < 0)
+                {
+                    // nothing listens on the nameserver port
+                    if (errno != EINTR && errno != EAGAIN)
+                        failed = true;
+                    continue;
+                }
+                for (int i = 0; i < 2; i++)
+                {
+                    if (!answers[i].done && parseResponse(buf, len, answers[i]))
+                        break;
+                }
+                // don't wait long for AAAA, IPv4 can be used meanwhile
+                if (answers[1].done && !answers[0].done && !answers[1].addresses.empty())
+                    until = std::min(until, getMonotonicMs() + RESOLUTION_DELAY);
+            }
+            close(fd);
+            // other nameserver may know better when this one failed
+            bool answered = false, nxdomain = false;
+            addresses.clear();
+            ttl = MAX_TTL;
+            for (int i = 0; i < 2; i++)
+            {
+                if (!answers[i].done || (answers[i].rcode && answers[i].rcode != DNS_RCODE_NXDOMAIN))
+                    continue;
+                answered = true;
+                nxdomain |= answers[i].rcode == DNS_RCODE_NXDOMAIN;
+                addresses.insert(addresses.end(), answers[i].addresses.begin(), answers[i].addresses.end());
+                if (!answers[i].addresses.empty())
+                    ttl = std::min(ttl, answers[i].ttl);
+            }
+            if (!addresses.empty())
+                return 0;
+            if (answered && (nxdomain || (answers[0].done && answers[1].done)))
+                return 1;
+        }
+    }
+    return -1;
+}
+
+int Resolver::resolve(const std::string &name, std::vector<SocketAddress> &addresses, int timeoutMs,
+        const std::atomic<bool> *cancelled)
+{
+    std::string host = name;
+    if (host.size() > 2 && host[0] == '[' && host[host.size() - 1] == ']')
+        host = host.substr(1, host.size() - 2);
+    addresses.clear();
+    SocketAddress numeric;
+    if (parseAddress(host, 0, numeric))
+    {
+        addresses.push_back(numeric);
+        return 0;
+    }
+    host = lowercase(host);
+    if (!host.empty() && host[host.size() - 1] == '.')
+        host.erase(host.size() - 1);
+    if (host.empty())
+        return -1;
+
+    pthread_mutex_lock(&mMutex);
+    mLookups++;
+    loadHosts();
+    std::map<std::string, std::vector<SocketAddress> >::const_iterator hostsIt = mHosts.find(host);
+    if (hostsIt != mHosts.end())
+    {
+        addresses = hostsIt->second;
+        pthread_mutex_unlock(&mMutex);
+        interleaveFamilies(addresses);
+        return 0;
+    }
+    std::map<std::string, ResolverEntry>::const_iterator it = mCache.find(host);
+    if (it != mCache.end() && it->second.expires > getMonotonicMs())
+    {
+        mHits++;
+        addresses = it->second.addresses;
+        pthread_mutex_unlock(&mMutex);
+        return addresses.empty() ? -1 : 0;
+    }
+    loadNameservers();
+    std::vector<SocketAddress> servers = mNameservers;
+    pthread_mutex_unlock(&mMutex);
+
+    int64_t start = getMonotonicMs();
+    unsigned int ttl = 0;
+    int ret = servers.empty() ? -1 : query(host, servers, addresses, ttl, start + timeoutMs, cancelled);
+    if (ret == 0)
+    {
+        interleaveFamilies(addresses);
+        store(host, addresses, ttl);
+        fprintf(stderr, "[Resolver] %s: %zu addresses in %lldms, ttl %us\n", host.c_str(), addresses.size(),
+                (long long)(getMonotonicMs() - start), ttl);
+        return 0;
+    }
+    if (ret == -2)
+    {
+        fprintf(stderr, "[Resolver] %s: %s\n", host.c_str(), cancelled && *cancelled ? "cancelled" : "timed out");
+        return -1;
+    }
+    // system resolver may still know the name, i.e. by search domains,
+    // mDNS or other sources of nsswitch
+    if (ret == 1)
+        fprintf(stderr, "[Resolver] %s: not found by nameservers\n", host.c_str());
+
+    struct addrinfo *info = NULL;
+    struct addrinfo hints;
+    memset(&hints, 0, sizeof(hints));
+    hints.ai_family = AF_UNSPEC;
+    hints.ai_socktype = SOCK_STREAM;
+#ifdef AI_ADDRCONFIG
+    hints.ai_flags = AI_ADDRCONFIG;
+#endif
+    if (getaddrinfo(host.c_str(), NULL, &hints, &info) || !info)
+    {
+        fprintf(stderr, "[Resolver] %s: getaddrinfo failed\n", host.c_str());
+        // names not found by both of them
+        store(host, addresses, NEGATIVE_TTL);
+        return -1;
+    }
+    for (struct addrinfo *ptr = info; ptr; ptr = ptr->ai_next)
+    {
+        SocketAddress address;
+        if (ptr->ai_addrlen > sizeof(address.addr))
+            continue;
+        memcpy(&address.addr, ptr->ai_addr, ptr->ai_addrlen);
+        address.len = ptr->ai_addrlen;
+        addresses.push_back(address);
+    }
+    freeaddrinfo(info);
+    interleaveFamilies(addresses);
+    store(host, addresses, FALLBACK_TTL);
+    return addresses.empty() ? -1 : 0;
+}
+
+int Resolver::setNameservers(const std::vector<std::string> &servers)
+{
+    std::vector<SocketAddress> addresses;
+    for (size_t i = 0; i < servers.size(); i++)
+    {
+        SocketAddress address;
+        if (!parseServer(servers[i], address))
+        {
+            fprintf(stderr, "[Resolver] invalid nameserver %s\n", servers[i].c_str());
+            return -1;
+        }
+        addresses.push_back(address);
+    }
+    pthread_mutex_lock(&mMutex);
+    mNameservers = addresses;
+    mNameserversSet = !addresses.empty();
+    mResolvConfTime = 0;
+    mCache.clear();
+    pthread_mutex_unlock(&mMutex);
+    return 0;
+}
+
+void Resolver::clear()
+{
+    pthread_mutex_lock(&mMutex);
+    mCache.clear();
+    pthread_mutex_unlock(&mMutex);
+}
+
+void Resolver::getStats(unsigned int &lookups, unsigned int &hits)
+{
+    pthread_mutex_lock(&mMutex);
+    lookups = mLookups;
+    hits = mHits;
+    pthread_mutex_unlock(&mMutex);
+}
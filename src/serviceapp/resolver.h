@@ -0,0 +1,77 @@
+#ifndef __resolver_h
+#define __resolver_h
+
+#include <pthread.h>
+#include <stdint.h>
+#include <sys/socket.h>
+#include <time.h>
+#include <atomic>
+#include <map>
+#include <string>
+#include <vector>
+
+struct SocketAddress
+{
+    struct sockaddr_storage addr;
+    socklen_t len;
+    SocketAddress(): len(0){}
+    int family() const { return addr.ss_family; }
+    void setPort(int port);
+    std::string toString() const;
+};
+
+struct ResolverEntry
+{
+    std::vector<SocketAddress> addresses;
+    int64_t expires;
+};
+
+// Process-wide resolver of host names with cache.
+//
+// Names are looked up in /etc/hosts and then by own DNS client, which asks
+// nameservers for AAAA and A records at once and caches answers for their
+// TTL. When no nameserver answers, i.e. they are not reachable over UDP, or
+// they don't know the name, getaddrinfo is used as before. Names which it
+// doesn't know either are cached shortly too.
+//
+// Resolved addresses are ordered for Happy Eyeballs (RFC 8305), IPv6 and
+// IPv4 interleaved, IPv6 first.
+class Resolver
+{
+    pthread_mutex_t mMutex;
+    std::map<std::string, ResolverEntry> mCache;
+    std::vector<SocketAddress> mNameservers;
+    bool mNameserversSet;
+    time_t mResolvConfTime;
+    std::map<std::string, std::vector<SocketAddress> > mHosts;
+    bool mHostsLoaded;
+    unsigned int mLookups;
+    unsigned int mHits;
+
+    void loadHosts();
+    void loadNameservers();
+    void store(const std::string &host, const std::vector<SocketAddress> &addresses, unsigned int ttl);
+    int query(const std::string &host, const std::vector<SocketAddress> &servers,
+            std::vector<SocketAddress> &addresses, unsigned int &ttl, int64_t deadline,
+            const std::atomic<bool> *cancelled);
+    Resolver();
+    ~Resolver();
+public:
+    static Resolver *getInstance();
+
+    // addresses of the host with port 0, returns -1 when host is not known,
+    // cancelled or the timeout in ms expired
+    int resolve(const std::string &host, std::vector<SocketAddress> &addresses, int timeoutMs,
+            const std::atomic<bool> *cancelled=NULL);
+    // "address" or "address:port", "[address]:port" for IPv6, empty list
+    // returns to nameservers of /etc/resolv.conf
+    int setNameservers(const std::vector<std::string> &servers);
+    void clear();
+    // number of lookups and how many of them were answered by the cache
+    void getStats(unsigned int &lookups, unsigned int &hits);
+};
+
+// IPv6 and IPv4 addresses alternate, order within family is kept
+void interleaveFamilies(std::vector<SocketAddress> &addresses);
+
+#endif
@@ -1,16 +1,16 @@
 #include "scriptrun.h"
 #include "common.h"
 
-void scriptrun::stdoutAvail(const char *data)
+void scriptrun::stdoutAvail(const char *data, int len)
 {
-    //eDebug("outData: %s", data);
-    m_stdout.append(data);
+    //eDebug("outData: %.*s", len, data);
+    m_stdout.append(data, len);
 }
 
-void scriptrun::stderrAvail(const char *data)
+void scriptrun::stderrAvail(const char *data, int len)
 {
-    //eDebug("errData: %s", data);
-    m_stderr.append(data);
+    //eDebug("errData: %.*s", len, data);
+    m_stderr.append(data, len);
 }
 
 void scriptrun::appClosed(int retval)
@@ -42,25 +42,7 @@ void scriptrun::run(eMainloop *context)
     for (size_t i = 0;  i < m_params.size(); i++)
         args.push_back(m_params[i]);
 
-    char **cargs = (char **) malloc(sizeof(char *) * args.size()+1);
-    for (size_t i=0; i <= args.size(); i++)
-    {
-        // execvp needs args array terminated with NULL
-        if (i == args.size())
-        {
-            cargs[i] = NULL;
-            eDebugNoNewLine("\n");
-        }
-        else
-        {
-            cargs[i] = strdup(args[i].c_str());
-            if (i != 0 && cargs[i][0] != '-')
-                eDebugNoNewLine("\"%s\" ", cargs[i]);
-            else
-                eDebugNoNewLine("%s ", cargs[i]);
-        }
-    }
-    m_console->execute(context, cargs[0], cargs);
+    m_console->execute(context, args);
 }
 
 void scriptrun::stop()
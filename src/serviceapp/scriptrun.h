@@ -21,8 +21,8 @@ class scriptrun: public Object
     std::string m_stderr;
     ePtr<eConsoleContainer> m_console;
 
-    void stdoutAvail(const char *data);
-    void stderrAvail(const char *data);
+    void stdoutAvail(const char *data, int len);
+    void stderrAvail(const char *data, int len);
     void appClosed(int retval);
 public:
     scriptrun(const std::string &scriptPath,
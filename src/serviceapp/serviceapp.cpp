@@ -1,6 +1,7 @@
 #include "Python.h"
 #include <sstream>
 #include <algorithm>
+#include <climits>
 #include <openssl/ssl.h>
 #include <openssl/err.h>
 
@@ -19,6 +20,11 @@
 #include "serviceapp.h"
 #include "gstplayer.h"
 #include "exteplayer3.h"
+#include "playerpool.h"
+#include "playlistcache.h"
+#include "bandwidthestimator.h"
+#include "hlsproxy.h"
+#include "playerhistory.h"
 
 enum
 {
@@ -27,12 +33,24 @@ enum
 	SUBSERVICES_BITRATEKB_START = 0x100
 };
 
+// automatically selected variant is switched down after this many
+// underruns within the window
+#define UNDERRUN_SWITCH_COUNT 3
+#define UNDERRUN_WINDOW 60000
+
 enum
 {
 	EXTEPLAYER3,
 	GSTPLAYER,
 };
 
+enum
+{
+	HISTORY_DISABLED,
+	HISTORY_REMEMBER,
+	HISTORY_FALLBACK,
+};
+
 enum
 {
 	OPTIONS_SERVICEMP3,
@@ -42,6 +60,7 @@ enum
 };
 
 static int g_playerServiceMP3 = GSTPLAYER;
+static int g_playerHistory = HISTORY_DISABLED;
 static bool g_useUserSettings = false;
 
 static GstPlayerOptions *g_GstPlayerOptionsServiceMP3;
@@ -73,6 +92,20 @@ static HeaderMap getHttpHeaders(const std::string& path)
 	return headers;
 }
 
+// sapp_ entries of the url, options of the player
+static HeaderMap getPlayerOptions(const std::string& path)
+{
+	HeaderMap headers = getHeaders(path);
+	for (HeaderMap::iterator it(headers.begin()); it != headers.end();)
+	{
+		if (it->first.find("sapp_") != 0)
+			headers.erase(it++);
+		else
+			it++;
+	}
+	return headers;
+}
+
 static void updatePlayerOptions(IOption &options, const HeaderMap &headers)
 {
 	for (HeaderMap::const_iterator it(headers.begin()); it != headers.end(); it++)
@@ -84,10 +117,28 @@ static void updatePlayerOptions(IOption &options, const HeaderMap &headers)
 	}
 }
 
-static BasePlayer *createPlayer(const eServiceReference& ref, const HeaderMap &headers)
+// backend configured for the service type, -1 when there is none
+static int getConfiguredBackend(const eServiceReference& ref)
 {
-	BasePlayer *player = NULL;
 	if (ref.type == eServiceFactoryApp::idServiceExtEplayer3 || (ref.type == eServiceFactoryApp::idServiceMP3 && g_playerServiceMP3 == EXTEPLAYER3) )
+		return EXTEPLAYER3;
+	if (ref.type == eServiceFactoryApp::idServiceGstPlayer || (ref.type == eServiceFactoryApp::idServiceMP3 && g_playerServiceMP3 == GSTPLAYER) )
+		return GSTPLAYER;
+	return -1;
+}
+
+// references of gstplayer and exteplayer3 services choose the backend
+// themselves, history applies only to the replaced servicemp3
+static bool useHistory(const eServiceReference& ref)
+{
+	return g_playerHistory != HISTORY_DISABLED && ref.type == eServiceFactoryApp::idServiceMP3;
+}
+
+// options of the service type are updated by sapp_ ones
+static BasePlayer *createPlayer(const eServiceReference& ref, int backend, const HeaderMap &headers)
+{
+	BasePlayer *player = NULL;
+	if (backend == EXTEPLAYER3)
 	{
 		ExtEplayer3Options options;
 		if (g_useUserSettings)
@@ -99,7 +150,7 @@ static BasePlayer *createPlayer(const eServiceReference& ref, const HeaderMap &h
 		updatePlayerOptions(options, headers);
 		player = new ExtEplayer3(options);
 	}
-	else if (ref.type == eServiceFactoryApp::idServiceGstPlayer || (ref.type == eServiceFactoryApp::idServiceMP3 && g_playerServiceMP3 == GSTPLAYER) )
+	else if (backend == GSTPLAYER)
 	{
 		GstPlayerOptions options;
 		if (g_useUserSettings)
@@ -206,6 +257,15 @@ DEFINE_REF(eServiceApp);
 eServiceApp::eServiceApp(eServiceReference ref):
 	m_ref(ref),
 	m_subservices_checked(false),
+	m_variant_auto(false),
+	m_resume_position(0),
+	m_backend(-1),
+	m_history_bitrate(0),
+	m_backend_started(false),
+	m_backend_failed(false),
+	m_backend_fallback(false),
+	m_stopped(false),
+	m_start_latency(-1),
 	player(0),
 	extplayer(0),
 	m_resolver(0),
@@ -218,13 +278,14 @@ eServiceApp::eServiceApp(eServiceReference ref):
 	m_progressive(-1),
 	m_subtitle_pages(0),
 	m_selected_subtitle_track(0),
-	m_prev_subtitle_message(0),
-	m_prev_subtitle_fps(1),
+	m_subtitle_scale(1),
 	m_prev_decoder_time(-1),
-	m_decoder_time_valid_state(0)
+	m_decoder_time_valid_state(0),
+	m_start_time(0)
 {
 	options = createOptions(ref);
-	extplayer = createPlayer(ref, getHeaders(ref.path));
+	selectBackend();
+	extplayer = createPlayer(ref, m_backend, m_backend_options);
 	player = new PlayerBackend(extplayer);
 
 	m_subtitle_widget = 0;
@@ -232,12 +293,18 @@ eServiceApp::eServiceApp(eServiceReference ref):
 	CONNECT(m_subtitle_sync_timer->timeout, eServiceApp::pushSubtitles);
 	m_event_updated_info_timer = eTimer::create(eApp);
 	CONNECT(m_event_updated_info_timer->timeout, eServiceApp::signalEventUpdatedInfo);
+	m_switch_down_timer = eTimer::create(eApp);
+	CONNECT(m_switch_down_timer->timeout, eServiceApp::switchDown);
+	m_fallback_timer = eTimer::create(eApp);
+	CONNECT(m_fallback_timer->timeout, eServiceApp::fallbackBackend);
 
 #ifdef HAVE_EPG
 	m_nownext_timer = eTimer::create(eApp);
 	CONNECT(m_nownext_timer->timeout, eServiceApp::updateEpgCacheNowNext);
 #endif
 	CONNECT(player->gotPlayerMessage, eServiceApp::gotExtPlayerMessage);
+	CONNECT(m_explorer.explored, eServiceApp::subservicesExplored);
+	CONNECT(m_subtitle_loader.loaded, eServiceApp::subtitlesLoaded);
 };
 
 eServiceApp::~eServiceApp()
@@ -246,6 +313,7 @@ eServiceApp::~eServiceApp()
 	delete player;
 	delete extplayer;
 	delete m_resolver;
+	closeProxySession();
 
 	if (m_subtitle_widget) m_subtitle_widget->destroy();
 	m_subtitle_widget = 0;
@@ -257,89 +325,175 @@ eServiceApp::~eServiceApp()
 
 
 
-void eServiceApp::fillSubservices()
+void eServiceApp::fillSubservices(const M3U8MasterPlaylist &playlist)
 {
-	m_subservice_vec.clear();
+	m_playlist = playlist;
+	m_subservice_vec = playlist.variants;
 	m_subserviceref_vec.clear();
 
-	if (isM3U8Url(m_ref.path))
+	if (m_subservice_vec.empty())
+	{
+		eDebug("eServiceApp::fillSubservices - failed to retrieve subservices");
+	}
+	else
 	{
-		M3U8VariantsExplorer ve(m_ref.path, getHttpHeaders(m_ref.path));
-		m_subservice_vec = ve.getStreams();
-		if (m_subservice_vec.empty())
+		// sort subservices from best quality to worst (internally sorted according to bitrate)
+		sort(m_subservice_vec.rbegin(), m_subservice_vec.rend());
+
+		std::vector<M3U8StreamInfo>::const_iterator it;
+		// find title from parent, if parent has already bitrate
+		// string set, we look for this bitrate and separate original
+		// name from it.
+		std::stringstream sstm;
+		std::string original_title(m_ref.name);
+		for (it = m_subservice_vec.begin(); it != m_subservice_vec.end(); it++)
 		{
-			eDebug("eServiceApp::fillSubservices - failed to retrieve subservices");
+			sstm.str(std::string());
+			sstm << it->bitrate;
+			std::string bitrate_str = sstm.str();
+			size_t bitrate_idx = m_ref.name.find(": " + bitrate_str);
+			if (bitrate_idx != std::string::npos)
+			{
+				original_title = m_ref.name.substr(0, bitrate_idx);
+				break;
+			}
 		}
-		else
+
+		int i = 0;
+		for (it = m_subservice_vec.begin(); it != m_subservice_vec.end(); it++, i++)
 		{
-			// sort subservices from best quality to worst (internally sorted according to bitrate)
-			sort(m_subservice_vec.rbegin(), m_subservice_vec.rend());
-
-			std::vector<M3U8StreamInfo>::const_iterator it;
-			// find title from parent, if parent has already bitrate
-			// string set, we look for this bitrate and separate original
-			// name from it.
-			std::stringstream sstm;
-			std::string original_title(m_ref.name);
-			for (it = m_subservice_vec.begin(); it != m_subservice_vec.end(); it++)
+			if (SUBSERVICES_INDEX_START + i > SUBSERVICES_INDEX_END)
 			{
-				sstm.str(std::string());
-				sstm << it->bitrate;
-				std::string bitrate_str = sstm.str();
-				size_t bitrate_idx = m_ref.name.find(": " + bitrate_str);
-				if (bitrate_idx != std::string::npos)
-				{
-					original_title = m_ref.name.substr(0, bitrate_idx);
-					break;
-				}
+				eWarning("eServiceApp::fillSubservices - cannot add more then %d subservices!", SUBSERVICES_INDEX_END);
+				break;
+			}
+			// we need to copy all flags from parent service, neccessary for EPG
+			eServiceReference ref(m_ref);
+			// set index so we know which service to select from master playlist
+			ref.setUnsignedData(7, SUBSERVICES_INDEX_START + i);
+			// set parentTransportStreamId, since InfoBarSubservicesSupport
+			// checks this flag when creating subservices menu. If it's available
+			// at least for one subservice then it will allow to add subservices 
+			// to bouquet or favorites, see subserviceSelection.
+			//
+			// If it's not available it will only allow to quickzap subservices and it
+			// will also remove name for subservice service, see playSubservice.
+			eServiceReferenceDVB &dvb_ref = (eServiceReferenceDVB&)ref;
+			if (dvb_ref.getTransportStreamID().get())
+			{
+				// If user wants EPG, i.e. fills serviceId, transportStreamId then
+				// we have to set these as parentServiceId and parentTransportStreamID
+				// since epgcache uses those to create EPG query
+				dvb_ref.setParentServiceID(dvb_ref.getServiceID());
+				dvb_ref.setParentTransportStreamID(dvb_ref.getTransportStreamID());
+			}
+			else
+			{
+				dvb_ref.setParentTransportStreamID(1);// some random value
 			}
+			sstm.str(std::string());
+			sstm << original_title << ": " << it->bitrate << "b/s";
+			if (!it->resolution.empty())
+				sstm << " - " << it->resolution;
+			ref.name = sstm.str();
+			m_subserviceref_vec.push_back(ref);
+		}
+		eDebug("eServiceApp::fillSubservices - found %zd subservices", m_subservice_vec.size());
+	}
+}
+
+// exploration doesn't block the mainloop, subservices are filled
+// when it finishes, see subservicesExplored
+void eServiceApp::exploreSubservices()
+{
+	if (m_subservices_checked || m_explorer.running())
+		return;
+	if (!isM3U8Url(m_ref.path))
+	{
+		eDebug("eServiceApp::exploreSubservices - failed to retrieve subservices, not supported url");
+		m_subservices_checked = true;
+		return;
+	}
+	if (m_explorer.start(m_ref.path, getHttpHeaders(m_ref.path)) < 0)
+		m_subservices_checked = true;
+}
+
+void eServiceApp::subservicesExplored(int success)
+{
+	eDebug("eServiceApp::subservicesExplored - %s", success ? "success" : "error");
+	// failed exploration keeps variants which are known already
+	if (success || m_subservice_vec.empty())
+		fillSubservices(m_explorer.getPlaylist());
+	m_subservices_checked = true;
+	m_event(this, evUpdatedEventInfo);
+	if (!success || m_stopped || m_subservice_vec.empty() || !options->HLSExplorer || !options->autoSelectStream)
+		return;
+	// master playlist was played without known variants, or the played
+	// variant is not in the revalidated playlist anymore
+	bool listed = false;
+	for (size_t i = 0; i < m_subservice_vec.size() && !listed; i++)
+		listed = m_subservice_vec[i].url == m_variant.url;
+	if (listed)
+		return;
+	M3U8StreamInfo subservice = selectSubservice();
+	if (subservice.url != m_variant.url)
+		switchVariant(subservice);
+}
 
-			int i = 0;
-			for (it = m_subservice_vec.begin(); it != m_subservice_vec.end(); it++, i++)
+// variant by the subservice index or bitrate of the reference, otherwise
+// by connection speed, measured bandwidth and history of the url
+M3U8StreamInfo eServiceApp::selectSubservice()
+{
+	size_t subservice_num = m_subservice_vec.size();
+	M3U8StreamInfo subservice = *(m_subservice_vec.begin());
+	unsigned int subservice_flag = m_ref.getUnsignedData(7);
+	bool bitrate_selection = (!subservice_flag || subservice_flag >= SUBSERVICES_BITRATEKB_START);
+	if (bitrate_selection)
+	{
+		unsigned long bitrate_kb = 0;
+		if (subservice_flag)
+			bitrate_kb = (subservice_flag - SUBSERVICES_BITRATEKB_START);
+		else
+			bitrate_kb = options->connectionSpeedInKb;
+		unsigned long bitrate = bitrate_kb < ULONG_MAX / 1000 ? bitrate_kb * 1000 : ULONG_MAX;
+		if (!subservice_flag)
+		{
+			// measured throughput of the server, configured speed is upper limit
+			unsigned long budget = BandwidthEstimator::getInstance()->getBudget(Url(subservice.url).host());
+			if (budget && budget < bitrate)
 			{
-				if (SUBSERVICES_INDEX_START + i > SUBSERVICES_INDEX_END)
-				{
-					eWarning("eServiceApp::fillSubservices - cannot add more then %d subservices!", SUBSERVICES_INDEX_END);
-					break;
-				}
-				// we need to copy all flags from parent service, neccessary for EPG
-				eServiceReference ref(m_ref);
-				// set index so we know which service to select from master playlist
-				ref.setUnsignedData(7, SUBSERVICES_INDEX_START + i);
-				// set parentTransportStreamId, since InfoBarSubservicesSupport
-				// checks this flag when creating subservices menu. If it's available
-				// at least for one subservice then it will allow to add subservices 
-				// to bouquet or favorites, see subserviceSelection.
-				//
-				// If it's not available it will only allow to quickzap subservices and it
-				// will also remove name for subservice service, see playSubservice.
-				eServiceReferenceDVB &dvb_ref = (eServiceReferenceDVB&)ref;
-				if (dvb_ref.getTransportStreamID().get())
-				{
-					// If user wants EPG, i.e. fills serviceId, transportStreamId then
-					// we have to set these as parentServiceId and parentTransportStreamID
-					// since epgcache uses those to create EPG query
-					dvb_ref.setParentServiceID(dvb_ref.getServiceID());
-					dvb_ref.setParentTransportStreamID(dvb_ref.getTransportStreamID());
-				}
-				else
-				{
-					dvb_ref.setParentTransportStreamID(1);// some random value
-				}
-				sstm.str(std::string());
-				sstm << original_title << ": " << it->bitrate << "b/s";
-				if (!it->resolution.empty())
-					sstm << " - " << it->resolution;
-				ref.name = sstm.str();
-				m_subserviceref_vec.push_back(ref);
+				eDebug("eServiceApp::selectSubservice - using measured bandwidth budget %lub/s", budget);
+				bitrate = budget;
+			}
+			// without measurement variant which played last time is a good start
+			else if (!budget && m_history_bitrate && m_history_bitrate < bitrate)
+			{
+				eDebug("eServiceApp::selectSubservice - using remembered variant bitrate %lub/s", m_history_bitrate);
+				bitrate = m_history_bitrate;
 			}
-			eDebug("eServiceApp::fillSubservices - found %zd subservices", m_subservice_vec.size());
 		}
+		m_variant_auto = !subservice_flag;
+		subservice = *selectVariant(m_subservice_vec, bitrate);
+		eDebug("eServiceApp::selectSubservice - subservice(%lub/s) selected according to connection speed (%lu)",
+			subservice.bitrate, bitrate);
 	}
 	else
 	{
-		eDebug("eServiceApp::fillSubservices - failed to retrieve subservices, not supported url");
+		unsigned int subservice_idx = subservice_flag - SUBSERVICES_INDEX_START;
+		if (subservice_idx < subservice_num)
+		{
+			subservice = m_subservice_vec[subservice_idx];
+		}
+		else
+		{
+			eWarning("eServiceApp::selectSubservice - subservice_idx(%u) >= subservice_num(%zu), assuming lowest quality",
+				subservice_idx, subservice_num);
+			subservice = *(m_subservice_vec.end() - 1);
+		}
+		eDebug("eServiceApp::selectSubservice - subservice(%lub/s) selected according to index(%u)",
+			subservice.bitrate, subservice_idx);
 	}
+	return subservice;
 }
 
 #ifdef HAVE_EPG
@@ -451,40 +605,33 @@ bool eServiceApp::isExternalTrack(const SubtitleTrack &track)
 
 void eServiceApp::pullSubtitles()
 {
-	std::queue<subtitleMessage> pulled;
+	std::vector<subtitleMessage> pulled;
 	player->getSubtitles(pulled);
-	eDebug("eServiceApp::pullSubtitles - pulling %d subtitles", pulled.size());
-	while (!pulled.empty())
-	{
-		subtitleMessage sub = pulled.front();
-		m_embedded_subtitle_pages.insert(subtitle_pages_map_pair(sub.end_ms, sub));
-		pulled.pop();
-	}
+	eDebug("eServiceApp::pullSubtitles - pulling %zu subtitles", pulled.size());
+	for (std::vector<subtitleMessage>::const_iterator it(pulled.begin()); it != pulled.end(); ++it)
+		m_embedded_subtitle_pages.append(it->start_ms, it->end_ms, it->text);
 	m_subtitle_sync_timer->start(1, true);
 }
 
 void eServiceApp::pushSubtitles()
 {
 	pts_t running_pts = 0;
-	int32_t next_timer = 0, decoder_ms, start_ms, end_ms, diff_start_ms, diff_end_ms;
-	subtitle_pages_map::const_iterator current;
+	int32_t next_timer = 0, decoder_ms;
+	uint32_t time_ms, next_ms, timeout_ms = 0;
+	std::vector<size_t> active;
+	std::vector<uint32_t> shown;
 
 	int delay = eConfigManager::getConfigIntValue("config.subtitles.pango_subtitles_delay");
+	double scale = 1;
 	if (isExternalTrack(*m_selected_subtitle_track))
 	{
 		int subtitle_fps = eConfigManager::getConfigIntValue("config.subtitles.pango_subtitles_fps");
-		if (subtitle_fps != m_prev_subtitle_fps)
-		{
-			m_prev_subtitle_fps = subtitle_fps;
-			ssize_t track_pos = getTrackPosition(*m_selected_subtitle_track);
-			const subtitleMap *submap = NULL;
-			submap = m_subtitle_manager.load(m_subtitle_streams[track_pos].path, m_framerate, subtitle_fps);
-			if (submap)
-			{
-				m_prev_subtitle_message = NULL;
-				m_subtitle_pages = submap;
-			}
-		}
+		scale = SubtitleManager::getScale(m_framerate, subtitle_fps);
+	}
+	if (scale != m_subtitle_scale)
+	{
+		m_subtitle_scale = scale;
+		m_prev_subtitle_cues.clear();
 	}
 
 	if (!m_subtitle_pages)
@@ -511,7 +658,7 @@ void eServiceApp::pushSubtitles()
 			// eDebug("eServiceApp::pushSubtitles - waiting for clock to stabilise: valid=%d, prev=%lld,current=%lld",
 			//		m_decoder_time_valid_state, m_prev_decoder_time, decoder_ms);
 			m_prev_decoder_time = running_pts;
-			// we are updating play position every 100ms in extplayer
+			// extplayer polls play position every 100ms until its clock is locked
 			// so to see any progress in decoder_ms we have to wait a little longer
 			next_timer = 110;
 			goto exit;
@@ -519,48 +666,40 @@ void eServiceApp::pushSubtitles()
 		// eDebug("eServiceApp::pushSubtitles - push subtitles, clock stable");
 	}
 	decoder_ms = (running_pts - delay) / 90;
+	time_ms = decoder_ms > 0 ? decoder_ms : 0;
 
-	for (current = m_subtitle_pages->lower_bound(decoder_ms); current != m_subtitle_pages->end(); current++)
+	// subtitles which start in 50ms are shown already, timer is started
+	// for the next change of the screen, end of a shown subtitle or start
+	// of the next one, times of the timeline are scaled to the playback
+	m_subtitle_pages->getActive(time_ms / m_subtitle_scale, (time_ms + 50) / m_subtitle_scale, active);
+	if (m_subtitle_pages->getNextStart((time_ms + 50) / m_subtitle_scale, next_ms))
+		next_timer = std::max<int64_t>(1, (int64_t)(next_ms * m_subtitle_scale) - 50 - time_ms);
+	for (std::vector<size_t>::const_iterator it(active.begin()); it != active.end(); ++it)
 	{
-		start_ms = current->second.start_ms;
-		end_ms = current->second.end_ms;
-		diff_start_ms = start_ms - decoder_ms;
-		diff_end_ms = end_ms - decoder_ms;
-		
-		//eDebug("eServiceApp::pushSubtitles - next subtitle: decoder: %d, start: %d, end: %d, duration_ms: %d, diff_start: %d, diff_end: %d : %s",
-		//	decoder_ms, start_ms, end_ms, end_ms - start_ms, diff_start_ms, diff_end_ms, current->second.text.c_str());
-
-		if (diff_end_ms < 0)
-		{
-			//eDebug("eServiceApp::pushSubtitles - current sub has already ended, skip: %d", diff_end_ms);
-			continue;
-		}
-		if (diff_start_ms > 50)
-		{
-			//eDebug("eServiceApp::pushSubtitles - current sub in the future, start timer, %d", diff_start_ms);
-			next_timer = diff_start_ms;
-			goto exit;
-		}
-		// don't show the same message twice
-		if (m_prev_subtitle_message && m_prev_subtitle_message == &(current->second))
-		{
-			next_timer = 30;
-			goto exit;
-		}
-		if (m_subtitle_widget && !m_paused)
-		{
-			//eDebug("eServiceApp::pushSubtitles - current sub actual, show!");
-			m_prev_subtitle_message = &(current->second);
-			ePangoSubtitlePage pango_page;
-			gRGB rgbcol(0xD0,0xD0,0xD0);
+		uint32_t diff_end_ms = std::max<int64_t>(1, (int64_t)(m_subtitle_pages->end(*it) * m_subtitle_scale) - time_ms);
+		if (!next_timer || diff_end_ms < (uint32_t)next_timer)
+			next_timer = diff_end_ms;
+		timeout_ms = std::max(timeout_ms, diff_end_ms);
+		shown.push_back(m_subtitle_pages->id(*it));
+	}
+	if (active.empty())
+	{
+		m_prev_subtitle_cues.clear();
+	}
+	// don't show the same messages twice
+	else if (shown != m_prev_subtitle_cues && m_subtitle_widget && !m_paused)
+	{
+		//eDebug("eServiceApp::pushSubtitles - %zu subs actual, show!", active.size());
+		m_prev_subtitle_cues = shown;
+		ePangoSubtitlePage pango_page;
+		gRGB rgbcol(0xD0,0xD0,0xD0);
 
-			pango_page.m_elements.push_back(ePangoSubtitlePageElement(rgbcol, current->second.text.c_str()));
-			pango_page.m_show_pts = start_ms * 90; // actually completely unused by widget!
-			pango_page.m_timeout = end_ms - decoder_ms; // take late start into account
+		for (std::vector<size_t>::const_iterator it(active.begin()); it != active.end(); ++it)
+			pango_page.m_elements.push_back(ePangoSubtitlePageElement(rgbcol, m_subtitle_pages->text(*it)));
+		pango_page.m_show_pts = m_subtitle_pages->start(active.front()) * m_subtitle_scale * 90; // actually completely unused by widget!
+		pango_page.m_timeout = timeout_ms; // take late start into account
 
-			m_subtitle_widget->setPage(pango_page);
-		}
-		//eDebug("eServiceApp::pushSubtitles - no next sub scheduled, check NEXT subtitle");
+		m_subtitle_widget->setPage(pango_page);
 	}
 exit:
 	if (next_timer == 0)
@@ -571,9 +710,180 @@ exit:
 	m_subtitle_sync_timer->start(next_timer, true);
 }
 
+void eServiceApp::subtitlesLoaded(int success)
+{
+	eDebug("eServiceApp::subtitlesLoaded - %s", success ? "success" : "error");
+	if (!success)
+	{
+		eWarning("eServiceApp::subtitlesLoaded - cannot load external subtitles");
+		return;
+	}
+	m_subtitle_pages = m_subtitle_manager.add(m_subtitle_loader.getPath(), m_subtitle_loader.getTimeline());
+	m_prev_subtitle_cues.clear();
+	m_subtitle_sync_timer->start(1, true);
+}
+
+// url and headers for the player, with separate audio rendition if any
+void eServiceApp::getVariantSource(const M3U8StreamInfo &variant, std::string &path, HeaderMap &headers)
+{
+	headers = variant.headers;
+	path = getProxyUrl(Url(variant.url).url(), headers);
+	const M3U8Rendition *audio = m_playlist.selectAudio(variant);
+	if (audio && !audio->url.empty())
+	{
+		if (extplayer->supportsAudioUrl())
+		{
+			eDebug("eServiceApp::getVariantSource - audio rendition '%s' selected", audio->name.c_str());
+			path += "&suburi=" + getProxyUrl(Url(audio->url).url(), headers);
+		}
+		else
+		{
+			// variant alone would play without audio, player
+			// selects renditions from master playlist by itself
+			eDebug("eServiceApp::getVariantSource - player doesn't support separate audio rendition, using master playlist");
+			headers = getHttpHeaders(m_ref.path);
+			path = getProxyUrl(Url(m_ref.path).url(), headers);
+		}
+	}
+}
+
+static bool isHlsUrl(const std::string &url)
+{
+	Url purl(url);
+	std::string path = purl.path();
+	if (purl.proto() != "http" && purl.proto() != "https")
+		return false;
+	return (path.size() > 5 && !path.compare(path.size() - 5, 5, ".m3u8")) ||
+		(path.size() > 4 && !path.compare(path.size() - 4, 4, ".m3u"));
+}
+
+// playlist url in the local proxy, original one when proxy is disabled
+std::string eServiceApp::getProxyUrl(const std::string &url, const HeaderMap &headers)
+{
+	HlsProxy *proxy = HlsProxy::getInstance();
+	if (!proxy->enabled())
+		return url;
+	if (m_proxy_session.empty())
+		m_proxy_session = proxy->open(headers);
+	std::string proxied = m_proxy_session.empty() ? "" : proxy->getUrl(m_proxy_session, url);
+	if (proxied.empty())
+		return url;
+	eDebug("eServiceApp::getProxyUrl - %s through %s", url.c_str(), proxied.c_str());
+	return proxied;
+}
+
+void eServiceApp::closeProxySession()
+{
+	if (!m_proxy_session.empty())
+	{
+		HlsProxy::getInstance()->close(m_proxy_session);
+		m_proxy_session.clear();
+	}
+}
+
+// called from timer, player can't be replaced while its message is delivered
+void eServiceApp::switchDown()
+{
+	const M3U8StreamInfo *lower = m_variant.bitrate ? selectVariant(m_subservice_vec, m_variant.bitrate - 1) : NULL;
+	if (lower == NULL || lower->bitrate >= m_variant.bitrate)
+	{
+		eDebug("eServiceApp::switchDown - no variant lower than %lub/s", m_variant.bitrate);
+		return;
+	}
+	eDebug("eServiceApp::switchDown - %lub/s -> %lub/s", m_variant.bitrate, lower->bitrate);
+	switchVariant(*lower);
+}
+
+void eServiceApp::switchVariant(const M3U8StreamInfo &variant)
+{
+	// vod continues from the same position, live stream from the live point
+	int length = 0, position = 0;
+	if (!player->getLength(length) && length > 0)
+		player->getPlayPosition(position);
+	eDebug("eServiceApp::switchVariant - %lub/s, position %dms", variant.bitrate, position);
+	m_variant = variant;
+	player->stop();
+	delete player;
+	delete extplayer;
+	extplayer = createPlayer(m_ref, m_backend, m_backend_options);
+	player = new PlayerBackend(extplayer);
+	CONNECT(player->gotPlayerMessage, eServiceApp::gotExtPlayerMessage);
+	m_paused = false;
+	m_resume_position = position;
+	closeProxySession();
+	std::string path;
+	HeaderMap headers;
+	getVariantSource(m_variant, path, headers);
+	player->start(Url(path).url(), headers);
+}
+
+// backend which played the url best so far, configured one otherwise
+void eServiceApp::selectBackend()
+{
+	m_backend = getConfiguredBackend(m_ref);
+	m_backend_options = getPlayerOptions(m_ref.path);
+	m_history_bitrate = 0;
+	int backend;
+	HeaderMap options;
+	unsigned long bitrate;
+	if (useHistory(m_ref) &&
+		!PlayerHistory::getInstance()->getBackend(m_ref.path, m_backend, backend, options, bitrate))
+	{
+		if (backend != m_backend)
+			eDebug("eServiceApp::selectBackend - backend %d instead of %d according to history", backend, m_backend);
+		m_backend = backend;
+		// options of the url itself win over remembered ones
+		m_backend_options.insert(options.begin(), options.end());
+		m_history_bitrate = bitrate;
+	}
+}
+
+// returns true when the other backend will be tried
+bool eServiceApp::backendFailed()
+{
+	if (!useHistory(m_ref) || m_stopped || m_backend_failed)
+		return false;
+	m_backend_failed = true;
+	PlayerHistory::getInstance()->addFailure(m_ref.path, m_backend);
+	if (g_playerHistory != HISTORY_FALLBACK || m_backend_started || m_backend_fallback)
+		return false;
+	m_backend_fallback = true;
+	m_fallback_timer->start(0, true);
+	return true;
+}
+
+// called from timer, player can't be replaced while its message is delivered
+void eServiceApp::fallbackBackend()
+{
+	int backend = m_backend == EXTEPLAYER3 ? GSTPLAYER : EXTEPLAYER3;
+	eDebug("eServiceApp::fallbackBackend - backend %d failed, trying %d", m_backend, backend);
+	player->stop();
+	delete player;
+	delete extplayer;
+	m_backend = backend;
+	// remembered options belong to the failed backend
+	m_backend_options = getPlayerOptions(m_ref.path);
+	extplayer = createPlayer(m_ref, m_backend, m_backend_options);
+	player = new PlayerBackend(extplayer);
+	CONNECT(player->gotPlayerMessage, eServiceApp::gotExtPlayerMessage);
+	m_paused = false;
+	m_backend_failed = false;
+	closeProxySession();
+	std::string path(m_ref.path);
+	HeaderMap headers = getHttpHeaders(m_ref.path);
+	if (!m_variant.url.empty())
+		getVariantSource(m_variant, path, headers);
+	else if (isHlsUrl(path))
+		path = getProxyUrl(Url(path).url(), headers);
+	m_start_time = getMonotonicMs();
+	player->start(Url(path).url(), headers);
+}
+
 void eServiceApp::signalEventUpdatedInfo()
 {
 	eDebug("eServiceApp::signalEventUpdatedInfo");
+	// audio and subtitle tracks are queried by the listeners
+	player->updateTrackLists(500);
     m_event(this, evUpdatedInfo);
 }
 
@@ -595,14 +905,29 @@ void eServiceApp::gotExtPlayerMessage(int message)
 	switch (message)
 	{
 		case PlayerMessage::start:
-			eDebug("eServiceApp::gotExtPlayerMessage - start");
+			eDebug("eServiceApp::gotExtPlayerMessage - start, zap latency %lldms", (long long)(getMonotonicMs() - m_start_time));
+			if (!m_backend_started)
+			{
+				m_backend_started = true;
+				m_start_latency = getMonotonicMs() - m_start_time;
+				if (useHistory(m_ref))
+					PlayerHistory::getInstance()->addStart(m_ref.path, m_backend, m_start_latency, m_backend_options, m_variant.bitrate);
+			}
 			m_event_updated_info_timer->start(1000, true);
+			if (m_resume_position > 0)
+			{
+				player->seekTo(m_resume_position / 1000);
+				m_resume_position = 0;
+			}
 #ifdef HAVE_EPG
 			updateEpgCacheNowNext();
 #endif
 			break;
 		case PlayerMessage::stop:
 			eDebug("eServiceApp::gotExtPlayerMessage - stop");
+			// player which ended before the first frame failed to play the url
+			if (!m_backend_started && backendFailed())
+				break;
 			// evEOF signals that end of file was reached and we
 			// could make operations like seek back or play again, 
 			// however when player signals stop, process
@@ -621,6 +946,8 @@ void eServiceApp::gotExtPlayerMessage(int message)
 			break;
 		case PlayerMessage::error:
 			eDebug("eServiceApp::gotExtPlayerMessage - error");
+			if (backendFailed())
+				break;
 			m_event(this, evUser + 12);
 			break;
 		case PlayerMessage::videoSizeChanged:
@@ -643,6 +970,14 @@ void eServiceApp::gotExtPlayerMessage(int message)
 			{
 				m_framerate = v.framerate;
 			}
+			// frame based subtitles timed by other frame rate are read again
+			if (m_selected_subtitle_track && m_subtitle_widget && isExternalTrack(*m_selected_subtitle_track) &&
+				(m_subtitle_loader.running() || (m_subtitle_pages && m_subtitle_pages->videoFps() &&
+					m_subtitle_pages->videoFps() != (m_framerate > 0 ? m_framerate : -1))))
+			{
+				eDebug("eServiceApp::gotExtPlayerMessage - reloading external subtitles for %d fps", m_framerate);
+				enableSubtitles(m_subtitle_widget, *m_selected_subtitle_track);
+			}
 			m_event(this, evVideoFramerateChanged);
 			break;
 		}
@@ -661,7 +996,31 @@ void eServiceApp::gotExtPlayerMessage(int message)
 			eDebug("eServiceApp::gotExtPlayerMessage - subtitleAvailable");
 			if (m_selected_subtitle_track && isEmbeddedTrack(*m_selected_subtitle_track))
 				pullSubtitles();
+			else
+			{
+				// nobody shows them, don't let them fill the queue
+				std::vector<subtitleMessage> unused;
+				player->getSubtitles(unused);
+			}
 			break;
+		case PlayerMessage::underrun:
+		{
+			eDebug("eServiceApp::gotExtPlayerMessage - underrun");
+			if (m_variant.url.empty())
+				break;
+			int64_t now = getMonotonicMs();
+			m_underruns.push_back(now);
+			while (now - m_underruns.front() > UNDERRUN_WINDOW)
+				m_underruns.erase(m_underruns.begin());
+			if (m_underruns.size() < UNDERRUN_SWITCH_COUNT)
+				break;
+			m_underruns.clear();
+			// link can't sustain the variant, next automatic choice will be lower
+			BandwidthEstimator::getInstance()->addUnderrun(Url(m_variant.url).host(), m_variant.bitrate);
+			if (m_variant_auto)
+				m_switch_down_timer->start(0, true);
+			break;
+		}
 		default:
 			eDebug("eServiceApp::gotExtPlayerMessage - unhandled message");
 			break;
@@ -682,6 +1041,8 @@ RESULT eServiceApp::connectEvent(const Slot2< void, iPlayableService*, int >& ev
 
 RESULT eServiceApp::start()
 {
+	m_start_time = getMonotonicMs();
+	m_stopped = false;
 	if (!m_event_started)
 	{
 		m_event(this, evUpdatedEventInfo);
@@ -702,60 +1063,29 @@ RESULT eServiceApp::start()
 	{
 		if (!m_subservices_checked)
 		{
-			fillSubservices();
-			m_event(this, evUpdatedEventInfo);
-			m_subservices_checked = true;
-		}
-		size_t subservice_num = m_subservice_vec.size();
-		if (subservice_num)
-		{
-			M3U8StreamInfo subservice = *(m_subservice_vec.begin());
-			unsigned int subservice_flag = m_ref.getUnsignedData(7);
-			bool bitrate_selection = (!subservice_flag || subservice_flag >= SUBSERVICES_BITRATEKB_START);
-			if (bitrate_selection)
+			// variants from playlist cache, stale or missing entry is
+			// explored meanwhile, master playlist is played and player
+			// switches to the variant when they are known
+			M3U8MasterPlaylist playlist;
+			if (AsyncVariantsExplorer::getCached(m_ref.path, headers, playlist))
 			{
-				unsigned int bitrate = 0;
-				if (subservice_flag)
-					bitrate = (subservice_flag - SUBSERVICES_BITRATEKB_START);
-				else
-					bitrate = options->connectionSpeedInKb;
-				// vector is sorted from best to lowest quality in fillSubservices
-				std::vector<M3U8StreamInfo>::const_reverse_iterator it(m_subservice_vec.rbegin());
-				while(it != m_subservice_vec.rend())
-				{
-					if (it->bitrate > bitrate * 1000L)
-					{
-						if (it != m_subservice_vec.rbegin())
-							subservice = *(--it);
-						else
-							subservice = *(it);
-						break;
-					}
-					it++;
-				}
-				eDebug("eServiceApp::start - subservice(%lub/s) selected according to connection speed (%lu)",
-					subservice.bitrate, bitrate * 1000L);
+				fillSubservices(playlist);
+				m_subservices_checked = true;
+				m_event(this, evUpdatedEventInfo);
 			}
 			else
-			{
-				unsigned int subservice_idx = subservice_flag - SUBSERVICES_INDEX_START;
-				if (subservice_idx < subservice_num)
-				{
-					subservice = m_subservice_vec[subservice_idx];
-				}
-				else
-				{
-					eWarning("eServiceApp::start - subservice_idx(%u) >= subservice_num(%zu), assuming lowest quality",
-						subservice_idx, subservice_num);
-					subservice = *(m_subservice_vec.end() - 1);
-				}
-				eDebug("eServiceApp::start - subservice(%lub/s) selected according to index(%u)",
-					subservice.bitrate, subservice_idx);
-			}
-			path_str = subservice.url;
-			headers = subservice.headers;
+				exploreSubservices();
+		}
+		if (!m_subservice_vec.empty())
+		{
+			M3U8StreamInfo subservice = selectSubservice();
+			m_variant = subservice;
+			getVariantSource(subservice, path_str, headers);
 		}
 	}
+	// playlist without known variants goes through the proxy as well
+	if (m_proxy_session.empty() && isHlsUrl(path_str))
+		path_str = getProxyUrl(Url(path_str).url(), headers);
 	// don't pass fragment part to player
 	player->start(Url(path_str).url(), headers);
 	return 0;
@@ -765,7 +1095,13 @@ RESULT eServiceApp::stop()
 {
 	eDebug("eServiceApp::stop");
 	if (m_resolver) m_resolver->stop();
+	m_explorer.cancel();
+	m_subtitle_loader.cancel();
+	m_switch_down_timer->stop();
+	m_fallback_timer->stop();
+	m_stopped = true;
 	player->stop();
+	closeProxySession();
 	return 0;
 }
 
@@ -932,7 +1268,8 @@ RESULT eServiceApp::selectChannel(int i)
 RESULT eServiceApp::enableSubtitles(iSubtitleUser *user, struct SubtitleTrack &track)
 {
 	m_subtitle_sync_timer->stop();
-	m_prev_subtitle_message = NULL;
+	m_subtitle_loader.cancel();
+	m_prev_subtitle_cues.clear();
 	m_subtitle_pages = NULL;
 	m_selected_subtitle_track = NULL;
 
@@ -956,12 +1293,14 @@ RESULT eServiceApp::enableSubtitles(iSubtitleUser *user, struct SubtitleTrack &t
 	{
 		eDebug("eServiceApp::enableSubtitles - track = %d (external)", track.pid);
 		subtitleStream s = m_subtitle_streams[track_pos];
-		m_subtitle_pages = m_subtitle_manager.load(s.path);
+		// file which wasn't loaded yet is read in the background, see
+		// subtitlesLoaded
+		m_subtitle_pages = m_subtitle_manager.get(s.path, m_framerate);
 		if (m_subtitle_pages != NULL)
 		{
 			m_subtitle_sync_timer->start(1, true);
 		}
-		else
+		else if (m_subtitle_loader.start(s.path, m_framerate) < 0)
 		{
 			eWarning("eServiceApp::enableSubtitles - cannot load external subtitles");
 			return -1;
@@ -981,7 +1320,8 @@ RESULT eServiceApp::disableSubtitles()
 {
 	eDebug("eServiceApp::disableSubtitles");
 	m_subtitle_sync_timer->stop();
-	m_prev_subtitle_message = NULL;
+	m_subtitle_loader.cancel();
+	m_prev_subtitle_cues.clear();
 	m_embedded_subtitle_pages.clear();
 	m_subtitle_pages = NULL;
 	m_selected_subtitle_track = NULL;
@@ -1055,6 +1395,25 @@ RESULT eServiceApp::getCachedSubtitle(struct SubtitleTrack &track)
 	return ret;
 }
 
+// extensions of the external subtitle files, ".txt" is accepted only
+// with the name of the video as it's too common otherwise
+static const char *subtitleExtensions[] = {".srt", ".ass", ".ssa", ".vtt", ".sub", ".mpl", ".txt"};
+
+static bool isSubtitleFile(const std::string &dirname, const std::string &basename, const std::string &extension,
+		bool video_name)
+{
+	size_t count = sizeof(subtitleExtensions) / sizeof(subtitleExtensions[0]);
+	size_t i = 0;
+	while (i < count && strcasecmp(extension.c_str(), subtitleExtensions[i]))
+		i++;
+	if (i == count || (!video_name && !strcasecmp(extension.c_str(), ".txt")))
+		return false;
+	// ".sub" with ".idx" are vobsub pictures
+	if (!strcasecmp(extension.c_str(), ".sub") && !access((dirname + "/" + basename + ".idx").c_str(), F_OK))
+		return false;
+	return true;
+}
+
 RESULT eServiceApp::getSubtitleList(std::vector<struct SubtitleTrack> &subtitlelist)
 {
 	m_subtitle_tracks.clear();
@@ -1072,10 +1431,9 @@ RESULT eServiceApp::getSubtitleList(std::vector<struct SubtitleTrack> &subtitlel
 	}
 	std::string basename, extension;
 	splitExtension(m_ref.path, basename, extension);
-	std::string subtitle_path(basename + ".srt");
 
 	std::string dirname, filename;
-	splitPath(subtitle_path, dirname, filename);
+	splitPath(basename, dirname, filename);
 	// TODO 
 	//
 	// - try to find out language code from filename if possible
@@ -1083,9 +1441,15 @@ RESULT eServiceApp::getSubtitleList(std::vector<struct SubtitleTrack> &subtitlel
 	// of the list
 	//
 	// - probably whole thing should be moved to manager
-	if (!access(subtitle_path.c_str(), F_OK))
+	std::vector<std::string> video_name_paths;
+	for (size_t i = 0; i < sizeof(subtitleExtensions) / sizeof(subtitleExtensions[0]); i++)
 	{
-		addExternalTrack(subtitlelist, pid++, filename, subtitle_path);
+		std::string subtitle_path(basename + subtitleExtensions[i]);
+		if (!access(subtitle_path.c_str(), F_OK) && isSubtitleFile(dirname, filename, subtitleExtensions[i], true))
+		{
+			addExternalTrack(subtitlelist, pid++, filename + subtitleExtensions[i], subtitle_path);
+			video_name_paths.push_back(subtitle_path);
+		}
 	}
 	std::vector<std::string> directories, files;
 	if (listDir(dirname, &files, &directories) == 0)
@@ -1099,7 +1463,7 @@ RESULT eServiceApp::getSubtitleList(std::vector<struct SubtitleTrack> &subtitlel
 				for (it = subsdir_files.begin(); it != subsdir_files.end(); it++)
 				{
 					splitExtension(*it, basename, extension);
-					if (extension == ".srt")
+					if (isSubtitleFile(dirname + "/Subs", basename, extension, false))
 					{
 						addExternalTrack(subtitlelist, pid++, basename, dirname + "/Subs/" + *it);
 					}
@@ -1110,7 +1474,8 @@ RESULT eServiceApp::getSubtitleList(std::vector<struct SubtitleTrack> &subtitlel
 		{
 			splitExtension(*it, basename, extension);
 			std::string path = dirname + "/" + *it;
-			if (extension == ".srt" && subtitle_path != path)
+			if (isSubtitleFile(dirname, basename, extension, false) &&
+					std::find(video_name_paths.begin(), video_name_paths.end(), path) == video_name_paths.end())
 			{
 				addExternalTrack(subtitlelist, pid++, basename, path);
 			}
@@ -1126,8 +1491,7 @@ int eServiceApp::getNumberOfSubservices()
 	std::string path_str(m_ref.path);
 	if (options->HLSExplorer && path_str.find(m_resolve_uri) && !m_subservices_checked)
 	{
-		fillSubservices();
-		m_subservices_checked = true;
+		exploreSubservices();
 	}
 	eDebug("eServiceApp::getNumberOfSubservices - %zu", m_subserviceref_vec.size());
 	return m_subserviceref_vec.size();
@@ -1226,6 +1590,28 @@ int eServiceApp::getInfo(int w)
 	case sTagChannelMode:
 	case sUser+12:
 		return resIsString;
+	case sProxyCacheSize:
+	case sProxyPrefetchDepth:
+	case sProxyHits:
+	case sProxyMisses:
+	{
+		if (m_proxy_session.empty())
+			return resNA;
+		size_t cached;
+		unsigned int depth, hits, misses;
+		HlsProxy::getInstance()->getStats(cached, depth, hits, misses);
+		if (w == sProxyCacheSize)
+			return cached < INT_MAX ? cached : INT_MAX;
+		if (w == sProxyPrefetchDepth)
+			return depth;
+		return w == sProxyHits ? hits : misses;
+	}
+	case sPlayerBackend:
+		return m_backend >= 0 ? m_backend : resNA;
+	case sStartLatency:
+		if (m_start_latency < 0)
+			return resNA;
+		return m_start_latency < INT_MAX ? m_start_latency : INT_MAX;
 	case sTagTrackGain:
 	case sTagTrackPeak:
 	case sTagAlbumGain:
@@ -1484,6 +1870,66 @@ use_user_settings(PyObject *self, PyObject *args)
 	Py_RETURN_NONE;
 }
 
+static PyObject *
+player_pool_enable(PyObject *self, PyObject *args)
+{
+	bool enabled;
+	if (!PyArg_ParseTuple(args, "b", &enabled))
+		return NULL;
+	PlayerPool::getInstance()->setEnabled(enabled);
+	Py_RETURN_NONE;
+}
+
+static PyObject *
+playlist_cache_set(PyObject *self, PyObject *args)
+{
+	int ttl;
+	unsigned int maxEntries;
+	char *snapshotPath;
+	if (!PyArg_ParseTuple(args, "iIs", &ttl, &maxEntries, &snapshotPath))
+		return NULL;
+	PlaylistCache *cache = PlaylistCache::getInstance();
+	cache->setLimits(maxEntries, ttl > 0 ? ttl * 1000 : 0);
+	cache->setSnapshot(snapshotPath);
+	Py_RETURN_NONE;
+}
+
+static PyObject *
+bandwidth_estimator_set(PyObject *self, PyObject *args)
+{
+	unsigned int margin;
+	char *snapshotPath;
+	if (!PyArg_ParseTuple(args, "Is", &margin, &snapshotPath))
+		return NULL;
+	BandwidthEstimator *estimator = BandwidthEstimator::getInstance();
+	estimator->setMargin(margin);
+	estimator->setSnapshot(snapshotPath);
+	Py_RETURN_NONE;
+}
+
+static PyObject *
+hls_proxy_set(PyObject *self, PyObject *args)
+{
+	unsigned int prefetch;
+	unsigned int cacheSizeKb;
+	if (!PyArg_ParseTuple(args, "II", &prefetch, &cacheSizeKb))
+		return NULL;
+	HlsProxy::getInstance()->setLimits(prefetch, (size_t)cacheSizeKb * 1024);
+	Py_RETURN_NONE;
+}
+
+static PyObject *
+player_history_set(PyObject *self, PyObject *args)
+{
+	unsigned int mode;
+	char *snapshotPath;
+	if (!PyArg_ParseTuple(args, "Is", &mode, &snapshotPath))
+		return NULL;
+	g_playerHistory = mode <= HISTORY_FALLBACK ? mode : HISTORY_FALLBACK;
+	PlayerHistory::getInstance()->setSnapshot(g_playerHistory != HISTORY_DISABLED ? snapshotPath : "");
+	Py_RETURN_NONE;
+}
+
 static PyObject *
 servicemp3_exteplayer3_enable(PyObject *self, PyObject *args)
 {
@@ -1660,6 +2106,29 @@ serviceapp_set_setting(PyObject *self, PyObject *args)
 static PyMethodDef serviceappMethods[] = {
 	{"use_user_settings", use_user_settings, METH_NOARGS,
 	 "user settings will be used for creation of player"},
+	{"player_pool_enable", player_pool_enable, METH_VARARGS,
+	 "keep one player process started in standby, so the next service starts faster (enabled)"},
+	{"playlist_cache_set", playlist_cache_set, METH_VARARGS,
+	 "set cache of HLS master playlists (ttl, maxEntries, snapshotPath)\n\n"
+	 " ttl - in seconds cached playlist is used without request, then it's revalidated (0 - disabled)\n"
+	 " maxEntries - number of cached playlists\n"
+	 " snapshotPath - file where cache is kept over restart (\"\" - disabled)\n"
+	},
+	{"bandwidth_estimator_set", bandwidth_estimator_set, METH_VARARGS,
+	 "set estimation of bandwidth used for automatic HLS variant selection (margin, snapshotPath)\n\n"
+	 " margin - percentage of measured bandwidth which variant may use <0, 100> (0 - disabled)\n"
+	 " snapshotPath - file where estimates are kept over restart (\"\" - disabled)\n"
+	},
+	{"hls_proxy_set", hls_proxy_set, METH_VARARGS,
+	 "set local proxy of HLS streams with segment prefetch (prefetch, cacheSizeKb)\n\n"
+	 " prefetch - number of next segments downloaded in advance (0 - proxy disabled)\n"
+	 " cacheSizeKb - memory for downloaded segments\n"
+	},
+	{"player_history_set", player_history_set, METH_VARARGS,
+	 "set history of players which is used to choose backend of the stream (mode, snapshotPath)\n\n"
+	 " mode - (0 - disabled, 1 - backend which played the stream best, 2 - also try other backend when player fails)\n"
+	 " snapshotPath - file where history is kept over restart (\"\" - disabled)\n"
+	},
 	{"servicemp3_exteplayer3_enable", servicemp3_exteplayer3_enable, METH_NOARGS,
 	 "use ffmpeg based extplayer3, when servicemp3 is replaced by serviceapp"},
 	{"servicemp3_gstplayer_enable", servicemp3_gstplayer_enable, METH_NOARGS,
@@ -12,6 +12,8 @@
 #include "extplayer.h"
 #include "scriptrun.h"
 #include "m3u8.h"
+#include "asyncexplorer.h"
+#include "asyncsubtitles.h"
 
 struct eServiceAppOptions
 {
@@ -43,8 +45,44 @@ class eServiceApp: public Object,
 
 	std::vector<eServiceReference> m_subserviceref_vec;
 	std::vector<M3U8StreamInfo> m_subservice_vec;
+	M3U8MasterPlaylist m_playlist;
 	bool m_subservices_checked;
-	void fillSubservices();
+	AsyncVariantsExplorer m_explorer;
+	void fillSubservices(const M3U8MasterPlaylist &playlist);
+	void exploreSubservices();
+	void subservicesExplored(int success);
+	M3U8StreamInfo selectSubservice();
+	void getVariantSource(const M3U8StreamInfo &variant, std::string &path, HeaderMap &headers);
+
+	// played variant, when it was selected automatically player is
+	// restarted on lower variant after repeated underruns
+	M3U8StreamInfo m_variant;
+	bool m_variant_auto;
+	std::vector<int64_t> m_underruns;
+	ePtr<eTimer> m_switch_down_timer;
+	int m_resume_position;
+	void switchDown();
+	void switchVariant(const M3U8StreamInfo &variant);
+
+	// HLS is played through local segment prefetch proxy when enabled
+	std::string m_proxy_session;
+	std::string getProxyUrl(const std::string &url, const HeaderMap &headers);
+	void closeProxySession();
+
+	// backend chosen by the history of the url, on failure before the
+	// first frame the other backend is tried once when fallback is enabled
+	int m_backend;
+	HeaderMap m_backend_options;
+	unsigned long m_history_bitrate;
+	bool m_backend_started;
+	bool m_backend_failed;
+	bool m_backend_fallback;
+	bool m_stopped;
+	int64_t m_start_latency;
+	ePtr<eTimer> m_fallback_timer;
+	void selectBackend();
+	bool backendFailed();
+	void fallbackBackend();
 
 #if SIGCXX_MAJOR_VERSION == 2
 	sigc::signal2<void,iPlayableService*,int> m_event;
@@ -62,25 +100,27 @@ class eServiceApp: public Object,
 	bool m_paused;
 	int m_framerate, m_width, m_height, m_progressive;
 
-	typedef std::map<uint32_t, subtitleMessage> subtitle_pages_map;
-	typedef std::pair<uint32_t, subtitleMessage> subtitle_pages_map_pair;
 	typedef std::map<SubtitleTrack, subtitleStream> subtitle_track_stream_map;
 
 	std::vector<SubtitleTrack> m_subtitle_tracks;
 	std::vector<subtitleStream> m_subtitle_streams;
 
-	subtitle_pages_map m_embedded_subtitle_pages;
-	subtitle_pages_map const *m_subtitle_pages;
+	EmbeddedSubtitleTimeline m_embedded_subtitle_pages;
+	SubtitleTimeline const *m_subtitle_pages;
 	SubtitleTrack const *m_selected_subtitle_track;
-	subtitleMessage const *m_prev_subtitle_message;
+	// ids of the cues on the screen
+	std::vector<uint32_t> m_prev_subtitle_cues;
 	ePtr<eTimer> m_subtitle_sync_timer;
 	iSubtitleUser *m_subtitle_widget;
 	SubtitleManager m_subtitle_manager;
-	pts_t m_prev_subtitle_fps;
+	AsyncSubtitleLoader m_subtitle_loader;
+	// playback time of a time of external subtitles
+	double m_subtitle_scale;
 	ePtr<eTimer> m_event_updated_info_timer;
 
 	pts_t m_prev_decoder_time;
 	int m_decoder_time_valid_state;
+	int64_t m_start_time;
 
 	ssize_t getTrackPosition(const SubtitleTrack &track);
 	void addEmbeddedTrack(std::vector<struct SubtitleTrack> &, subtitleStream &s, int pid);
@@ -89,6 +129,7 @@ class eServiceApp: public Object,
 	static bool isExternalTrack(const SubtitleTrack &track);
 	void pullSubtitles();
 	void pushSubtitles();
+	void subtitlesLoaded(int success);
 	void signalEventUpdatedInfo();
 	void urlResolved(int success);
 
@@ -100,6 +141,10 @@ class eServiceApp: public Object,
 	void gotExtPlayerMessage(int message);
 
 public:
+	// statistics of the HLS proxy in getInfo, sUser+12 is error message,
+	// then backend (0 - exteplayer3, 1 - gstplayer) and time to first frame in ms
+	enum { sProxyCacheSize = sUser + 13, sProxyPrefetchDepth, sProxyHits, sProxyMisses, sPlayerBackend, sStartLatency };
+
 	eServiceApp(eServiceReference ref);
 	~eServiceApp();
 
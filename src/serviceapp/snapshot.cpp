@@ -0,0 +1,99 @@
+#include <fcntl.h>
+#include <stdio.h>
+#include <string.h>
+#include <unistd.h>
+
+#include "common.h"
+#include "snapshot.h"
+
+#define SNAPSHOT_INTERVAL 60000
+
+SnapshotStore::SnapshotStore(const char *name, const char *header):
+    mName(name),
+    mHeader(header),
+    mDirty(false),
+    mSaved(0)
+{
+    pthread_mutex_init(&mMutex, NULL);
+}
+
+SnapshotStore::~SnapshotStore()
+{
+    pthread_mutex_destroy(&mMutex);
+}
+
+int SnapshotStore::setSnapshot(const std::string &path)
+{
+    int ret = 0;
+    pthread_mutex_lock(&mMutex);
+    if (path != mSnapshotPath)
+    {
+        saveLocked(true);
+        mSnapshotPath = path;
+        if (!path.empty())
+            ret = loadLocked();
+    }
+    pthread_mutex_unlock(&mMutex);
+    return ret;
+}
+
+int SnapshotStore::save()
+{
+    pthread_mutex_lock(&mMutex);
+    mDirty = true;
+    saveLocked(true);
+    bool saved = !mDirty;
+    pthread_mutex_unlock(&mMutex);
+    return saved ? 0 : -1;
+}
+
+void SnapshotStore::saveLocked(bool force)
+{
+    if (mSnapshotPath.empty() || !mDirty)
+        return;
+    int64_t now = getMonotonicMs();
+    if (!force && mSaved && now - mSaved < SNAPSHOT_INTERVAL)
+        return;
+    mSaved = now;
+    std::string tmpPath = mSnapshotPath + ".tmp";
+    // records may carry private data of the user, file is readable only
+    // by the owner, leftover of failed write may have other mode
+    unlink(tmpPath.c_str());
+    int fd = open(tmpPath.c_str(), O_WRONLY | O_CREAT | O_EXCL | O_CLOEXEC, 0600);
+    FILE *f = fd < 0 ? NULL : fdopen(fd, "w");
+    if (f == NULL)
+    {
+        if (fd >= 0)
+            close(fd);
+        fprintf(stderr, "[%s] cannot write snapshot %s\n", mName, tmpPath.c_str());
+        return;
+    }
+    fprintf(f, "%s\n", mHeader);
+    writeSnapshot(f);
+    bool ok = !ferror(f);
+    ok &= fclose(f) == 0;
+    if (!ok || rename(tmpPath.c_str(), mSnapshotPath.c_str()) < 0)
+    {
+        fprintf(stderr, "[%s] cannot write snapshot %s\n", mName, mSnapshotPath.c_str());
+        unlink(tmpPath.c_str());
+        return;
+    }
+    mDirty = false;
+}
+
+int SnapshotStore::loadLocked()
+{
+    FILE *f = fopen(mSnapshotPath.c_str(), "r");
+    if (f == NULL)
+        return -1;
+    char header[128];
+    size_t loaded = 0;
+    bool valid = fgets(header, sizeof(header), f) && !strncmp(header, mHeader, strlen(mHeader)) &&
+            !strcmp(header + strlen(mHeader), "\n");
+    if (valid)
+        valid = readSnapshot(f, loaded);
+    fclose(f);
+    fprintf(stderr, "[%s] loaded %zu records from %s%s\n", mName, loaded, mSnapshotPath.c_str(),
+            valid ? "" : ", snapshot is corrupted");
+    return valid ? 0 : -1;
+}
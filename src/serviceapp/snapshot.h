@@ -0,0 +1,48 @@
+#ifndef __snapshot_h
+#define __snapshot_h
+
+#include <pthread.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <string>
+
+// Base of the process-wide stores which can be saved to a snapshot file,
+// so they survive restart of the enigma2.
+//
+// Store guards its content by mMutex of the base. Change marks the
+// snapshot dirty and it's written at most once a minute, to a temporary
+// file which replaces the old one, so power loss doesn't leave it half
+// written. First line of the file identifies the store and the version of
+// its format, file with other one is ignored.
+class SnapshotStore
+{
+    const char *mName;
+    const char *mHeader;
+    std::string mSnapshotPath;
+    bool mDirty;
+    int64_t mSaved;
+
+    int loadLocked();
+protected:
+    pthread_mutex_t mMutex;
+
+    // name is prefix of the log messages
+    SnapshotStore(const char *name, const char *header);
+    virtual ~SnapshotStore();
+
+    // lines after the header, called with the mutex locked
+    virtual void writeSnapshot(FILE *f) = 0;
+    // returns false when the file is corrupted, loaded is number of records
+    virtual bool readSnapshot(FILE *f, size_t &loaded) = 0;
+
+    // called with the mutex locked, dirty snapshot is written within the
+    // interval unless force, destructor of the store has to save it
+    void setDirty(bool dirty) { mDirty = dirty; }
+    void saveLocked(bool force);
+public:
+    // loads records of the snapshot file, empty path disables the snapshot
+    int setSnapshot(const std::string &path);
+    int save();
+};
+
+#endif
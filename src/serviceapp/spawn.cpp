@@ -0,0 +1,141 @@
+#include <dirent.h>
+#include <errno.h>
+#include <fcntl.h>
+#include <stdlib.h>
+#include <unistd.h>
+#include <sys/resource.h>
+#include <sys/syscall.h>
+
+#include "spawn.h"
+
+static void closePipe(int p[])
+{
+    if (p[0] != -1)
+        close(p[0]);
+    if (p[1] != -1)
+        close(p[1]);
+}
+
+// highest descriptor currently open
+static int getMaxFd()
+{
+    int maxfd = -1;
+    DIR *dir = opendir("/proc/self/fd");
+    if (dir)
+    {
+        struct dirent *entry;
+        while ((entry = readdir(dir)) != NULL)
+        {
+            int fd = atoi(entry->d_name);
+            if (fd > maxfd)
+                maxfd = fd;
+        }
+        closedir(dir);
+        return maxfd;
+    }
+    struct rlimit rl;
+    if (getrlimit(RLIMIT_NOFILE, &rl) == 0 && rl.rlim_cur != RLIM_INFINITY)
+        return rl.rlim_cur - 1;
+    return 1023;
+}
+
+// only async-signal-safe calls from here, we share memory with the parent
+static int moveFd(int fd, int target)
+{
+    if (fd == target)
+    {
+        // dup2 would keep FD_CLOEXEC
+        return fcntl(fd, F_SETFD, 0);
+    }
+    return dup2(fd, target);
+}
+
+static void closeFrom(int lowfd, int maxfd)
+{
+#ifdef SYS_close_range
+    if (maxfd < 0 && syscall(SYS_close_range, lowfd, ~0U, 0) == 0)
+        return;
+#endif
+    for (int fd = lowfd; fd <= maxfd; fd++)
+        close(fd);
+}
+
+// close_range is available since linux 5.9, returns -1 when it's supported
+// or highest descriptor to close one by one
+static int getCloseLimit()
+{
+#ifdef SYS_close_range
+    static int supported = -1;
+    if (supported == -1)
+    {
+        // nothing is open that high, just checks if kernel knows the call
+        supported = syscall(SYS_close_range, ~0U - 1, ~0U, 0) == 0;
+    }
+    if (supported)
+        return -1;
+#endif
+    // +2 for descriptors we may duplicate in the child
+    return getMaxFd() + 2;
+}
+
+int bidirpipe(int pfd[], const char *cmd , const char * const argv[], const char *cwd )
+{
+    int pfdin[2] = {-1, -1};  /* from child to parent */
+    int pfdout[2] = {-1, -1}; /* from parent to child */
+    int pfderr[2] = {-1, -1}; /* stderr from child to parent */
+    int pid;       /* child's pid */
+
+    // close-on-exec, so other threads starting processes don't pass them on
+    if (pipe2(pfdin, O_CLOEXEC) == -1 || pipe2(pfdout, O_CLOEXEC) == -1 || pipe2(pfderr, O_CLOEXEC) == -1)
+    {
+        closePipe(pfdin);
+        closePipe(pfdout);
+        closePipe(pfderr);
+        return(-1);
+    }
+
+    int maxfd = getCloseLimit();
+
+    if ( ( pid = vfork() ) == -1 )
+    {
+        closePipe(pfdin);
+        closePipe(pfdout);
+        closePipe(pfderr);
+        return(-1);
+    }
+    else if (pid == 0) /* child process */
+    {
+        setsid();
+        // descriptors of the child end up at 0, 1, 2, make sure we don't
+        // overwrite one of them by another before it's moved, we don't
+        // touch parent's variables, memory is shared
+        int out = pfdin[1], err = pfderr[1];
+        if (out == 0)
+            out = fcntl(out, F_DUPFD, 3);
+        if (err == 0 || err == 1)
+            err = fcntl(err, F_DUPFD, 3);
+
+        if (moveFd(pfdout[0], 0) == -1 || moveFd(out, 1) == -1 || moveFd(err, 2) == -1)
+            _exit(127);
+
+        closeFrom(3, maxfd);
+
+        if (cwd && chdir(cwd) == -1)
+            _exit(127);
+
+        execvp(cmd, (char * const *)argv);
+                /* the vfork will actually suspend the parent thread until execvp is called. thus it's ok to use the shared arg/cmdline pointers here. */
+        _exit(127);
+    }
+    close(pfdout[0]);
+    close(pfdin[1]);
+    close(pfderr[1]);
+
+    pfd[0] = pfdin[0];
+    pfd[1] = pfdout[1];
+    pfd[2] = pfderr[0];
+    for (int i = 0; i < 3; i++)
+        fcntl(pfd[i], F_SETFL, O_NONBLOCK);
+
+    return(pid);
+}
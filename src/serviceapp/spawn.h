@@ -0,0 +1,10 @@
+#ifndef __spawn_h
+#define __spawn_h
+
+// Starts cmd in new session with stdin, stdout and stderr connected to pipes,
+// pfd = {child's stdout, child's stdin, child's stderr}, parent's ends
+// are non-blocking and close-on-exec. No other descriptor of the parent
+// is passed to the child. Returns pid of the child or -1.
+int bidirpipe(int pfd[], const char *cmd , const char * const argv[], const char *cwd );
+
+#endif
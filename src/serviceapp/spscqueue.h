@@ -0,0 +1,76 @@
+#ifndef __spscqueue_h
+#define __spscqueue_h
+
+#include <stddef.h>
+#include <atomic>
+#include <utility>
+#include <vector>
+
+// Bounded queue for passing items from one producer thread
+// to one consumer thread without locking.
+//
+// Items are moved in and out of preallocated ring, producer only
+// writes mTail and consumer only writes mHead, so each side just
+// has to see the other's index to know what is safe to touch.
+template <typename T>
+class SPSCQueue
+{
+	std::vector<T> mRing;
+	size_t mMask;
+	// keep indexes on separate cache lines, so producer and consumer
+	// don't invalidate each other on every operation
+	alignas(64) std::atomic<size_t> mHead;
+	alignas(64) std::atomic<size_t> mTail;
+	alignas(64) std::atomic<unsigned int> mDropped;
+
+	SPSCQueue(const SPSCQueue&);
+	SPSCQueue& operator=(const SPSCQueue&);
+public:
+	// capacity is rounded up to power of two
+	SPSCQueue(size_t capacity):
+		mHead(0),
+		mTail(0),
+		mDropped(0)
+	{
+		size_t size = 1;
+		while (size < capacity)
+			size <<= 1;
+		mRing.resize(size);
+		mMask = size - 1;
+	}
+
+	// producer, returns false when queue is full, item is then left untouched
+	bool push(T &item)
+	{
+		size_t tail = mTail.load(std::memory_order_relaxed);
+		if (tail - mHead.load(std::memory_order_acquire) > mMask)
+		{
+			mDropped.fetch_add(1, std::memory_order_relaxed);
+			return false;
+		}
+		mRing[tail & mMask] = std::move(item);
+		mTail.store(tail + 1, std::memory_order_release);
+		return true;
+	}
+
+	// consumer, returns false when queue is empty
+	bool pop(T &item)
+	{
+		size_t head = mHead.load(std::memory_order_relaxed);
+		if (head == mTail.load(std::memory_order_acquire))
+			return false;
+		item = std::move(mRing[head & mMask]);
+		mHead.store(head + 1, std::memory_order_release);
+		return true;
+	}
+
+	bool empty() const
+	{
+		return mHead.load(std::memory_order_acquire) == mTail.load(std::memory_order_acquire);
+	}
+	size_t capacity() const {return mMask + 1;}
+	// number of items rejected by push, because queue was full
+	unsigned int dropped() const {return mDropped.load(std::memory_order_relaxed);}
+};
+
+#endif
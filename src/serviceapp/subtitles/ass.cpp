@@ -0,0 +1,297 @@
+// file is scanned in one pass as the subrip files, styles have to be
+// defined before the events which use them, as libass expects it too
+
+#include <strings.h>
+
+#include "ass.h"
+#include "scanner.h"
+
+#define MAX_FIELDS 32
+
+enum
+{
+    SECTION_OTHER,
+    SECTION_STYLES,
+    SECTION_EVENTS
+};
+
+enum
+{
+    STYLE_ITALIC = 1,
+    STYLE_BOLD = 2,
+    STYLE_UNDERLINE = 4
+};
+
+static const char *styleTags[][2] = {{"<i>", "</i>"}, {"<b>", "</b>"}, {"<u>", "</u>"}};
+
+// formats which are used when the sections don't have "Format:" line,
+// fields of the SSA are at the same positions
+static const char defaultStyleFormat[] = "Name, Fontname, Fontsize, PrimaryColour, SecondaryColour, "
+        "OutlineColour, BackColour, Bold, Italic, Underline";
+static const char defaultEventFormat[] = "Layer, Start, End, Style, Name, MarginL, MarginR, MarginV, Effect, Text";
+
+void AssParser::parseFormat(const char *p, const char *end, Format &format)
+{
+    static const struct
+    {
+        const char *name;
+        int Format::*index;
+    } known[] =
+    {
+        {"Name", &Format::name}, {"Start", &Format::start}, {"End", &Format::end}, {"Style", &Format::style},
+        {"Text", &Format::text}, {"Bold", &Format::bold}, {"Italic", &Format::italic},
+        {"Underline", &Format::underline},
+    };
+    format.count = 0;
+    for (size_t i = 0; i < sizeof(known) / sizeof(known[0]); i++)
+        format.*known[i].index = -1;
+    while (p < end && format.count < MAX_FIELDS)
+    {
+        p = skipBlank(p, end);
+        const char *comma = (const char *) memchr(p, ',', end - p);
+        size_t field_len = trimmedLength(p, (comma ? comma : end) - p);
+        for (size_t i = 0; i < sizeof(known) / sizeof(known[0]); i++)
+        {
+            if (field_len == strlen(known[i].name) && !strncasecmp(p, known[i].name, field_len))
+                format.*known[i].index = format.count;
+        }
+        format.count++;
+        p = comma ? comma + 1 : end;
+    }
+}
+
+// values of "Style:" or "Dialogue:" line, the last field takes the rest
+// of the line as the text may contain commas, returns number of fields
+int AssParser::splitFields(const char *p, const char *end, int count, const char **fields, size_t *lens)
+{
+    int i = 0;
+    while (i < count)
+    {
+        p = skipBlank(p, end);
+        const char *comma = i < count - 1 ? (const char *) memchr(p, ',', end - p) : NULL;
+        const char *field_end = comma ? comma : end;
+        fields[i] = p;
+        lens[i++] = trimmedLength(p, field_end - p);
+        if (!comma)
+            break;
+        p = comma + 1;
+    }
+    return i;
+}
+
+// tags of "{...}" block which change the style, "\b700", "\i0", "\r"...
+// are distinguished from "\bord2" or "\pos(...)" by the digit
+void AssParser::parseOverride(const char *p, const char *end, unsigned int base, unsigned int &wanted, bool &drawing)
+{
+    while ((p = (const char *) memchr(p, '\\', end - p)) != NULL && ++p < end)
+    {
+        char tag = *p++;
+        if (tag == 'r')
+        {
+            wanted = base;
+            continue;
+        }
+        unsigned int flag = tag == 'i' ? STYLE_ITALIC : tag == 'b' ? STYLE_BOLD : tag == 'u' ? STYLE_UNDERLINE : 0;
+        if ((!flag && tag != 'p') || (p < end && *p != '\\' && (*p < '0' || *p > '9')))
+            continue;
+        int value = scanNumber(p, end, 4);
+        if (tag == 'p')
+            drawing = value > 0;
+        else if (value < 0)
+            wanted = (wanted & ~flag) | (base & flag);
+        else if (value)
+            wanted |= flag;
+        else
+            wanted &= ~flag;
+    }
+}
+
+// boolean of the styles is "-1" or "1", "0" when it's not set
+static bool isSet(const char **fields, const size_t *lens, int count, int index)
+{
+    if (index < 0 || index >= count)
+        return false;
+    const char *p = fields[index], *end = p + lens[index];
+    if (p < end && *p == '-')
+        p++;
+    return scanNumber(p, end, 9) > 0;
+}
+
+static void switchTags(unsigned int &open, unsigned int wanted, SubtitleCues &cues)
+{
+    if (open == wanted)
+        return;
+    // closed and opened again, so the tags are nested properly
+    for (int i = 2; i >= 0; i--)
+    {
+        if (open & (1 << i))
+            cues.appendText(styleTags[i][1], 4);
+    }
+    for (int i = 0; i < 3; i++)
+    {
+        if (wanted & (1 << i))
+            cues.appendText(styleTags[i][0], 3);
+    }
+    open = wanted;
+}
+
+void AssParser::appendText(const char *text, size_t len, unsigned int base, SubtitleCues &cues)
+{
+    const char *p = text, *end = text + len, *run = text;
+    unsigned int open = 0, wanted = base;
+    bool drawing = false;
+    while (p < end)
+    {
+        const char *close = NULL;
+        const char *replacement = NULL;
+        if (*p == '{')
+            close = (const char *) memchr(p, '}', end - p);
+        else if (*p == '\\' && p + 1 < end)
+            replacement = p[1] == 'N' ? "\n" : p[1] == 'n' || p[1] == 'h' ? " " : NULL;
+        if (!close && !replacement)
+        {
+            p++;
+            continue;
+        }
+        if (p > run && !drawing)
+        {
+            switchTags(open, wanted, cues);
+            cues.appendText(run, p - run);
+        }
+        if (close)
+        {
+            parseOverride(p + 1, close, base, wanted, drawing);
+            p = close + 1;
+        }
+        else
+        {
+            if (!drawing)
+            {
+                switchTags(open, wanted, cues);
+                cues.appendText(replacement, 1);
+            }
+            p += 2;
+        }
+        run = p;
+    }
+    if (p > run && !drawing)
+    {
+        switchTags(open, wanted, cues);
+        cues.appendText(run, p - run);
+    }
+    switchTags(open, 0, cues);
+}
+
+int AssParser::_probe(const char *data, size_t len)
+{
+    SubtitleScanner scanner(data, len);
+    const char *line;
+    size_t line_len;
+
+    do
+    {
+        if (!scanner.getLine(line, line_len))
+            return PROB_SCORE_MIN;
+    } while (!trimmedLength(line, line_len));
+
+    if (hasPrefix(line, line_len, "[Script Info]"))
+        return PROB_SCORE_MAX;
+    return PROB_SCORE_MIN;
+}
+
+bool AssParser::_parse(const char *data, size_t len, int fps, SubtitleCues &cues)
+{
+    SubtitleScanner scanner(data, len);
+    const char *line, *fields[MAX_FIELDS];
+    size_t line_len, lens[MAX_FIELDS];
+    int section = SECTION_OTHER;
+    Format style_format, event_format;
+
+    parseFormat(defaultStyleFormat, defaultStyleFormat + sizeof(defaultStyleFormat) - 1, style_format);
+    parseFormat(defaultEventFormat, defaultEventFormat + sizeof(defaultEventFormat) - 1, event_format);
+    m_styles.clear();
+    // dialogue line takes 100 bytes of the file on average, half of it
+    // are times, margins and override tags
+    cues.reserve(len / 100, len / 2);
+    while (scanner.getLine(line, line_len))
+    {
+        const char *end = line + line_len;
+        line = skipBlank(line, end);
+        line_len = end - line;
+        if (!line_len)
+            continue;
+
+        if (line[0] == '[')
+        {
+            if (hasPrefix(line, line_len, "[Events]"))
+                section = SECTION_EVENTS;
+            else if (memmem(line, line_len, "Styles", 6))
+                section = SECTION_STYLES;
+            else
+                section = SECTION_OTHER;
+            continue;
+        }
+        if (section == SECTION_OTHER)
+            continue;
+
+        Format &format = section == SECTION_STYLES ? style_format : event_format;
+        if (hasPrefix(line, line_len, "Format:"))
+        {
+            parseFormat(line + 7, end, format);
+            continue;
+        }
+        size_t prefix = section == SECTION_STYLES ? 6 : 9;
+        if (!hasPrefix(line, line_len, section == SECTION_STYLES ? "Style:" : "Dialogue:"))
+            continue;
+        int count = splitFields(line + prefix, end, format.count, fields, lens);
+
+        // names of the styles may start with '*', as libass does
+        int name = section == SECTION_STYLES ? format.name : format.style;
+        if (name >= count)
+            continue;
+        std::string style;
+        if (name >= 0)
+        {
+            const char *p = fields[name];
+            size_t style_len = lens[name];
+            if (style_len && *p == '*')
+            {
+                p++;
+                style_len--;
+            }
+            style.assign(p, style_len);
+        }
+
+        if (section == SECTION_STYLES)
+        {
+            unsigned int flags = 0;
+            if (isSet(fields, lens, count, format.bold))
+                flags |= STYLE_BOLD;
+            if (isSet(fields, lens, count, format.italic))
+                flags |= STYLE_ITALIC;
+            if (isSet(fields, lens, count, format.underline))
+                flags |= STYLE_UNDERLINE;
+            m_styles[style] = flags;
+            continue;
+        }
+
+        uint32_t start_ms, end_ms;
+        const char *p;
+        if (format.start < 0 || format.end < 0 || format.text < 0 || format.start >= count ||
+                format.end >= count || format.text >= count)
+            continue;
+        p = fields[format.start];
+        if (!scanClock(p, p + lens[format.start], start_ms))
+            continue;
+        p = fields[format.end];
+        if (!scanClock(p, p + lens[format.end], end_ms))
+            continue;
+        std::map<std::string, unsigned int>::const_iterator it = m_styles.find(style);
+        appendText(fields[format.text], lens[format.text], it != m_styles.end() ? it->second : 0, cues);
+        // drawings only
+        if (!cues.pendingText())
+            continue;
+        cues.add(start_ms, end_ms);
+    }
+    return true;
+}
@@ -0,0 +1,31 @@
+#ifndef __assparser
+#define __assparser
+#include <stdint.h>
+#include <map>
+
+#include "subtitles.h"
+
+// SubStation Alpha and Advanced SubStation Alpha scripts.
+//
+// Only text of the dialogues is kept. Italic, bold and underline of the
+// styles and of the override tags are converted to the tags of subrip
+// text, other override tags and drawings are dropped.
+class AssParser: public BaseSubtitleParser
+{
+    struct Format
+    {
+        int count, name, start, end, style, text, bold, italic, underline;
+    };
+    static void parseFormat(const char *p, const char *end, Format &format);
+    static int splitFields(const char *p, const char *end, int count, const char **fields, size_t *lens);
+    static void parseOverride(const char *p, const char *end, unsigned int base, unsigned int &wanted, bool &drawing);
+    static void appendText(const char *text, size_t len, unsigned int base, SubtitleCues &cues);
+    std::map<std::string, unsigned int> m_styles;
+public:
+    AssParser(){}
+    ~AssParser(){}
+    std::string name(){return "AssParser";}
+    int _probe(const char *data, size_t len);
+    bool _parse(const char *data, size_t len, int fps, SubtitleCues &cues);
+};
+#endif
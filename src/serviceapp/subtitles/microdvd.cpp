@@ -0,0 +1,173 @@
+// adapted ffmpeg microdvddec sources:
+// https://github.com/FFmpeg/FFmpeg/blob/master/libavformat/microdvddec.c
+// https://github.com/FFmpeg/FFmpeg/blob/master/libavcodec/microdvddec.c
+//
+// file is scanned in one pass, only italic, bold and underline of the
+// control codes are kept
+
+#include "microdvd.h"
+#include "scanner.h"
+
+// frames per 1000 seconds, as the fps of the service
+#define DEFAULT_FPS 23976
+// cue without end frame is shown until the next one, the last one for
+// this long
+#define DEFAULT_DURATION 3000
+
+static const char *styleTags[][2] = {{"<i>", "</i>"}, {"<b>", "</b>"}, {"<u>", "</u>"}};
+
+// "{start}{end}" or "{start}{}", end is -1 when it's not set
+bool MicroDvdParser::getFrames(const char *line, size_t len, int &start, int &end, const char **text)
+{
+    const char *p = line, *line_end = line + len;
+    p = skipBlank(p, line_end);
+    if (!scanBracketNumber(p, line_end, '{', '}', start) || start < 0)
+        return false;
+    if (!scanBracketNumber(p, line_end, '{', '}', end))
+        return false;
+    if (text)
+        *text = p;
+    return true;
+}
+
+// fps of "{1}{1}23.976" line, -1 when it isn't such line
+int MicroDvdParser::getFps(const char *line, size_t len)
+{
+    int start, end;
+    const char *p, *line_end = line + trimmedLength(line, len);
+    if (!getFrames(line, len, start, end, &p) || start > 1 || end < 0 || end > 1)
+        return -1;
+    int fps = scanNumber(p, line_end, 3);
+    if (fps < 0)
+        return -1;
+    fps *= 1000;
+    if (p < line_end && *p == '.')
+    {
+        p++;
+        for (int scale = 100; p < line_end && *p >= '0' && *p <= '9'; scale /= 10)
+            fps += (*p++ - '0') * scale;
+    }
+    if (p != line_end || fps <= 3000 || fps >= 100000)
+        return -1;
+    return fps;
+}
+
+// lines are separated by '|', "{y:i}" at the start of the line makes it
+// italic, "{Y:i}" makes italic the rest of the cue
+void MicroDvdParser::appendText(const char *text, size_t len, SubtitleCues &cues)
+{
+    const char *p = text, *end = text + len;
+    unsigned int cue_flags = 0;
+    while (p <= end)
+    {
+        unsigned int flags = cue_flags;
+        while (end - p > 3 && p[0] == '{' && p[2] == ':' && ((p[1] >= 'a' && p[1] <= 'z') || (p[1] >= 'A' && p[1] <= 'Z')))
+        {
+            const char *close = (const char *) memchr(p, '}', end - p);
+            if (!close)
+                break;
+            if (p[1] == 'y' || p[1] == 'Y')
+            {
+                unsigned int code_flags = 0;
+                for (const char *c = p + 3; c < close; c++)
+                    code_flags |= *c == 'i' ? 1 : *c == 'b' ? 2 : *c == 'u' ? 4 : 0;
+                flags |= code_flags;
+                if (p[1] == 'Y')
+                    cue_flags |= code_flags;
+            }
+            p = close + 1;
+        }
+        const char *bar = (const char *) memchr(p, '|', end - p);
+        const char *line_end = bar ? bar : end;
+        for (int i = 0; i < 3; i++)
+        {
+            if (flags & (1 << i))
+                cues.appendText(styleTags[i][0], 3);
+        }
+        cues.appendText(p, line_end - p);
+        for (int i = 2; i >= 0; i--)
+        {
+            if (flags & (1 << i))
+                cues.appendText(styleTags[i][1], 4);
+        }
+        cues.appendText("\n", 1);
+        p = line_end + 1;
+    }
+}
+
+int MicroDvdParser::_probe(const char *data, size_t len)
+{
+    SubtitleScanner scanner(data, len);
+    const char *line;
+    size_t line_len;
+    int start, end, lines = 0;
+
+    // first three lines, if there are so many
+    while (lines < 3 && scanner.getLine(line, line_len))
+    {
+        if (!trimmedLength(line, line_len))
+            continue;
+        if (!getFrames(line, line_len, start, end, NULL))
+            return PROB_SCORE_MIN;
+        lines++;
+    }
+    return lines ? PROB_SCORE_MAX : PROB_SCORE_MIN;
+}
+
+bool MicroDvdParser::_parse(const char *data, size_t len, int fps, SubtitleCues &cues)
+{
+    SubtitleScanner scanner(data, len);
+    const char *line, *text;
+    size_t line_len;
+    bool first = true;
+
+    // cue takes 50 bytes of the file on average
+    cues.reserve(len / 50, len);
+    while (scanner.getLine(line, line_len))
+    {
+        int start, end;
+        if (!trimmedLength(line, line_len))
+            continue;
+        if (first)
+        {
+            first = false;
+            // frames were written for the frame rate of the header,
+            // whatever the video is
+            int file_fps = getFps(line, line_len);
+            if (file_fps > 0)
+            {
+                fps = file_fps;
+                continue;
+            }
+            cues.setVideoFps(fps > 0 ? fps : -1);
+        }
+        if (fps <= 0)
+            fps = DEFAULT_FPS;
+        if (!getFrames(line, line_len, start, end, &text))
+            continue;
+
+        uint64_t start_ms = (uint64_t) start * 1000000 / fps, end_ms;
+        if (end < 0)
+        {
+            // start of the next cue
+            SubtitleScanner next = scanner;
+            const char *next_line;
+            size_t next_len;
+            int next_start = -1, next_end;
+            while (next.getLine(next_line, next_len))
+            {
+                if (getFrames(next_line, next_len, next_start, next_end, NULL))
+                    break;
+                next_start = -1;
+            }
+            end_ms = next_start >= start ? (uint64_t) next_start * 1000000 / fps : start_ms + DEFAULT_DURATION;
+        }
+        else
+            end_ms = (uint64_t) end * 1000000 / fps;
+        if (end_ms > UINT32_MAX)
+            continue;
+        appendText(text, line + line_len - text, cues);
+        cues.add(start_ms, end_ms);
+    }
+    return true;
+}
@@ -0,0 +1,23 @@
+#ifndef __microdvdparser
+#define __microdvdparser
+#include <stdint.h>
+
+#include "subtitles.h"
+
+// MicroDVD files "{start}{end}text" with times in frames of the video.
+//
+// Frame rate is the one which is passed to parse, or the one of the
+// "{1}{1}23.976" line at the start of the file, 23.976 otherwise.
+class MicroDvdParser: public BaseSubtitleParser
+{
+    static bool getFrames(const char *line, size_t len, int &start, int &end, const char **text);
+    static int getFps(const char *line, size_t len);
+    static void appendText(const char *text, size_t len, SubtitleCues &cues);
+public:
+    MicroDvdParser(){}
+    ~MicroDvdParser(){}
+    std::string name(){return "MicroDvdParser";}
+    int _probe(const char *data, size_t len);
+    bool _parse(const char *data, size_t len, int fps, SubtitleCues &cues);
+};
+#endif
@@ -0,0 +1,106 @@
+// adapted ffmpeg mpl2dec sources:
+// https://github.com/FFmpeg/FFmpeg/blob/master/libavformat/mpl2dec.c
+//
+// file is scanned in one pass as the microdvd files
+
+#include "mpl2.h"
+#include "scanner.h"
+
+// cue without end is shown until the next one, the last one for this
+// long
+#define DEFAULT_DURATION 3000
+
+// "[start][end]" or "[start][]", end is -1 when it's not set
+bool Mpl2Parser::getTimes(const char *line, size_t len, int &start, int &end, const char **text)
+{
+    const char *p = line, *line_end = line + len;
+    p = skipBlank(p, line_end);
+    if (!scanBracketNumber(p, line_end, '[', ']', start) || start < 0)
+        return false;
+    if (!scanBracketNumber(p, line_end, '[', ']', end))
+        return false;
+    if (text)
+        *text = p;
+    return true;
+}
+
+// lines are separated by '|', line which starts with '/' is italic
+void Mpl2Parser::appendText(const char *text, size_t len, SubtitleCues &cues)
+{
+    const char *p = text, *end = text + len;
+    while (p <= end)
+    {
+        const char *bar = (const char *) memchr(p, '|', end - p);
+        const char *line_end = bar ? bar : end;
+        bool italic = p < line_end && *p == '/';
+        if (italic)
+        {
+            cues.appendText("<i>", 3);
+            p++;
+        }
+        cues.appendText(p, line_end - p);
+        if (italic)
+            cues.appendText("</i>", 4);
+        cues.appendText("\n", 1);
+        p = line_end + 1;
+    }
+}
+
+int Mpl2Parser::_probe(const char *data, size_t len)
+{
+    SubtitleScanner scanner(data, len);
+    const char *line;
+    size_t line_len;
+    int start, end, lines = 0;
+
+    // first two lines, if there are so many
+    while (lines < 2 && scanner.getLine(line, line_len))
+    {
+        if (!trimmedLength(line, line_len))
+            continue;
+        if (!getTimes(line, line_len, start, end, NULL))
+            return PROB_SCORE_MIN;
+        lines++;
+    }
+    return lines ? PROB_SCORE_MAX : PROB_SCORE_MIN;
+}
+
+bool Mpl2Parser::_parse(const char *data, size_t len, int fps, SubtitleCues &cues)
+{
+    SubtitleScanner scanner(data, len);
+    const char *line, *text;
+    size_t line_len;
+
+    // cue takes 50 bytes of the file on average
+    cues.reserve(len / 50, len);
+    while (scanner.getLine(line, line_len))
+    {
+        int start, end;
+        if (!getTimes(line, line_len, start, end, &text))
+            continue;
+
+        uint64_t start_ms = (uint64_t) start * 100, end_ms;
+        if (end < 0)
+        {
+            // start of the next cue
+            SubtitleScanner next = scanner;
+            const char *next_line;
+            size_t next_len;
+            int next_start = -1, next_end;
+            while (next.getLine(next_line, next_len))
+            {
+                if (getTimes(next_line, next_len, next_start, next_end, NULL))
+                    break;
+                next_start = -1;
+            }
+            end_ms = next_start >= start ? (uint64_t) next_start * 100 : start_ms + DEFAULT_DURATION;
+        }
+        else
+            end_ms = (uint64_t) end * 100;
+        if (end_ms > UINT32_MAX)
+            continue;
+        appendText(text, line + line_len - text, cues);
+        cues.add(start_ms, end_ms);
+    }
+    return true;
+}
@@ -0,0 +1,19 @@
+#ifndef __mpl2parser
+#define __mpl2parser
+#include <stdint.h>
+
+#include "subtitles.h"
+
+// MPL2 files "[start][end]text" with times in tenths of a second.
+class Mpl2Parser: public BaseSubtitleParser
+{
+    static bool getTimes(const char *line, size_t len, int &start, int &end, const char **text);
+    static void appendText(const char *text, size_t len, SubtitleCues &cues);
+public:
+    Mpl2Parser(){}
+    ~Mpl2Parser(){}
+    std::string name(){return "Mpl2Parser";}
+    int _probe(const char *data, size_t len);
+    bool _parse(const char *data, size_t len, int fps, SubtitleCues &cues);
+};
+#endif
@@ -0,0 +1,150 @@
+#ifndef __serviceapp_subtitles_scanner_h
+#define __serviceapp_subtitles_scanner_h
+
+#include <stdint.h>
+#include <string.h>
+
+// Zero-copy reader of lines of a subtitle file in memory.
+//
+// Lines point to the file data, they are not terminated and they are
+// returned without the line break, "\r\n" line breaks included.
+class SubtitleScanner
+{
+    const char *m_pos;
+    const char *m_end;
+public:
+    SubtitleScanner(const char *data, size_t len): m_pos(data), m_end(data + len){}
+    bool eof() const {return m_pos >= m_end;}
+    const char *pos() const {return m_pos;}
+
+    bool getLine(const char *&line, size_t &len)
+    {
+        if (m_pos >= m_end)
+            return false;
+        const char *nl = (const char *) memchr(m_pos, '\n', m_end - m_pos);
+        const char *line_end = nl ? nl : m_end;
+        line = m_pos;
+        len = line_end - m_pos;
+        if (len && line[len - 1] == '\r')
+            len--;
+        m_pos = nl ? nl + 1 : m_end;
+        return true;
+    }
+};
+
+static inline bool isBlank(char c)
+{
+    return c == ' ' || c == '\t';
+}
+
+static inline const char *skipBlank(const char *p, const char *end)
+{
+    while (p < end && isBlank(*p))
+        p++;
+    return p;
+}
+
+// length of the text without trailing whitespace
+static inline size_t trimmedLength(const char *text, size_t len)
+{
+    while (len && (isBlank(text[len - 1]) || text[len - 1] == '\r' || text[len - 1] == '\n' ||
+            text[len - 1] == '\v' || text[len - 1] == '\f'))
+        len--;
+    return len;
+}
+
+// parses at most maxDigits decimal digits and moves p after them,
+// returns -1 when p doesn't point to a digit
+static inline int scanNumber(const char *&p, const char *end, int maxDigits)
+{
+    int value = 0, digits = 0;
+    while (p < end && digits < maxDigits && *p >= '0' && *p <= '9')
+    {
+        value = value * 10 + (*p++ - '0');
+        digits++;
+    }
+    return digits ? value : -1;
+}
+
+// "h:mm:ss,mmm" or "h:mm:ss.mmm" as ffmpeg accepts it in srt files, hours
+// have any number of digits, minutes and seconds at most two and
+// milliseconds at most three
+static inline bool scanTimestamp(const char *&p, const char *end, uint32_t &ms)
+{
+    int hh = scanNumber(p, end, 6);
+    if (hh < 0 || p >= end || *p++ != ':')
+        return false;
+    int mm = scanNumber(p, end, 2);
+    if (mm < 0 || p >= end || *p++ != ':')
+        return false;
+    int ss = scanNumber(p, end, 2);
+    if (ss < 0 || p >= end || (*p != ',' && *p != '.'))
+        return false;
+    p++;
+    int fraction = scanNumber(p, end, 3);
+    if (fraction < 0)
+        return false;
+    uint64_t value = ((uint64_t) hh * 3600 + mm * 60 + ss) * 1000 + fraction;
+    if (value > UINT32_MAX)
+        return false;
+    ms = value;
+    return true;
+}
+
+// "h:mm:ss.cc" of ASS or "[hh:]mm:ss[.ttt]" of WebVTT, hours are
+// optional and fraction of any number of digits is scaled to milliseconds
+static inline bool scanClock(const char *&p, const char *end, uint32_t &ms)
+{
+    int first = scanNumber(p, end, 6);
+    if (first < 0 || p >= end || *p++ != ':')
+        return false;
+    int second = scanNumber(p, end, 2);
+    if (second < 0)
+        return false;
+    int hh = 0, mm = first, ss = second;
+    if (p < end && *p == ':')
+    {
+        p++;
+        hh = first;
+        mm = second;
+        ss = scanNumber(p, end, 2);
+        if (ss < 0)
+            return false;
+    }
+    int fraction = 0;
+    if (p < end && (*p == '.' || *p == ','))
+    {
+        p++;
+        if (p >= end || *p < '0' || *p > '9')
+            return false;
+        for (int scale = 100; p < end && *p >= '0' && *p <= '9'; scale /= 10)
+            fraction += (*p++ - '0') * scale;
+    }
+    uint64_t value = ((uint64_t) hh * 3600 + (uint64_t) mm * 60 + ss) * 1000 + fraction;
+    if (value > UINT32_MAX)
+        return false;
+    ms = value;
+    return true;
+}
+
+// "{123}" of MicroDVD or "[123]" of MPL2 and moves p after it, value is
+// -1 when the brackets are empty
+static inline bool scanBracketNumber(const char *&p, const char *end, char open, char close, int &value)
+{
+    if (p >= end || *p != open)
+        return false;
+    const char *q = p + 1;
+    value = scanNumber(q, end, 9);
+    if (q >= end || *q != close)
+        return false;
+    p = q + 1;
+    return true;
+}
+
+static inline bool hasPrefix(const char *line, size_t len, const char *prefix)
+{
+    size_t prefix_len = strlen(prefix);
+    return len >= prefix_len && !memcmp(line, prefix, prefix_len);
+}
+
+#endif
@@ -1,90 +1,86 @@
+
 // adapted ffmpeg srtdec sources:
 // https://github.com/FFmpeg/FFmpeg/blob/master/libavformat/srtdec.c
+//
+// file is scanned in one pass, text of the cues is copied only once
+// to the text block of SubtitleCues
 
 #include "subrip.h"
-#include "common.h"
+#include "scanner.h"
 
-int SubripParser::get_event_info(const char *line, event_info *ei)
+// "00:00:01,000 --> 00:00:02,000", optionally followed by coordinates
+// "X1:... X2:... Y1:... Y2:..." which are ignored
+bool SubripParser::getEventInfo(const char *line, size_t len, uint32_t &start_ms, uint32_t &end_ms)
 {
-    int hh1, mm1, ss1, ms1;
-    int hh2, mm2, ss2, ms2;
-
-    ei->x1 = ei->x2 = ei->y1 = ei->y2 = ei->duration = -1;
-    ei->start = 0;//fixme
-    ei->pos = -1;
-    if (sscanf(line, "%d:%2d:%2d%*1[,.]%3d --> %d:%2d:%2d%*1[,.]%3d"
-               "%*[ ]X1:%u X2:%u Y1:%u Y2:%u",
-               &hh1, &mm1, &ss1, &ms1,
-               &hh2, &mm2, &ss2, &ms2,
-               &ei->x1, &ei->x2, &ei->y1, &ei->y2) >= 8) {
-        const int64_t start = (hh1*3600LL + mm1*60LL + ss1) * 1000LL + ms1;
-        const int64_t end   = (hh2*3600LL + mm2*60LL + ss2) * 1000LL + ms2;
-        ei->duration = end - start;
-        ei->start = start;
-        return 0;
-    }
-    return -1;
+    const char *p = line, *end = line + len;
+    p = skipBlank(p, end);
+    if (!scanTimestamp(p, end, start_ms))
+        return false;
+    p = skipBlank(p, end);
+    if (end - p < 3 || memcmp(p, "-->", 3))
+        return false;
+    p = skipBlank(p + 3, end);
+    return scanTimestamp(p, end, end_ms);
 }
 
-int SubripParser::add_event(subtitleMap &submap, std::stringstream &buf, char *line_cache,
-                     const event_info *ei, int append_cache)
+// line starts with a non-negative number, standalone is set when there
+// is nothing else on the line
+bool SubripParser::isNumber(const char *line, size_t len, bool *standalone)
 {
-    if (append_cache && line_cache[0])
-        buf << line_cache << std::endl;
-    line_cache[0] = 0;
-
-    subtitleMessage sub;
-    sub.start_ms = ei->start;
-    sub.duration_ms = ei->duration;
-    sub.end_ms = sub.start_ms + sub.duration_ms;
-    sub.text = buf.str();
-    sub.text = rtrim(sub.text);
-
-    submap.insert(std::pair<int, subtitleMessage>(sub.end_ms, sub));
-    return 0;
+    const char *p = line, *end = line + len;
+    p = skipBlank(p, end);
+    if (p < end && *p == '+')
+        p++;
+    const char *digits = p;
+    while (p < end && *p >= '0' && *p <= '9')
+        p++;
+    if (p == digits)
+        return false;
+    if (standalone)
+        *standalone = p == end;
+    return true;
 }
 
-bool SubripParser::_parse(std::istream &is, int fps, subtitleMap &submap)
+bool SubripParser::_parse(const char *data, size_t len, int fps, SubtitleCues &cues)
 {
-    std::stringstream buf;
-    int res = 0;
-    char line[4096], line_cache[4096];
-    int has_event_info = 0;
-    event_info ei;
-    while (is)
+    SubtitleScanner scanner(data, len);
+    const char *line, *cache = NULL;
+    size_t line_len, cache_len = 0;
+    bool has_event_info = false;
+    uint32_t start_ms = 0, end_ms = 0;
+
+    // cue takes 80 bytes of the file on average
+    cues.reserve(len / 80, len);
+    while (scanner.getLine(line, line_len))
     {
-        event_info tmp_ei;
-        is.getline(line, sizeof(line));
-        int len = strlen(line);
-
-        if (len < 0)
-            break;
-
-        if (!len || !line[0] || (len == 1 && line[0] == '\r') )
+        uint32_t tmp_start_ms, tmp_end_ms;
+        if (!line_len)
             continue;
 
-        if (get_event_info(line, &tmp_ei) < 0)
+        if (!getEventInfo(line, line_len, tmp_start_ms, tmp_end_ms))
         {
-            char *pline;
-
             if (!has_event_info)
                 continue;
 
-            if (line_cache[0]) {
+            if (cache_len)
+            {
                 /* We got some cache and a new line so we assume the cached
                  * line was actually part of the payload */
-                buf << line_cache << std::endl;
-                line_cache[0] = 0;
+                cues.appendLine(cache, cache_len);
+                cache_len = 0;
             }
 
             /* If the line doesn't start with a number, we assume it's part of
              * the payload, otherwise is likely an event number preceding the
              * timing information... but we can't be sure of this yet, so we
              * cache it */
-            if (strtol(line, &pline, 10) < 0 || line == pline)
-                buf << line << std::endl;
+            if (!isNumber(line, line_len, NULL))
+                cues.appendLine(line, line_len);
             else
-                strcpy(line_cache, line);
+            {
+                cache = line;
+                cache_len = line_len;
+            }
         }
         else
         {
@@ -93,56 +89,54 @@ bool SubripParser::_parse(std::istream &is, int fps, subtitleMap &submap)
                 /* We have the information of previous event, append it to the
                  * queue. We insert the cached line if and only if the payload
                  * is empty and the cached line is not a standalone number. */
-                char *pline = NULL;
-                const int standalone_number = strtol(line_cache, &pline, 10) >= 0 && pline && !*pline;
-                int buflen = buf.str().size();
-
-                res = add_event(submap, buf, line_cache, &ei, !buflen && !standalone_number);
-                buf.str(std::string());
-                line_cache[0] = 0;
-                if (res < 0)
-                    goto end;
-            } else {
-                has_event_info = 1;
+                bool standalone_number = false;
+                if (cache_len && !cues.pendingText() && !(isNumber(cache, cache_len, &standalone_number) && standalone_number))
+                    cues.appendLine(cache, cache_len);
+                cues.add(start_ms, end_ms);
+                cache_len = 0;
+            }
+            else
+            {
+                has_event_info = true;
             }
-            //tmp_ei.pos = pos;
-            ei = tmp_ei;
+            start_ms = tmp_start_ms;
+            end_ms = tmp_end_ms;
         }
     }
-    if (has_event_info) {
-        res = add_event(submap, buf, line_cache, &ei, 1);
-        if (res < 0)
-            goto end;
+    if (has_event_info)
+    {
+        if (cache_len)
+            cues.appendLine(cache, cache_len);
+        cues.add(start_ms, end_ms);
     }
-end:
-    if (res < 0)
-        return false;
     return true;
-
 }
 
-int SubripParser::_probe(std::istream &is)
+int SubripParser::_probe(const char *data, size_t len)
 {
-    int v;
-    char buf[64], *pbuf;
+    SubtitleScanner scanner(data, len);
+    const char *line;
+    size_t line_len;
+    uint32_t start_ms, end_ms;
 
-    while (is.peek() == '\r' || is.peek() == '\n')
-        is.read(buf, 1);
+    do
+    {
+        if (!scanner.getLine(line, line_len))
+            return PROB_SCORE_MIN;
+    } while (!line_len);
 
     /* Check if the first non-empty line is a number. We do not check what the
      * number is because in practice it can be anything.
      * Also, that number can be followed by random garbage, so we can not
      * unfortunately check that we only have a number. */
-    if (!is.getline(buf, sizeof(buf)) || strtol(buf, &pbuf, 10) < 0 || pbuf == buf)
+    if (!isNumber(line, line_len, NULL))
         return PROB_SCORE_MIN;
 
     /* Check if the next line matches a SRT timestamp */
-    if (!is.getline(buf, sizeof(buf)))
+    if (!scanner.getLine(line, line_len))
         return PROB_SCORE_MIN;
 
-    if (buf[0] >= '0' && buf[0] <= '9' && strstr(buf, " --> ")
-        && sscanf(buf, "%*d:%*2d:%*2d%*1[,.]%*3d --> %*d:%*2d:%*2d%*1[,.]%3d", &v) == 1)
+    if (line_len && line[0] >= '0' && line[0] <= '9' && getEventInfo(line, line_len, start_ms, end_ms))
         return PROB_SCORE_MAX;
     return PROB_SCORE_MIN;
 }
-
@@ -1,35 +1,242 @@
 #include <cstdlib>
 #include <cerrno>
-#include <istream>
-#include <fstream>
+#include <cstring>
+#include <algorithm>
 #include <map>
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
 
 #include "common.h"
+#include "charset.h"
 #include "subtitles.h"
 #include "subrip.h"
+#include "ass.h"
+#include "webvtt.h"
+#include "microdvd.h"
+#include "mpl2.h"
+#include "scanner.h"
 
-static void skipBOM(std::istream& is)
+// prefix of the file which is scored by the parsers
+#define PROBE_SIZE 4096
+
+void SubtitleCues::reserve(size_t cues, size_t text)
+{
+    m_cues.reserve(m_cues.size() + cues);
+    m_text.reserve(m_text.size() + text);
+}
+
+void SubtitleCues::appendText(const char *text, size_t len)
+{
+    m_text.append(text, len);
+}
+
+void SubtitleCues::appendLine(const char *text, size_t len)
+{
+    m_text.append(text, len);
+    m_text += '\n';
+}
+
+void SubtitleCues::add(uint32_t start_ms, uint32_t end_ms)
+{
+    subtitleCue cue;
+    cue.start_ms = start_ms;
+    cue.end_ms = end_ms;
+    cue.text_offset = m_text_start;
+    cue.text_length = trimmedLength(m_text.data() + m_text_start, m_text.size() - m_text_start);
+    m_text.resize(m_text_start + cue.text_length);
+    m_text += '\0';
+    m_text_start = m_text.size();
+    m_cues.push_back(cue);
+}
+
+void SubtitleCues::clear()
+{
+    m_cues.clear();
+    m_text.clear();
+    m_text_start = 0;
+    m_video_fps = 0;
+}
+
+struct startLess
+{
+    const std::vector<subtitleCue> &cues;
+    startLess(const std::vector<subtitleCue> &c): cues(c){}
+    bool operator()(uint32_t a, uint32_t b) const {return cues[a].start_ms < cues[b].start_ms;}
+};
+
+void SubtitleTimeline::build(SubtitleCues &cues)
+{
+    clear();
+    const std::vector<subtitleCue> &c = cues.m_cues;
+    // files are mostly in order already, cues with the same start keep
+    // the order of the file
+    std::vector<uint32_t> order(c.size());
+    for (size_t i = 0; i < c.size(); i++)
+        order[i] = i;
+    std::stable_sort(order.begin(), order.end(), startLess(c));
+
+    m_start_ms.resize(c.size());
+    m_end_ms.resize(c.size());
+    m_max_end_ms.resize(c.size());
+    m_text_offset.resize(c.size());
+    uint32_t max_end_ms = 0;
+    for (size_t i = 0; i < c.size(); i++)
+    {
+        const subtitleCue &cue = c[order[i]];
+        m_start_ms[i] = cue.start_ms;
+        m_end_ms[i] = cue.end_ms;
+        max_end_ms = std::max(max_end_ms, cue.end_ms);
+        m_max_end_ms[i] = max_end_ms;
+        m_text_offset[i] = cue.text_offset;
+    }
+    m_text.swap(cues.m_text);
+    m_video_fps = cues.m_video_fps;
+    cues.clear();
+}
+
+void SubtitleTimeline::swap(SubtitleTimeline &timeline)
+{
+    m_start_ms.swap(timeline.m_start_ms);
+    m_end_ms.swap(timeline.m_end_ms);
+    m_max_end_ms.swap(timeline.m_max_end_ms);
+    m_text_offset.swap(timeline.m_text_offset);
+    m_text.swap(timeline.m_text);
+    std::swap(m_video_fps, timeline.m_video_fps);
+}
+
+void SubtitleTimeline::clear()
+{
+    m_start_ms.clear();
+    m_end_ms.clear();
+    m_max_end_ms.clear();
+    m_text_offset.clear();
+    m_text.clear();
+    m_video_fps = 0;
+}
+
+void SubtitleTimeline::getActive(uint32_t from_ms, uint32_t to_ms, std::vector<size_t> &active) const
+{
+    active.clear();
+    // all cues before the first one whose max end is after from_ms have
+    // already ended, cues from the last one don't start until to_ms
+    size_t first = std::upper_bound(m_max_end_ms.begin(), m_max_end_ms.end(), from_ms) - m_max_end_ms.begin();
+    size_t last = std::upper_bound(m_start_ms.begin(), m_start_ms.end(), to_ms) - m_start_ms.begin();
+    for (size_t i = first; i < last; i++)
+    {
+        if (m_end_ms[i] > from_ms)
+            active.push_back(i);
+    }
+}
+
+bool SubtitleTimeline::getNextStart(uint32_t time_ms, uint32_t &start_ms) const
+{
+    std::vector<uint32_t>::const_iterator it = std::upper_bound(m_start_ms.begin(), m_start_ms.end(), time_ms);
+    if (it == m_start_ms.end())
+        return false;
+    start_ms = *it;
+    return true;
+}
+
+void EmbeddedSubtitleTimeline::append(uint32_t start_ms, uint32_t end_ms, const std::string &text)
+{
+    uint32_t text_offset = m_text.size();
+    m_text.append(text.c_str(), text.size() + 1);
+    if (m_start_ms.empty() || start_ms >= m_start_ms.back())
+    {
+        m_start_ms.push_back(start_ms);
+        m_end_ms.push_back(end_ms);
+        m_max_end_ms.push_back(m_max_end_ms.empty() ? end_ms : std::max(m_max_end_ms.back(), end_ms));
+        m_text_offset.push_back(text_offset);
+        return;
+    }
+    // late cue, max end times after it have to be updated
+    size_t pos = std::upper_bound(m_start_ms.begin(), m_start_ms.end(), start_ms) - m_start_ms.begin();
+    m_start_ms.insert(m_start_ms.begin() + pos, start_ms);
+    m_end_ms.insert(m_end_ms.begin() + pos, end_ms);
+    m_text_offset.insert(m_text_offset.begin() + pos, text_offset);
+    m_max_end_ms.insert(m_max_end_ms.begin() + pos, 0);
+    uint32_t max_end_ms = pos ? m_max_end_ms[pos - 1] : 0;
+    for (size_t i = pos; i < m_max_end_ms.size(); i++)
+    {
+        max_end_ms = std::max(max_end_ms, m_end_ms[i]);
+        m_max_end_ms[i] = max_end_ms;
+    }
+}
+
+int SubtitleFile::open(const std::string &path)
 {
-    if (is.get() != 0xEF || is.get() != 0xBB || is.get() != 0xBF)
+    close();
+    int fd = ::open(path.c_str(), O_RDONLY);
+    if (fd < 0)
+        return -1;
+    struct stat st;
+    if (fstat(fd, &st) < 0)
+    {
+        ::close(fd);
+        return -1;
+    }
+    m_size = st.st_size;
+    if (m_size)
     {
-        is.seekg(0, std::ios::beg);
+        m_map = mmap(NULL, m_size, PROT_READ, MAP_PRIVATE, fd, 0);
+        if (m_map == MAP_FAILED)
+            m_map = NULL;
+        else
+            madvise(m_map, m_size, MADV_SEQUENTIAL);
     }
+    // some filesystems cannot be mapped
+    if (!m_map && m_size)
+    {
+        m_buffer.resize(m_size);
+        size_t done = 0;
+        while (done < m_size)
+        {
+            ssize_t rd = read(fd, &m_buffer[done], m_size - done);
+            if (rd < 0 && errno == EINTR)
+                continue;
+            if (rd <= 0)
+                break;
+            done += rd;
+        }
+        m_buffer.resize(done);
+        m_size = done;
+    }
+    ::close(fd);
+    return 0;
 }
 
-bool BaseSubtitleParser::parse(std::istream &is, int fps, subtitleMap &submap)
+void SubtitleFile::close()
 {
-    is.seekg(0, std::ios::beg);
-    skipBOM(is);
-    bool res = _parse(is, fps, submap);
+    if (m_map)
+        munmap(m_map, m_size);
+    m_map = NULL;
+    m_size = 0;
+    m_buffer.clear();
+}
+
+static void skipBOM(const char *&data, size_t &len)
+{
+    if (len >= 3 && !memcmp(data, "\xEF\xBB\xBF", 3))
+    {
+        data += 3;
+        len -= 3;
+    }
+}
+
+bool BaseSubtitleParser::parse(const char *data, size_t len, int fps, SubtitleCues &cues)
+{
+    skipBOM(data, len);
+    bool res = _parse(data, len, fps, cues);
     fprintf(stderr,"%s::parse, %s\n", name().c_str(), res ? "success":"failed");
     return res;
 }
 
-unsigned int BaseSubtitleParser::probe(std::istream &is)
+unsigned int BaseSubtitleParser::probe(const char *data, size_t len)
 {
-    is.seekg(0, std::ios::beg);
-    skipBOM(is);
-    unsigned int res = _probe(is);
+    skipBOM(data, len);
+    unsigned int res = _probe(data, len);
     fprintf(stderr,"%s::probe, score = %u\n", name().c_str(), res);
     return res;
 }
@@ -37,6 +244,10 @@ unsigned int BaseSubtitleParser::probe(std::istream &is)
 void SubtitleParser::initParserList()
 {
     m_parser_vec.push_back(new SubripParser);
+    m_parser_vec.push_back(new AssParser);
+    m_parser_vec.push_back(new WebvttParser);
+    m_parser_vec.push_back(new MicroDvdParser);
+    m_parser_vec.push_back(new Mpl2Parser);
 };
 
 void SubtitleParser::cleanParserList()
@@ -48,118 +259,110 @@ void SubtitleParser::cleanParserList()
     }
 };
 
-bool SubtitleParser::parse(std::istream &is, int fps, subtitleMap& submap)
+bool SubtitleParser::parse(const char *data, size_t len, int fps, SubtitleCues &cues)
 {
+    // parsers score the same prefix of whole lines, so probing doesn't
+    // depend on the size of the file
+    size_t probe_len = len;
+    if (probe_len > PROBE_SIZE)
+    {
+        probe_len = PROBE_SIZE;
+        while (probe_len && data[probe_len - 1] != '\n')
+            probe_len--;
+        if (!probe_len)
+            probe_len = PROBE_SIZE;
+    }
     std::multimap<int, BaseSubtitleParser*> map;
     for (std::vector<BaseSubtitleParser*>::const_iterator it(m_parser_vec.begin()); it != m_parser_vec.end(); it++)
     {
-        int score = (*it)->probe(is);
+        int score = (*it)->probe(data, probe_len);
         if (score > PROB_SCORE_MIN)
             map.insert(std::pair<int, BaseSubtitleParser*>(score, *it));
     }
     for (std::multimap<int, BaseSubtitleParser*>::reverse_iterator it(map.rbegin()); it!=map.rend(); it++)
     {
-        if (it->second->parse(is, fps, submap))
+        if (it->second->parse(data, len, fps, cues))
             return true;
+        cues.clear();
     }
     return false;
 }
 
-const subtitleMap *SubtitleManager::load(const std::string &path, int video_fps, int subtitle_fps, bool force_reload)
+int SubtitleManager::read(const std::string &path, SubtitleTimeline &timeline, bool convert_to_utf8,
+        const std::atomic<bool> *cancelled, int fps)
 {
-    fprintf(stderr,"SubtitleManager::load(%s,video_fps=%d,subtitle_fps=%d)\n",path.c_str(), video_fps, subtitle_fps);
-    bool convert_fps = false;
-    subtitleId orig_sid(path, std::pair<int,int>(1,1));
-    subtitleId sid(path, std::pair<int, int>(subtitle_fps, video_fps));
-    if (subtitle_fps == 1 || video_fps == subtitle_fps || (video_fps == -1 || subtitle_fps == -1))
-    {
-        //fprintf(stderr,"SubtitleManager::load(%s,video_fps=%d,subtitle_fps=%d) missing or same video/subtitle fps, no conversion will be done.\n",
-        //        path.c_str(), video_fps, subtitle_fps);
-        sid = orig_sid;
-    }
-    subtitles::iterator it = m_loaded_subtitles.find(sid);
-    //if (it != m_loaded_subtitles.end())
-    //{
-    //    fprintf(stderr,"SubtitleManager::load(%s,video_fps=%d,subtitle_fps=%d) already loaded!\n", 
-    //            path.c_str(), video_fps, subtitle_fps);
-    //}
-    if (it == m_loaded_subtitles.end() && sid != orig_sid)
+    SubtitleFile file;
+    if (file.open(path) < 0)
     {
-        it = m_loaded_subtitles.find(orig_sid);
-        if ((it != m_loaded_subtitles.end()))
-        {
-            //fprintf(stderr,"SubtitleManager::load(%s,video_fps=%d,subtitle_fps=%d) already loaded but need to convert fps\n", 
-            //        path.c_str(), video_fps, subtitle_fps);
-            convert_fps = true;
-        }
+        fprintf(stderr,"SubtitleManager::read(%s) - cannot open file: %s\n", path.c_str(), strerror(errno));
+        return -1;
     }
-    if (it == m_loaded_subtitles.end() || force_reload)
+    const char *data = file.data();
+    size_t size = file.size();
+    std::string out;
+    if (convert_to_utf8)
     {
-        if (it != m_loaded_subtitles.end())
+        int ret = toUTF8(data, size, out);
+        if (ret < 0)
         {
-            it = m_loaded_subtitles.begin();
-            while(it != m_loaded_subtitles.end())
-            {
-                if (it->first.first == path)
-                {
-                    m_loaded_subtitles.erase(it++);
-                }
-                else
-                {
-                    it++;
-                }
-            }
+            fprintf(stderr,"SubtitleManager::read(%s) - error in convert to utf-8\n", path.c_str());
         }
-        std::ifstream ifs(path.c_str());
-        if (!ifs.is_open())
+        else if (ret == 0)
         {
-            fprintf(stderr,"SubtitleManager::load(%s,video_fps=%d,subtitle_fps=%d) - cannot open file: %s\n", 
-                    path.c_str(), video_fps, subtitle_fps, strerror(errno));
-            return NULL;
+            data = out.data();
+            size = out.size();
         }
-        std::stringstream ss;
-        ss << ifs.rdbuf();
-        std::string out;
-        if (m_convert_to_utf8)
-        {
-            if (convertToUTF8(ss.str(), out) != 0)
-            {
-                fprintf(stderr,"SubtitleManager::load(%s,video_fps=%d,subtitle_fps=%d) - error in convert to utf-8\n",
-                        path.c_str(), video_fps, subtitle_fps);
-            }
-            else
-            {
-                ss.str(std::string());
-                ss << out;
-            }
-        }
-        subtitleMap map;
-        if (!m_parser.parse(ss, video_fps, map))
-        {
-            fprintf(stderr,"SubtitleManager::load(%s,video_fps=%d,subtitle_fps=%d) - cannot parse file\n", 
-                    path.c_str(), video_fps, subtitle_fps);
-            return NULL;
-        }
-        convert_fps = sid != orig_sid;
-        m_loaded_subtitles.insert(std::pair<subtitleId, subtitleMap>(orig_sid, map));
     }
-
-    if (convert_fps)
+    if (cancelled && *cancelled)
+        return -1;
+    SubtitleParser parser;
+    SubtitleCues cues;
+    if (!parser.parse(data, size, fps, cues))
     {
-        subtitleMap *origmap = &m_loaded_subtitles.find(orig_sid)->second;
-        subtitleMap convmap;
-        float fps_ratio = sid.second.second / (double) sid.second.first;
-        for (subtitleMap::const_iterator sit(origmap->begin()); sit != origmap->end(); sit++)
-        {
-            subtitleMessage sub(sit->second);
-            sub.start_ms *= fps_ratio;
-            sub.end_ms *= fps_ratio;
-            sub.duration_ms = sub.end_ms - sub.start_ms;
-            convmap.insert(std::pair<int32_t, subtitleMessage>(sub.end_ms, sub));
-        }
-        m_loaded_subtitles.insert(std::pair<subtitleId, subtitleMap>(sid, convmap));
+        fprintf(stderr,"SubtitleManager::read(%s) - cannot parse file\n", path.c_str());
+        return -1;
     }
-    fprintf(stderr,"SubtitleManager::load(%s,video_fps=%d,subtitle_fps=%d) succesfully loaded\n",path.c_str(), video_fps, subtitle_fps);
-    return &(m_loaded_subtitles.find(sid)->second);
+    if (cancelled && *cancelled)
+        return -1;
+    timeline.build(cues);
+    fprintf(stderr,"SubtitleManager::read(%s) - %zu subtitles\n", path.c_str(), timeline.size());
+    return 0;
 }
 
+double SubtitleManager::getScale(int video_fps, int subtitle_fps)
+{
+    if (subtitle_fps == 1 || video_fps == subtitle_fps || (video_fps <= 0 || subtitle_fps <= 0))
+        return 1;
+    return video_fps / (double) subtitle_fps;
+}
+
+const SubtitleTimeline *SubtitleManager::get(const std::string &path, int fps) const
+{
+    subtitles::const_iterator it = m_loaded_subtitles.find(path);
+    if (it == m_loaded_subtitles.end())
+        return NULL;
+    int video_fps = it->second.videoFps();
+    if (video_fps && video_fps != (fps > 0 ? fps : -1))
+        return NULL;
+    return &it->second;
+}
+
+const SubtitleTimeline *SubtitleManager::add(const std::string &path, SubtitleTimeline &timeline)
+{
+    SubtitleTimeline &loaded = m_loaded_subtitles[path];
+    loaded.clear();
+    loaded.swap(timeline);
+    return &loaded;
+}
+
+const SubtitleTimeline *SubtitleManager::load(const std::string &path, bool force_reload, int fps)
+{
+    fprintf(stderr,"SubtitleManager::load(%s)\n", path.c_str());
+    const SubtitleTimeline *loaded = get(path, fps);
+    if (loaded && !force_reload)
+        return loaded;
+    SubtitleTimeline timeline;
+    if (read(path, timeline, true, NULL, fps) < 0)
+        return NULL;
+    return add(path, timeline);
+}
@@ -1,9 +1,11 @@
 #ifndef __serviceapp_subtitles_h
 #define __serviceapp_subtitles_h
 
+#include <atomic>
 #include <map>
+#include <string>
 #include <vector>
-#include <iostream>
+#include <stddef.h>
 #include <stdint.h>
 
 enum
@@ -30,19 +32,131 @@ struct subtitleMessage
     subtitleMessage(): start_ms(0), duration_ms(0), end_ms(0){};
 };
 
-// endtime, message
-typedef std::map<uint32_t, subtitleMessage> subtitleMap;
+struct subtitleCue
+{
+    uint32_t start_ms;
+    uint32_t end_ms;
+    // position of the text in the text block of the file
+    uint32_t text_offset;
+    uint32_t text_length;
+};
+
+// Cues of a subtitle file in the order of the file.
+//
+// Text of all cues is kept in one block, every cue refers to its NUL
+// terminated text by offset, so parsed file takes two allocations
+// instead of a string per cue.
+class SubtitleCues
+{
+    friend class SubtitleTimeline;
+    std::vector<subtitleCue> m_cues;
+    std::string m_text;
+    // start of the text of the cue which is being added
+    size_t m_text_start;
+    int m_video_fps;
+public:
+    SubtitleCues(): m_text_start(0), m_video_fps(0){}
+    void reserve(size_t cues, size_t text);
+    // text of the next cue, it can be appended in parts
+    void appendText(const char *text, size_t len);
+    // text followed by a line break
+    void appendLine(const char *text, size_t len);
+    size_t pendingText() const {return m_text.size() - m_text_start;}
+    // adds cue with the appended text, trailing whitespace is removed
+    void add(uint32_t start_ms, uint32_t end_ms);
+    void clear();
+
+    size_t size() const {return m_cues.size();}
+    bool empty() const {return m_cues.empty();}
+    const subtitleCue &operator[](size_t i) const {return m_cues[i];}
+    const char *text(const subtitleCue &cue) const {return m_text.c_str() + cue.text_offset;}
+    // size of the text block
+    size_t textSize() const {return m_text.size();}
+    // frame based cues are timed by the frame rate of the video in 1/1000,
+    // -1 when it wasn't known, 0 when the timing doesn't depend on it
+    void setVideoFps(int fps) {m_video_fps = fps;}
+    int videoFps() const {return m_video_fps;}
+};
+
+// Cues sorted by start time for lookups of the playback.
+//
+// Times are kept as arrays and every cue has the latest end time of
+// itself and of the cues before it, so cues which show at some time and
+// the start of the next cue are found by binary search over contiguous
+// memory. Cues with the same times are all kept. Timeline of a file is
+// built once and then it's only read.
+class SubtitleTimeline
+{
+protected:
+    std::vector<uint32_t> m_start_ms;
+    std::vector<uint32_t> m_end_ms;
+    std::vector<uint32_t> m_max_end_ms;
+    std::vector<uint32_t> m_text_offset;
+    // NUL terminated texts of the cues
+    std::string m_text;
+    int m_video_fps;
+public:
+    SubtitleTimeline(): m_video_fps(0){}
+    // takes the text block of the cues, cues are left empty
+    void build(SubtitleCues &cues);
+    void swap(SubtitleTimeline &timeline);
+    void clear();
+
+    size_t size() const {return m_start_ms.size();}
+    bool empty() const {return m_start_ms.empty();}
+    uint32_t start(size_t i) const {return m_start_ms[i];}
+    uint32_t end(size_t i) const {return m_end_ms[i];}
+    const char *text(size_t i) const {return m_text.c_str() + m_text_offset[i];}
+    // identifies the cue within the timeline, unlike its position it
+    // isn't changed by adding of other cues
+    uint32_t id(size_t i) const {return m_text_offset[i];}
+    // see SubtitleCues::videoFps
+    int videoFps() const {return m_video_fps;}
+
+    // cues which show at some time between from_ms and to_ms, in the
+    // order of their start
+    void getActive(uint32_t from_ms, uint32_t to_ms, std::vector<size_t> &active) const;
+    // start of the first cue which starts after time_ms, false when there
+    // is no such cue
+    bool getNextStart(uint32_t time_ms, uint32_t &start_ms) const;
+};
+
+// Timeline of subtitles which are received from the player during the
+// playback. They come mostly in order, so appending of such cue doesn't
+// move the others.
+class EmbeddedSubtitleTimeline: public SubtitleTimeline
+{
+public:
+    void append(uint32_t start_ms, uint32_t end_ms, const std::string &text);
+};
+
+// Content of a subtitle file, mapped to the memory when possible.
+class SubtitleFile
+{
+    void *m_map;
+    size_t m_size;
+    std::string m_buffer;
+    SubtitleFile(const SubtitleFile &);
+    SubtitleFile &operator=(const SubtitleFile &);
+public:
+    SubtitleFile(): m_map(NULL), m_size(0){}
+    ~SubtitleFile(){close();}
+    int open(const std::string &path);
+    void close();
+    const char *data() const {return m_map ? (const char *) m_map : m_buffer.data();}
+    size_t size() const {return m_size;}
+};
 
 class BaseSubtitleParser
 {
 protected:
-    virtual int _probe(std::istream &is) = 0;
-    virtual bool _parse(std::istream &is, int fps, subtitleMap &map) = 0;
+    virtual int _probe(const char *data, size_t len) = 0;
+    virtual bool _parse(const char *data, size_t len, int fps, SubtitleCues &cues) = 0;
 public:
     virtual ~BaseSubtitleParser(){}
     virtual std::string name() = 0;
-    unsigned int probe(std::istream &is);
-    bool parse(std::istream &is, int fps, subtitleMap &map);
+    unsigned int probe(const char *data, size_t len);
+    bool parse(const char *data, size_t len, int fps, SubtitleCues &cues);
 };
 
 class SubtitleParser
@@ -53,22 +167,39 @@ class SubtitleParser
 public:
     SubtitleParser(){initParserList();}
     ~SubtitleParser(){cleanParserList();}
-    bool parse(std::istream &is, int fps, subtitleMap &submap);
+    bool parse(const char *data, size_t len, int fps, SubtitleCues &cues);
 };
 
 
+// Cache of the loaded subtitle files.
+//
+// Files are read by read(), which doesn't touch the cache, so it can run
+// in a worker thread and its result is added to the cache afterwards.
+// Timelines keep times of the file, difference of the video and
+// subtitle frame rates is applied when they are looked up, see getScale.
 class SubtitleManager
 {
-    SubtitleParser m_parser;
-    bool m_convert_to_utf8;
-    // path -> videofps,subtitlefps
-    typedef std::pair<std::string, std::pair<int, int> > subtitleId;
-    typedef std::map<subtitleId, subtitleMap> subtitles;
-    std::multimap<subtitleId, subtitleMap> m_loaded_subtitles;
+    typedef std::map<std::string, SubtitleTimeline> subtitles;
+    subtitles m_loaded_subtitles;
 public:
-    const subtitleMap *load(const std::string &filepath, int video_fps=-1, int subtitle_fps=-1, bool force_reload=false);
+    // reads, converts to utf-8 and parses the file, returns -1 on failure
+    // or when it was cancelled meanwhile, fps of the video in 1/1000 is
+    // used by frame based formats, -1 when it's not known
+    static int read(const std::string &path, SubtitleTimeline &timeline, bool convert_to_utf8=true,
+            const std::atomic<bool> *cancelled=NULL, int fps=-1);
+    // playback time of a subtitle time, 1 when the frame rates are not
+    // known or when they are the same
+    static double getScale(int video_fps, int subtitle_fps);
+
+    // already loaded file, NULL if it wasn't loaded yet or when it's frame
+    // based and it was timed by other frame rate of the video
+    const SubtitleTimeline *get(const std::string &path, int fps=-1) const;
+    // timeline is moved to the cache
+    const SubtitleTimeline *add(const std::string &path, SubtitleTimeline &timeline);
+    // synchronous get or read and add
+    const SubtitleTimeline *load(const std::string &path, bool force_reload=false, int fps=-1);
 
-    SubtitleManager():m_convert_to_utf8(true){};
+    SubtitleManager(){};
     ~SubtitleManager(){};
 };
 
@@ -0,0 +1,154 @@
+// file is scanned in one pass, blocks of the file are separated by blank
+// lines, see https://www.w3.org/TR/webvtt1/
+
+#include <algorithm>
+
+#include "webvtt.h"
+#include "scanner.h"
+
+static const struct
+{
+    const char *name;
+    const char *text;
+} entities[] =
+{
+    {"amp", "&"}, {"lt", "<"}, {"gt", ">"}, {"nbsp", " "}, {"quot", "\""}, {"apos", "'"},
+    {"lrm", ""}, {"rlm", ""},
+};
+
+// "00:01.000 --> 00:02.000", optionally followed by cue settings
+bool WebvttParser::getTiming(const char *line, size_t len, uint32_t &start_ms, uint32_t &end_ms)
+{
+    const char *p = line, *end = line + len;
+    p = skipBlank(p, end);
+    if (!scanClock(p, end, start_ms))
+        return false;
+    p = skipBlank(p, end);
+    if (end - p < 3 || memcmp(p, "-->", 3))
+        return false;
+    p = skipBlank(p + 3, end);
+    return scanClock(p, end, end_ms) && (p == end || isBlank(*p));
+}
+
+// "<i>" and "<i.class>" are kept as "<i>", "<c.yellow>", "<v Bob>",
+// timestamps and the other tags are dropped
+static const char *convertTag(const char *tag, size_t len, size_t &out_len)
+{
+    static const char *kept[] = {"<i>", "<b>", "<u>", "</i>", "</b>", "</u>"};
+    bool closing = len && tag[0] == '/';
+    if (closing)
+    {
+        tag++;
+        len--;
+    }
+    if (!len || (len > 1 && tag[1] != '.' && !isBlank(tag[1])))
+        return NULL;
+    const char *name = strchr("ibu", tag[0]);
+    if (!tag[0] || !name)
+        return NULL;
+    out_len = closing ? 4 : 3;
+    return kept[(name - "ibu") + (closing ? 3 : 0)];
+}
+
+void WebvttParser::appendText(const char *text, size_t len, SubtitleCues &cues)
+{
+    const char *p = text, *end = text + len, *run = text;
+    while (p < end)
+    {
+        const char *close = NULL, *replacement = NULL;
+        size_t replacement_len = 0;
+        if (*p == '<')
+        {
+            close = (const char *) memchr(p, '>', end - p);
+            if (close)
+                replacement = convertTag(p + 1, close - p - 1, replacement_len);
+        }
+        else if (*p == '&')
+        {
+            close = (const char *) memchr(p, ';', std::min<size_t>(end - p, 8));
+            for (size_t i = 0; close && i < sizeof(entities) / sizeof(entities[0]); i++)
+            {
+                if ((size_t)(close - p - 1) == strlen(entities[i].name) && !memcmp(p + 1, entities[i].name, close - p - 1))
+                {
+                    replacement = entities[i].text;
+                    replacement_len = strlen(replacement);
+                    break;
+                }
+            }
+            // unknown references are kept as they are
+            if (!replacement)
+                close = NULL;
+        }
+        if (!close)
+        {
+            p++;
+            continue;
+        }
+        cues.appendText(run, p - run);
+        if (replacement)
+            cues.appendText(replacement, replacement_len);
+        p = close + 1;
+        run = p;
+    }
+    cues.appendText(run, p - run);
+}
+
+int WebvttParser::_probe(const char *data, size_t len)
+{
+    SubtitleScanner scanner(data, len);
+    const char *line;
+    size_t line_len;
+
+    if (scanner.getLine(line, line_len) && hasPrefix(line, line_len, "WEBVTT") &&
+            (line_len == 6 || isBlank(line[6])))
+        return PROB_SCORE_MAX;
+    return PROB_SCORE_MIN;
+}
+
+static bool isBlockKeyword(const char *line, size_t len)
+{
+    static const char *keywords[] = {"NOTE", "STYLE", "REGION"};
+    for (size_t i = 0; i < sizeof(keywords) / sizeof(keywords[0]); i++)
+    {
+        size_t keyword_len = strlen(keywords[i]);
+        if (hasPrefix(line, len, keywords[i]) && (len == keyword_len || isBlank(line[keyword_len])))
+            return true;
+    }
+    return false;
+}
+
+bool WebvttParser::_parse(const char *data, size_t len, int fps, SubtitleCues &cues)
+{
+    SubtitleScanner scanner(data, len);
+    const char *line;
+    size_t line_len = 0;
+
+    // header up to the first blank line
+    while (scanner.getLine(line, line_len) && line_len)
+        ;
+    cues.reserve(len / 80, len);
+    while (scanner.getLine(line, line_len))
+    {
+        uint32_t start_ms, end_ms;
+        if (!line_len)
+            continue;
+
+        // timing line is optionally preceded by identifier of the cue
+        bool timing = getTiming(line, line_len, start_ms, end_ms);
+        if (!timing && !isBlockKeyword(line, line_len) && scanner.getLine(line, line_len))
+            timing = getTiming(line, line_len, start_ms, end_ms);
+        if (!timing)
+        {
+            while (line_len && scanner.getLine(line, line_len))
+                ;
+            continue;
+        }
+        while (scanner.getLine(line, line_len) && line_len)
+        {
+            appendText(line, line_len, cues);
+            cues.appendText("\n", 1);
+        }
+        cues.add(start_ms, end_ms);
+    }
+    return true;
+}
@@ -0,0 +1,21 @@
+#ifndef __webvttparser
+#define __webvttparser
+#include <stdint.h>
+
+#include "subtitles.h"
+
+// WebVTT files, cue settings, regions and styles are ignored. Italic,
+// bold and underline tags are kept, other tags are dropped and character
+// references are decoded.
+class WebvttParser: public BaseSubtitleParser
+{
+    static bool getTiming(const char *line, size_t len, uint32_t &start_ms, uint32_t &end_ms);
+    static void appendText(const char *text, size_t len, SubtitleCues &cues);
+public:
+    WebvttParser(){}
+    ~WebvttParser(){}
+    std::string name(){return "WebvttParser";}
+    int _probe(const char *data, size_t len);
+    bool _parse(const char *data, size_t len, int fps, SubtitleCues &cues);
+};
+#endif
@@ -5,6 +5,7 @@
 #include <string.h>
 #include <unistd.h>
 #include <fcntl.h>
+#include <poll.h>
 #include <sys/socket.h>
 #include <sys/select.h>
 #include <sys/time.h>
@@ -12,12 +13,19 @@
 #include <netdb.h>
 #include <openssl/ssl.h>
 #include <openssl/err.h>
+#include <zlib.h>
 
 #include <vector>
 #include <string>
 
+#include "common.h"
+#include "resolver.h"
 #include "wrappers.h"
 
+/* ms between starts of connection attempts to next address */
+#define CONNECT_ATTEMPT_DELAY 250
+#define CONNECT_CANCEL_INTERVAL 100
+
 
 int Select(int maxfd, fd_set *readfds, fd_set *writefds, fd_set *exceptfds, struct timeval *timeout)
 {
@@ -122,140 +130,518 @@ ssize_t timedRead(SSL *ssl, int fd, void *buf, size_t count, int initialtimeout,
 	return totalread;
 }
 
-ssize_t readLine(SSL *ssl, int fd, char** buffer, size_t* bufsize)
+enum
 {
-	size_t i = 0;
-	int result;
-	while (1)
+	bodyUntilClose,
+	bodyLength,
+	bodyChunked,
+};
+
+enum
+{
+	chunkSize,
+	chunkData,
+	chunkDataEnd,
+	chunkTrailer,
+};
+
+#define CHUNK_LINE_MAX 4096
+
+ConnectionReader::ConnectionReader(SSL *ssl, int fd, size_t blockSize, int timeout, size_t maxLineLength):
+	mSsl(ssl),
+	mFd(fd),
+	mBuffer(blockSize),
+	mStart(0),
+	mEnd(0),
+	mRawStart(0),
+	mRawEnd(0),
+	mBody(bodyUntilClose),
+	mChunkState(chunkSize),
+	mRemaining(0),
+	mBodyDone(false),
+	mMaxLineLength(maxLineLength),
+	mTimeout(timeout),
+	mEof(false),
+	mBodyReceived(0),
+	mInflate(NULL),
+	mInflateDone(false)
+{
+}
+
+ConnectionReader::~ConnectionReader()
+{
+	if (mInflate)
 	{
-		if (i >= *bufsize)
+		inflateEnd(mInflate);
+		delete mInflate;
+	}
+}
+
+// appends next block of the stream to the buffer
+ssize_t ConnectionReader::fill()
+{
+	if (mStart == mEnd)
+	{
+		mStart = mEnd = 0;
+	}
+	else if (mEnd == mBuffer.size())
+	{
+		if (mStart > 0)
 		{
-			char *newbuf = (char*)realloc(*buffer, (*bufsize)+1024);
-			if (newbuf == NULL)
-				return -ENOMEM;
-			*buffer = newbuf;
-			*bufsize = (*bufsize) + 1024;
+			memmove(&mBuffer[0], &mBuffer[mStart], mEnd - mStart);
+			mEnd -= mStart;
+			mStart = 0;
 		}
-		result = timedRead(ssl, fd, (*buffer) + i, 1, 3000, 100);
-		if (result <= 0 || (*buffer)[i] == '\n')
+		else
 		{
-			(*buffer)[i] = '\0';
-			return result <= 0 ? -1 : i;
+			// line doesn't fit in the buffer
+			mBuffer.resize(mBuffer.size() * 2);
 		}
-		if ((*buffer)[i] != '\r') i++;
 	}
-	return -1;
+	ssize_t result = decodeContent(&mBuffer[mEnd], mBuffer.size() - mEnd);
+	if (result > 0)
+		mEnd += result;
+	return result;
 }
 
-int Connect(const char *hostname, int port, int timeoutsec)
+// next part of the body without content coding, 0 at its end
+ssize_t ConnectionReader::decodeContent(char *buf, size_t count)
 {
-	int sd = -1;
-	std::vector<struct addrinfo *> addresses;
-	struct addrinfo *info = NULL;
-	struct addrinfo hints;
-	memset(&hints, 0, sizeof(hints));
-	hints.ai_family = AF_UNSPEC; /* both ipv4 and ipv6 */
-	hints.ai_socktype = SOCK_STREAM;
-	hints.ai_protocol = 0; /* any */
-#ifdef AI_ADDRCONFIG
-	hints.ai_flags = AI_ADDRCONFIG; /* only return ipv6 if we have an ipv6 address ourselves, and ipv4 if we have an ipv4 address ourselves */
-#else
-	hints.ai_flags = 0; /* we have only IPV4 support, if AI_ADDRCONFIG is not available */
-#endif
-	char portstring[15];
-	/* this is suboptimal, but the alternative would require us to mess with the memberdata of an 'abstract' addressinfo struct */
-	snprintf(portstring, sizeof(portstring), "%d", port);
-	if (getaddrinfo(hostname, portstring, &hints, &info) || !info) return -1;
-	struct addrinfo *ptr = info;
-	while (ptr)
+	if (!mInflate)
+		return decode(buf, count);
+	while (!mInflateDone)
 	{
-		addresses.push_back(ptr);
-		ptr = ptr->ai_next;
+		if (!mInflate->avail_in)
+		{
+			ssize_t result = decode(&mCompressed[0], mCompressed.size());
+			if (result <= 0)
+			{
+				if (!result)
+					fprintf(stderr, "[ConnectionReader] compressed body is truncated\n");
+				return -1;
+			}
+			mInflate->next_in = (Bytef *) &mCompressed[0];
+			mInflate->avail_in = result;
+		}
+		mInflate->next_out = (Bytef *) buf;
+		mInflate->avail_out = count;
+		int result = inflate(mInflate, Z_NO_FLUSH);
+		size_t len = count - mInflate->avail_out;
+		if (result == Z_STREAM_END)
+		{
+			mInflateDone = true;
+			// rest of the body, i.e. last chunk, is consumed for reuse of the connection
+			char tail[256];
+			while (decode(tail, sizeof(tail)) > 0);
+		}
+		else if (result != Z_OK && result != Z_BUF_ERROR)
+		{
+			fprintf(stderr, "[ConnectionReader] corrupt compressed body: %s\n", mInflate->msg ? mInflate->msg : "");
+			return -1;
+		}
+		if (len)
+			return len;
 	}
+	return 0;
+}
 
-	for (unsigned int i = 0; i < addresses.size(); i++)
+// next part of the body, 0 at its end
+ssize_t ConnectionReader::decode(char *buf, size_t count)
+{
+	if (mBody == bodyUntilClose)
 	{
-		sd = ::socket(addresses[i]->ai_family, addresses[i]->ai_socktype, addresses[i]->ai_protocol);
-		if (sd < 0) break;
-		int flags;
-		bool setblocking = false;
-		if ((flags = fcntl(sd, F_GETFL, 0)) < 0)
-		{
-			::close(sd);
-			sd = -1;
-			continue;
-		}
-		if (!(flags & O_NONBLOCK))
+		ssize_t result = decodeRaw(buf, count);
+		if (result > 0)
+			mBodyReceived += result;
+		return result;
+	}
+	while (!mBodyDone)
+	{
+		if (mBody == bodyLength || mChunkState == chunkData)
 		{
-			/* set socket nonblocking, to allow for our own timeout on a nonblocking connect */
-			flags |= O_NONBLOCK;
-			if (fcntl(sd, F_SETFL, flags) < 0)
+			if (!mRemaining)
 			{
-				::close(sd);
-				sd = -1;
+				if (mBody == bodyLength)
+					mBodyDone = true;
+				else
+					mChunkState = chunkDataEnd;
 				continue;
 			}
-			/* remember to restore O_NONBLOCK when we're connected */
-			setblocking = true;
+			ssize_t result = decodeRaw(buf, count < mRemaining ? count : mRemaining);
+			if (result > 0)
+			{
+				mRemaining -= result;
+				mBodyReceived += result;
+			}
+			return result;
 		}
-		int connectresult;
-		while (1)
+		char *line;
+		int result = rawLine(&line);
+		if (result <= 0)
+			return result;
+		switch (mChunkState)
 		{
-			connectresult = ::connect(sd, addresses[i]->ai_addr, addresses[i]->ai_addrlen);
-			if (connectresult < 0)
+			case chunkSize:
 			{
-				if (errno == EINTR || errno == EINPROGRESS)
+				char *end;
+				// chunk extensions after ';' are ignored
+				mRemaining = strtoul(line, &end, 16);
+				if (end == line)
 				{
-					int error;
-					socklen_t len = sizeof(error);
-					timeval timeout;
-					fd_set wset;
-					FD_ZERO(&wset);
-					FD_SET(sd, &wset);
+					fprintf(stderr, "[ConnectionReader] invalid chunk size: %s\n", line);
+					return -1;
+				}
+				mChunkState = mRemaining ? chunkData : chunkTrailer;
+				break;
+			}
+			case chunkDataEnd:
+				mChunkState = chunkSize;
+				break;
+			case chunkTrailer:
+				if (!*line)
+					mBodyDone = true;
+				break;
+		}
+	}
+	return 0;
+}
 
-					timeout.tv_sec = timeoutsec;
-					timeout.tv_usec = 0;
+// data of the body which came with the header or directly from the socket
+ssize_t ConnectionReader::decodeRaw(char *buf, size_t count)
+{
+	if (mRawStart == mRawEnd)
+		return readSocket(buf, count);
+	size_t len = mRawEnd - mRawStart < count ? mRawEnd - mRawStart : count;
+	memcpy(buf, &mRaw[mRawStart], len);
+	mRawStart += len;
+	return len;
+}
 
-					if (select(sd + 1, NULL, &wset, NULL, &timeout) <= 0) break;
+// line of chunked coding, 1 when there is one, 0 or -1 at the end of the stream
+int ConnectionReader::rawLine(char **line)
+{
+	size_t scanned = mRawStart;
+	while (1)
+	{
+		char *nl = mRawEnd > scanned ? (char *) memchr(&mRaw[scanned], '\n', mRawEnd - scanned) : NULL;
+		if (nl)
+		{
+			*line = &mRaw[mRawStart];
+			size_t len = nl - *line;
+			if (len && (*line)[len - 1] == '\r')
+				len--;
+			(*line)[len] = '\0';
+			mRawStart = nl - &mRaw[0] + 1;
+			return 1;
+		}
+		if (mRawEnd - mRawStart >= CHUNK_LINE_MAX)
+		{
+			fprintf(stderr, "[ConnectionReader] chunk line exceeds %d bytes\n", CHUNK_LINE_MAX);
+			return -1;
+		}
+		if (mRawStart > 0)
+		{
+			memmove(&mRaw[0], &mRaw[mRawStart], mRawEnd - mRawStart);
+			mRawEnd -= mRawStart;
+			mRawStart = 0;
+		}
+		scanned = mRawEnd;
+		if (mRaw.size() < CHUNK_LINE_MAX)
+			mRaw.resize(CHUNK_LINE_MAX);
+		ssize_t result = readSocket(&mRaw[mRawEnd], mRaw.size() - mRawEnd);
+		if (result <= 0)
+			return result;
+		mRawEnd += result;
+	}
+}
 
-					if (getsockopt(sd, SOL_SOCKET, SO_ERROR, &error, &len) < 0) break;
+// single read of the socket, what is available up to count
+ssize_t ConnectionReader::readSocket(void *buf, size_t count)
+{
+	if (mEof)
+		return 0;
+	// data already decrypted by SSL are not signalled on the socket
+	if (!mSsl || !SSL_pending(mSsl))
+	{
+		fd_set rset;
+		struct timeval timeout;
+		int result;
+		FD_ZERO(&rset);
+		FD_SET(mFd, &rset);
+		timeout.tv_sec = mTimeout / 1000;
+		timeout.tv_usec = (mTimeout % 1000) * 1000;
+		if ((result = Select(mFd + 1, &rset, NULL, NULL, &timeout)) <= 0)
+		{
+			mEof = true;
+			return result;
+		}
+	}
+	ssize_t result = singleRead(mSsl, mFd, buf, count);
+	if (result <= 0)
+		mEof = true;
+	return result;
+}
 
-					if (error) break;
-					/* we are connected */
-					connectresult = 0;
-					break;
-				}
+ssize_t ConnectionReader::readLine(char **line)
+{
+	size_t scanned = mStart;
+	while (1)
+	{
+		char *data = &mBuffer[0];
+		char *nl = (char *) memchr(data + scanned, '\n', mEnd - scanned);
+		size_t end = nl ? nl - data : mEnd;
+		if (!nl)
+		{
+			if (mEnd - mStart > mMaxLineLength)
+			{
+				fprintf(stderr, "[ConnectionReader] line exceeds %zu bytes\n", mMaxLineLength);
+				return -1;
 			}
-			break;
+			size_t offset = mEnd - mStart;
+			if (fill() > 0)
+			{
+				// fill may have moved the data
+				scanned = mStart + offset;
+				continue;
+			}
+			// last line of the stream without newline
+			if (mStart == mEnd)
+				return -1;
+			if (mEnd == mBuffer.size())
+				mBuffer.push_back('\0');
+			data = &mBuffer[0];
+		}
+		size_t len = end - mStart;
+		*line = data + mStart;
+		if (len && data[end - 1] == '\r')
+			len--;
+		(*line)[len] = '\0';
+		mStart = nl ? end + 1 : mEnd;
+		return len;
+	}
+}
+
+ssize_t ConnectionReader::read(void *buf, size_t count)
+{
+	if (mStart == mEnd)
+	{
+		if (count >= mBuffer.size())
+		{
+			// large read, no need to copy it through the buffer
+			ssize_t result = decodeContent((char *) buf, count);
+			return result < 0 ? 0 : result;
 		}
-		if (connectresult < 0)
+		if (fill() <= 0)
+			return 0;
+	}
+	size_t len = mEnd - mStart < count ? mEnd - mStart : count;
+	memcpy(buf, &mBuffer[mStart], len);
+	mStart += len;
+	return len;
+}
+
+void ConnectionReader::startBody(int body)
+{
+	// what was read with the header is the beginning of the body
+	mRaw.assign(mBuffer.begin() + mStart, mBuffer.begin() + mEnd);
+	mRawStart = 0;
+	mRawEnd = mRaw.size();
+	mStart = mEnd = 0;
+	mBody = body;
+	mChunkState = chunkSize;
+	mBodyDone = false;
+	mBodyReceived = 0;
+}
+
+void ConnectionReader::setBodyLength(size_t length)
+{
+	startBody(bodyLength);
+	mRemaining = length;
+}
+
+void ConnectionReader::setChunked()
+{
+	startBody(bodyChunked);
+	mRemaining = 0;
+}
+
+bool ConnectionReader::setContentEncoding(const char *encoding)
+{
+	encoding += strspn(encoding, " \t");
+	size_t len = strcspn(encoding, " \t;");
+	if (!len || (len == 8 && !strncasecmp(encoding, "identity", len)))
+		return true;
+	if (!((len == 4 && !strncasecmp(encoding, "gzip", len)) ||
+			(len == 6 && !strncasecmp(encoding, "x-gzip", len)) ||
+			(len == 7 && !strncasecmp(encoding, "deflate", len))))
+	{
+		fprintf(stderr, "[ConnectionReader] not supported content encoding: %s\n", encoding);
+		return false;
+	}
+	if (mInflate)
+		return true;
+	mInflate = new z_stream();
+	// zlib and gzip headers are detected automatically
+	if (inflateInit2(mInflate, 15 + 32) != Z_OK)
+	{
+		delete mInflate;
+		mInflate = NULL;
+		return false;
+	}
+	// without delimited body the rest of the header block is compressed already
+	if (mBody == bodyUntilClose)
+		startBody(bodyUntilClose);
+	mCompressed.resize(mBuffer.size());
+	mInflateDone = false;
+	return true;
+}
+
+bool ConnectionReader::bodyComplete() const
+{
+	if (mBody == bodyUntilClose || mStart != mEnd || mRawStart != mRawEnd)
+		return false;
+	if (mInflate && !mInflateDone)
+		return false;
+	return mBody == bodyLength ? !mRemaining : mBodyDone;
+}
+
+static int startConnect(const SocketAddress &address, int &fd)
+{
+	fd = ::socket(address.family(), SOCK_STREAM, 0);
+	if (fd < 0)
+		return -1;
+	/* set socket nonblocking, to allow for our own timeout on a nonblocking connect */
+	int flags = fcntl(fd, F_GETFL, 0);
+	if (flags < 0 || fcntl(fd, F_SETFL, flags | O_NONBLOCK) < 0)
+	{
+		::close(fd);
+		fd = -1;
+		return -1;
+	}
+	int connectresult;
+	do
+	{
+		connectresult = ::connect(fd, (const struct sockaddr *)&address.addr, address.len);
+	} while (connectresult < 0 && errno == EINTR);
+	if (connectresult == 0)
+		return 1;
+	if (errno == EINPROGRESS)
+		return 0;
+	/* i.e. no route to IPv6, next address is tried at once */
+	::close(fd);
+	fd = -1;
+	return -1;
+}
+
+int Connect(const char *hostname, int port, int timeoutsec)
+{
+	return Connect(hostname, port, timeoutsec, NULL);
+}
+
+/*
+ * Happy Eyeballs (RFC 8305): connection attempts to the resolved addresses
+ * are started one after another with CONNECT_ATTEMPT_DELAY between them,
+ * without waiting for the previous ones to fail, and first connected wins.
+ * Dead IPv6 route or blackholed address then costs the delay, not the timeout.
+ */
+int Connect(const char *hostname, int port, int timeoutsec, const std::atomic<bool> *cancelled)
+{
+	int64_t start = getMonotonicMs();
+	int64_t deadline = start + timeoutsec * 1000;
+	std::vector<SocketAddress> addresses;
+	if (Resolver::getInstance()->resolve(hostname, addresses, timeoutsec * 1000, cancelled) < 0)
+		return -1;
+
+	int sd = -1;
+	size_t winner = 0;
+	std::vector<struct pollfd> pending;
+	std::vector<size_t> indexes;
+	size_t next = 0;
+	int64_t nextStart = start;
+	while (sd < 0)
+	{
+		int64_t now = getMonotonicMs();
+		if ((cancelled && *cancelled) || now >= deadline)
+			break;
+		if (next < addresses.size() && (now >= nextStart || pending.empty()))
 		{
-			::close(sd);
-			sd = -1;
+			int fd;
+			addresses[next].setPort(port);
+			int result = startConnect(addresses[next], fd);
+			if (result > 0)
+			{
+				sd = fd;
+				winner = next;
+			}
+			else if (result == 0)
+			{
+				struct pollfd pfd = {fd, POLLOUT, 0};
+				pending.push_back(pfd);
+				indexes.push_back(next);
+				nextStart = now + CONNECT_ATTEMPT_DELAY;
+			}
+			else
+				nextStart = now;
+			next++;
 			continue;
 		}
-		if (setblocking)
+		if (pending.empty())
+			break;
+		int64_t until = deadline;
+		if (next < addresses.size())
+			until = std::min(until, nextStart);
+		if (cancelled)
+			until = std::min(until, now + CONNECT_CANCEL_INTERVAL);
+		int result = poll(&pending[0], pending.size(), until - now);
+		if (result < 0 && errno != EINTR)
+			break;
+		for (size_t i = 0; result > 0 && i < pending.size() && sd < 0;)
 		{
-			/* set socket blocking again */
-			flags &= ~O_NONBLOCK;
-			if (fcntl(sd, F_SETFL, flags) < 0)
+			if (!pending[i].revents)
 			{
-				::close(sd);
-				sd = -1;
+				i++;
 				continue;
 			}
+			int error = 0;
+			socklen_t len = sizeof(error);
+			if (getsockopt(pending[i].fd, SOL_SOCKET, SO_ERROR, &error, &len) == 0 && !error)
+			{
+				/* we are connected */
+				sd = pending[i].fd;
+				winner = indexes[i];
+			}
+			else
+			{
+				::close(pending[i].fd);
+				/* failed attempt doesn't wait for the delay */
+				nextStart = getMonotonicMs();
+			}
+			pending.erase(pending.begin() + i);
+			indexes.erase(indexes.begin() + i);
 		}
-		if (sd >= 0)
-		{
+	}
+	for (size_t i = 0; i < pending.size(); i++)
+		::close(pending[i].fd);
+	if (sd < 0)
+	{
+		fprintf(stderr, "[Connect] %s: %s after %lldms\n", hostname,
+			cancelled && *cancelled ? "cancelled" : "no address connected", (long long)(getMonotonicMs() - start));
+		return -1;
+	}
+	if (winner > 0)
+		fprintf(stderr, "[Connect] %s: connected to %s, address %zu of %zu, in %lldms\n", hostname,
+			addresses[winner].toString().c_str(), winner + 1, addresses.size(), (long long)(getMonotonicMs() - start));
+	/* set socket blocking again */
+	int flags = fcntl(sd, F_GETFL, 0);
+	if (flags < 0 || fcntl(sd, F_SETFL, flags & ~O_NONBLOCK) < 0)
+	{
+		::close(sd);
+		return -1;
+	}
 #ifdef SO_NOSIGPIPE
-			int val = 1;
-			setsockopt(sd, SOL_SOCKET, SO_NOSIGPIPE, (char*)&val, sizeof(val));
+	int val = 1;
+	setsockopt(sd, SOL_SOCKET, SO_NOSIGPIPE, (char*)&val, sizeof(val));
 #endif
-			/* we have a working connection */
-			break;
-		}
-	}
-	freeaddrinfo(info);
 	return sd;
 }
 
@@ -313,16 +699,25 @@ int SSLConnect(const char *hostname, int fd, SSL **ssl, SSL_CTX **ctx)
 		SSL_CTX_free(*ctx);
 		return -1;
 	}
+	if (SSLConnect(hostname, fd, *ssl) < 0)
+	{
+		SSL_free(*ssl);
+		SSL_CTX_free(*ctx);
+		return -1;
+	}
+	return 0;
+}
+
+int SSLConnect(const char *hostname, int fd, SSL *ssl)
+{
 	struct addrinfo hints = { 0 }, *ai = NULL;
 	hints.ai_flags = AI_NUMERICHOST;
 	if (getaddrinfo(hostname, NULL, &hints, &ai) != 0)
 	{
-		if (SSL_set_tlsext_host_name(*ssl, hostname) != 1)
+		if (SSL_set_tlsext_host_name(ssl, hostname) != 1)
 		{
 			fprintf(stderr, "Error in SSL_set_tlsext_host_name:\n");
 			ERR_print_errors_fp(stderr);
-			SSL_free(*ssl);
-			SSL_CTX_free(*ctx);
 			return -1;
 		}
 	}
@@ -330,23 +725,18 @@ int SSLConnect(const char *hostname, int fd, SSL **ssl, SSL_CTX **ctx)
 	{
 		freeaddrinfo(ai);
 	}
-	if (SSL_set_fd(*ssl, fd) == 0)
+	if (SSL_set_fd(ssl, fd) == 0)
 	{
 		fprintf(stderr, "Error in SSL_set_fd:\n");
 		ERR_print_errors_fp(stderr);
-		SSL_free(*ssl);
-		SSL_CTX_free(*ctx);
 		return -1;
 	}
-	long ret = SSL_connect(*ssl);
+	long ret = SSL_connect(ssl);
 	if (ret != 1)
 	{
 		fprintf(stderr, "Error in SSL_connect: %s\n",
-				ERR_error_string(SSL_get_error(*ssl, ret), NULL));
-		SSL_free(*ssl);
-		SSL_CTX_free(*ctx);
+				ERR_error_string(SSL_get_error(ssl, ret), NULL));
 		return -1;
 	}
 	return 0;
 }
-
@@ -16,16 +16,80 @@
 #include <openssl/ssl.h>
 #include <openssl/err.h>
 
+#include <atomic>
 #include <vector>
 #include <string>
 #include <sys/select.h>
 
+struct z_stream_s;
+
 ssize_t singleRead(SSL *ssl, int fd, void *buf, size_t count);
 ssize_t timedRead(SSL *ssl, int fd, void *buf, size_t count, int initialtimeout, int interbytetimeout);
-ssize_t readLine(SSL *ssl, int fd, char** buffer, size_t* bufsize);
 ssize_t writeAll(SSL *ssl, int fd, const void *buf, size_t count);
 int Select(int maxfd, fd_set *readfds, fd_set *writefds, fd_set *exceptfds, struct timeval *timeout);
 int Connect(const char *hostname, int port, int timeoutsec);
+// gives up once the flag is set, timeout covers also name resolution
+int Connect(const char *hostname, int port, int timeoutsec, const std::atomic<bool> *cancelled);
 int SSLConnect(const char *hostname, int fd, SSL **ssl, SSL_CTX **ctx);
+// handshake on already created ssl, i.e. with session set for resumption
+int SSLConnect(const char *hostname, int fd, SSL *ssl);
+
+// Buffered reader of the connection, socket is read in blocks and both
+// header lines and body are served from the same buffer. Once the body
+// is delimited by Content-Length or chunked transfer coding, reader stops
+// at its end, so the connection can be used for next request.
+class ConnectionReader
+{
+	SSL *mSsl;
+	int mFd;
+	std::vector<char> mBuffer;
+	size_t mStart;
+	size_t mEnd;
+	// not yet decoded data of the body
+	std::vector<char> mRaw;
+	size_t mRawStart;
+	size_t mRawEnd;
+	int mBody;
+	int mChunkState;
+	size_t mRemaining;
+	bool mBodyDone;
+	size_t mMaxLineLength;
+	int mTimeout;
+	bool mEof;
+	size_t mBodyReceived;
+	// gzip or deflate content coding, inflated over the transfer coding
+	struct z_stream_s *mInflate;
+	std::vector<char> mCompressed;
+	bool mInflateDone;
+	ssize_t fill();
+	ssize_t decodeContent(char *buf, size_t count);
+	ssize_t decode(char *buf, size_t count);
+	ssize_t decodeRaw(char *buf, size_t count);
+	int rawLine(char **line);
+	ssize_t readSocket(void *buf, size_t count);
+	void startBody(int body);
+public:
+	// timeout in ms for every read of the socket
+	ConnectionReader(SSL *ssl, int fd, size_t blockSize=16*1024, int timeout=3000, size_t maxLineLength=1024*1024);
+	~ConnectionReader();
+	// returns length of the line without "\r\n", line is terminated by '\0'
+	// and valid until next call, -1 when nothing more can be read
+	ssize_t readLine(char **line);
+	// body after the header lines, returns 0 at the end of the stream
+	ssize_t read(void *buf, size_t count);
+	size_t buffered() const { return mEnd - mStart; }
+	// called after the empty line, which ends the header, without them
+	// the body ends when the connection is closed
+	void setBodyLength(size_t length);
+	void setChunked();
+	// value of Content-Encoding header, called after the body is delimited,
+	// returns false when the coding is not supported
+	bool setContentEncoding(const char *encoding);
+	// body was read up to its end and nothing follows it
+	bool bodyComplete() const;
+	// bytes of the body as they came over the connection, without chunk
+	// framing and before inflating
+	size_t bodyReceived() const { return mBodyReceived; }
+};
 
 #endif
@@ -0,0 +1,344 @@
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <string>
+#include <vector>
+#include <atomic>
+#include <pthread.h>
+#include <time.h>
+#include <netinet/in.h>
+
+#include "bandwidthestimator.h"
+#include "m3u8.h"
+#include "testutil.h"
+
+#define HOST "127.0.0.1"
+
+// local http stand-in which sends responses at limited rate
+struct Server
+{
+    int fd;
+    int port;
+    std::string playlist;
+    std::atomic<long> rate; // bits/s
+};
+
+struct Client
+{
+    Server *server;
+    int fd;
+};
+
+static double now()
+{
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return ts.tv_sec + ts.tv_nsec / 1e9;
+}
+
+static void sleepUntil(double until)
+{
+    double left = until - now();
+    if (left > 0)
+    {
+        struct timespec ts = {(time_t) left, (long) ((left - (time_t) left) * 1e9)};
+        nanosleep(&ts, NULL);
+    }
+}
+
+static void sendThrottled(Client *client, const std::string &data)
+{
+    const size_t chunk = 4096;
+    double start = now();
+    for (size_t sent = 0; sent < data.size(); sent += chunk)
+    {
+        sleepUntil(start + sent * 8.0 / client->server->rate);
+        size_t len = std::min(chunk, data.size() - sent);
+        if (writeAll(NULL, client->fd, data.c_str() + sent, len) != (ssize_t) len)
+            return;
+    }
+}
+
+static void *serveClient(void *arg)
+{
+    Client *client = (Client *) arg;
+    while (1)
+    {
+        std::string request;
+        char buf[1024];
+        ssize_t rd;
+        while (request.find("\r\n\r\n") == std::string::npos && (rd = read(client->fd, buf, sizeof(buf))) > 0)
+            request.append(buf, rd);
+        if (request.find("\r\n\r\n") == std::string::npos)
+            break;
+        size_t start = request.find(' ') + 1;
+        std::string path = request.substr(start, request.find(' ', start) - start);
+        std::string body;
+        if (path == "/master.m3u8")
+            body = client->server->playlist;
+        else if (!path.compare(0, 15, "/segment?bytes="))
+            body.assign(strtoul(path.c_str() + 15, NULL, 10), 'x');
+        std::string head = "HTTP/1.1 200 OK\r\nContent-Type: application/vnd.apple.mpegurl\r\nContent-Length: " +
+                std::to_string(body.size()) + "\r\n\r\n";
+        writeAll(NULL, client->fd, head.c_str(), head.size());
+        sendThrottled(client, body);
+        if (request.find("Connection: close") != std::string::npos)
+            break;
+    }
+    close(client->fd);
+    delete client;
+    return NULL;
+}
+
+static void *serve(void *arg)
+{
+    Server *server = (Server *) arg;
+    while (1)
+    {
+        int fd = accept(server->fd, NULL, NULL);
+        if (fd < 0)
+            break;
+        Client *client = new Client();
+        client->server = server;
+        client->fd = fd;
+        pthread_t thread;
+        pthread_create(&thread, NULL, serveClient, client);
+        pthread_detach(thread);
+    }
+    return NULL;
+}
+
+static bool startServer(Server &server)
+{
+    server.fd = listenLoopback(SOCK_STREAM, server.port);
+    if (server.fd < 0)
+        return false;
+    return startDetached(serve, &server);
+}
+
+static const unsigned long ladder[] = {300000, 600000, 1200000, 2400000, 4800000};
+static const size_t ladderSize = sizeof(ladder) / sizeof(ladder[0]);
+
+// variants of the ladder and comments, so the playlist is big enough to be measured
+static std::string masterPlaylist()
+{
+    std::string body = "#EXTM3U\n#EXT-X-VERSION:3\n";
+    for (size_t i = 0; i < ladderSize; i++)
+    {
+        char line[256];
+        snprintf(line, sizeof(line), "#EXT-X-STREAM-INF:BANDWIDTH=%lu,CODECS=\"avc1.4d401f,mp4a.40.2\"\n"
+                "variant%zu/index.m3u8\n", ladder[i], i);
+        body += line;
+    }
+    while (body.size() < 160000)
+        body += "# provider padding 0123456789abcdef0123456789abcdef0123456789abcdef\n";
+    return body;
+}
+
+static std::vector<M3U8StreamInfo> variants()
+{
+    std::vector<M3U8StreamInfo> result(ladderSize);
+    for (size_t i = 0; i < ladderSize; i++)
+    {
+        result[i].bitrate = ladder[i];
+        result[i].codecs = "avc1.4d401f,mp4a.40.2";
+    }
+    return result;
+}
+
+static bool near(unsigned long value, unsigned long expected, double tolerance)
+{
+    return value >= expected * (1 - tolerance) && value <= expected * (1 + tolerance);
+}
+
+static bool testSamples()
+{
+    BandwidthEstimator *estimator = BandwidthEstimator::getInstance();
+    estimator->clear();
+    estimator->setMargin(70);
+    int saved = silenceStderr();
+    // too small to measure and not enough bytes yet
+    estimator->addSample("a", 10000, 1);
+    bool ok = estimator->getEstimate("a") == 0;
+    estimator->addSample("a", 64000, 100);
+    ok &= estimator->getEstimate("a") == 0;
+    estimator->addSample("a", 64000, 100);
+    ok &= near(estimator->getEstimate("a"), 5120000, 0.01);
+    ok &= near(estimator->getBudget("a"), 3584000, 0.01);
+    // drop of the throughput shows quickly, peak slowly
+    estimator->addSample("a", 64000, 400);
+    ok &= estimator->getEstimate("a") < 4000000;
+    estimator->addSample("a", 640000, 100);
+    ok &= estimator->getEstimate("a") < 51200000 / 4;
+    ok &= estimator->getEstimate("b") == 0;
+    restoreStderr(saved);
+    return check("samples", ok);
+}
+
+static bool testUnderrun()
+{
+    BandwidthEstimator *estimator = BandwidthEstimator::getInstance();
+    estimator->clear();
+    int saved = silenceStderr();
+    // unknown host is known from now on
+    estimator->addUnderrun("a", 2000000);
+    bool ok = estimator->getEstimate("a") == 2000000;
+    for (int i = 0; i < 4; i++)
+        estimator->addSample("b", 640000, 100);
+    estimator->addUnderrun("b", 4000000);
+    ok &= near(estimator->getEstimate("b"), 4000000, 0.01);
+    // estimate lower than the bitrate is kept
+    estimator->addUnderrun("b", 8000000);
+    ok &= near(estimator->getEstimate("b"), 4000000, 0.01);
+    restoreStderr(saved);
+    return check("underrun", ok);
+}
+
+static bool testSnapshot()
+{
+    char path[] = "/tmp/bandwidth_test.XXXXXX";
+    int fd = mkstemp(path);
+    if (fd < 0)
+        return check("snapshot", false);
+    close(fd);
+    unlink(path);
+    BandwidthEstimator *estimator = BandwidthEstimator::getInstance();
+    estimator->clear();
+    int saved = silenceStderr();
+    bool ok = estimator->setSnapshot(path) < 0;
+    for (int i = 0; i < 4; i++)
+        estimator->addSample("cdn.example.com", 640000, 1000);
+    estimator->addUnderrun("slow.example.com", 1000000);
+    unsigned long estimate = estimator->getEstimate("cdn.example.com");
+    ok &= estimator->save() == 0;
+    estimator->clear();
+    estimator->setSnapshot("");
+    ok &= estimator->getEstimate("cdn.example.com") == 0;
+    ok &= estimator->setSnapshot(path) == 0;
+    ok &= near(estimator->getEstimate("cdn.example.com"), estimate, 0.01);
+    ok &= estimator->getEstimate("slow.example.com") == 1000000;
+    estimator->setSnapshot("");
+    restoreStderr(saved);
+    unlink(path);
+    return check("snapshot", ok);
+}
+
+// master playlist downloaded by explorer is measured
+static bool testExplorer(Server &server)
+{
+    BandwidthEstimator *estimator = BandwidthEstimator::getInstance();
+    estimator->clear();
+    server.rate = 10000000;
+    char url[128];
+    snprintf(url, sizeof(url), "http://" HOST ":%d/master.m3u8", server.port);
+    M3U8VariantsExplorer explorer(url, HeaderMap());
+    int saved = silenceStderr();
+    std::vector<M3U8StreamInfo> streams = explorer.getStreams();
+    restoreStderr(saved);
+    unsigned long estimate = estimator->getEstimate(HOST);
+    printf("%20s: %lu b/s at %ld b/s\n", "explorer", estimate, server.rate.load());
+    return check("explorer", streams.size() == ladderSize && near(estimate, server.rate, 0.3));
+}
+
+// seconds to download the segment
+static double download(const Server &server, size_t bytes)
+{
+    double start = now();
+    int fd = Connect(HOST, server.port, 5);
+    if (fd < 0)
+        return -1;
+    char request[128];
+    snprintf(request, sizeof(request), "GET /segment?bytes=%zu HTTP/1.1\r\nHost: " HOST "\r\nConnection: close\r\n\r\n", bytes);
+    writeAll(NULL, fd, request, strlen(request));
+    char buf[16384];
+    size_t total = 0;
+    ssize_t rd;
+    while ((rd = read(fd, buf, sizeof(buf))) > 0)
+        total += rd;
+    close(fd);
+    double elapsed = now() - start;
+    int saved = silenceStderr();
+    BandwidthEstimator::getInstance()->addSample(HOST, total, (int64_t) (elapsed * 1000));
+    restoreStderr(saved);
+    return elapsed;
+}
+
+struct Phase
+{
+    long rate;
+    int segments;
+    unsigned long lastBitrate;
+    int underruns;
+};
+
+// player downloads segments of variant which fits to the budget and plays
+// them, underrun limits the estimate as the service does after switch-down
+static bool simulate(Server &server, Phase &phase, double &buffer)
+{
+    const double segmentDuration = 0.5;
+    const double maxBuffer = 2.0;
+    BandwidthEstimator *estimator = BandwidthEstimator::getInstance();
+    std::vector<M3U8StreamInfo> streams = variants();
+    server.rate = phase.rate;
+    phase.underruns = 0;
+    std::string chosen;
+    for (int i = 0; i < phase.segments; i++)
+    {
+        const M3U8StreamInfo *variant = selectVariant(streams, estimator->getBudget(HOST));
+        double elapsed = download(server, variant->bitrate * segmentDuration / 8);
+        if (elapsed < 0)
+            return false;
+        buffer -= elapsed;
+        if (buffer < 0)
+        {
+            phase.underruns++;
+            buffer = 0;
+            int saved = silenceStderr();
+            estimator->addUnderrun(HOST, variant->bitrate);
+            restoreStderr(saved);
+        }
+        buffer = std::min(buffer + segmentDuration, maxBuffer);
+        phase.lastBitrate = variant->bitrate;
+        chosen += " " + std::to_string(variant->bitrate / 1000);
+    }
+    printf("%20s: link %ldkb/s, variants%s, %d underruns\n", "simulation", phase.rate / 1000, chosen.c_str(),
+            phase.underruns);
+    return true;
+}
+
+static bool testSimulation(Server &server)
+{
+    double buffer = 1.0;
+    Phase fast = {10000000, 6, 0, 0};
+    Phase slow = {1500000, 8, 0, 0};
+    bool ok = simulate(server, fast, buffer) && simulate(server, slow, buffer);
+    // best variant on fast link, after drop the one sustainable without underruns
+    ok &= fast.lastBitrate == ladder[ladderSize - 1] && fast.underruns == 0;
+    ok &= slow.lastBitrate <= 1200000 && slow.underruns <= 3;
+    return check("simulation", ok);
+}
+
+int main(int argc, char *argv[])
+{
+    int failed = 0;
+    if (!testSamples())
+        failed++;
+    if (!testUnderrun())
+        failed++;
+    if (!testSnapshot())
+        failed++;
+
+    Server server;
+    server.playlist = masterPlaylist();
+    server.rate = 10000000;
+    if (!startServer(server))
+    {
+        printf("cannot start server\n");
+        return 1;
+    }
+    if (!testExplorer(server))
+        failed++;
+    if (!testSimulation(server))
+        failed++;
+    return failed ? 1 : 0;
+}
@@ -0,0 +1,174 @@
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <string>
+#include <unistd.h>
+#include <fcntl.h>
+
+#include "common.h"
+#include "charset.h"
+#include "testutil.h"
+
+// lines of a long subtitle file, about 16 MB
+#define BENCH_LINES 200000
+
+#define POLISH "Zażółć gęślą jaźń"
+#define POLISH_1250 "Za\xBF\xF3\xB3\xE6 g\xEA\x9Cl\xB9 ja\x9F\xF1"
+#define POLISH_8859_2 "Za\xBF\xF3\xB3\xE6 g\xEA\xB6l\xB1 ja\xBC\xF1"
+#define CZECH "Příliš žluťoučký kůň úpěl ďábelské ódy"
+#define CZECH_1250 "P\xF8\xEDli\x9A \x9Elu\x9Dou\xE8k\xFD k\xF9\xF2 \xFAp\xECl \xEF\xE1" "belsk\xE9 \xF3" "dy"
+#define CZECH_8859_2 "P\xF8\xEDli\xB9 \xBElu\xBBou\xE8k\xFD k\xF9\xF2 \xFAp\xECl \xEF\xE1" "belsk\xE9 \xF3" "dy"
+
+static bool utf8(const std::string &data)
+{
+    return isUTF8(data.c_str(), data.size());
+}
+
+static std::string convert(const std::string &data, const char *encoding)
+{
+    std::string output;
+    int saved = silenceStderr();
+    int ret = convertCharset(data.c_str(), data.size(), encoding, output);
+    restoreStderr(saved);
+    return ret < 0 ? "<unsupported>" : output;
+}
+
+static std::string guess(const std::string &data)
+{
+    return guessCentralEuropean(data.c_str(), data.size(), "?");
+}
+
+static bool testDetection()
+{
+    bool ascii = false;
+    std::string text = "plain ascii text which is longer than a few words\n";
+    bool ok = isUTF8(text.c_str(), text.size(), &ascii) && ascii;
+    ok &= isUTF8(POLISH, strlen(POLISH), &ascii) && !ascii;
+    ok &= isUTF8("", 0, &ascii) && ascii;
+    // non-ascii byte at every position of the eight byte words
+    for (size_t i = 0; i < 24; i++)
+    {
+        std::string s = text.substr(0, i) + "\xC3\xA9" + text.substr(i);
+        ok &= utf8(s) && !utf8(text.substr(0, i) + "\xE9" + text.substr(i));
+    }
+    ok &= utf8("\xF0\x9F\x98\x80 \xEF\xBF\xBD \xF4\x8F\xBF\xBF");
+    // overlong forms, surrogates, too large and truncated sequences
+    ok &= !utf8("\xC0\x80") && !utf8("\xC1\xBF") && !utf8("\xE0\x80\x80") && !utf8("\xF0\x80\x80\x80");
+    ok &= !utf8("\xED\xA0\x80") && !utf8("\xF4\x90\x80\x80") && !utf8("\xF5\x80\x80\x80");
+    ok &= !utf8("abc\xC3") && !utf8("abc\xE2\x82") && !utf8("\x80") && !utf8("\xC3 ");
+    return ok;
+}
+
+static bool testConversion()
+{
+    bool ok = convert(POLISH_1250, "WINDOWS-1250") == POLISH;
+    ok &= convert(POLISH_1250, "cp1250") == POLISH;
+    ok &= convert(POLISH_8859_2, "ISO-8859-2") == POLISH && convert(POLISH_8859_2, "iso8859-2") == POLISH;
+    ok &= convert(CZECH_1250, "WINDOWS-1250") == CZECH && convert(CZECH_8859_2, "ISO-8859-2") == CZECH;
+    ok &= convert("\xF0\xD2\xC9\xD7\xC5\xD4", "KOI8-R") == "Привет";
+    ok &= convert("\xCF\xF0\xE8\xE2\xE5\xF2", "WINDOWS-1251") == "Привет";
+    ok &= convert("caf\xE9 \x80", "WINDOWS-1252") == "café €";
+    // undefined byte of the codepage
+    ok &= convert("a\x81z", "WINDOWS-1250") == "a\xEF\xBF\xBDz";
+    // encodings without table are converted by iconv
+    ok &= convert(std::string("A\0\x04\x01", 4), "UTF-16LE") == "AĄ";
+    ok &= convert("\xA4", "ISO-8859-15") == "€";
+    ok &= convert("x", "NO-SUCH-ENCODING") == "<unsupported>";
+
+    std::string output = "untouched", encoding;
+    ok &= toUTF8(POLISH, strlen(POLISH), output, &encoding) == 1 && output == "untouched" && encoding == "UTF-8";
+    ok &= toUTF8("ascii", 5, output, &encoding) == 1 && encoding == "ASCII";
+    return ok;
+}
+
+static bool testCentralEuropean()
+{
+    bool ok = guess(POLISH_1250) == "WINDOWS-1250" && guess(POLISH_8859_2) == "ISO-8859-2";
+    ok &= guess(CZECH_1250) == "WINDOWS-1250" && guess(CZECH_8859_2) == "ISO-8859-2";
+    // same letters in both of them
+    ok &= guess("\xE8\xE1\xED") == "?" && guess("ascii") == "?";
+    // symbols of WINDOWS-1250 which are letters in ISO-8859-2
+    ok &= guess("\xA9 2024, 5 \xB1 1") == "WINDOWS-1250";
+    return ok;
+}
+
+static std::string benchText(const char *line)
+{
+    std::string data;
+    data.reserve(BENCH_LINES * (strlen(line) + 2));
+    for (int i = 0; i < BENCH_LINES; i++)
+    {
+        data += line;
+        data += "\r\n";
+    }
+    return data;
+}
+
+#ifndef NO_PYTHON
+static int64_t benchPython(const std::string &data, const char *encoding, const std::string &expected)
+{
+    std::string output;
+    int64_t start = getMonotonicMs();
+    if (convertToUTF8(data, encoding, output) != 0 || output != expected)
+        return -1;
+    return getMonotonicMs() - start;
+}
+#endif
+
+static bool benchmark()
+{
+    std::string ascii = benchText("00:01:02,345 --> 00:01:04,567 We have 24 hours before they find out.");
+    std::string unicode = benchText("00:01:02,345 --> 00:01:04,567 " POLISH " " CZECH);
+    std::string legacy = benchText("00:01:02,345 --> 00:01:04,567 " POLISH_1250 " " CZECH_1250);
+    double mb = ascii.size() / (1024.0 * 1024.0);
+
+    // input which is used as it is
+    int64_t start = getMonotonicMs();
+    bool ascii_only = false;
+    bool ok = isUTF8(ascii.c_str(), ascii.size(), &ascii_only) && ascii_only;
+    printf("%20s: %.0f MB scanned in %lldms\n", "ascii", mb, (long long) (getMonotonicMs() - start));
+    start = getMonotonicMs();
+    ok &= isUTF8(unicode.c_str(), unicode.size(), &ascii_only) && !ascii_only;
+    printf("%20s: %.0f MB scanned in %lldms\n", "utf-8", mb, (long long) (getMonotonicMs() - start));
+
+    // codepage which needs conversion
+    start = getMonotonicMs();
+    ok &= guessCentralEuropean(legacy.c_str(), legacy.size(), "ISO-8859-2") == "WINDOWS-1250";
+    printf("%20s: %.0f MB scored in %lldms\n", "1250 or 8859-2", mb, (long long) (getMonotonicMs() - start));
+    std::string output;
+    start = getMonotonicMs();
+    ok &= convertCharset(legacy.c_str(), legacy.size(), "WINDOWS-1250", output) == 0 && output == unicode;
+    printf("%20s: %.0f MB converted in %lldms\n", "table", mb, (long long) (getMonotonicMs() - start));
+    // same conversion by iconv, suffix of the name keeps it from the table
+    start = getMonotonicMs();
+    ok &= convertCharset(legacy.c_str(), legacy.size(), "CP1250//", output) == 0 && output == unicode;
+    printf("%20s: %.0f MB converted in %lldms\n", "iconv", mb, (long long) (getMonotonicMs() - start));
+#ifndef NO_PYTHON
+    int64_t python = benchPython(legacy, "WINDOWS-1250", unicode);
+    ok &= python >= 0;
+    printf("%20s: %.0f MB converted in %lldms\n", "python", mb, (long long) python);
+    // former path decoded even the ascii and utf-8 input
+    python = benchPython(ascii, "ASCII", ascii);
+    ok &= python >= 0;
+    printf("%20s: %.0f MB converted in %lldms\n", "python ascii", mb, (long long) python);
+#endif
+    return ok;
+}
+
+int main(int argc, char *argv[])
+{
+    int failed = 0;
+#ifndef NO_PYTHON
+    // last resort of the conversion
+    Py_Initialize();
+#endif
+    if (!check("detection", testDetection()))
+        failed++;
+    if (!check("conversion", testConversion()))
+        failed++;
+    if (!check("central european", testCentralEuropean()))
+        failed++;
+    if (!check("benchmark", benchmark()))
+        failed++;
+    return failed ? 1 : 0;
+}
@@ -0,0 +1,289 @@
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <string>
+#include <vector>
+#include <pthread.h>
+#include <netinet/in.h>
+#include <openssl/x509.h>
+#include <zlib.h>
+
+#include "connectionpool.h"
+#include "m3u8.h"
+#include "testutil.h"
+
+// local keep-alive http(s) stand-in, every connection is served by own thread
+struct Server
+{
+    int fd;
+    int port;
+    SSL_CTX *ctx;
+    // with "Connection: close" or without telling, as after keep-alive timeout
+    bool closeAfterResponse;
+    bool dropAfterResponse;
+    int accepted;
+    pthread_mutex_t mutex;
+};
+
+struct Client
+{
+    Server *server;
+    int fd;
+};
+
+static std::string playlist()
+{
+    std::string body = "#EXTM3U\r\n";
+    for (int i = 0; i < 3; i++)
+    {
+        char line[128];
+        snprintf(line, sizeof(line), "#EXT-X-STREAM-INF:BANDWIDTH=%d\r\nvariant%d.m3u8\r\n", 100000 * (i + 1), i);
+        body += line;
+    }
+    return body;
+}
+
+static std::string gzip(const std::string &data)
+{
+    z_stream stream;
+    memset(&stream, 0, sizeof(stream));
+    deflateInit2(&stream, Z_DEFAULT_COMPRESSION, Z_DEFLATED, 15 + 16, 8, Z_DEFAULT_STRATEGY);
+    std::string result(deflateBound(&stream, data.size()), '\0');
+    stream.next_in = (Bytef *) data.data();
+    stream.avail_in = data.size();
+    stream.next_out = (Bytef *) &result[0];
+    stream.avail_out = result.size();
+    deflate(&stream, Z_FINISH);
+    result.resize(stream.total_out);
+    deflateEnd(&stream);
+    return result;
+}
+
+static std::string response(const Server *server, const std::string &path)
+{
+    std::string connection = server->closeAfterResponse ? "Connection: close\r\n" : "";
+    std::string body = playlist();
+    char buf[256];
+    if (path == "/redirect.m3u8")
+    {
+        snprintf(buf, sizeof(buf), "http%s://127.0.0.1:%d/master.m3u8", server->ctx ? "s" : "", server->port);
+        std::string moved = "<html>moved</html>";
+        return "HTTP/1.1 302 Found\r\nLocation: " + std::string(buf) + "\r\nContent-Type: text/html\r\n" +
+                connection + "Content-Length: " + std::to_string(moved.size()) + "\r\n\r\n" + moved;
+    }
+    std::string head = "HTTP/1.1 200 OK\r\nContent-Type: application/vnd.apple.mpegurl\r\n" + connection;
+    if (path == "/gzip.m3u8")
+    {
+        head += "Content-Encoding: gzip\r\n";
+        body = gzip(body);
+    }
+    if (path == "/chunked.m3u8" || path == "/gzip.m3u8")
+    {
+        std::string chunks;
+        for (size_t pos = 0; pos < body.size(); pos += 10)
+        {
+            std::string chunk = body.substr(pos, 10);
+            snprintf(buf, sizeof(buf), "%zx;ext=1\r\n", chunk.size());
+            chunks += buf + chunk + "\r\n";
+        }
+        return head + "Transfer-Encoding: chunked\r\n\r\n" + chunks + "0\r\nX-Trailer: 1\r\n\r\n";
+    }
+    return head + "Content-Length: " + std::to_string(body.size()) + "\r\n\r\n" + body;
+}
+
+static void *serveClient(void *arg)
+{
+    Client *client = (Client *) arg;
+    Server *server = client->server;
+    SSL *ssl = NULL;
+    if (server->ctx)
+    {
+        ssl = SSL_new(server->ctx);
+        SSL_set_fd(ssl, client->fd);
+        if (SSL_accept(ssl) != 1)
+            goto out;
+    }
+    while (1)
+    {
+        std::string request;
+        char buf[1024];
+        ssize_t rd;
+        while (request.find("\r\n\r\n") == std::string::npos && (rd = singleRead(ssl, client->fd, buf, sizeof(buf))) > 0)
+            request.append(buf, rd);
+        if (request.find("\r\n\r\n") == std::string::npos)
+            break;
+        size_t start = request.find(' ') + 1;
+        std::string path = request.substr(start, request.find(' ', start) - start);
+        // decided before the client gets the response and changes the flags
+        bool last = server->closeAfterResponse || server->dropAfterResponse;
+        std::string resp = response(server, path);
+        writeAll(ssl, client->fd, resp.c_str(), resp.size());
+        if (last)
+            break;
+    }
+out:
+    if (ssl)
+    {
+        SSL_shutdown(ssl);
+        SSL_free(ssl);
+    }
+    close(client->fd);
+    delete client;
+    return NULL;
+}
+
+static void *serve(void *arg)
+{
+    Server *server = (Server *) arg;
+    while (1)
+    {
+        int fd = accept(server->fd, NULL, NULL);
+        if (fd < 0)
+            break;
+        pthread_mutex_lock(&server->mutex);
+        server->accepted++;
+        pthread_mutex_unlock(&server->mutex);
+        Client *client = new Client();
+        client->server = server;
+        client->fd = fd;
+        pthread_t thread;
+        pthread_create(&thread, NULL, serveClient, client);
+        pthread_detach(thread);
+    }
+    return NULL;
+}
+
+static bool startServer(Server &server, SSL_CTX *ctx)
+{
+    server.ctx = ctx;
+    server.closeAfterResponse = false;
+    server.dropAfterResponse = false;
+    server.accepted = 0;
+    pthread_mutex_init(&server.mutex, NULL);
+    server.fd = listenLoopback(SOCK_STREAM, server.port);
+    if (server.fd < 0)
+        return false;
+    return startDetached(serve, &server);
+}
+
+static int accepted(Server &server)
+{
+    pthread_mutex_lock(&server.mutex);
+    int count = server.accepted;
+    pthread_mutex_unlock(&server.mutex);
+    return count;
+}
+
+// self-signed certificate for the https stand-in
+static SSL_CTX *serverContext()
+{
+    EVP_PKEY *key = NULL;
+    EVP_PKEY_CTX *kctx = EVP_PKEY_CTX_new_id(EVP_PKEY_RSA, NULL);
+    if (!kctx || EVP_PKEY_keygen_init(kctx) <= 0 || EVP_PKEY_CTX_set_rsa_keygen_bits(kctx, 2048) <= 0 ||
+            EVP_PKEY_keygen(kctx, &key) <= 0)
+        return NULL;
+    EVP_PKEY_CTX_free(kctx);
+    X509 *cert = X509_new();
+    ASN1_INTEGER_set(X509_get_serialNumber(cert), 1);
+    X509_gmtime_adj(X509_get_notBefore(cert), 0);
+    X509_gmtime_adj(X509_get_notAfter(cert), 3600);
+    X509_set_pubkey(cert, key);
+    X509_NAME *name = X509_get_subject_name(cert);
+    X509_NAME_add_entry_by_txt(name, "CN", MBSTRING_ASC, (const unsigned char *) "127.0.0.1", -1, -1, 0);
+    X509_set_issuer_name(cert, name);
+    X509_sign(cert, key, EVP_sha256());
+    SSL_CTX *ctx = SSL_CTX_new(SSLv23_server_method());
+    SSL_CTX_use_certificate(ctx, cert);
+    SSL_CTX_use_PrivateKey(ctx, key);
+    X509_free(cert);
+    EVP_PKEY_free(key);
+    return ctx;
+}
+
+static int explore(const Server &server, const char *path)
+{
+    char url[128];
+    snprintf(url, sizeof(url), "http%s://127.0.0.1:%d%s", server.ctx ? "s" : "", server.port, path);
+    M3U8VariantsExplorer explorer(url, HeaderMap());
+    int saved = silenceStderr();
+    std::vector<M3U8StreamInfo> streams = explorer.getStreams();
+    restoreStderr(saved);
+    return streams.size();
+}
+
+// cancelled exploration doesn't make any request
+static bool testCancel(Server &server)
+{
+    char url[128];
+    snprintf(url, sizeof(url), "http://127.0.0.1:%d/master.m3u8", server.port);
+    M3U8VariantsExplorer explorer(url, HeaderMap());
+    std::atomic<bool> cancelled(true);
+    explorer.setCancelFlag(&cancelled);
+    int before = accepted(server);
+    int saved = silenceStderr();
+    std::vector<M3U8StreamInfo> streams = explorer.getStreams();
+    restoreStderr(saved);
+    return streams.empty() && accepted(server) == before;
+}
+
+int main()
+{
+    SSL_load_error_strings();
+    SSL_library_init();
+    ConnectionPool *pool = ConnectionPool::getInstance();
+    int failed = 0;
+    unsigned int connects, reuses, resumptions;
+
+    Server server;
+    if (!startServer(server, NULL))
+    {
+        printf("cannot start server\n");
+        return 1;
+    }
+    // redirect and following requests over one connection
+    bool ok = explore(server, "/redirect.m3u8") == 3 && accepted(server) == 1;
+    if (!check("redirect", ok))
+        failed++;
+    ok = explore(server, "/master.m3u8") == 3 && explore(server, "/chunked.m3u8") == 3 &&
+            explore(server, "/gzip.m3u8") == 3 && explore(server, "/master.m3u8") == 3 && accepted(server) == 1;
+    if (!check("keep-alive", ok))
+        failed++;
+    // idle connection closed by server is replaced
+    server.dropAfterResponse = true;
+    ok = explore(server, "/master.m3u8") == 3 && explore(server, "/master.m3u8") == 3 && accepted(server) == 2;
+    if (!check("dropped by server", ok))
+        failed++;
+    server.dropAfterResponse = false;
+    server.closeAfterResponse = true;
+    ok = explore(server, "/master.m3u8") == 3 && explore(server, "/master.m3u8") == 3 && accepted(server) == 4;
+    if (!check("connection: close", ok))
+        failed++;
+    if (!check("cancel", testCancel(server)))
+        failed++;
+    pool->getStats(connects, reuses, resumptions);
+    printf("%20s: %u connects, %u reuses\n", "http", connects, reuses);
+
+    SSL_CTX *ctx = serverContext();
+    Server secure;
+    if (!ctx || !startServer(secure, ctx))
+    {
+        printf("cannot start https server\n");
+        return 1;
+    }
+    ok = explore(secure, "/redirect.m3u8") == 3 && accepted(secure) == 1;
+    if (!check("https redirect", ok))
+        failed++;
+    // idle connection is used once more, then new connections resume the session
+    secure.closeAfterResponse = true;
+    ok = explore(secure, "/master.m3u8") == 3 && explore(secure, "/master.m3u8") == 3 &&
+            explore(secure, "/master.m3u8") == 3 && accepted(secure) == 3;
+    unsigned int connects2, reuses2, resumptions2;
+    pool->getStats(connects2, reuses2, resumptions2);
+    ok &= resumptions2 - resumptions == 2;
+    if (!check("https resumption", ok))
+        failed++;
+    printf("%20s: %u connects, %u reuses, %u resumed\n", "https", connects2 - connects, reuses2 - reuses,
+            resumptions2 - resumptions);
+    pool->clear();
+    return failed ? 1 : 0;
+}
@@ -23,9 +23,11 @@ int main(int argc, char *argv[])
             continue;
         }
         M3U8VariantsExplorer ve(url, getHeaders(url));
-        std::vector<M3U8StreamInfo> streams = ve.getStreams();
+        M3U8MasterPlaylist playlist = ve.getPlaylist();
+        printf("version: %d, independent segments: %s\n", playlist.version,
+                playlist.independentSegments ? "yes" : "no");
         int i = 0;
-        for (std::vector<M3U8StreamInfo>::const_iterator iter(streams.begin()); iter != streams.end(); iter++, i++)
+        for (std::vector<M3U8StreamInfo>::const_iterator iter(playlist.variants.begin()); iter != playlist.variants.end(); iter++, i++)
         {
             printf("HLS[%d]: %s\n", i, iter->url.c_str());
             printf("%15s: ", "headers");
@@ -38,8 +40,29 @@ int main(int argc, char *argv[])
             }
             printf("\n");
             printf("%15s: %ld\n", "bitrate", iter->bitrate);
+            printf("%15s: %ld\n", "average bitrate", iter->averageBitrate);
             printf("%15s: %s\n", "resolution", iter->resolution.c_str());
+            printf("%15s: %.3f\n", "frame rate", iter->frameRate);
             printf("%15s: %s\n", "codecs", iter->codecs.c_str());
+            printf("%15s: %s\n", "hdcp level", iter->hdcpLevel.c_str());
+            printf("%15s: audio=%s video=%s subtitles=%s cc=%s\n", "groups", iter->audioGroup.c_str(),
+                    iter->videoGroup.c_str(), iter->subtitlesGroup.c_str(), iter->closedCaptionsGroup.c_str());
+        }
+        i = 0;
+        for (std::vector<M3U8StreamInfo>::const_iterator iter(playlist.iframeStreams.begin()); iter != playlist.iframeStreams.end(); iter++, i++)
+        {
+            printf("I-FRAME[%d]: %s\n", i, iter->url.c_str());
+            printf("%15s: %ld\n", "bitrate", iter->bitrate);
+            printf("%15s: %s\n", "resolution", iter->resolution.c_str());
+        }
+        const char *types[] = {"AUDIO", "VIDEO", "SUBTITLES", "CLOSED-CAPTIONS"};
+        i = 0;
+        for (std::vector<M3U8Rendition>::const_iterator iter(playlist.renditions.begin()); iter != playlist.renditions.end(); iter++, i++)
+        {
+            printf("MEDIA[%d]: %s %s \"%s\" (%s)%s%s\n", i, types[iter->type], iter->groupId.c_str(), iter->name.c_str(),
+                    iter->language.c_str(), iter->isDefault ? " default" : "", iter->forced ? " forced" : "");
+            if (!iter->url.empty())
+                printf("%15s: %s\n", "url", iter->url.c_str());
         }
     }
     return 0;
@@ -0,0 +1,309 @@
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <string>
+#include <vector>
+#include <pthread.h>
+#include <netinet/in.h>
+
+#include "hlsproxy.h"
+#include "m3u8.h"
+#include "wrappers.h"
+#include "testutil.h"
+
+#define SEGMENTS 8
+#define SEGMENT_SIZE (100 * 1000)
+
+// local origin of the stream, every connection is served by own thread
+struct Origin
+{
+    int fd;
+    int port;
+    // latency of every segment response
+    int delayMs;
+    // first segment of the live window, moves with every request of it
+    int liveSequence;
+    pthread_mutex_t mutex;
+};
+
+struct Client
+{
+    Origin *origin;
+    int fd;
+};
+
+static std::string segmentData(int index)
+{
+    std::string data(SEGMENT_SIZE, '\0');
+    for (size_t i = 0; i < data.size(); i++)
+        data[i] = (char)(index * 31 + i);
+    return data;
+}
+
+static std::string mediaPlaylist()
+{
+    std::string body = "#EXTM3U\r\n#EXT-X-TARGETDURATION:1\r\n#EXT-X-MEDIA-SEQUENCE:0\r\n";
+    body += "#EXT-X-KEY:METHOD=AES-128,URI=\"key.bin\",IV=0x1\r\n";
+    for (int i = 0; i < SEGMENTS; i++)
+        body += "#EXTINF:1.0,\r\nseg" + std::to_string(i) + ".ts?token=1\r\n";
+    // segment which the origin doesn't have
+    body += "#EXTINF:1.0,\r\nmissing.ts\r\n#EXT-X-ENDLIST\r\n";
+    return body;
+}
+
+static std::string response(Origin *origin, const std::string &path)
+{
+    const char *playlistType = "application/vnd.apple.mpegurl";
+    std::string body, type = "video/mp2t", status = "200 OK", extra;
+    int index;
+    if (path == "/master.m3u8")
+    {
+        body = "#EXTM3U\n#EXT-X-MEDIA:TYPE=AUDIO,GROUP-ID=\"aud\",NAME=\"en\",URI=\"audio/index.m3u8\"\n"
+                "#EXT-X-STREAM-INF:BANDWIDTH=500000,AUDIO=\"aud\"\nlow/index.m3u8\n"
+                "#EXT-X-STREAM-INF:BANDWIDTH=2000000,AUDIO=\"aud\"\nhigh/index.m3u8\n";
+        type = playlistType;
+    }
+    else if (path == "/low/index.m3u8")
+    {
+        body = mediaPlaylist();
+        type = playlistType;
+    }
+    else if (path == "/live/index.m3u8")
+    {
+        pthread_mutex_lock(&origin->mutex);
+        int sequence = origin->liveSequence++ % (SEGMENTS - 2);
+        pthread_mutex_unlock(&origin->mutex);
+        body = "#EXTM3U\n#EXT-X-TARGETDURATION:1\n#EXT-X-MEDIA-SEQUENCE:" + std::to_string(sequence) + "\n";
+        for (int i = sequence; i < sequence + 3; i++)
+            body += "#EXTINF:1.0,\n/low/seg" + std::to_string(i) + ".ts\n";
+        type = playlistType;
+    }
+    else if (path == "/redirect.m3u8")
+    {
+        status = "302 Found";
+        extra = "Location: /low/index.m3u8\r\n";
+    }
+    else if (sscanf(path.c_str(), "/low/seg%d.ts", &index) == 1 && index >= 0 && index < SEGMENTS)
+    {
+        pthread_mutex_lock(&origin->mutex);
+        int delay = origin->delayMs;
+        pthread_mutex_unlock(&origin->mutex);
+        usleep(delay * 1000);
+        body = segmentData(index);
+    }
+    else
+        status = "404 Not Found";
+    return "HTTP/1.1 " + status + "\r\nContent-Type: " + type + "\r\n" + extra +
+            "Content-Length: " + std::to_string(body.size()) + "\r\n\r\n" + body;
+}
+
+static void *serveClient(void *arg)
+{
+    Client *client = (Client *) arg;
+    while (1)
+    {
+        std::string request;
+        char buf[1024];
+        ssize_t rd;
+        while (request.find("\r\n\r\n") == std::string::npos && (rd = read(client->fd, buf, sizeof(buf))) > 0)
+            request.append(buf, rd);
+        if (request.find("\r\n\r\n") == std::string::npos)
+            break;
+        size_t start = request.find(' ') + 1;
+        std::string path = request.substr(start, request.find_first_of(" ?", start) - start);
+        std::string resp = response(client->origin, path);
+        if (writeAll(NULL, client->fd, resp.c_str(), resp.size()) < 0)
+            break;
+    }
+    close(client->fd);
+    delete client;
+    return NULL;
+}
+
+static void *serve(void *arg)
+{
+    Origin *origin = (Origin *) arg;
+    while (1)
+    {
+        int fd = accept(origin->fd, NULL, NULL);
+        if (fd < 0)
+            break;
+        Client *client = new Client();
+        client->origin = origin;
+        client->fd = fd;
+        pthread_t thread;
+        pthread_create(&thread, NULL, serveClient, client);
+        pthread_detach(thread);
+    }
+    return NULL;
+}
+
+static bool startOrigin(Origin &origin)
+{
+    origin.delayMs = 0;
+    origin.liveSequence = 0;
+    pthread_mutex_init(&origin.mutex, NULL);
+    origin.fd = listenLoopback(SOCK_STREAM, origin.port);
+    if (origin.fd < 0)
+        return false;
+    return startDetached(serve, &origin);
+}
+
+static int get(const std::string &url, std::string &body, const HeaderMap &headers=HeaderMap())
+{
+    std::string finalUrl;
+    int saved = silenceStderr();
+    int status = HlsProxy::fetch(url, headers, body, finalUrl, 16 * 1024 * 1024);
+    restoreStderr(saved);
+    return status;
+}
+
+static std::vector<std::string> uris(const std::string &playlist)
+{
+    std::vector<std::string> result;
+    size_t pos = 0;
+    while (pos < playlist.size())
+    {
+        size_t end = playlist.find('\n', pos);
+        std::string line = playlist.substr(pos, end - pos);
+        pos = end == std::string::npos ? end : end + 1;
+        if (!line.empty() && line[0] != '#')
+            result.push_back(line);
+    }
+    return result;
+}
+
+// plays segments of the playlist one after another, each for playMs,
+// returns ms spent waiting for the segments or -1 on wrong content
+static int play(const std::string &playlistUrl, int playMs)
+{
+    std::string playlist;
+    if (get(playlistUrl, playlist) != 200)
+        return -1;
+    std::vector<std::string> segments = uris(playlist);
+    if (segments.size() != SEGMENTS + 1)
+        return -1;
+    int64_t waited = 0;
+    for (int i = 0; i < SEGMENTS; i++)
+    {
+        std::string data;
+        int64_t start = getMonotonicMs();
+        if (get(resolveUrl(playlistUrl, segments[i]), data) != 200 || data != segmentData(i))
+            return -1;
+        waited += getMonotonicMs() - start;
+        usleep(playMs * 1000);
+    }
+    return waited;
+}
+
+int main(int argc, char *argv[])
+{
+    HlsProxy *proxy = HlsProxy::getInstance();
+    int failed = 0;
+    Origin origin;
+    if (!startOrigin(origin))
+    {
+        printf("cannot start origin\n");
+        return 1;
+    }
+    char base[64];
+    snprintf(base, sizeof(base), "http://127.0.0.1:%d", origin.port);
+    proxy->setLimits(3, 16 * 1024 * 1024);
+    std::string session = proxy->open(HeaderMap());
+    if (session.empty())
+    {
+        printf("cannot start proxy\n");
+        return 1;
+    }
+
+    // variants and renditions of master playlist lead to the proxy
+    std::string proxied = proxy->getUrl(session, std::string(base) + "/master.m3u8");
+    std::string prefix = proxied.substr(0, proxied.rfind('/') + 1);
+    std::string playlist;
+    bool ok = get(proxied, playlist) == 200;
+    std::vector<std::string> variants = uris(playlist);
+    ok &= variants.size() == 2 && !variants[0].compare(0, prefix.size(), prefix) &&
+            variants[0] != variants[1] && playlist.find("URI=\"" + prefix) != std::string::npos;
+    if (!check("master rewrite", ok))
+        failed++;
+
+    // key stays at the origin, segments are proxied with their extension
+    ok = get(variants[0], playlist) == 200;
+    std::vector<std::string> segments = uris(playlist);
+    ok &= playlist.find("URI=\"" + std::string(base) + "/low/key.bin\",IV=0x1") != std::string::npos &&
+            segments.size() == SEGMENTS + 1 && !segments[0].compare(0, prefix.size(), prefix) &&
+            segments[0].substr(segments[0].size() - 3) == ".ts" && playlist.find('\r') == std::string::npos;
+    if (!check("media rewrite", ok))
+        failed++;
+
+    std::string data;
+    ok = get(segments[SEGMENTS], data) == 502 && get(prefix + "s999.ts", data) == 404;
+    if (!check("errors", ok))
+        failed++;
+
+    HeaderMap range;
+    range["Range"] = "bytes=10-19";
+    ok = get(segments[1], data, range) == 206 && data == segmentData(1).substr(10, 10);
+    range["Range"] = "bytes=-10";
+    ok &= get(segments[1], data, range) == 206 && data == segmentData(1).substr(SEGMENT_SIZE - 10);
+    range["Range"] = "bytes=-0";
+    ok &= get(segments[1], data, range) == 416;
+    if (!check("range", ok))
+        failed++;
+
+    // segments which left the live window are forgotten
+    std::string live = proxy->getUrl(session, std::string(base) + "/live/index.m3u8");
+    ok = get(live, playlist) == 200;
+    std::vector<std::string> first = uris(playlist);
+    for (int i = 0; i < 3; i++)
+        ok &= get(live, playlist) == 200;
+    std::vector<std::string> last = uris(playlist);
+    ok &= first.size() == 3 && last.size() == 3 && get(first[0], data) == 404 &&
+            get(last[0], data) == 200 && data == segmentData(3);
+    if (!check("live window", ok))
+        failed++;
+    proxy->close(session);
+
+    // jittery origin, player waits for every segment without the proxy
+    origin.delayMs = 150;
+    int direct = play(std::string(base) + "/low/index.m3u8", 100);
+    std::string closed = session;
+    session = proxy->open(HeaderMap());
+    // ids of the sessions can't be guessed from each other
+    ok = session.size() == 32 && session.find_first_not_of("0123456789abcdef") == std::string::npos &&
+            session != closed;
+    if (!check("session id", ok))
+        failed++;
+    size_t cached;
+    unsigned int depth, hits, misses;
+    proxy->getStats(cached, depth, hits, misses);
+    int64_t start = getMonotonicMs();
+    int waited = play(proxy->getUrl(session, std::string(base) + "/low/index.m3u8"), 100);
+    int elapsed = getMonotonicMs() - start;
+    unsigned int hits2, misses2;
+    proxy->getStats(cached, depth, hits2, misses2);
+    printf("%20s: waited %dms direct, %dms through proxy, %u hits, %u misses\n", "playback", direct, waited,
+            hits2 - hits, misses2 - misses);
+    ok = direct >= SEGMENTS * 150 && waited >= 0 && waited < direct / 2 && hits2 - hits >= SEGMENTS - 2 &&
+            elapsed < SEGMENTS * 250;
+    if (!check("prefetch", ok))
+        failed++;
+    ok = cached == SEGMENTS * SEGMENT_SIZE;
+    proxy->close(session);
+    proxy->getStats(cached, depth, hits, misses);
+    ok &= cached == 0 && get(prefix + "p0.m3u8", data) == 404;
+    if (!check("close", ok))
+        failed++;
+
+    // cache holds 2.5 segments, served ones are dropped first
+    origin.delayMs = 0;
+    proxy->setLimits(3, SEGMENT_SIZE * 5 / 2);
+    session = proxy->open(HeaderMap());
+    ok = play(proxy->getUrl(session, std::string(base) + "/redirect.m3u8"), 50) >= 0;
+    proxy->getStats(cached, depth, hits, misses);
+    ok &= cached <= SEGMENT_SIZE * 5 / 2;
+    if (!check("cache limit", ok))
+        failed++;
+    proxy->close(session);
+    return failed ? 1 : 0;
+}
@@ -0,0 +1,356 @@
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <string>
+#include <vector>
+#include <pthread.h>
+#include <time.h>
+#include <netinet/in.h>
+#include <zlib.h>
+
+#include "m3u8.h"
+#include "testutil.h"
+
+// previous implementation from wrappers.cpp, for comparison
+static ssize_t legacyReadLine(SSL *ssl, int fd, char** buffer, size_t* bufsize)
+{
+    size_t i = 0;
+    int result;
+    while (1)
+    {
+        if (i >= *bufsize)
+        {
+            char *newbuf = (char*)realloc(*buffer, (*bufsize)+1024);
+            if (newbuf == NULL)
+                return -ENOMEM;
+            *buffer = newbuf;
+            *bufsize = (*bufsize) + 1024;
+        }
+        result = timedRead(ssl, fd, (*buffer) + i, 1, 3000, 100);
+        if (result <= 0 || (*buffer)[i] == '\n')
+        {
+            (*buffer)[i] = '\0';
+            return result <= 0 ? -1 : i;
+        }
+        if ((*buffer)[i] != '\r') i++;
+    }
+    return -1;
+}
+
+// local http stand-in, answers every request with the same response
+struct Server
+{
+    int fd;
+    int port;
+    std::string response;
+    pthread_t thread;
+};
+
+static void *serve(void *arg)
+{
+    Server *server = (Server *) arg;
+    while (1)
+    {
+        int client = accept(server->fd, NULL, NULL);
+        if (client < 0)
+            break;
+        std::string request;
+        char buf[1024];
+        ssize_t rd;
+        while (request.find("\r\n\r\n") == std::string::npos && (rd = read(client, buf, sizeof(buf))) > 0)
+            request.append(buf, rd);
+        if (request.compare(0, 4, "QUIT") == 0)
+        {
+            close(client);
+            break;
+        }
+        writeAll(NULL, client, server->response.c_str(), server->response.size());
+        close(client);
+    }
+    return NULL;
+}
+
+static bool startServer(Server &server, const std::string &response)
+{
+    server.fd = listenLoopback(SOCK_STREAM, server.port);
+    if (server.fd < 0)
+        return false;
+    server.response = response;
+    return pthread_create(&server.thread, NULL, serve, &server) == 0;
+}
+
+static bool startServer(Server &server, const std::string &body, const char *contentType)
+{
+    char headers[256];
+    snprintf(headers, sizeof(headers), "HTTP/1.1 200 OK\r\nContent-Type: %s\r\nContent-Length: %zu\r\n\r\n",
+            contentType, body.size());
+    return startServer(server, headers + body);
+}
+
+static void stopServer(Server &server)
+{
+    int fd = Connect("127.0.0.1", server.port, 5);
+    writeAll(NULL, fd, "QUIT\r\n\r\n", 8);
+    close(fd);
+    pthread_join(server.thread, NULL);
+    close(server.fd);
+}
+
+static int request(const Server &server)
+{
+    int fd = Connect("127.0.0.1", server.port, 5);
+    const char *req = "GET / HTTP/1.1\r\nHost: 127.0.0.1\r\nConnection: close\r\n\r\n";
+    if (fd >= 0)
+        writeAll(NULL, fd, req, strlen(req));
+    return fd;
+}
+
+static std::string masterPlaylist(int variants)
+{
+    std::string body = "#EXTM3U\n#EXT-X-VERSION:3\n";
+    for (int i = 0; i < variants; i++)
+    {
+        char line[256];
+        snprintf(line, sizeof(line), "#EXT-X-STREAM-INF:BANDWIDTH=%d,RESOLUTION=1280x720,CODECS=\"avc1.4d401f,mp4a.40.2\"\n"
+                "variant/%05d/index.m3u8?token=0123456789abcdef0123456789abcdef\n", 100000 + i, i);
+        body += line;
+    }
+    return body;
+}
+
+// stderr of the explorer is too chatty for a big playlist
+static std::vector<std::string> readerLines(const Server &server, size_t blockSize)
+{
+    std::vector<std::string> lines;
+    int fd = request(server);
+    ConnectionReader reader(NULL, fd, blockSize);
+    char *line;
+    ssize_t len;
+    while ((len = reader.readLine(&line)) >= 0)
+        lines.push_back(std::string(line, len));
+    close(fd);
+    return lines;
+}
+
+static bool testLines()
+{
+    // crlf, long line and no newline at the end
+    std::string longLine(100000, 'x');
+    std::string body = "#EXTM3U\r\n\r\n" + longLine + "\nlast";
+    Server server;
+    if (!startServer(server, body, "text/plain"))
+        return check("lines", false);
+    bool ok = true;
+    size_t blocks[] = {16, 1000, 16 * 1024};
+    for (size_t i = 0; i < sizeof(blocks) / sizeof(blocks[0]); i++)
+    {
+        std::vector<std::string> lines = readerLines(server, blocks[i]);
+        ok &= lines.size() == 8 && lines[0] == "HTTP/1.1 200 OK" && lines[3] == "" &&
+                lines[4] == "#EXTM3U" && lines[5] == "" && lines[6] == longLine && lines[7] == "last";
+    }
+
+    // body after the header lines
+    int fd = request(server);
+    ConnectionReader reader(NULL, fd, 1024);
+    char *line;
+    while (reader.readLine(&line) > 0);
+    std::string content;
+    std::vector<char> buf(4096);
+    ssize_t rd;
+    while ((rd = reader.read(&buf[0], buf.size())) > 0)
+        content.append(&buf[0], rd);
+    close(fd);
+    ok &= content == body;
+
+    stopServer(server);
+    return check("lines", ok);
+}
+
+static std::string compress(const std::string &data, bool gzip)
+{
+    z_stream stream;
+    memset(&stream, 0, sizeof(stream));
+    deflateInit2(&stream, Z_DEFAULT_COMPRESSION, Z_DEFLATED, gzip ? 15 + 16 : 15, 8, Z_DEFAULT_STRATEGY);
+    std::string result(deflateBound(&stream, data.size()), '\0');
+    stream.next_in = (Bytef *) data.data();
+    stream.avail_in = data.size();
+    stream.next_out = (Bytef *) &result[0];
+    stream.avail_out = result.size();
+    deflate(&stream, Z_FINISH);
+    result.resize(stream.total_out);
+    deflateEnd(&stream);
+    return result;
+}
+
+static std::string chunked(const std::string &data, size_t chunkSize)
+{
+    std::string result;
+    for (size_t pos = 0; pos < data.size(); pos += chunkSize)
+    {
+        std::string chunk = data.substr(pos, chunkSize);
+        char size[32];
+        snprintf(size, sizeof(size), "%zx;ext=1\r\n", chunk.size());
+        result += size + chunk + "\r\n";
+    }
+    return result + "0\r\n\r\n";
+}
+
+// body of the response with delimited body and content coding
+static bool readCompressed(const std::string &response, std::string &content, bool &complete, size_t &received)
+{
+    Server server;
+    if (!startServer(server, response))
+        return false;
+    int fd = request(server);
+    ConnectionReader reader(NULL, fd, 1024);
+    char *line;
+    ssize_t len;
+    bool chunk = false, ok = true;
+    long long length = -1;
+    std::string encoding;
+    while ((len = reader.readLine(&line)) > 0)
+    {
+        if (!strncasecmp(line, "Content-Length:", 15))
+            length = atoll(&line[15]);
+        else if (!strncasecmp(line, "Transfer-Encoding:", 18))
+            chunk = true;
+        else if (!strncasecmp(line, "Content-Encoding:", 17))
+            encoding = &line[17];
+    }
+    if (chunk)
+        reader.setChunked();
+    else if (length >= 0)
+        reader.setBodyLength(length);
+    if (reader.setContentEncoding(encoding.c_str()))
+    {
+        // mixed line and block reads
+        content.clear();
+        if ((len = reader.readLine(&line)) >= 0)
+            content.append(line, len).append("\n");
+        std::vector<char> buf(3000);
+        while ((len = reader.read(&buf[0], buf.size())) > 0)
+            content.append(&buf[0], len);
+    }
+    else
+        ok = false;
+    complete = reader.bodyComplete();
+    received = reader.bodyReceived();
+    close(fd);
+    stopServer(server);
+    return ok;
+}
+
+static bool testCompressed()
+{
+    std::string body = masterPlaylist(300);
+    std::string gzipped = compress(body, true);
+    std::string content;
+    bool complete;
+    size_t received;
+    char headers[256];
+    snprintf(headers, sizeof(headers), "HTTP/1.1 200 OK\r\nContent-Encoding: gzip\r\nContent-Length: %zu\r\n\r\n",
+            gzipped.size());
+    bool ok = readCompressed(headers + gzipped, content, complete, received) &&
+            content == body && complete && received == gzipped.size();
+
+    std::string response = "HTTP/1.1 200 OK\r\nTransfer-Encoding: chunked\r\nContent-Encoding: x-gzip\r\n\r\n";
+    ok &= readCompressed(response + chunked(gzipped, 100), content, complete, received) &&
+            content == body && complete && received == gzipped.size();
+
+    // zlib stream, body ends when the connection is closed
+    response = "HTTP/1.1 200 OK\r\nContent-Encoding: deflate\r\n\r\n";
+    ok &= readCompressed(response + compress(body, false), content, complete, received) && content == body;
+
+    // corrupted in the middle and truncated streams are not complete
+    std::string corrupt = gzipped;
+    corrupt[corrupt.size() / 2] ^= 0x55;
+    response = "HTTP/1.1 200 OK\r\nTransfer-Encoding: chunked\r\nContent-Encoding: gzip\r\n\r\n";
+    int saved = silenceStderr();
+    ok &= readCompressed(response + chunked(corrupt, 100), content, complete, received) && !complete &&
+            content != body;
+    ok &= readCompressed(response + chunked(gzipped.substr(0, gzipped.size() - 20), 100), content, complete,
+            received) && !complete && content.size() < body.size();
+    response = "HTTP/1.1 200 OK\r\nContent-Encoding: br\r\nContent-Length: 4\r\n\r\nxxxx";
+    ok &= !readCompressed(response, content, complete, received);
+    restoreStderr(saved);
+    return check("compressed", ok);
+}
+
+static bool testExplorer(const Server &server, int variants)
+{
+    char url[64];
+    snprintf(url, sizeof(url), "http://127.0.0.1:%d/master.m3u8", server.port);
+    M3U8VariantsExplorer explorer(url, HeaderMap());
+    int saved = silenceStderr();
+    std::vector<M3U8StreamInfo> streams = explorer.getStreams();
+    restoreStderr(saved);
+    char last[128];
+    snprintf(last, sizeof(last), "http://127.0.0.1:%d/variant/%05d/index.m3u8?token=0123456789abcdef0123456789abcdef",
+            server.port, variants - 1);
+    bool ok = (int) streams.size() == variants &&
+            streams[0].bitrate == 100000 && streams[0].resolution == "1280x720" &&
+            streams[variants - 1].url == last;
+    return check("explorer", ok);
+}
+
+static double elapsed(const struct timespec &start)
+{
+    struct timespec now;
+    clock_gettime(CLOCK_MONOTONIC, &now);
+    return (now.tv_sec - start.tv_sec) + (now.tv_nsec - start.tv_nsec) / 1e9;
+}
+
+// reads response of the server line by line
+static void benchmark(const Server &server, bool legacy)
+{
+    const int rounds = 5;
+    size_t lines = 0;
+    struct timespec start;
+    clock_gettime(CLOCK_MONOTONIC, &start);
+    for (int i = 0; i < rounds; i++)
+    {
+        int fd = request(server);
+        if (legacy)
+        {
+            size_t bufferSize = 1024;
+            char *lineBuffer = (char *) malloc(bufferSize);
+            while (legacyReadLine(NULL, fd, &lineBuffer, &bufferSize) >= 0)
+                lines++;
+            free(lineBuffer);
+        }
+        else
+        {
+            ConnectionReader reader(NULL, fd);
+            char *line;
+            while (reader.readLine(&line) >= 0)
+                lines++;
+        }
+        close(fd);
+    }
+    printf("%20s: %-9s %8.2f ms/playlist, %zu lines\n", "benchmark", legacy ? "legacy" : "buffered",
+            elapsed(start) * 1e3 / rounds, lines / rounds);
+}
+
+int main()
+{
+    int failed = 0;
+    if (!testLines())
+        failed++;
+    if (!testCompressed())
+        failed++;
+
+    const int variants = 5000;
+    Server server;
+    if (!startServer(server, masterPlaylist(variants), "application/vnd.apple.mpegurl"))
+    {
+        printf("cannot start server\n");
+        return 1;
+    }
+    printf("master playlist: %d variants, %zu bytes\n", variants, server.response.size());
+    if (!testExplorer(server, variants))
+        failed++;
+    benchmark(server, true);
+    benchmark(server, false);
+    stopServer(server);
+    return failed ? 1 : 0;
+}
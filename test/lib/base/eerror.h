@@ -0,0 +1,12 @@
+#ifndef __lib_base_eerror_h
+#define __lib_base_eerror_h
+
+// Stand-in for the enigma2 log functions, for the sources under test
+// which use them. Debug messages are dropped.
+
+#include <cstdio>
+
+#define eDebug(...) do {} while (0)
+#define eWarning(...) do { fprintf(stderr, __VA_ARGS__); fputc('\n', stderr); } while (0)
+
+#endif
@@ -0,0 +1,141 @@
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <string>
+#include <vector>
+#include <time.h>
+
+#include "lineframer.h"
+
+class LineCollector: public iLineHandler
+{
+public:
+    std::vector<std::string> lines;
+    size_t count;
+    size_t bytes;
+    bool collect;
+    LineCollector(bool collect): count(0), bytes(0), collect(collect){}
+    void handleLine(const char *data, size_t len)
+    {
+        count++;
+        bytes += len;
+        if (collect)
+            lines.push_back(std::string(data, len));
+    }
+};
+
+static bool readFile(const char *path, std::string &content)
+{
+    FILE *f = fopen(path, "rb");
+    if (!f)
+        return false;
+    char buf[4096];
+    size_t rd;
+    while ((rd = fread(buf, 1, sizeof(buf), f)) > 0)
+        content.append(buf, rd);
+    fclose(f);
+    return true;
+}
+
+static std::vector<std::string> referenceLines(const std::string &content)
+{
+    std::vector<std::string> lines;
+    size_t start = 0, pos;
+    while ((pos = content.find('\n', start)) != std::string::npos)
+    {
+        std::string line = content.substr(start, pos - start);
+        if (!line.empty() && line[line.size() - 1] == '\r')
+            line.erase(line.size() - 1);
+        if (!line.empty())
+            lines.push_back(line);
+        start = pos + 1;
+    }
+    if (start < content.size())
+        lines.push_back(content.substr(start));
+    return lines;
+}
+
+// feed content in chunks, as it would come from the console pipe, chunkSize = 0 means random
+static std::vector<std::string> frame(const std::string &content, size_t chunkSize)
+{
+    LineFramer framer;
+    LineCollector collector(true);
+    std::vector<char> chunk;
+    size_t pos = 0;
+    while (pos < content.size())
+    {
+        size_t len = chunkSize ? chunkSize : 1 + rand() % 4096;
+        if (len > content.size() - pos)
+            len = content.size() - pos;
+        // console passes nul terminated buffer
+        chunk.assign(content.begin() + pos, content.begin() + pos + len);
+        chunk.push_back('\0');
+        framer.feed(&chunk[0], len, collector);
+        pos += len;
+    }
+    framer.flush(collector);
+    return collector.lines;
+}
+
+static double elapsed(const struct timespec &start)
+{
+    struct timespec now;
+    clock_gettime(CLOCK_MONOTONIC, &now);
+    return (now.tv_sec - start.tv_sec) + (now.tv_nsec - start.tv_nsec) / 1e9;
+}
+
+static void benchmark(const std::string &content, size_t chunkSize)
+{
+    const int rounds = 200;
+    LineFramer framer;
+    LineCollector collector(false);
+    struct timespec start;
+    clock_gettime(CLOCK_MONOTONIC, &start);
+    for (int i = 0; i < rounds; i++)
+    {
+        for (size_t pos = 0; pos < content.size(); pos += chunkSize)
+        {
+            size_t len = std::min(chunkSize, content.size() - pos);
+            framer.feed(content.c_str() + pos, len, collector);
+        }
+    }
+    double secs = elapsed(start);
+    printf("%15s: chunk=%5zu %8.1f MB/s %10.0f lines/s\n", "benchmark", chunkSize,
+            rounds * content.size() / secs / (1024 * 1024), collector.count / secs);
+}
+
+int main(int argc, char *argv[])
+{
+    if (argc < 2)
+    {
+        fprintf(stderr, "usage: %s [capture...]\n", argv[0]);
+        return 1;
+    }
+    int failed = 0;
+    srand(1);
+    while (--argc > 0)
+    {
+        const char *path = *(++argv);
+        std::string content;
+        if (!readFile(path, content))
+        {
+            fprintf(stderr, "cannot read '%s'\n", path);
+            failed++;
+            continue;
+        }
+        printf("%s:\n", path);
+        std::vector<std::string> expected = referenceLines(content);
+        size_t chunkSizes[] = {1, 2, 7, 64, 2048, 0};
+        for (size_t i = 0; i < sizeof(chunkSizes) / sizeof(chunkSizes[0]); i++)
+        {
+            std::vector<std::string> lines = frame(content, chunkSizes[i]);
+            bool ok = lines == expected;
+            printf("%15s: chunk=%5zu lines=%zu %s\n", "framing", chunkSizes[i], lines.size(), ok ? "OK" : "FAILED");
+            if (!ok)
+                failed++;
+        }
+        benchmark(content, 2048);
+        benchmark(content, 64 * 1024);
+    }
+    return failed ? 1 : 0;
+}
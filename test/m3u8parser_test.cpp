@@ -0,0 +1,392 @@
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <string>
+#include <vector>
+#include <time.h>
+#include <fcntl.h>
+#include <unistd.h>
+
+#include "m3u8.h"
+#include "testutil.h"
+
+#define BASE_URL "http://example.com:8080/path/master.m3u8?token=abc"
+#define BASE_DIR "http://example.com:8080/path/"
+
+static bool readFile(const std::string &path, std::string &content)
+{
+    FILE *f = fopen(path.c_str(), "rb");
+    if (!f)
+        return false;
+    char buf[4096];
+    size_t rd;
+    while ((rd = fread(buf, 1, sizeof(buf), f)) > 0)
+        content.append(buf, rd);
+    fclose(f);
+    return true;
+}
+
+// lines are fed as they are split, carriage returns are left to the parser
+static int parse(const std::string &content, M3U8MasterPlaylist &playlist)
+{
+    M3U8Parser parser(BASE_URL);
+    size_t pos = 0;
+    while (pos < content.size())
+    {
+        size_t nl = content.find('\n', pos);
+        if (nl == std::string::npos)
+            nl = content.size();
+        if (parser.parseLine(content.c_str() + pos, nl - pos) < 0)
+            return -1;
+        pos = nl + 1;
+    }
+    int ret = parser.finish();
+    playlist = parser.getPlaylist();
+    return ret;
+}
+
+// stream split at random positions, like it comes off the connection
+static int feed(const std::string &content, M3U8MasterPlaylist &playlist, unsigned int &seed)
+{
+    M3U8Parser parser(BASE_URL);
+    size_t pos = 0;
+    while (pos < content.size())
+    {
+        size_t len = rand_r(&seed) % 4 ? rand_r(&seed) % 16 + 1 : rand_r(&seed) % 4096 + 1;
+        if (len > content.size() - pos)
+            len = content.size() - pos;
+        if (parser.feed(content.c_str() + pos, len) < 0)
+            return -1;
+        pos += len;
+    }
+    int ret = parser.finish();
+    playlist = parser.getPlaylist();
+    return ret;
+}
+
+static bool samePlaylist(const M3U8MasterPlaylist &a, const M3U8MasterPlaylist &b)
+{
+    if (a.variants.size() != b.variants.size() || a.iframeStreams.size() != b.iframeStreams.size() ||
+            a.renditions.size() != b.renditions.size() || a.version != b.version)
+        return false;
+    for (size_t i = 0; i < a.variants.size(); i++)
+    {
+        if (a.variants[i].url != b.variants[i].url || a.variants[i].bitrate != b.variants[i].bitrate ||
+                a.variants[i].codecs != b.variants[i].codecs || a.variants[i].audioGroup != b.variants[i].audioGroup)
+            return false;
+    }
+    for (size_t i = 0; i < a.renditions.size(); i++)
+    {
+        if (a.renditions[i].url != b.renditions[i].url || a.renditions[i].name != b.renditions[i].name)
+            return false;
+    }
+    return true;
+}
+
+static size_t countRenditions(const M3U8MasterPlaylist &playlist, int type)
+{
+    size_t count = 0;
+    for (size_t i = 0; i < playlist.renditions.size(); i++)
+        count += playlist.renditions[i].type == type;
+    return count;
+}
+
+// mutated playlists make the parser chatty
+// modelled on apple's advanced example, every variant in three audio groups
+static bool testAdvanced(const M3U8MasterPlaylist &playlist)
+{
+    const std::vector<M3U8StreamInfo> &v = playlist.variants;
+    bool ok = playlist.version == 6 && playlist.independentSegments &&
+            v.size() == 24 && playlist.iframeStreams.size() == 7 && playlist.renditions.size() == 5;
+    if (!ok)
+        return false;
+    ok &= v[0].url == BASE_DIR "v1/prog_index.m3u8" && v[0].bitrate == 145000 && v[0].averageBitrate == 140000 &&
+            v[0].resolution == "416x234" && v[0].frameRate == 15 && v[0].codecs == "avc1.640015,mp4a.40.2" &&
+            v[0].audioGroup == "aud1" && v[0].subtitlesGroup == "sub1" && v[0].closedCaptionsGroup == "cc1";
+    ok &= v[8].audioGroup == "aud2" && v[8].bitrate == 435000;
+    ok &= playlist.iframeStreams[0].url == BASE_DIR "v2/iframe_index.m3u8" &&
+            playlist.iframeStreams[0].bitrate == 31000 && playlist.iframeStreams[0].resolution == "480x270";
+    ok &= countRenditions(playlist, M3U8Rendition::audio) == 3 &&
+            countRenditions(playlist, M3U8Rendition::subtitles) == 1 &&
+            countRenditions(playlist, M3U8Rendition::closedCaptions) == 1;
+    const M3U8Rendition &cc = playlist.renditions[3];
+    ok &= cc.type == M3U8Rendition::closedCaptions && cc.instreamId == "CC1" && cc.url.empty() && cc.isDefault;
+    const M3U8Rendition &sub = playlist.renditions[4];
+    ok &= sub.url == BASE_DIR "s1/en/prog_index.m3u8" && sub.language == "en" && !sub.forced;
+    const M3U8Rendition *audio = playlist.selectAudio(v[8]);
+    ok &= audio && audio->url == BASE_DIR "a2/prog_index.m3u8" && audio->channels == "6";
+    const M3U8StreamInfo *selected = selectVariant(v, 3200000);
+    ok &= selected && selected->url == BASE_DIR "v6/prog_index.m3u8" && selected->audioGroup == "aud1";
+    return ok;
+}
+
+// old style playlist with audio-only variant
+static bool testGears(const M3U8MasterPlaylist &playlist)
+{
+    const std::vector<M3U8StreamInfo> &v = playlist.variants;
+    bool ok = playlist.version == 1 && v.size() == 5 && playlist.renditions.empty();
+    if (!ok)
+        return false;
+    ok &= v[0].hasVideo() && !v[4].hasVideo() && v[0].codecs == "mp4a.40.2, avc1.4d4015";
+    ok &= selectVariant(v, 100000) == &v[4];
+    ok &= selectVariant(v, 10000) == &v[0];
+    ok &= selectVariant(v, 1000000) == &v[2];
+    ok &= selectVariant(v, 100000000) == &v[3];
+    ok &= playlist.selectAudio(v[0]) == NULL;
+    return ok;
+}
+
+// byte order mark, crlf, absolute, host and protocol relative uris
+static bool testIptv(const M3U8MasterPlaylist &playlist)
+{
+    const std::vector<M3U8StreamInfo> &v = playlist.variants;
+    bool ok = playlist.version == 3 && v.size() == 4;
+    if (!ok)
+        return false;
+    ok &= v[0].url == "http://edge1.example.net:8000/live/chan/360p.m3u8?token=a1b2,c3&expires=1700000000" &&
+            v[0].resolution == "640x360" && v[0].bitrate == 800000;
+    ok &= v[1].url == "http://example.com:8080/live/chan/720p.m3u8?token=a1b2";
+    // stream info without uri is dropped
+    ok &= v[2].url == "http://cdn2.example.net/live/chan/1080p.m3u8" && v[2].bitrate == 2500000;
+    ok &= v[3].url == BASE_DIR "audio/chan.m3u8" && !v[3].hasVideo();
+    return ok;
+}
+
+// hevc and dolby vision with stereo and surround audio groups
+static bool testHdr(const M3U8MasterPlaylist &playlist)
+{
+    const std::vector<M3U8StreamInfo> &v = playlist.variants;
+    bool ok = playlist.version == 7 && v.size() == 3 && playlist.iframeStreams.size() == 2 &&
+            playlist.renditions.size() == 7;
+    if (!ok)
+        return false;
+    ok &= v[2].hasVideo() && v[2].hdcpLevel == "TYPE-1" && v[2].frameRate > 23.97 && v[2].frameRate < 23.98 &&
+            v[2].closedCaptionsGroup == "NONE" && v[2].averageBitrate == 12813000;
+    const M3U8Rendition *audio = playlist.selectAudio(v[2]);
+    ok &= audio && audio->url == BASE_DIR "audio/surround/en/320kbit.m3u8" && audio->isDefault;
+    audio = playlist.selectAudio(v[0], "dubbing");
+    ok &= audio && audio->name == "Dubbing" && audio->url == BASE_DIR "audio/stereo/none/128kbit.m3u8";
+    audio = playlist.selectAudio(v[0], "fr");
+    ok &= audio && audio->name == "English" && audio->groupId == "stereo";
+    size_t forced = 0;
+    for (size_t i = 0; i < playlist.renditions.size(); i++)
+        forced += playlist.renditions[i].forced;
+    ok &= countRenditions(playlist, M3U8Rendition::subtitles) == 3 && forced == 1;
+    ok &= playlist.iframeStreams[1].url == BASE_DIR "dolby_2160/iframe_index.m3u8" &&
+            playlist.iframeStreams[1].hdcpLevel == "TYPE-1";
+    return ok;
+}
+
+// packager output with audio muxed in variants and audio-only variants
+static bool testPackaged(const M3U8MasterPlaylist &playlist)
+{
+    const std::vector<M3U8StreamInfo> &v = playlist.variants;
+    bool ok = playlist.version == 4 && v.size() == 5 && playlist.iframeStreams.size() == 1 &&
+            playlist.renditions.size() == 2;
+    if (!ok)
+        return false;
+    ok &= v[0].url == BASE_DIR "channel-audio_eng=64000-video=400000.m3u8" && v[0].frameRate == 25;
+    ok &= !v[3].hasVideo() && !v[4].hasVideo();
+    ok &= selectVariant(v, 100000) == &v[3];
+    ok &= selectVariant(v, 150000) == &v[4];
+    ok &= selectVariant(v, 500000) == &v[0];
+    // rendition is in the variant stream
+    const M3U8Rendition *audio = playlist.selectAudio(v[1]);
+    ok &= audio && audio->groupId == "audio-aacl-128" && audio->url.empty();
+    return ok;
+}
+
+static bool testRejected(const M3U8MasterPlaylist &playlist)
+{
+    return playlist.variants.empty();
+}
+
+struct CorpusFile
+{
+    const char *name;
+    bool master;
+    bool (*test)(const M3U8MasterPlaylist &playlist);
+};
+
+static const CorpusFile corpus[] =
+{
+    {"advanced_ts.m3u8", true, testAdvanced},
+    {"basic_gears.m3u8", true, testGears},
+    {"iptv_crlf.m3u8", true, testIptv},
+    {"hevc_hdr.m3u8", true, testHdr},
+    {"packaged_audio.m3u8", true, testPackaged},
+    {"media_playlist.m3u8", false, testRejected},
+    {"error_page.m3u8", false, testRejected},
+};
+
+static bool testResolve()
+{
+    bool ok = true;
+    ok &= resolveUrl("http://h/a/b/master.m3u8", "v.m3u8") == "http://h/a/b/v.m3u8";
+    ok &= resolveUrl("http://h:81/a/m.m3u8?x=/y/z#f", "v/i.m3u8") == "http://h:81/a/v/i.m3u8";
+    ok &= resolveUrl("https://h/a/m.m3u8", "//c/d.m3u8") == "https://c/d.m3u8";
+    ok &= resolveUrl("http://h:81/a/m.m3u8?x=1", "/d.m3u8?y=2") == "http://h:81/d.m3u8?y=2";
+    ok &= resolveUrl("http://h", "v.m3u8") == "http://h/v.m3u8";
+    ok &= resolveUrl("http://h?x=/y", "v.m3u8") == "http://h/v.m3u8";
+    ok &= resolveUrl("http://h/a/m.m3u8", "https://x/y.m3u8") == "https://x/y.m3u8";
+    return check("resolve", ok);
+}
+
+static bool testSelect()
+{
+    std::vector<M3U8StreamInfo> variants;
+    bool ok = selectVariant(variants, 1000000) == NULL;
+    // without codecs variant is expected to have video
+    variants.resize(2);
+    variants[0].bitrate = 2000000;
+    variants[1].bitrate = 800000;
+    ok &= selectVariant(variants, 1000000) == &variants[1];
+    ok &= selectVariant(variants, 0) == &variants[1];
+    variants[1].codecs = "mp4a.40.2";
+    ok &= selectVariant(variants, 1000000) == &variants[1];
+    // audio is not preferred to video which fits
+    variants[0].bitrate = 600000;
+    ok &= selectVariant(variants, 1000000) == &variants[0];
+    return check("select", ok);
+}
+
+// same result however the stream is split
+static bool testFeed(const std::vector<std::string> &contents)
+{
+    unsigned int seed = 1;
+    bool ok = !contents.empty();
+    for (size_t i = 0; i < contents.size(); i++)
+    {
+        M3U8MasterPlaylist whole;
+        int ret = parse(contents[i], whole);
+        for (int round = 0; round < 20; round++)
+        {
+            M3U8MasterPlaylist split;
+            ok &= feed(contents[i], split, seed) == ret && samePlaylist(whole, split);
+        }
+    }
+    // line longer than the limit stops the parser
+    M3U8Parser parser(BASE_URL);
+    std::string junk(64 * 1024, 'x');
+    ok &= parser.feed("#EXTM3U\n", 8) == 0;
+    int ret = 0;
+    for (int i = 0; i < 17 && ret == 0; i++)
+        ret = parser.feed(junk.c_str(), junk.size());
+    ok &= ret < 0 && parser.finish() < 0;
+    return check("feed", ok);
+}
+
+// mutated playlists must not crash the parser or make it loop
+static bool testFuzz(const std::vector<std::string> &contents)
+{
+    static const char tokens[][24] = {"\n", "\r\n", "\"", ",", "=", "#EXT-X-STREAM-INF:", "#EXT-X-MEDIA:",
+            "BANDWIDTH=", "URI=\"", "\xef\xbb\xbf", "#EXTM3U\n", "GROUP-ID=", "0x"};
+    unsigned int seed = 2;
+    size_t variants = 0;
+    int saved = silenceStderr();
+    for (size_t i = 0; i < contents.size(); i++)
+    {
+        for (int round = 0; round < 500; round++)
+        {
+            std::string content = contents[i];
+            int mutations = rand_r(&seed) % 8 + 1;
+            for (int m = 0; m < mutations && !content.empty(); m++)
+            {
+                size_t pos = rand_r(&seed) % content.size();
+                switch (rand_r(&seed) % 4)
+                {
+                    case 0:
+                        content[pos] = (char) rand_r(&seed);
+                        break;
+                    case 1:
+                        content.insert(pos, tokens[rand_r(&seed) % (sizeof(tokens) / sizeof(tokens[0]))]);
+                        break;
+                    case 2:
+                        content.erase(pos, rand_r(&seed) % 32);
+                        break;
+                    case 3:
+                        content.resize(pos);
+                        break;
+                }
+            }
+            M3U8MasterPlaylist playlist;
+            feed(content, playlist, seed);
+            variants += playlist.variants.size();
+        }
+    }
+    restoreStderr(saved);
+    printf("%20s: %zu variants from %zu mutated playlists\n", "fuzz", variants, contents.size() * 500);
+    return check("fuzz", true);
+}
+
+static double elapsed(const struct timespec &start)
+{
+    struct timespec now;
+    clock_gettime(CLOCK_MONOTONIC, &now);
+    return (now.tv_sec - start.tv_sec) + (now.tv_nsec - start.tv_nsec) / 1e9;
+}
+
+static void benchmark()
+{
+    std::string content = "#EXTM3U\n#EXT-X-VERSION:6\n#EXT-X-INDEPENDENT-SEGMENTS\n";
+    const int groups = 8, variants = 5000, rounds = 20;
+    for (int i = 0; i < groups; i++)
+    {
+        char line[256];
+        snprintf(line, sizeof(line), "#EXT-X-MEDIA:TYPE=AUDIO,GROUP-ID=\"aud%d\",LANGUAGE=\"en\",NAME=\"English\","
+                "AUTOSELECT=YES,DEFAULT=YES,CHANNELS=\"2\",URI=\"a%d/prog_index.m3u8\"\n", i, i);
+        content += line;
+    }
+    for (int i = 0; i < variants; i++)
+    {
+        char line[512];
+        snprintf(line, sizeof(line), "#EXT-X-STREAM-INF:AVERAGE-BANDWIDTH=%d,BANDWIDTH=%d,CODECS=\"avc1.640020,mp4a.40.2\","
+                "RESOLUTION=1280x720,FRAME-RATE=60.000,CLOSED-CAPTIONS=\"cc1\",AUDIO=\"aud%d\",SUBTITLES=\"sub1\"\n"
+                "v%05d/prog_index.m3u8?token=0123456789abcdef0123456789abcdef\n", 90000 + i, 100000 + i, i % groups, i);
+        content += line;
+    }
+    struct timespec start;
+    clock_gettime(CLOCK_MONOTONIC, &start);
+    size_t parsed = 0;
+    for (int r = 0; r < rounds; r++)
+    {
+        M3U8MasterPlaylist playlist;
+        parse(content, playlist);
+        parsed += playlist.variants.size();
+    }
+    double t = elapsed(start);
+    printf("%20s: %8.2f ms/playlist, %6.0f ns/variant, %zu bytes\n", "benchmark", t * 1e3 / rounds,
+            parsed ? t * 1e9 / parsed : 0, content.size());
+}
+
+int main(int argc, char *argv[])
+{
+    int failed = 0;
+    if (!testResolve())
+        failed++;
+    if (!testSelect())
+        failed++;
+    std::string dir = argc > 1 ? argv[1] : "data/hls";
+    std::vector<std::string> contents;
+    for (size_t i = 0; i < sizeof(corpus) / sizeof(corpus[0]); i++)
+    {
+        std::string content;
+        if (!readFile(dir + "/" + corpus[i].name, content))
+        {
+            printf("cannot read %s/%s\n", dir.c_str(), corpus[i].name);
+            failed++;
+            continue;
+        }
+        contents.push_back(content);
+        M3U8MasterPlaylist playlist;
+        bool ok = (parse(content, playlist) == 0) == corpus[i].master && corpus[i].test(playlist);
+        if (!check(corpus[i].name, ok))
+            failed++;
+    }
+    if (!testFeed(contents))
+        failed++;
+    if (!testFuzz(contents))
+        failed++;
+    benchmark();
+    return failed ? 1 : 0;
+}
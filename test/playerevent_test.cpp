@@ -0,0 +1,197 @@
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <string>
+#include <vector>
+#include <time.h>
+
+#include "cJSON/cJSON.h"
+#include "lineframer.h"
+#include "playerevent.h"
+
+static const char *fieldNames[PlayerEvent::fCount] =
+{
+    "id", "ms", "sts", "s", "e", "t", "n", "w", "h", "f", "p",
+    "length", "start", "duration", "text", "msg", "code"
+};
+
+class JsonLines: public iLineHandler
+{
+public:
+    std::vector<std::string> lines;
+    void handleLine(const char *data, size_t len)
+    {
+        if (data[0] == '{')
+            lines.push_back(std::string(data, len));
+    }
+};
+
+static bool readFile(const char *path, std::string &content)
+{
+    FILE *f = fopen(path, "rb");
+    if (!f)
+        return false;
+    char buf[4096];
+    size_t rd;
+    while ((rd = fread(buf, 1, sizeof(buf), f)) > 0)
+        content.append(buf, rd);
+    fclose(f);
+    return true;
+}
+
+static bool compareFields(const std::string &line, const PlayerEvent &event, cJSON *value)
+{
+    for (int i = 0; i < PlayerEvent::fCount; i++)
+    {
+        cJSON *item = cJSON_GetObjectItem(value, fieldNames[i]);
+        if (!item)
+        {
+            if (event.has(i))
+            {
+                printf("unexpected field '%s' in: %s\n", fieldNames[i], line.c_str());
+                return false;
+            }
+            continue;
+        }
+        if (item->type == cJSON_String)
+        {
+            if (event[i].toString() != item->valuestring)
+            {
+                printf("field '%s' differs (%s != %s) in: %s\n", fieldNames[i],
+                        event[i].toString().c_str(), item->valuestring, line.c_str());
+                return false;
+            }
+        }
+        else if (item->type == cJSON_Number)
+        {
+            if (event[i].toInt() != item->valueint || event[i].toDouble() != item->valuedouble)
+            {
+                printf("field '%s' differs (%d != %d) in: %s\n", fieldNames[i],
+                        event[i].toInt(), item->valueint, line.c_str());
+                return false;
+            }
+        }
+    }
+    return true;
+}
+
+static bool compare(const std::string &line)
+{
+    PlayerEvent event;
+    cJSON *json = cJSON_Parse(line.c_str());
+    int ret = decodePlayerEvent(line.c_str(), line.size(), event);
+    if (!json || !json->child)
+    {
+        cJSON_Delete(json);
+        return true;
+    }
+    bool ok = true;
+    cJSON *value = json->child;
+    if (ret < 0 || std::string(event.key, event.keyLen) != value->string)
+    {
+        printf("key differs in: %s\n", line.c_str());
+        ok = false;
+    }
+    else if (value->type == cJSON_Array)
+    {
+        PlayerEvent item;
+        PlayerEventItems items(event);
+        int i = 0;
+        for (; items.next(item); i++)
+        {
+            if (!compareFields(line, item, cJSON_GetArrayItem(value, i)))
+                ok = false;
+        }
+        if (i != cJSON_GetArraySize(value))
+        {
+            printf("number of items differs in: %s\n", line.c_str());
+            ok = false;
+        }
+    }
+    else
+    {
+        ok = compareFields(line, event, value);
+    }
+    cJSON_Delete(json);
+    return ok;
+}
+
+static double elapsed(const struct timespec &start)
+{
+    struct timespec now;
+    clock_gettime(CLOCK_MONOTONIC, &now);
+    return (now.tv_sec - start.tv_sec) + (now.tv_nsec - start.tv_nsec) / 1e9;
+}
+
+static void benchmark(const std::vector<std::string> &lines)
+{
+    const int rounds = 100;
+    struct timespec start;
+    // keep results used, so the loops are not optimized out
+    volatile long sum = 0;
+
+    clock_gettime(CLOCK_MONOTONIC, &start);
+    for (int r = 0; r < rounds; r++)
+    {
+        for (size_t i = 0; i < lines.size(); i++)
+        {
+            cJSON *json = cJSON_Parse(lines[i].c_str());
+            if (json && json->child && json->child->child)
+                sum += json->child->child->valueint;
+            cJSON_Delete(json);
+        }
+    }
+    double cjson = elapsed(start);
+
+    clock_gettime(CLOCK_MONOTONIC, &start);
+    for (int r = 0; r < rounds; r++)
+    {
+        for (size_t i = 0; i < lines.size(); i++)
+        {
+            PlayerEvent event;
+            if (!decodePlayerEvent(lines[i].c_str(), lines[i].size(), event))
+                sum += event[PlayerEvent::fMs].toInt();
+        }
+    }
+    double decoder = elapsed(start);
+    size_t total = rounds * lines.size();
+    printf("%15s: cJSON %6.0f ns/line, decoder %6.0f ns/line (%.1fx)\n", "benchmark",
+            cjson * 1e9 / total, decoder * 1e9 / total, cjson / decoder);
+}
+
+int main(int argc, char *argv[])
+{
+    if (argc < 2)
+    {
+        fprintf(stderr, "usage: %s [capture...]\n", argv[0]);
+        return 1;
+    }
+    int failed = 0;
+    while (--argc > 0)
+    {
+        const char *path = *(++argv);
+        std::string content;
+        if (!readFile(path, content))
+        {
+            fprintf(stderr, "cannot read '%s'\n", path);
+            failed++;
+            continue;
+        }
+        LineFramer framer;
+        JsonLines json;
+        framer.feed(content.c_str(), content.size(), json);
+        framer.flush(json);
+
+        int lineFailed = 0;
+        for (size_t i = 0; i < json.lines.size(); i++)
+        {
+            if (!compare(json.lines[i]))
+                lineFailed++;
+        }
+        printf("%s:\n", path);
+        printf("%15s: lines=%zu %s\n", "decoding", json.lines.size(), lineFailed ? "FAILED" : "OK");
+        failed += lineFailed;
+        benchmark(json.lines);
+    }
+    return failed ? 1 : 0;
+}
@@ -0,0 +1,128 @@
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <string>
+#include <unistd.h>
+#include <fcntl.h>
+
+#include "playerhistory.h"
+#include "testutil.h"
+
+#define URL "http://cdn.example.com:8080/live/12345/index.m3u8?token=1"
+
+enum
+{
+    EXTEPLAYER3,
+    GSTPLAYER,
+};
+
+static int backendOf(const std::string &url, int preferred)
+{
+    int backend;
+    HeaderMap options;
+    unsigned long int bitrate;
+    if (PlayerHistory::getInstance()->getBackend(url, preferred, backend, options, bitrate) < 0)
+        return -1;
+    return backend;
+}
+
+static bool testPattern()
+{
+    bool ok = PlayerHistory::getPattern(URL "#User-Agent=x") == "cdn.example.com/live/#/index.m3u8";
+    ok &= PlayerHistory::getPattern("http://h/ch1/2024/seg12.ts") == "h/ch1/#/seg#.ts";
+    ok &= PlayerHistory::getPattern("/media/hdd/movie.mkv").empty();
+    return check("pattern", ok);
+}
+
+static bool testSelection()
+{
+    PlayerHistory *history = PlayerHistory::getInstance();
+    bool ok = backendOf(URL, GSTPLAYER) == -1;
+
+    // only known backend is used, other one has to be clearly faster
+    HeaderMap options;
+    options["sapp_downmix"] = "1";
+    history->addStart(URL, EXTEPLAYER3, 600, options, 2000000);
+    ok &= backendOf(URL, GSTPLAYER) == EXTEPLAYER3 && backendOf(URL, EXTEPLAYER3) == EXTEPLAYER3;
+    history->addStart(URL, GSTPLAYER, 500, HeaderMap(), 0);
+    ok &= backendOf(URL, EXTEPLAYER3) == EXTEPLAYER3;
+    history->addStart(URL, GSTPLAYER, 100, HeaderMap(), 0);
+    ok &= backendOf(URL, EXTEPLAYER3) == GSTPLAYER;
+
+    // other channel of the same server follows the pattern
+    ok &= backendOf("http://cdn.example.com:8080/live/777/index.m3u8", EXTEPLAYER3) == GSTPLAYER;
+
+    // repeated failures make the backend unusable until it starts again
+    history->addFailure(URL, GSTPLAYER);
+    ok &= backendOf(URL, GSTPLAYER) == GSTPLAYER;
+    history->addFailure(URL, GSTPLAYER);
+    int backend;
+    unsigned long int bitrate;
+    ok &= !history->getBackend(URL, GSTPLAYER, backend, options, bitrate) && backend == EXTEPLAYER3 &&
+            options.size() == 1 && options["sapp_downmix"] == "1" && bitrate == 2000000;
+
+    // not yet tried backend is preferred to failing one
+    const char *other = "http://other.example.com/stream.ts";
+    history->addFailure(other, EXTEPLAYER3);
+    history->addFailure(other, EXTEPLAYER3);
+    ok &= backendOf(other, EXTEPLAYER3) == GSTPLAYER && backendOf("http://other.example.com/a/b", GSTPLAYER) == GSTPLAYER;
+    return ok;
+}
+
+static bool testSnapshot()
+{
+    PlayerHistory *history = PlayerHistory::getInstance();
+    char path[] = "/tmp/playerhistory_testXXXXXX";
+    int fd = mkstemp(path);
+    if (fd < 0)
+        return false;
+    close(fd);
+    unlink(path);
+    bool ok = history->setSnapshot(path) < 0;
+    ok &= history->save() == 0;
+    history->setSnapshot("");
+    history->clear();
+    ok &= backendOf(URL, GSTPLAYER) == -1;
+    ok &= history->setSnapshot(path) == 0;
+    int backend;
+    HeaderMap options;
+    unsigned long int bitrate;
+    PlayerHistoryEntry entry;
+    ok &= !history->getBackend(URL, GSTPLAYER, backend, options, bitrate) && backend == EXTEPLAYER3 &&
+            options["sapp_downmix"] == "1" && bitrate == 2000000;
+    ok &= !history->getEntry(URL, entry) && entry.backends[GSTPLAYER].starts == 2 &&
+            entry.backends[GSTPLAYER].failStreak == 2 && entry.backends[EXTEPLAYER3].startMs == 600;
+    ok &= backendOf("http://other.example.com/stream.ts", EXTEPLAYER3) == GSTPLAYER;
+
+    // corrupted snapshot is reported, valid lines before are kept
+    history->setSnapshot("");
+    history->clear();
+    FILE *f = fopen(path, "a");
+    fputs("garbage\n", f);
+    fclose(f);
+    ok &= history->setSnapshot(path) < 0 && backendOf(URL, GSTPLAYER) == EXTEPLAYER3;
+    history->setSnapshot("");
+    unlink(path);
+    return ok;
+}
+
+int main(int argc, char *argv[])
+{
+    int failed = 0;
+    if (!testPattern())
+        failed++;
+    int saved = silenceStderr();
+    bool ok = testSelection();
+    restoreStderr(saved);
+    if (!check("selection", ok))
+        failed++;
+    saved = silenceStderr();
+    ok = testSnapshot();
+    restoreStderr(saved);
+    if (!check("snapshot", ok))
+        failed++;
+    unsigned int lookups, hits;
+    PlayerHistory::getInstance()->getStats(lookups, hits);
+    printf("%20s: %u lookups, %u hits\n", "history", lookups, hits);
+    return failed ? 1 : 0;
+}
@@ -0,0 +1,232 @@
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <string>
+#include <vector>
+#include <poll.h>
+#include <signal.h>
+#include <unistd.h>
+#include <sys/stat.h>
+#include <sys/wait.h>
+
+#include "common.h"
+#include "playerpool.h"
+#include "playerprotocol.h"
+#include "spawn.h"
+#include "testutil.h"
+
+// fake player: loading of the libraries and probing of the stream
+#define STARTUP_MS 300
+#define PROBE_MS 50
+// time spent on the channel, pool has a player ready after it
+#define WATCH_MS 500
+#define ZAPS 5
+// lines of about 64 bytes, pipe holds 64 KiB
+#define FLOOD_LINES 4096
+
+static void report(const char *line)
+{
+    std::string data = std::string(line) + "\n";
+    if (write(2, data.c_str(), data.size()) < 0)
+        _exit(1);
+}
+
+// fake player, either plays the url or waits for it in standby, the
+// flooding one writes more than the pipes hold while it waits
+static int player(const char *arg, bool flood)
+{
+    usleep(STARTUP_MS * 1000);
+    if (!strcmp(arg, "--standby"))
+    {
+        report("{\"PLAYBACK_STANDBY\":{\"sts\":0}}");
+        for (int i = 0; flood && i < FLOOD_LINES; i++)
+        {
+            const char line[] = "{\"log\":\"buffering..............................................\"}\n";
+            if (write(1, line, sizeof(line) - 1) < 0 || write(2, line, sizeof(line) - 1) < 0)
+                return 1;
+        }
+        char line[1024];
+        if (!fgets(line, sizeof(line), stdin) || line[0] != 'u')
+            return 1;
+    }
+    usleep(PROBE_MS * 1000);
+    report("{\"PLAYBACK_PLAY\":{\"sts\":0}}");
+    // playing until stopped
+    char c;
+    while (read(0, &c, 1) > 0);
+    return 0;
+}
+
+// waits for the play report of the player, output got before is passed
+static bool waitPlay(int fd, std::string output)
+{
+    struct pollfd pfd = {fd, POLLIN, 0};
+    while (output.find("PLAYBACK_PLAY") == std::string::npos)
+    {
+        if (poll(&pfd, 1, 5000) <= 0)
+            return false;
+        char buf[1024];
+        ssize_t rd = read(fd, buf, sizeof(buf));
+        if (rd <= 0)
+            return false;
+        output.append(buf, rd);
+    }
+    return true;
+}
+
+static void stop(PlayerPool::Process &process)
+{
+    kill(-process.pid, SIGKILL);
+    waitpid(process.pid, NULL, 0);
+    for (int i = 0; i < 3; i++)
+        close(process.fd[i]);
+}
+
+static std::vector<std::string> command(const char *self, const char *url)
+{
+    std::vector<std::string> args;
+    args.push_back(self);
+    args.push_back(url);
+    return args;
+}
+
+// zap latency from the start to the play report of the player, the way
+// PlayerApp::processStart starts it, -1 on error
+static int zap(const char *self, const char *url, bool pool)
+{
+    PlayerProtocol protocol(PlayerTraits::eplayer);
+    std::vector<std::string> standbyArgs = command(self, "--standby");
+    std::string handover;
+    protocol.encode(PlayerCommand::handover, url, handover);
+
+    int64_t start = getMonotonicMs();
+    PlayerPool::Process process;
+    bool warm = pool && PlayerPool::getInstance()->acquire(standbyArgs, process);
+    if (warm)
+    {
+        if (write(process.fd[1], handover.c_str(), handover.size()) < 0)
+            return -1;
+    }
+    else
+    {
+        std::vector<std::string> args = command(self, url);
+        const char *argv[] = {args[0].c_str(), args[1].c_str(), NULL};
+        process.pid = bidirpipe(process.fd, argv[0], argv, NULL);
+        if (process.pid == -1)
+            return -1;
+    }
+    bool played = waitPlay(process.fd[2], process.output);
+    int64_t latency = getMonotonicMs() - start;
+    if (pool)
+        PlayerPool::getInstance()->prepare(standbyArgs);
+    usleep(WATCH_MS * 1000);
+    stop(process);
+    return played && (warm || !pool) ? latency : -1;
+}
+
+static int benchmark(const char *self, bool pool)
+{
+    PlayerPool::getInstance()->setEnabled(pool);
+    if (pool)
+    {
+        // player of the first zap is started with the enigma2
+        PlayerPool::getInstance()->prepare(command(self, "--standby"));
+        usleep(WATCH_MS * 1000);
+    }
+    int64_t total = 0;
+    for (int i = 0; i < ZAPS; i++)
+    {
+        int latency = zap(self, "http://127.0.0.1/channel.m3u8", pool);
+        if (latency < 0)
+            return -1;
+        total += latency;
+    }
+    PlayerPool::getInstance()->setEnabled(false);
+    printf("%20s: %s %lldms/zap\n", "benchmark", pool ? "pool   " : "no pool", (long long) (total / ZAPS));
+    return total / ZAPS;
+}
+
+// binary without standby mode is not used for the pool
+static bool testUnsupported()
+{
+    // probe looks for the option in the binary
+    bool ok = PlayerPool::probeStandby("/proc/self/exe") && !PlayerPool::probeStandby("true") &&
+            !PlayerPool::probeStandby("/bin/true") && !PlayerPool::probeStandby("missing-player");
+
+    // player which knows the option, but exits without the standby report
+    char script[] = "/tmp/playerpool_testXXXXXX";
+    int fd = mkstemp(script);
+    const char body[] = "#!/bin/sh\n# usage: player [--standby] url\nexit 0\n";
+    ok &= fd >= 0 && write(fd, body, sizeof(body) - 1) == sizeof(body) - 1 && !fchmod(fd, 0700);
+    if (fd >= 0)
+        close(fd);
+
+    PlayerPool *pool = PlayerPool::getInstance();
+    pool->setEnabled(true);
+    int saved = silenceStderr();
+    const char *binaries[] = {"/bin/true", script};
+    for (int i = 0; i < 2; i++)
+    {
+        std::vector<std::string> args;
+        args.push_back(binaries[i]);
+        args.push_back("--standby");
+        for (int attempt = 0; attempt < 2; attempt++)
+        {
+            pool->prepare(args);
+            usleep(200 * 1000);
+            PlayerPool::Process process;
+            ok &= !pool->acquire(args, process);
+        }
+    }
+    restoreStderr(saved);
+    pool->setEnabled(false);
+    unlink(script);
+    return ok;
+}
+
+// standby player isn't blocked by its pipes while it waits in the pool
+static bool testIdle(const char *self)
+{
+    std::vector<std::string> args = command(self, "--standby");
+    args.push_back("flood");
+    PlayerPool *pool = PlayerPool::getInstance();
+    pool->setEnabled(true);
+    pool->prepare(args);
+    usleep((STARTUP_MS + WATCH_MS) * 1000);
+    PlayerPool::Process process;
+    bool ok = pool->acquire(args, process);
+    pool->setEnabled(false);
+    if (!ok)
+        return false;
+    ok = process.output.size() <= PlayerPool::MAX_OUTPUT && process.output.find("buffering") != std::string::npos;
+    PlayerProtocol protocol(PlayerTraits::eplayer);
+    std::string handover;
+    protocol.encode(PlayerCommand::handover, "http://127.0.0.1/channel.m3u8", handover);
+    // player reads the url only after it wrote all its output, stdout
+    // isn't read by anyone else than the pool
+    ok &= write(process.fd[1], handover.c_str(), handover.size()) == (ssize_t) handover.size() &&
+            waitPlay(process.fd[2], "");
+    stop(process);
+    return ok;
+}
+
+int main(int argc, char *argv[])
+{
+    // spawned as the player
+    if (argc > 1)
+        return player(argv[1], argc > 2);
+
+    // players are spawned from the test binary
+    const char *self = "/proc/self/exe";
+    int failed = 0;
+    if (!check("unsupported", testUnsupported()))
+        failed++;
+    if (!check("idle", testIdle(self)))
+        failed++;
+    int cold = benchmark(self, false);
+    int warm = benchmark(self, true);
+    // pool saves the startup of the player
+    if (!check("zap latency", cold >= 0 && warm >= 0 && warm + STARTUP_MS / 2 < cold))
+        failed++;
+    return failed ? 1 : 0;
+}
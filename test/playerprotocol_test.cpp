@@ -0,0 +1,225 @@
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <string>
+#include <vector>
+#include <time.h>
+
+#include "playerprotocol.h"
+#include "testutil.h"
+
+static const PlayerTraits framedTraits =
+{
+    {"q", "p", "c", "l", "j", "js", "al", "ac", "a", "sl", "sc", "s", "gc", "kc", "u"},
+    true,
+};
+
+class EventCollector: public iPlayerEventHandler
+{
+public:
+    std::vector<std::string> keys;
+    size_t count;
+    size_t undecodable;
+    bool collect;
+    EventCollector(bool collect): count(0), undecodable(0), collect(collect){}
+    void handleEvent(const PlayerEvent &event)
+    {
+        count++;
+        if (collect)
+            keys.push_back(std::string(event.key, event.keyLen));
+    }
+    void handleUndecodable(const char *, size_t)
+    {
+        undecodable++;
+    }
+};
+
+static bool readFile(const char *path, std::string &content)
+{
+    FILE *f = fopen(path, "rb");
+    if (!f)
+        return false;
+    char buf[4096];
+    size_t rd;
+    while ((rd = fread(buf, 1, sizeof(buf), f)) > 0)
+        content.append(buf, rd);
+    fclose(f);
+    return true;
+}
+
+// json messages of the log, as player would send them
+static std::vector<std::string> messages(const std::string &content)
+{
+    std::vector<std::string> result;
+    size_t pos = 0;
+    while (pos < content.size())
+    {
+        size_t nl = content.find('\n', pos);
+        if (nl == std::string::npos)
+            nl = content.size();
+        std::string line = content.substr(pos, nl - pos);
+        if (!line.empty() && line[line.size() - 1] == '\r')
+            line.erase(line.size() - 1);
+        PlayerEvent event;
+        if (!line.empty() && line[0] == '{' && line[line.size() - 1] == '}' &&
+                !decodePlayerEvent(line.c_str(), line.size(), event))
+            result.push_back(line);
+        pos = nl + 1;
+    }
+    return result;
+}
+
+static std::string keyOf(const std::string &message)
+{
+    PlayerEvent event;
+    decodePlayerEvent(message.c_str(), message.size(), event);
+    return std::string(event.key, event.keyLen);
+}
+
+static void feedChunks(PlayerProtocol &protocol, const std::string &data, size_t maxChunk, EventCollector &collector)
+{
+    std::vector<char> buf;
+    size_t pos = 0;
+    while (pos < data.size())
+    {
+        size_t len = maxChunk == 1 ? 1 : 1 + rand() % maxChunk;
+        if (len > data.size() - pos)
+            len = data.size() - pos;
+        // chunk is terminated, as console's buffer is
+        buf.assign(data.begin() + pos, data.begin() + pos + len);
+        buf.push_back('\0');
+        protocol.feed(&buf[0], len, collector);
+        pos += len;
+    }
+    protocol.flush(collector);
+}
+
+static bool testEncode()
+{
+    PlayerProtocol text(PlayerTraits::eplayer);
+    PlayerProtocol framed(framedTraits);
+    std::string out;
+    bool ok = true;
+    ok &= text.encode(PlayerCommand::seekTo, 120, out) == 0 && out == "gc120\n";
+    ok &= text.encode(PlayerCommand::seekRelative, -10, out) == 0 && out == "kc-10\n";
+    ok &= text.encode(PlayerCommand::stop, out) == 0 && out == "q\n";
+    ok &= text.encode(PlayerCommand::handover, std::string("http://a/b"), out) == 0 && out == "uhttp://a/b\n";
+    ok &= text.encode(PlayerCommand::handover, std::string("http://a\nq"), out) < 0;
+    ok &= !text.supports(PlayerCommand::positionSubscribe);
+    ok &= text.encode(PlayerCommand::positionSubscribe, 1000, out) < 0;
+    ok &= framed.encode(PlayerCommand::audioSelect, 2, out) == 0 && out == std::string("\xfe\x00\x02" "a2", 5);
+    ok &= framed.encode(PlayerCommand::positionSubscribe, 1000, out) == 0 && out == std::string("\xfe\x00\x06" "js1000", 9);
+    return check("encode", ok);
+}
+
+static bool testText(const std::string &content)
+{
+    std::vector<std::string> expected = messages(content);
+    bool ok = true;
+    size_t chunks[] = {1, 7, 2048};
+    for (size_t i = 0; i < sizeof(chunks) / sizeof(chunks[0]); i++)
+    {
+        PlayerProtocol protocol(PlayerTraits::eplayer);
+        EventCollector collector(true);
+        feedChunks(protocol, content, chunks[i], collector);
+        ok &= collector.keys.size() == expected.size();
+        for (size_t j = 0; ok && j < expected.size(); j++)
+            ok &= collector.keys[j] == keyOf(expected[j]);
+    }
+    return check("text", ok);
+}
+
+static std::string frame(const std::string &payload)
+{
+    std::string out;
+    out.push_back((char) PlayerProtocol::frameMagic);
+    out.push_back((char) (payload.size() >> 8));
+    out.push_back((char) (payload.size() & 0xff));
+    return out + payload;
+}
+
+static bool testFramed(const std::string &content)
+{
+    std::vector<std::string> expected = messages(content);
+    std::string stream;
+    for (size_t i = 0; i < expected.size(); i++)
+    {
+        // garbage between frames is skipped
+        if (i % 5 == 0)
+            stream += "noise\n";
+        stream += frame(expected[i]);
+    }
+    // empty frame and undecodable one
+    stream += frame("");
+    stream += frame("{\"J\":");
+    bool ok = true;
+    size_t chunks[] = {1, 7, 2048};
+    for (size_t i = 0; i < sizeof(chunks) / sizeof(chunks[0]); i++)
+    {
+        PlayerProtocol protocol(framedTraits);
+        EventCollector collector(true);
+        feedChunks(protocol, stream, chunks[i], collector);
+        ok &= collector.keys.size() == expected.size() && collector.undecodable == 1;
+        for (size_t j = 0; ok && j < expected.size(); j++)
+            ok &= collector.keys[j] == keyOf(expected[j]);
+    }
+    return check("framed", ok);
+}
+
+static double elapsed(const struct timespec &start)
+{
+    struct timespec now;
+    clock_gettime(CLOCK_MONOTONIC, &now);
+    return (now.tv_sec - start.tv_sec) + (now.tv_nsec - start.tv_nsec) / 1e9;
+}
+
+// same messages with logging of the player in text protocol and alone in frames
+static void benchmark(const std::string &content)
+{
+    std::vector<std::string> expected = messages(content);
+    std::string stream;
+    for (size_t i = 0; i < expected.size(); i++)
+        stream += frame(expected[i]);
+    const int rounds = 200;
+    const char *names[] = {"text", "framed"};
+    const std::string *data[] = {&content, &stream};
+    for (int m = 0; m < 2; m++)
+    {
+        PlayerProtocol protocol(m ? framedTraits : PlayerTraits::eplayer);
+        EventCollector collector(false);
+        struct timespec start;
+        clock_gettime(CLOCK_MONOTONIC, &start);
+        for (int r = 0; r < rounds; r++)
+        {
+            protocol.feed(data[m]->c_str(), data[m]->size(), collector);
+            protocol.flush(collector);
+        }
+        double t = elapsed(start);
+        printf("%20s: %-8s %6.0f ns/message, %zu bytes per round\n", "benchmark", names[m],
+                collector.count ? t * 1e9 / collector.count : 0, data[m]->size());
+    }
+}
+
+int main(int argc, char *argv[])
+{
+    int failed = 0;
+    if (!testEncode())
+        failed++;
+    for (int i = 1; i < argc; i++)
+    {
+        std::string content;
+        if (!readFile(argv[i], content))
+        {
+            printf("cannot read %s\n", argv[i]);
+            failed++;
+            continue;
+        }
+        printf("%s:\n", argv[i]);
+        if (!testText(content))
+            failed++;
+        if (!testFramed(content))
+            failed++;
+        benchmark(content);
+    }
+    return failed ? 1 : 0;
+}
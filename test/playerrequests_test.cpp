@@ -0,0 +1,116 @@
+#include <cstdio>
+#include <unistd.h>
+
+#include "common.h"
+#include "playerrequests.h"
+#include "testutil.h"
+
+enum { tAudioList = 1, tSubtitleList, tStop };
+
+// player thread which answers after a delay, in its own order
+struct Player
+{
+    PlayerRequests *requests;
+    int replies[4];
+    int count;
+    int delayMs;
+};
+
+static void *playerThread(void *arg)
+{
+    Player *player = (Player *) arg;
+    for (int i = 0; i < player->count; i++)
+    {
+        usleep(player->delayMs * 1000);
+        player->requests->complete(player->replies[i]);
+    }
+    delete player;
+    return NULL;
+}
+
+static bool reply(PlayerRequests &requests, int delayMs, int first, int second=0)
+{
+    Player *player = new Player();
+    player->requests = &requests;
+    player->replies[0] = first;
+    player->replies[1] = second;
+    player->count = second ? 2 : 1;
+    player->delayMs = delayMs;
+    return startDetached(playerThread, player);
+}
+
+// both track lists are waited for together, whatever order they come in
+static bool testBatch()
+{
+    PlayerRequests requests;
+    int types[] = {tAudioList, tSubtitleList};
+    unsigned int first = requests.add(types, 2);
+    int64_t start = getMonotonicMs();
+    bool ok = reply(requests, 50, tSubtitleList, tAudioList);
+    ok &= requests.wait(first, 2, 2000) == 0;
+    int64_t elapsed = getMonotonicMs() - start;
+    ok &= elapsed >= 100 && elapsed < 1000 && requests.pending() == 0;
+
+    // one reply is not enough
+    first = requests.add(types, 2);
+    ok &= reply(requests, 10, tAudioList);
+    ok &= requests.wait(first, 2, 200) == -1 && requests.pending() == 1;
+    return ok;
+}
+
+// late reply completes the abandoned request, not the one sent after it
+static bool testLateReply()
+{
+    PlayerRequests requests;
+    int type = tAudioList;
+    unsigned int first = requests.add(&type, 1);
+    bool ok = requests.wait(first, 1, 0) == -1;
+    first = requests.add(&type, 1);
+    requests.complete(tAudioList);
+    ok &= requests.wait(first, 1, 0) == -1 && requests.pending() == 1;
+    requests.complete(tAudioList);
+    ok &= requests.wait(first, 1, 0) == 0 && requests.pending() == 0;
+    return ok;
+}
+
+// player which never replies doesn't keep abandoned requests forever
+static bool testAbandoned()
+{
+    PlayerRequests requests(50);
+    int type = tAudioList;
+    requests.wait(requests.add(&type, 1), 1, 0);
+    requests.wait(requests.add(&type, 1), 1, 0);
+    bool ok = requests.pending() == 2;
+    usleep(100 * 1000);
+    unsigned int first = requests.add(&type, 1);
+    ok &= requests.pending() == 1;
+    requests.complete(tAudioList);
+    ok &= requests.wait(first, 1, 0) == 0;
+    return ok;
+}
+
+// exit of the player completes everything what is pending
+static bool testStop()
+{
+    PlayerRequests requests;
+    int types[] = {tAudioList, tStop};
+    unsigned int first = requests.add(types, 2);
+    bool ok = requests.pending() == 2;
+    requests.complete(tStop, true);
+    ok &= requests.wait(first, 2, 0) == 0 && requests.pending() == 0;
+    return ok;
+}
+
+int main()
+{
+    int failed = 0;
+    if (!check("batch", testBatch()))
+        failed++;
+    if (!check("late reply", testLateReply()))
+        failed++;
+    if (!check("abandoned", testAbandoned()))
+        failed++;
+    if (!check("stop", testStop()))
+        failed++;
+    return failed ? 1 : 0;
+}
@@ -0,0 +1,350 @@
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <string>
+#include <vector>
+#include <pthread.h>
+#include <time.h>
+#include <netinet/in.h>
+#include <sys/stat.h>
+
+#include "m3u8.h"
+#include "playlistcache.h"
+#include "testutil.h"
+
+// local http stand-in with validators of the playlist
+struct Server
+{
+    int fd;
+    int port;
+    pthread_t thread;
+    pthread_mutex_t mutex;
+    int version;
+    bool etag;
+    bool lastModified;
+    int requests;
+    int notModified;
+    std::string lastRequest;
+};
+
+static std::string playlist(int variants)
+{
+    std::string body = "#EXTM3U\r\n";
+    for (int i = 0; i < variants; i++)
+    {
+        char line[128];
+        snprintf(line, sizeof(line), "#EXT-X-STREAM-INF:BANDWIDTH=%d,CODECS=\"avc1.4d401f,mp4a.40.2\"\r\nvariant%d.m3u8\r\n",
+                100000 * (i + 1), i);
+        body += line;
+    }
+    return body;
+}
+
+static std::string header(const std::string &request, const char *name)
+{
+    size_t pos = request.find(std::string("\r\n") + name + ": ");
+    if (pos == std::string::npos)
+        return "";
+    pos += strlen(name) + 4;
+    return request.substr(pos, request.find("\r\n", pos) - pos);
+}
+
+static void *serve(void *arg)
+{
+    Server *server = (Server *) arg;
+    while (1)
+    {
+        int client = accept(server->fd, NULL, NULL);
+        if (client < 0)
+            break;
+        std::string request;
+        char buf[1024];
+        ssize_t rd;
+        while (request.find("\r\n\r\n") == std::string::npos && (rd = read(client, buf, sizeof(buf))) > 0)
+            request.append(buf, rd);
+        if (request.compare(0, 4, "QUIT") == 0)
+        {
+            close(client);
+            break;
+        }
+        pthread_mutex_lock(&server->mutex);
+        server->requests++;
+        server->lastRequest = request;
+        char etag[32], modified[64];
+        snprintf(etag, sizeof(etag), "\"v%d\"", server->version);
+        snprintf(modified, sizeof(modified), "Mon, 0%d Jan 2024 00:00:00 GMT", server->version);
+        std::string validators;
+        if (server->etag)
+            validators += std::string("ETag: ") + etag + "\r\n";
+        if (server->lastModified)
+            validators += std::string("Last-Modified: ") + modified + "\r\n";
+        bool unchanged = (server->etag && header(request, "If-None-Match") == etag) ||
+                (!server->etag && server->lastModified && header(request, "If-Modified-Since") == modified);
+        std::string resp;
+        if (unchanged)
+        {
+            server->notModified++;
+            resp = "HTTP/1.1 304 Not Modified\r\n" + validators + "Connection: close\r\n\r\n";
+        }
+        else
+        {
+            std::string body = playlist(server->version + 2);
+            resp = "HTTP/1.1 200 OK\r\nContent-Type: application/vnd.apple.mpegurl\r\n" + validators +
+                    "Connection: close\r\nContent-Length: " + std::to_string(body.size()) + "\r\n\r\n" + body;
+        }
+        pthread_mutex_unlock(&server->mutex);
+        writeAll(NULL, client, resp.c_str(), resp.size());
+        close(client);
+    }
+    return NULL;
+}
+
+static bool startServer(Server &server)
+{
+    server.version = 1;
+    server.etag = true;
+    server.lastModified = true;
+    server.requests = 0;
+    server.notModified = 0;
+    pthread_mutex_init(&server.mutex, NULL);
+    server.fd = listenLoopback(SOCK_STREAM, server.port);
+    if (server.fd < 0)
+        return false;
+    return pthread_create(&server.thread, NULL, serve, &server) == 0;
+}
+
+static void stopServer(Server &server)
+{
+    int fd = Connect("127.0.0.1", server.port, 5);
+    writeAll(NULL, fd, "QUIT\r\n\r\n", 8);
+    close(fd);
+    pthread_join(server.thread, NULL);
+    close(server.fd);
+}
+
+// number of requests and 304 responses since last call
+static void served(Server &server, int &requests, int &notModified)
+{
+    pthread_mutex_lock(&server.mutex);
+    requests = server.requests;
+    notModified = server.notModified;
+    server.requests = 0;
+    server.notModified = 0;
+    pthread_mutex_unlock(&server.mutex);
+}
+
+static std::string lastRequest(Server &server)
+{
+    pthread_mutex_lock(&server.mutex);
+    std::string request = server.lastRequest;
+    pthread_mutex_unlock(&server.mutex);
+    return request;
+}
+
+static std::vector<M3U8StreamInfo> explore(const Server &server, const char *path, const HeaderMap &headers = HeaderMap())
+{
+    char url[128];
+    snprintf(url, sizeof(url), "http://127.0.0.1:%d%s", server.port, path);
+    M3U8VariantsExplorer explorer(url, headers);
+    int saved = silenceStderr();
+    std::vector<M3U8StreamInfo> streams = explorer.getStreams();
+    restoreStderr(saved);
+    return streams;
+}
+
+static bool sameStreams(const std::vector<M3U8StreamInfo> &a, const std::vector<M3U8StreamInfo> &b)
+{
+    if (a.size() != b.size())
+        return false;
+    for (size_t i = 0; i < a.size(); i++)
+    {
+        if (a[i].url != b[i].url || a[i].bitrate != b[i].bitrate || a[i].codecs != b[i].codecs ||
+                a[i].resolution != b[i].resolution || a[i].headers != b[i].headers)
+            return false;
+    }
+    return true;
+}
+
+static bool readFile(const char *path, std::string &content)
+{
+    FILE *f = fopen(path, "r");
+    if (!f)
+        return false;
+    char buf[4096];
+    size_t rd;
+    while ((rd = fread(buf, 1, sizeof(buf), f)) > 0)
+        content.append(buf, rd);
+    fclose(f);
+    return true;
+}
+
+static void sleepMs(int ms)
+{
+    struct timespec ts = {ms / 1000, (ms % 1000) * 1000000L};
+    nanosleep(&ts, NULL);
+}
+
+static double elapsed(const struct timespec &start)
+{
+    struct timespec now;
+    clock_gettime(CLOCK_MONOTONIC, &now);
+    return (now.tv_sec - start.tv_sec) + (now.tv_nsec - start.tv_nsec) / 1e9;
+}
+
+int main(int argc, char *argv[])
+{
+    const int ttl = 200;
+    PlaylistCache *cache = PlaylistCache::getInstance();
+    int failed = 0;
+    int requests, notModified;
+    Server server;
+    if (!startServer(server))
+    {
+        printf("cannot start server\n");
+        return 1;
+    }
+
+    // disabled by default
+    bool ok = explore(server, "/master.m3u8").size() == 3 && explore(server, "/master.m3u8").size() == 3;
+    served(server, requests, notModified);
+    if (!check("disabled", ok && requests == 2))
+        failed++;
+
+    cache->setLimits(16, ttl);
+    std::vector<M3U8StreamInfo> first = explore(server, "/master.m3u8");
+    std::vector<M3U8StreamInfo> second = explore(server, "/master.m3u8");
+    served(server, requests, notModified);
+    if (!check("fresh", first.size() == 3 && sameStreams(first, second) && requests == 1))
+        failed++;
+
+    sleepMs(ttl + 50);
+    second = explore(server, "/master.m3u8");
+    served(server, requests, notModified);
+    ok = sameStreams(first, second) && requests == 1 && notModified == 1 &&
+            lastRequest(server).find("If-None-Match: \"v1\"\r\n") != std::string::npos;
+    // revalidated entry is fresh again
+    second = explore(server, "/master.m3u8");
+    served(server, requests, notModified);
+    if (!check("etag", ok && sameStreams(first, second) && requests == 0))
+        failed++;
+
+    server.etag = false;
+    cache->clear();
+    explore(server, "/master.m3u8");
+    // entry without etag is revalidated by date
+    sleepMs(ttl + 50);
+    second = explore(server, "/master.m3u8");
+    served(server, requests, notModified);
+    ok = sameStreams(first, second) && requests == 2 && notModified == 1 &&
+            lastRequest(server).find("If-Modified-Since: Mon, 01 Jan 2024") != std::string::npos;
+    if (!check("last-modified", ok))
+        failed++;
+
+    server.etag = true;
+    server.version = 2;
+    sleepMs(ttl + 50);
+    second = explore(server, "/master.m3u8");
+    served(server, requests, notModified);
+    if (!check("changed", second.size() == 4 && requests == 1 && notModified == 0))
+        failed++;
+
+    HeaderMap headers;
+    headers["Cookie"] = "session=1";
+    second = explore(server, "/master.m3u8", headers);
+    served(server, requests, notModified);
+    if (!check("headers in key", second.size() == 4 && second[0].headers["Cookie"] == "session=1" && requests == 1))
+        failed++;
+
+    // least recently used is dropped
+    cache->clear();
+    cache->setLimits(2, 60000);
+    explore(server, "/a.m3u8");
+    explore(server, "/b.m3u8");
+    explore(server, "/a.m3u8");
+    explore(server, "/c.m3u8");
+    served(server, requests, notModified);
+    ok = requests == 3;
+    explore(server, "/a.m3u8");
+    served(server, requests, notModified);
+    ok &= requests == 0;
+    explore(server, "/b.m3u8");
+    served(server, requests, notModified);
+    if (!check("lru", ok && requests == 1))
+        failed++;
+
+    // survives restart, stale entries can be still revalidated
+    char path[] = "/tmp/playlistcache_testXXXXXX";
+    int fd = mkstemp(path);
+    close(fd);
+    cache->setLimits(16, 60000);
+    HeaderMap agent;
+    agent["User-Agent"] = "snapshot";
+    first = explore(server, "/master.m3u8", agent);
+    // credentials are not saved
+    explore(server, "/a.m3u8", headers);
+    served(server, requests, notModified);
+    // empty file isn't a snapshot yet
+    int saved = silenceStderr();
+    cache->setSnapshot(path);
+    restoreStderr(saved);
+    ok = cache->save() == 0;
+    struct stat st;
+    std::string content;
+    ok &= stat(path, &st) == 0 && (st.st_mode & 0777) == 0600 && readFile(path, content);
+    ok &= content.find("snapshot") != std::string::npos && content.find("session=1") == std::string::npos;
+    cache->clear();
+    cache->setSnapshot("");
+    saved = silenceStderr();
+    ok &= cache->setSnapshot(path) == 0;
+    restoreStderr(saved);
+    second = explore(server, "/master.m3u8", agent);
+    served(server, requests, notModified);
+    ok &= first.size() == 4 && sameStreams(first, second) && requests == 0;
+    cache->setLimits(16, 1);
+    sleepMs(5);
+    second = explore(server, "/master.m3u8", agent);
+    served(server, requests, notModified);
+    ok &= sameStreams(first, second) && requests == 1 && notModified == 1;
+    cache->setSnapshot("");
+    // corrupted snapshot is refused
+    FILE *f = fopen(path, "w");
+    fprintf(f, "SERVICEAPP_PLAYLIST_CACHE 1\nP\t1\n");
+    fclose(f);
+    saved = silenceStderr();
+    ok &= cache->setSnapshot(path) < 0;
+    restoreStderr(saved);
+    cache->setSnapshot("");
+    unlink(path);
+    if (!check("snapshot", ok))
+        failed++;
+
+    // zap to the same channel: download, revalidation and cache hit
+    const int rounds = 50;
+    const char *names[] = {"miss", "revalidated", "hit"};
+    for (int m = 0; m < 3; m++)
+    {
+        cache->clear();
+        cache->setLimits(16, m == 1 ? 1 : 60000);
+        explore(server, "/master.m3u8");
+        if (m == 0)
+            cache->setLimits(16, 0);
+        double t = 0;
+        for (int r = 0; r < rounds; r++)
+        {
+            if (m == 1)
+                sleepMs(2);
+            struct timespec start;
+            clock_gettime(CLOCK_MONOTONIC, &start);
+            explore(server, "/master.m3u8");
+            t += elapsed(start);
+        }
+        served(server, requests, notModified);
+        printf("%20s: %-12s %8.3f ms/exploration, %d requests\n", "benchmark", names[m], t * 1e3 / rounds, requests);
+    }
+    unsigned int hits, revalidations, misses;
+    cache->getStats(hits, revalidations, misses);
+    printf("%20s: %u hits, %u revalidations, %u misses\n", "stats", hits, revalidations, misses);
+    cache->setLimits(16, 0);
+    stopServer(server);
+    return failed ? 1 : 0;
+}
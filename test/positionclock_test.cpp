@@ -0,0 +1,201 @@
+#include <cstdio>
+#include <cstdlib>
+#include <algorithm>
+
+#include "positionclock.h"
+#include "testutil.h"
+
+// player answers the poll after this time
+#define REPLY_MS 10
+#define HOUR_MS (3600 * 1000)
+
+// PlayerBackend with its poll timer and the player, in simulated time
+struct Simulation
+{
+    PositionClock clock;
+    int64_t now;
+    // periodic timer as eTimer runs it, -1 when stopped
+    unsigned int delay;
+    int64_t nextPoll;
+    unsigned int polls;
+    int64_t stalled;
+    // player
+    int64_t position;
+    bool playing;
+    int64_t frozenUntil;
+    // worst error of the interpolated position while playing
+    int64_t maxError;
+
+    Simulation(): now(1000), delay(0), nextPoll(-1), polls(0), stalled(0),
+        position(0), playing(false), frozenUntil(0), maxError(0){}
+
+    void advance(int64_t to)
+    {
+        for (; now < to; now++)
+        {
+            if (playing && now >= frozenUntil)
+                position++;
+        }
+    }
+    void updatePolling()
+    {
+        unsigned int d = clock.pollDelay();
+        if (d == delay)
+            return;
+        delay = d;
+        nextPoll = d ? now + d : -1;
+    }
+    void poll()
+    {
+        polls++;
+        int reported = (int) position;
+        advance(now + REPLY_MS);
+        int64_t s = clock.received(reported, now);
+        if (s)
+            stalled = s;
+        updatePolling();
+    }
+    void run(int64_t ms)
+    {
+        int64_t end = now + ms;
+        while (now < end)
+        {
+            int64_t next = std::min(end, now + 1000);
+            if (nextPoll != -1 && nextPoll < next)
+            {
+                advance(nextPoll);
+                nextPoll += delay;
+                poll();
+                continue;
+            }
+            advance(next);
+            // position as the subtitles and the progress bar read it
+            int ms;
+            if (playing && now >= frozenUntil + 5000 && clock.position(now, ms))
+                maxError = std::max(maxError, (int64_t) llabs(ms - position));
+        }
+    }
+    void start()
+    {
+        playing = true;
+        clock.start(false);
+        poll();
+        updatePolling();
+    }
+    void seek(int64_t to, int bufferingMs)
+    {
+        clock.seek(now);
+        updatePolling();
+        position = to;
+        frozenUntil = now + bufferingMs;
+    }
+};
+
+// one hour of playback polls the player much less than the fixed 100ms
+// polling did, position stays within the allowed drift
+static bool testHour()
+{
+    Simulation sim;
+    sim.start();
+    sim.run(HOUR_MS);
+    unsigned int fixed = HOUR_MS / PositionClock::pollFast;
+    printf("%20s: %u polls in 1h, fixed polling %u, max error %lldms\n", "wakeups", sim.polls, fixed,
+            (long long) sim.maxError);
+    return sim.polls <= HOUR_MS / PositionClock::pollSlow + 10 && sim.polls * 10 < fixed &&
+            sim.maxError <= PositionClock::maxDrift && sim.clock.pollDelay() == PositionClock::pollSlow;
+}
+
+// seek unlocks the clock, it locks again once the position moves
+static bool testSeek()
+{
+    Simulation sim;
+    sim.start();
+    sim.run(60 * 1000);
+    unsigned int polls = sim.polls;
+    sim.seek(20 * 60 * 1000, 500);
+    bool ok = sim.clock.pollDelay() == PositionClock::pollFast;
+    sim.run(10 * 1000);
+    int ms;
+    ok &= sim.clock.position(sim.now, ms) && llabs(ms - sim.position) <= PositionClock::maxDrift;
+    ok &= sim.clock.pollDelay() == PositionClock::pollSlow && sim.maxError <= PositionClock::maxDrift;
+    // buffering after the seek is not an underrun
+    ok &= !sim.stalled;
+    // fast polls only until it locks
+    ok &= sim.polls - polls < 30;
+    return ok;
+}
+
+// position stopping during playback is reported once it moves again,
+// wherever it falls between the polls
+static bool testStall()
+{
+    bool ok = true;
+    for (int offset = 0; offset < (int) PositionClock::pollSlow; offset += 250)
+    {
+        Simulation sim;
+        sim.start();
+        sim.run(60 * 1000 + offset);
+        sim.frozenUntil = sim.now + 3000;
+        sim.run(20 * 1000);
+        // stall is noticed by the poll which falls behind, its end by the
+        // fast polls which follow, start is known within the allowed drift
+        ok &= sim.stalled >= 3000 - PositionClock::maxDrift && sim.stalled <= 3000 + PositionClock::pollFast + REPLY_MS;
+        // interpolation doesn't run away while the player is stuck
+        int ms;
+        ok &= sim.clock.position(sim.now, ms) && llabs(ms - sim.position) <= PositionClock::maxDrift;
+    }
+    return ok;
+}
+
+// paused player isn't polled, except for the exact position where it stopped
+static bool testPause()
+{
+    Simulation sim;
+    sim.start();
+    sim.run(60 * 1000);
+    sim.clock.pause(sim.now);
+    sim.updatePolling();
+    sim.playing = false;
+    sim.poll();
+    unsigned int polls = sim.polls;
+    int paused;
+    bool ok = sim.clock.position(sim.now, paused) && paused == sim.position;
+    sim.run(10 * 60 * 1000);
+    int ms;
+    ok &= sim.polls == polls && sim.clock.position(sim.now, ms) && ms == paused;
+    sim.clock.resume();
+    sim.updatePolling();
+    sim.playing = true;
+    sim.run(10 * 1000);
+    ok &= sim.polls > polls && sim.clock.position(sim.now, ms) && llabs(ms - sim.position) <= PositionClock::maxDrift;
+    return ok;
+}
+
+// player which pushes its position isn't polled at all
+static bool testPushed()
+{
+    PositionClock clock;
+    clock.start(true);
+    bool ok = clock.pollDelay() == 0;
+    clock.received(1000, 1000);
+    clock.seek(2000);
+    ok &= clock.pollDelay() == 0;
+    clock.resume();
+    return ok && clock.pollDelay() == 0;
+}
+
+int main()
+{
+    int failed = 0;
+    if (!check("hour", testHour()))
+        failed++;
+    if (!check("seek", testSeek()))
+        failed++;
+    if (!check("stall", testStall()))
+        failed++;
+    if (!check("pause", testPause()))
+        failed++;
+    if (!check("pushed", testPushed()))
+        failed++;
+    return failed ? 1 : 0;
+}
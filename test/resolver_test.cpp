@@ -0,0 +1,393 @@
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <map>
+#include <string>
+#include <vector>
+#include <pthread.h>
+#include <netinet/in.h>
+
+#include "common.h"
+#include "resolver.h"
+#include "wrappers.h"
+#include "testutil.h"
+
+// records of the stub nameserver, names without record are not known
+struct Record
+{
+    std::vector<std::string> a;
+    std::vector<std::string> aaaa;
+    unsigned int ttl;
+    // queries are not answered at all
+    bool silent;
+    // answer of other name with the id of the query comes first
+    bool spoofed;
+    Record(): ttl(60), silent(false), spoofed(false){}
+};
+
+struct DnsServer
+{
+    int fd;
+    int port;
+    std::map<std::string, Record> records;
+    std::map<std::string, int> queries;
+    pthread_mutex_t mutex;
+};
+
+static void put16(std::string &out, unsigned int value)
+{
+    out += (char)(value >> 8);
+    out += (char)value;
+}
+
+static void *serveDns(void *arg)
+{
+    DnsServer *server = (DnsServer *) arg;
+    while (1)
+    {
+        unsigned char buf[512];
+        struct sockaddr_storage from;
+        socklen_t fromLen = sizeof(from);
+        ssize_t len = recvfrom(server->fd, buf, sizeof(buf), 0, (struct sockaddr *) &from, &fromLen);
+        if (len < 0)
+            break;
+        if (len < 17)
+            continue;
+        std::string name;
+        size_t pos = 12;
+        while (pos < (size_t) len && buf[pos])
+        {
+            if (!name.empty())
+                name += '.';
+            name.append((const char *) buf + pos + 1, buf[pos]);
+            pos += buf[pos] + 1;
+        }
+        pos++;
+        if (pos + 4 > (size_t) len)
+            continue;
+        int type = (buf[pos] << 8) | buf[pos + 1];
+        pos += 4;
+
+        pthread_mutex_lock(&server->mutex);
+        server->queries[name]++;
+        std::map<std::string, Record>::const_iterator it = server->records.find(name);
+        bool known = it != server->records.end();
+        Record record = known ? it->second : Record();
+        pthread_mutex_unlock(&server->mutex);
+        if (record.silent)
+            continue;
+        if (record.spoofed)
+        {
+            std::string spoof((const char *) buf, 12);
+            spoof[2] = (char) 0x81;
+            spoof[3] = (char) 0x80;
+            spoof[6] = 0;
+            spoof[7] = 1;
+            spoof += "\x05other\x04test";
+            spoof += std::string("\0", 1);
+            put16(spoof, type);
+            put16(spoof, 1);
+            put16(spoof, 0xc00c);
+            put16(spoof, 1);
+            put16(spoof, 1);
+            put16(spoof, 0);
+            put16(spoof, 60);
+            put16(spoof, 4);
+            spoof += "\x0a\x06\x06\x06";
+            sendto(server->fd, spoof.data(), spoof.size(), 0, (struct sockaddr *) &from, fromLen);
+        }
+
+        const std::vector<std::string> &addresses = type == 28 ? record.aaaa : record.a;
+        std::string response((const char *) buf, pos);
+        // response, recursion available, NXDOMAIN for unknown names
+        response[2] = (char) 0x81;
+        response[3] = (char)(known ? 0x80 : 0x83);
+        response[6] = 0;
+        response[7] = (char) addresses.size();
+        for (size_t i = 0; i < addresses.size(); i++)
+        {
+            unsigned char rdata[16];
+            int rdlength = type == 28 ? 16 : 4;
+            inet_pton(type == 28 ? AF_INET6 : AF_INET, addresses[i].c_str(), rdata);
+            put16(response, 0xc00c);
+            put16(response, type);
+            put16(response, 1);
+            put16(response, record.ttl >> 16);
+            put16(response, record.ttl);
+            put16(response, rdlength);
+            response.append((const char *) rdata, rdlength);
+        }
+        sendto(server->fd, response.data(), response.size(), 0, (struct sockaddr *) &from, fromLen);
+    }
+    return NULL;
+}
+
+static bool startDnsServer(DnsServer &server)
+{
+    pthread_mutex_init(&server.mutex, NULL);
+    server.fd = listenLoopback(SOCK_DGRAM, server.port);
+    if (server.fd < 0)
+        return false;
+    return startDetached(serveDns, &server);
+}
+
+static int queries(DnsServer &server, const std::string &name)
+{
+    pthread_mutex_lock(&server.mutex);
+    int count = server.queries[name];
+    pthread_mutex_unlock(&server.mutex);
+    return count;
+}
+
+static int listenOn(const char *address, int port, int backlog)
+{
+    SocketAddress addr;
+    std::vector<SocketAddress> addresses;
+    if (Resolver::getInstance()->resolve(address, addresses, 0) < 0)
+        return -1;
+    addr = addresses[0];
+    addr.setPort(port);
+    int fd = socket(addr.family(), SOCK_STREAM, 0);
+    int one = 1;
+    if (addr.family() == AF_INET6)
+        setsockopt(fd, IPPROTO_IPV6, IPV6_V6ONLY, &one, sizeof(one));
+    if (fd < 0 || bind(fd, (struct sockaddr *) &addr.addr, addr.len) < 0 || listen(fd, backlog) < 0)
+    {
+        if (fd >= 0)
+            close(fd);
+        return -1;
+    }
+    return fd;
+}
+
+// listener with full accept queue drops SYNs, as blackholed route would
+static int blackhole(const char *address, int port)
+{
+    int fd = listenOn(address, port, 0);
+    if (fd < 0)
+        return -1;
+    int filler = Connect(address, port, 1);
+    if (filler < 0)
+    {
+        close(fd);
+        return -1;
+    }
+    return fd;
+}
+
+static void *acceptAll(void *arg)
+{
+    int fd = *(int *) arg;
+    int client;
+    while ((client = accept(fd, NULL, NULL)) >= 0)
+        close(client);
+    return NULL;
+}
+
+struct Cancel
+{
+    std::atomic<bool> flag;
+    int delayMs;
+};
+
+static void *cancelLater(void *arg)
+{
+    Cancel *cancel = (Cancel *) arg;
+    usleep(cancel->delayMs * 1000);
+    cancel->flag = true;
+    return NULL;
+}
+
+// connects to the host and returns ms it took, -1 on failure
+static int timedConnect(const char *host, int port, int timeoutsec, const std::atomic<bool> *cancelled=NULL)
+{
+    int64_t start = getMonotonicMs();
+    int saved = silenceStderr();
+    int fd = Connect(host, port, timeoutsec, cancelled);
+    restoreStderr(saved);
+    int elapsed = getMonotonicMs() - start;
+    if (fd < 0)
+        return -1;
+    close(fd);
+    return elapsed;
+}
+
+static int timedFailure(const char *host, int port, int timeoutsec, const std::atomic<bool> *cancelled=NULL)
+{
+    int64_t start = getMonotonicMs();
+    int saved = silenceStderr();
+    int fd = Connect(host, port, timeoutsec, cancelled);
+    restoreStderr(saved);
+    if (fd >= 0)
+    {
+        close(fd);
+        return -1;
+    }
+    return getMonotonicMs() - start;
+}
+
+int main(int argc, char *argv[])
+{
+    Resolver *resolver = Resolver::getInstance();
+    int failed = 0;
+
+    DnsServer dns;
+    if (!startDnsServer(dns))
+    {
+        printf("cannot start nameserver\n");
+        return 1;
+    }
+    char nameserver[64];
+    snprintf(nameserver, sizeof(nameserver), "127.0.0.1:%d", dns.port);
+    resolver->setNameservers(std::vector<std::string>(1, nameserver));
+
+    // server on 127.0.0.1 and blackholes on the same port of other addresses
+    int port = 0, serverFd = -1, hole2 = -1, hole3 = -1, hole6 = -1;
+    for (int attempt = 0; attempt < 10 && hole3 < 0; attempt++)
+    {
+        serverFd = listenOn("127.0.0.1", 0, 16);
+        struct sockaddr_in addr;
+        socklen_t len = sizeof(addr);
+        getsockname(serverFd, (struct sockaddr *) &addr, &len);
+        port = ntohs(addr.sin_port);
+        hole2 = blackhole("127.0.0.2", port);
+        hole3 = hole2 >= 0 ? blackhole("127.0.0.3", port) : -1;
+        if (hole3 < 0)
+        {
+            close(serverFd);
+            if (hole2 >= 0)
+                close(hole2);
+        }
+    }
+    if (hole3 < 0)
+    {
+        printf("cannot start server\n");
+        return 1;
+    }
+    // IPv6 loopback is not available everywhere
+    hole6 = blackhole("::1", port);
+    pthread_t thread;
+    pthread_create(&thread, NULL, acceptAll, &serverFd);
+    pthread_detach(thread);
+
+    Record record;
+    record.a.push_back("127.0.0.1");
+    record.aaaa.push_back("2001:db8::1");
+    record.ttl = 1;
+    dns.records["cached.test"] = record;
+    // cached for the TTL, queried again once it expires
+    std::vector<SocketAddress> addresses;
+    int saved = silenceStderr();
+    bool ok = resolver->resolve("cached.test", addresses, 1000) == 0 && addresses.size() == 2 &&
+            addresses[0].toString() == "2001:db8::1" && addresses[1].toString() == "127.0.0.1";
+    ok &= resolver->resolve("Cached.Test.", addresses, 1000) == 0 && queries(dns, "cached.test") == 2;
+    usleep(1100 * 1000);
+    ok &= resolver->resolve("cached.test", addresses, 1000) == 0 && queries(dns, "cached.test") == 4;
+    restoreStderr(saved);
+    if (!check("cache ttl", ok))
+        failed++;
+
+    record = Record();
+    record.a.push_back("10.0.0.1");
+    record.a.push_back("10.0.0.2");
+    record.a.push_back("10.0.0.3");
+    record.aaaa.push_back("2001:db8::1");
+    dns.records["order.test"] = record;
+    saved = silenceStderr();
+    ok = resolver->resolve("order.test", addresses, 1000) == 0 && addresses.size() == 4 &&
+            addresses[0].toString() == "2001:db8::1" && addresses[1].toString() == "10.0.0.1" &&
+            addresses[2].toString() == "10.0.0.2" && addresses[3].toString() == "10.0.0.3";
+    restoreStderr(saved);
+    if (!check("interleaved", ok))
+        failed++;
+
+    saved = silenceStderr();
+    ok = resolver->resolve("missing.test", addresses, 1000) < 0 && resolver->resolve("missing.test", addresses, 1000) < 0 &&
+            queries(dns, "missing.test") == 2;
+    restoreStderr(saved);
+    if (!check("negative cache", ok))
+        failed++;
+
+    record = Record();
+    record.a.push_back("10.0.0.1");
+    record.spoofed = true;
+    dns.records["spoofed.test"] = record;
+    saved = silenceStderr();
+    ok = resolver->resolve("spoofed.test", addresses, 1000) == 0 && addresses.size() == 1 &&
+            addresses[0].toString() == "10.0.0.1";
+    restoreStderr(saved);
+    if (!check("question check", ok))
+        failed++;
+
+    record = Record();
+    record.silent = true;
+    dns.records["silent.test"] = record;
+    int64_t start = getMonotonicMs();
+    saved = silenceStderr();
+    ok = resolver->resolve("silent.test", addresses, 300) < 0;
+    restoreStderr(saved);
+    int elapsed = getMonotonicMs() - start;
+    ok &= elapsed >= 300 && elapsed < 600;
+    if (!check("resolve timeout", ok))
+        failed++;
+
+    ok = resolver->resolve("localhost", addresses, 0) == 0 && queries(dns, "localhost") == 0;
+    if (!check("hosts file", ok))
+        failed++;
+
+    // blackholed IPv6 route delays the connection by the attempt delay only
+    if (hole6 >= 0)
+    {
+        record = Record();
+        record.aaaa.push_back("::1");
+        record.a.push_back("127.0.0.1");
+        dns.records["dual.test"] = record;
+        elapsed = timedConnect("dual.test", port, 5);
+        printf("%20s: %dms\n", "ipv6 blackholed", elapsed);
+        if (!check("ipv6 fallback", elapsed >= 200 && elapsed < 1000))
+            failed++;
+    }
+    else
+        printf("%20s: skipped, no IPv6 loopback\n", "ipv6 fallback");
+
+    record = Record();
+    record.a.push_back("127.0.0.2");
+    record.a.push_back("127.0.0.3");
+    record.a.push_back("127.0.0.1");
+    dns.records["holes.test"] = record;
+    elapsed = timedConnect("holes.test", port, 5);
+    printf("%20s: %dms\n", "two blackholed", elapsed);
+    if (!check("staggered attempts", elapsed >= 450 && elapsed < 1500))
+        failed++;
+
+    // refused attempt doesn't wait for the delay, 127.0.0.4 has no listener
+    record = Record();
+    record.a.push_back("127.0.0.4");
+    record.a.push_back("127.0.0.1");
+    dns.records["refused.test"] = record;
+    elapsed = timedConnect("refused.test", port, 5);
+    if (!check("refused", elapsed >= 0 && elapsed < 200))
+        failed++;
+
+    record = Record();
+    record.a.push_back("127.0.0.2");
+    record.a.push_back("127.0.0.3");
+    dns.records["dead.test"] = record;
+    elapsed = timedFailure("dead.test", port, 1);
+    if (!check("connect timeout", elapsed >= 1000 && elapsed < 1500))
+        failed++;
+
+    Cancel cancel;
+    cancel.flag = false;
+    cancel.delayMs = 200;
+    pthread_create(&thread, NULL, cancelLater, &cancel);
+    elapsed = timedFailure("dead.test", port, 5, &cancel.flag);
+    pthread_join(thread, NULL);
+    if (!check("cancel", elapsed >= 200 && elapsed < 500))
+        failed++;
+
+    unsigned int lookups, hits;
+    resolver->getStats(lookups, hits);
+    printf("%20s: %u lookups, %u cached\n", "resolver", lookups, hits);
+    return failed ? 1 : 0;
+}
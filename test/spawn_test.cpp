@@ -0,0 +1,184 @@
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <string>
+#include <vector>
+#include <dirent.h>
+#include <fcntl.h>
+#include <poll.h>
+#include <time.h>
+#include <unistd.h>
+#include <sys/wait.h>
+
+#include "spawn.h"
+
+// previous implementation from myconsole.cpp, for comparison
+static int legacyBidirpipe(int pfd[], const char *cmd , const char * const argv[])
+{
+    int pfdin[2];
+    int pfdout[2];
+    int pfderr[2];
+    int pid;
+    if (pipe(pfdin) == -1 || pipe(pfdout) == -1 || pipe(pfderr) == -1)
+        return -1;
+    if ((pid = vfork()) == -1)
+        return -1;
+    else if (pid == 0)
+    {
+        setsid();
+        if (close(0) == -1 || close(1) == -1 || close(2) == -1)
+            _exit(0);
+        if (dup(pfdout[0]) != 0 || dup(pfdin[1]) != 1 || dup(pfderr[1]) != 2)
+            _exit(0);
+        if (close(pfdout[0]) == -1 || close(pfdout[1]) == -1 ||
+                close(pfdin[0]) == -1 || close(pfdin[1]) == -1 ||
+                close(pfderr[0]) == -1 || close(pfderr[1]) == -1)
+            _exit(0);
+        for (unsigned int i = 3; i < 90; ++i)
+            close(i);
+        execvp(cmd, (char * const *)argv);
+        _exit(0);
+    }
+    close(pfdout[0]);
+    close(pfdin[1]);
+    close(pfderr[1]);
+    pfd[0] = pfdin[0];
+    pfd[1] = pfdout[1];
+    pfd[2] = pfderr[0];
+    return pid;
+}
+
+// child: reports its open descriptors above stderr and echoes stdin
+static int child()
+{
+    DIR *dir = opendir("/proc/self/fd");
+    if (!dir)
+        return 1;
+    std::string fds;
+    struct dirent *entry;
+    while ((entry = readdir(dir)) != NULL)
+    {
+        int fd = atoi(entry->d_name);
+        if (entry->d_name[0] != '.' && fd > 2 && fd != dirfd(dir))
+            fds += std::string(entry->d_name) + " ";
+    }
+    closedir(dir);
+    printf("fds: %s\n", fds.c_str());
+    char line[256];
+    if (fgets(line, sizeof(line), stdin))
+        printf("echo: %s", line);
+    fprintf(stderr, "stderr\n");
+    return 0;
+}
+
+static std::string readAll(int fd)
+{
+    std::string data;
+    char buf[1024];
+    struct pollfd pfd = {fd, POLLIN, 0};
+    while (poll(&pfd, 1, 5000) > 0)
+    {
+        ssize_t rd = read(fd, buf, sizeof(buf));
+        if (rd <= 0)
+            break;
+        data.append(buf, rd);
+    }
+    return data;
+}
+
+static bool testLeaks(const char *self)
+{
+    // descriptors without close-on-exec, inside and beyond range closed previously
+    int leaked[] = {50, 95, 200, 1000};
+    for (size_t i = 0; i < sizeof(leaked) / sizeof(leaked[0]); i++)
+        dup2(1, leaked[i]);
+
+    const char *argv[] = {self, "--child", NULL};
+    int fd[3];
+    int pid = bidirpipe(fd, self, argv, NULL);
+    if (pid == -1)
+    {
+        printf("%15s: cannot spawn\n", "leaks");
+        return false;
+    }
+    if (write(fd[1], "hello\n", 6) != 6)
+        return false;
+    std::string out = readAll(fd[0]);
+    std::string err = readAll(fd[2]);
+    int status;
+    waitpid(pid, &status, 0);
+    for (int i = 0; i < 3; i++)
+        close(fd[i]);
+    for (size_t i = 0; i < sizeof(leaked) / sizeof(leaked[0]); i++)
+        close(leaked[i]);
+
+    bool ok = out == "fds: \necho: hello\n" && err == "stderr\n" && WIFEXITED(status) && !WEXITSTATUS(status);
+    printf("%15s: %s\n", "leaks", ok ? "OK" : "FAILED");
+    if (!ok)
+        printf("stdout: '%s'\nstderr: '%s'\n", out.c_str(), err.c_str());
+    return ok;
+}
+
+static bool testExecFailure()
+{
+    const char *argv[] = {"/nonexistent/player", NULL};
+    int fd[3];
+    int pid = bidirpipe(fd, argv[0], argv, NULL);
+    int status = 0;
+    if (pid != -1)
+    {
+        waitpid(pid, &status, 0);
+        for (int i = 0; i < 3; i++)
+            close(fd[i]);
+    }
+    bool ok = pid != -1 && WIFEXITED(status) && WEXITSTATUS(status) == 127;
+    printf("%15s: %s\n", "exec failure", ok ? "OK" : "FAILED");
+    return ok;
+}
+
+static double elapsed(const struct timespec &start)
+{
+    struct timespec now;
+    clock_gettime(CLOCK_MONOTONIC, &now);
+    return (now.tv_sec - start.tv_sec) + (now.tv_nsec - start.tv_nsec) / 1e9;
+}
+
+static void benchmark(const char *name, int (*spawn)(int[], const char *, const char * const[]))
+{
+    const int rounds = 300;
+    const char *argv[] = {"/bin/true", NULL};
+    struct timespec start;
+    clock_gettime(CLOCK_MONOTONIC, &start);
+    for (int i = 0; i < rounds; i++)
+    {
+        int fd[3];
+        int pid = spawn(fd, argv[0], argv);
+        if (pid == -1)
+            continue;
+        waitpid(pid, NULL, 0);
+        for (int j = 0; j < 3; j++)
+            close(fd[j]);
+    }
+    printf("%15s: %-10s %6.0f us/spawn\n", "benchmark", name, elapsed(start) * 1e6 / rounds);
+}
+
+static int newBidirpipe(int pfd[], const char *cmd, const char * const argv[])
+{
+    return bidirpipe(pfd, cmd, argv, NULL);
+}
+
+int main(int argc, char *argv[])
+{
+    if (argc > 1 && !strcmp(argv[1], "--child"))
+        return child();
+
+    int failed = 0;
+    if (!testLeaks("/proc/self/exe"))
+        failed++;
+    if (!testExecFailure())
+        failed++;
+    // spawn + wait, startup of the spawned process included
+    benchmark("legacy", legacyBidirpipe);
+    benchmark("bidirpipe", newBidirpipe);
+    return failed ? 1 : 0;
+}
@@ -0,0 +1,94 @@
+#include <cstdio>
+#include <cstdlib>
+#include <string>
+#include <pthread.h>
+#include <sched.h>
+
+#include "spscqueue.h"
+
+// passes numbered strings from producer to consumer thread, consumer
+// checks that nothing was lost, duplicated or reordered
+
+static const unsigned int itemCount = 1000000;
+
+struct QueueTest
+{
+    SPSCQueue<std::string> queue;
+    unsigned int retries;
+    QueueTest(size_t capacity): queue(capacity), retries(0){}
+};
+
+static void *producer(void *arg)
+{
+    QueueTest *t = (QueueTest *)arg;
+    char buf[32];
+    for (unsigned int i = 0; i < itemCount; i++)
+    {
+        snprintf(buf, sizeof(buf), "subtitle %u", i);
+        std::string item(buf);
+        while (!t->queue.push(item))
+        {
+            t->retries++;
+            sched_yield();
+        }
+    }
+    return NULL;
+}
+
+static bool consume(QueueTest &t)
+{
+    char buf[32];
+    std::string item;
+    for (unsigned int i = 0; i < itemCount; )
+    {
+        if (!t.queue.pop(item))
+        {
+            sched_yield();
+            continue;
+        }
+        snprintf(buf, sizeof(buf), "subtitle %u", i);
+        if (item != buf)
+        {
+            printf("expected '%s', got '%s'\n", buf, item.c_str());
+            return false;
+        }
+        i++;
+    }
+    return t.queue.empty();
+}
+
+int main()
+{
+    int failed = 0;
+    size_t capacities[] = {1, 16, 1024};
+    for (size_t i = 0; i < sizeof(capacities) / sizeof(capacities[0]); i++)
+    {
+        QueueTest t(capacities[i]);
+        pthread_t thread;
+        pthread_create(&thread, NULL, producer, &t);
+        bool ok = consume(t);
+        pthread_join(thread, NULL);
+        printf("%15s: capacity=%4zu items=%u producer retries=%u %s\n", "spsc", t.queue.capacity(),
+                itemCount, t.retries, ok ? "OK" : "FAILED");
+        if (!ok)
+            failed++;
+    }
+
+    SPSCQueue<std::string> full(2);
+    std::string item("a");
+    full.push(item);
+    item = "b";
+    full.push(item);
+    item = "c";
+    if (full.push(item) || item != "c" || full.dropped() != 1)
+    {
+        printf("%15s: FAILED\n", "full queue");
+        failed++;
+    }
+    else
+    {
+        printf("%15s: OK\n", "full queue");
+    }
+
+    return failed ? 1 : 0;
+}
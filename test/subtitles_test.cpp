@@ -0,0 +1,455 @@
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <string>
+#include <vector>
+#include <unistd.h>
+#include <fcntl.h>
+#include <pthread.h>
+
+#include "common.h"
+#include "subtitles/subtitles.h"
+#include "testutil.h"
+
+// dialogue of a long series compilation
+#define BENCH_CUES 200000
+
+static bool parse(const std::string &data, SubtitleCues &cues, int fps=-1)
+{
+    SubtitleParser parser;
+    cues.clear();
+    int saved = silenceStderr();
+    bool ok = parser.parse(data.c_str(), data.size(), fps, cues);
+    restoreStderr(saved);
+    return ok;
+}
+
+static bool cueIs(const SubtitleCues &cues, size_t i, uint32_t start_ms, uint32_t end_ms, const char *text)
+{
+    if (i >= cues.size())
+        return false;
+    const subtitleCue &cue = cues[i];
+    return cue.start_ms == start_ms && cue.end_ms == end_ms && cue.text_length == strlen(text) &&
+            !strcmp(cues.text(cue), text);
+}
+
+static std::string writeTemp(const std::string &data)
+{
+    char path[] = "/tmp/subtitles_testXXXXXX";
+    int fd = mkstemp(path);
+    if (fd < 0)
+        return "";
+    if (write(fd, data.c_str(), data.size()) != (ssize_t) data.size())
+    {
+        close(fd);
+        unlink(path);
+        return "";
+    }
+    close(fd);
+    return path;
+}
+
+static bool testSubrip()
+{
+    SubtitleCues cues;
+    std::string srt = "1\n00:00:01,000 --> 00:00:02,500\nHello\nworld  \n\n"
+            "2\n00:00:03.000-->00:00:04.000 X1:10 X2:20 Y1:30 Y2:40\n42 is the answer\n\n"
+            "3\n01:02:03,004 --> 01:02:05,006\n\n"
+            "4\n00:00:05,000 --> 00:00:06,000\nlast";
+    bool ok = parse(srt, cues) && cues.size() == 4;
+    ok &= cueIs(cues, 0, 1000, 2500, "Hello\nworld");
+    ok &= cueIs(cues, 1, 3000, 4000, "42 is the answer");
+    ok &= cueIs(cues, 2, 3723004, 3725006, "");
+    ok &= cueIs(cues, 3, 5000, 6000, "last");
+
+    // BOM, CRLF, garbage before the first cue is not accepted by probe
+    std::string crlf = "\xEF\xBB\xBF" "1\r\n00:00:01,000 --> 00:00:02,000\r\nline one\r\nline two\r\n\r\n"
+            "2\r\n00:00:03,000 --> 00:00:04,000\r\n7\r\n";
+    ok &= parse(crlf, cues) && cues.size() == 2 && cueIs(cues, 0, 1000, 2000, "line one\nline two") &&
+            cueIs(cues, 1, 3000, 4000, "7");
+    ok &= !parse("garbage\n" + srt, cues) && !parse("", cues) && !parse("1\n00:00:01 --> 00:00:02\n", cues);
+
+    // number followed by the text belongs to the text of the cue
+    std::string numbers = "1\n00:00:01,000 --> 00:00:02,000\n1999\nwas the year\n\n"
+            "2\n00:00:03,000 --> 00:00:04,000\n2000 apples\n";
+    ok &= parse(numbers, cues) && cues.size() == 2 && cueIs(cues, 0, 1000, 2000, "1999\nwas the year") &&
+            cueIs(cues, 1, 3000, 4000, "2000 apples");
+    return ok;
+}
+
+static bool testAss()
+{
+    SubtitleCues cues;
+    std::string ass = "\xEF\xBB\xBF[Script Info]\r\nTitle: test\r\nScriptType: v4.00+\r\n\r\n"
+            "[V4+ Styles]\r\n"
+            "Format: Name, Fontname, Fontsize, PrimaryColour, SecondaryColour, OutlineColour, BackColour, Bold, Italic\r\n"
+            "Style: Default,Arial,20,&H00FFFFFF,&H000000FF,&H00000000,&H00000000,0,0\r\n"
+            "Style: *Thoughts,Arial,20,&H00FFFFFF,&H000000FF,&H00000000,&H00000000,0,-1\r\n\r\n"
+            "[Events]\r\n"
+            "Format: Layer, Start, End, Style, Name, MarginL, MarginR, MarginV, Effect, Text\r\n"
+            "Dialogue: 0,0:00:01.50,0:00:03.00,Default,,0,0,0,,Hello, {\\b1}world{\\b0}!\\NSecond line\r\n"
+            "Comment: 0,0:00:02.00,0:00:03.00,Default,,0,0,0,,not shown\r\n"
+            "Dialogue: 0,0:00:04.00,0:00:05.00,Thoughts,,0,0,0,,{\\pos(10,20)\\bord2}I {\\i0}wonder{\\r}\\hwhy\r\n"
+            "Dialogue: 0,0:00:06.00,0:00:07.00,Default,,0,0,0,,{\\p1}m 0 0 l 100 0{\\p0}\r\n"
+            "Dialogue: 0,1:00:00.05,1:00:01.00,Missing,,0,0,0,,{comment}unknown style\r\n";
+    bool ok = parse(ass, cues) && cues.size() == 3;
+    ok &= cueIs(cues, 0, 1500, 3000, "Hello, <b>world</b>!\nSecond line");
+    ok &= cueIs(cues, 1, 4000, 5000, "<i>I </i>wonder<i> why</i>");
+    ok &= cueIs(cues, 2, 3600050, 3601000, "unknown style");
+
+    // SSA without format of the events
+    std::string ssa = "[Script Info]\nScriptType: v4.00\n\n[Events]\n"
+            "Dialogue: Marked=0,0:00:01.00,0:00:02.00,Default,,0000,0000,0000,,{\\i1}text, with comma\n";
+    ok &= parse(ssa, cues) && cues.size() == 1 && cueIs(cues, 0, 1000, 2000, "<i>text, with comma</i>");
+    return ok;
+}
+
+static bool testWebvtt()
+{
+    SubtitleCues cues;
+    std::string vtt = "WEBVTT - some title\n\n"
+            "NOTE this is a comment\n00:00:01.000 --> 00:00:02.000\n\n"
+            "STYLE\n::cue { color: yellow }\n\n"
+            "intro\n00:01.000 --> 00:02.500 align:start position:10%\n<v Bob>Hi <i.loud>there</i></v>\n"
+            "<c.yellow>Tom &amp; Jerry</c> &lt;3 &copy;\n\n"
+            "01:00:00.000 --> 01:00:01.000\n<00:00:00.500>karaoke <ruby>text<rt>reading</rt></ruby>\n\n"
+            "broken\n\n"
+            "00:00:05.000 --> 00:00:06.000\n<b>last</b>";
+    bool ok = parse(vtt, cues) && cues.size() == 3;
+    ok &= cueIs(cues, 0, 1000, 2500, "Hi <i>there</i>\nTom & Jerry <3 &copy;");
+    ok &= cueIs(cues, 1, 3600000, 3601000, "karaoke textreading");
+    ok &= cueIs(cues, 2, 5000, 6000, "<b>last</b>");
+    ok &= !parse("WEBVTTX\n\n00:01.000 --> 00:02.000\ntext\n", cues);
+    return ok;
+}
+
+static bool testMicroDvd()
+{
+    SubtitleCues cues;
+    std::string sub = "{1}{1}25.000\n{25}{50}First|second line\n{75}{}{y:i}Italic|{Y:b}bold|still bold\n"
+            "{100}{125}{c:$0000ff}{f:Arial}Styled\n";
+    bool ok = parse(sub, cues) && cues.size() == 3;
+    ok &= cueIs(cues, 0, 1000, 2000, "First\nsecond line");
+    ok &= cueIs(cues, 1, 3000, 4000, "<i>Italic</i>\n<b>bold</b>\n<b>still bold</b>");
+    ok &= cueIs(cues, 2, 4000, 5000, "Styled");
+
+    // fps header wins over the video, fps of the parse is used without it
+    // and 23.976 otherwise
+    ok &= parse(sub, cues, 50000) && cues.size() == 3 && cueIs(cues, 0, 1000, 2000, "First\nsecond line") &&
+            cues.videoFps() == 0;
+    ok &= parse("{25}{50}text\n", cues, 50000) && cues.size() == 1 && cueIs(cues, 0, 500, 1000, "text") &&
+            cues.videoFps() == 50000;
+    ok &= parse("{24}{48}text\n{240}{}last\n", cues) && cues.size() == 2 &&
+            cueIs(cues, 0, 1001, 2002, "text") && cueIs(cues, 1, 10010, 13010, "last") && cues.videoFps() == -1;
+    return ok;
+}
+
+static bool testMpl2()
+{
+    SubtitleCues cues;
+    std::string mpl2 = "[10][25]First|/italic line\n[30][]/Whole|cue\n\n[45][50]Last\n";
+    bool ok = parse(mpl2, cues) && cues.size() == 3;
+    ok &= cueIs(cues, 0, 1000, 2500, "First\n<i>italic line</i>");
+    ok &= cueIs(cues, 1, 3000, 4500, "<i>Whole</i>\ncue");
+    ok &= cueIs(cues, 2, 4500, 5000, "Last");
+    ok &= !parse("[10][20]one\nplain text\n", cues);
+    return ok;
+}
+
+struct ReadJob
+{
+    std::string path;
+    SubtitleTimeline timeline;
+    int result;
+};
+
+static void *readThread(void *arg)
+{
+    ReadJob *job = (ReadJob *) arg;
+    job->result = SubtitleManager::read(job->path, job->timeline);
+    return NULL;
+}
+
+static bool testManager()
+{
+    std::string srt = "1\n00:00:01,000 --> 00:00:02,000\nfirst\n\n2\n00:00:03,000 --> 00:00:05,000\nsecond\n";
+    std::string path = writeTemp(srt);
+    if (path.empty())
+        return false;
+    SubtitleManager manager;
+    int saved = silenceStderr();
+    bool ok = manager.get(path) == NULL;
+    const SubtitleTimeline *timeline = manager.load(path);
+    ok &= manager.get(path) == timeline && manager.load(path) == timeline && manager.load(path + ".missing") == NULL;
+
+    // cancelled read gives up, result of finished one is moved to the cache
+    std::atomic<bool> cancelled(true);
+    SubtitleTimeline read;
+    ok &= SubtitleManager::read(path, read, true, &cancelled) < 0 && read.empty();
+    cancelled = false;
+    ok &= SubtitleManager::read(path, read, true, &cancelled) == 0 && read.size() == 2;
+    ok &= manager.add(path, read) == timeline && read.empty();
+
+    // frames without fps header are timed by fps of the video
+    std::string sub = writeTemp("{25}{50}frames\n");
+    ok &= !sub.empty() && SubtitleManager::read(sub, read, true, NULL, 25000) == 0 && read.size() == 1 &&
+            read.start(0) == 1000 && read.end(0) == 2000;
+    read.clear();
+
+    // such files are cached for the frame rate they were timed by, the one
+    // read before the frame rate was known isn't used once it's known
+    const SubtitleTimeline *frames = manager.load(sub);
+    ok &= frames && frames->start(0) == 1042 && manager.get(sub) == frames && manager.get(sub, 25000) == NULL;
+    frames = manager.load(sub, false, 25000);
+    ok &= frames && frames->start(0) == 1000 && manager.get(sub, 25000) == frames && manager.get(sub) == NULL;
+    // subrip doesn't depend on it
+    ok &= manager.get(path, 25000) == timeline;
+    unlink(sub.c_str());
+
+    // files are read by worker threads in parallel
+    ReadJob jobs[4];
+    pthread_t threads[4];
+    for (int i = 0; i < 4; i++)
+    {
+        jobs[i].path = path;
+        ok &= !pthread_create(&threads[i], NULL, readThread, &jobs[i]);
+    }
+    for (int i = 0; i < 4; i++)
+    {
+        pthread_join(threads[i], NULL);
+        ok &= jobs[i].result == 0 && jobs[i].timeline.size() == 2 && !strcmp(jobs[i].timeline.text(1), "second");
+    }
+    restoreStderr(saved);
+    unlink(path.c_str());
+    if (!ok || !timeline || timeline->size() != 2)
+        return false;
+    ok &= timeline->start(1) == 3000 && timeline->end(1) == 5000 && !strcmp(timeline->text(1), "second");
+
+    // frame rates are applied at lookup
+    ok &= SubtitleManager::getScale(25, 50) == 0.5 && SubtitleManager::getScale(-1, 50) == 1 &&
+            SubtitleManager::getScale(25, 1) == 1 && SubtitleManager::getScale(25, 25) == 1;
+    return ok;
+}
+
+static std::string activeTexts(const SubtitleTimeline &timeline, uint32_t from_ms, uint32_t to_ms)
+{
+    std::vector<size_t> active;
+    timeline.getActive(from_ms, to_ms, active);
+    std::string texts;
+    for (size_t i = 0; i < active.size(); i++)
+        texts += std::string(i ? "," : "") + timeline.text(active[i]);
+    return texts;
+}
+
+static bool testTimeline()
+{
+    // out of order, overlapping and with the same end time
+    std::string srt = "1\n00:00:10,000 --> 00:00:12,000\nc\n\n"
+            "2\n00:00:01,000 --> 00:00:30,000\na\n\n"
+            "3\n00:00:05,000 --> 00:00:12,000\nb\n\n"
+            "4\n00:00:20,000 --> 00:00:21,000\nd\n";
+    SubtitleCues cues;
+    SubtitleTimeline timeline;
+    if (!parse(srt, cues))
+        return false;
+    timeline.build(cues);
+    uint32_t next;
+    bool ok = timeline.size() == 4 && cues.empty() && !strcmp(timeline.text(0), "a");
+    ok &= activeTexts(timeline, 0, 0).empty() && activeTexts(timeline, 0, 1000) == "a";
+    ok &= activeTexts(timeline, 11000, 11000) == "a,b,c" && activeTexts(timeline, 12000, 12000) == "a";
+    ok &= activeTexts(timeline, 30000, 40000).empty();
+    ok &= timeline.getNextStart(5000, next) && next == 10000 && !timeline.getNextStart(20000, next);
+
+    // embedded cues mostly come in order, late one is inserted
+    EmbeddedSubtitleTimeline embedded;
+    embedded.append(1000, 2000, "one");
+    embedded.append(3000, 9000, "three");
+    uint32_t id = embedded.id(1);
+    embedded.append(2000, 8000, "two");
+    embedded.append(3000, 4000, "four");
+    ok &= embedded.size() == 4 && embedded.id(2) == id && activeTexts(embedded, 3500, 3500) == "two,three,four";
+    ok &= activeTexts(embedded, 8500, 8500) == "three" && embedded.getNextStart(1000, next) && next == 2000;
+
+    // lookups agree with a scan of all cues
+    EmbeddedSubtitleTimeline random;
+    std::vector<uint32_t> starts, ends;
+    srand(1);
+    for (int i = 0; i < 2000; i++)
+    {
+        uint32_t start = i * 1000 + rand() % 3000, end = start + rand() % 10000;
+        random.append(start, end, std::to_string(i));
+        starts.push_back(start);
+        ends.push_back(end);
+    }
+    for (uint32_t t = 0; t < 2010000 && ok; t += 777)
+    {
+        std::vector<size_t> active;
+        random.getActive(t, t, active);
+        size_t expected = 0;
+        for (size_t i = 0; i < starts.size(); i++)
+        {
+            if (starts[i] <= t && ends[i] > t)
+                expected++;
+        }
+        ok &= active.size() == expected;
+        for (size_t i = 0; i < active.size(); i++)
+            ok &= random.start(active[i]) <= t && random.end(active[i]) > t &&
+                    (!i || random.start(active[i - 1]) <= random.start(active[i]));
+    }
+    return ok;
+}
+
+static std::string timestamp(uint32_t ms)
+{
+    char buf[32];
+    snprintf(buf, sizeof(buf), "%02u:%02u:%02u,%03u", ms / 3600000, ms / 60000 % 60, ms / 1000 % 60, ms % 1000);
+    return buf;
+}
+
+static std::string benchFile()
+{
+    static const char *lines[] =
+    {
+        "I told you we should have taken the other road.",
+        "<i>Previously on the show...</i>",
+        "- Where were you last night?\n- At home, I swear.",
+        "We have 24 hours before they find out.",
+    };
+    std::string data;
+    data.reserve(BENCH_CUES * 96);
+    for (uint32_t i = 0; i < BENCH_CUES; i++)
+    {
+        uint32_t start = i * 2500;
+        data += std::to_string(i + 1) + "\r\n" + timestamp(start) + " --> " + timestamp(start + 2000) + "\r\n";
+        data += lines[i % 4];
+        data += "\r\n\r\n";
+    }
+    return data;
+}
+
+// WebVTT accepts only '.' before milliseconds
+static std::string vttTimestamp(uint32_t ms)
+{
+    std::string t = timestamp(ms);
+    t[t.size() - 4] = '.';
+    return t;
+}
+
+static bool benchFormat(const char *name, const std::string &data)
+{
+    SubtitleParser parser;
+    SubtitleCues cues;
+    int64_t start = getMonotonicMs();
+    int saved = silenceStderr();
+    bool ok = parser.parse(data.c_str(), data.size(), -1, cues);
+    restoreStderr(saved);
+    int64_t parsed = getMonotonicMs() - start;
+    ok &= cues.size() == BENCH_CUES && cueIs(cues, BENCH_CUES - 1, (BENCH_CUES - 1) * 2500,
+            (BENCH_CUES - 1) * 2500 + 2000, "<i>We have 24 hours</i>\nbefore they find out.");
+    printf("%20s: %.1f MB, %zu cues, parsed in %lldms\n", name, data.size() / (1024.0 * 1024.0), cues.size(),
+            (long long) parsed);
+    return ok;
+}
+
+// the same cues in the other formats
+static bool benchFormats()
+{
+    std::string ass = "[Script Info]\nScriptType: v4.00+\n\n[Events]\n"
+            "Format: Layer, Start, End, Style, Name, MarginL, MarginR, MarginV, Effect, Text\n";
+    std::string vtt = "WEBVTT\n\n", sub = "{1}{1}40\n", mpl2;
+    char buf[256];
+    for (uint32_t i = 0; i < BENCH_CUES; i++)
+    {
+        uint32_t start = i * 2500, end = start + 2000;
+        snprintf(buf, sizeof(buf), "Dialogue: 0,%u:%02u:%02u.%02u,%u:%02u:%02u.%02u,Default,,0,0,0,,"
+                "{\\i1}We have 24 hours{\\i0}\\Nbefore they find out.\n", start / 3600000, start / 60000 % 60,
+                start / 1000 % 60, start % 1000 / 10, end / 3600000, end / 60000 % 60, end / 1000 % 60, end % 1000 / 10);
+        ass += buf;
+        vtt += std::to_string(i + 1) + "\n" + vttTimestamp(start) + " --> " + vttTimestamp(end) +
+                "\n<i>We have 24 hours</i>\nbefore they find out.\n\n";
+        snprintf(buf, sizeof(buf), "{%u}{%u}{y:i}We have 24 hours|before they find out.\n", start / 25, end / 25);
+        sub += buf;
+        snprintf(buf, sizeof(buf), "[%u][%u]/We have 24 hours|before they find out.\n", start / 100, end / 100);
+        mpl2 += buf;
+    }
+    bool ok = benchFormat("ass", ass);
+    ok &= benchFormat("webvtt", vtt);
+    ok &= benchFormat("microdvd", sub);
+    ok &= benchFormat("mpl2", mpl2);
+    return ok;
+}
+
+static bool benchmark()
+{
+    std::string data = benchFile();
+    std::string path = writeTemp(data);
+    if (path.empty())
+        return false;
+    double mb = data.size() / (1024.0 * 1024.0);
+    data.clear();
+
+    // mapped file to cues
+    int64_t start = getMonotonicMs();
+    SubtitleFile file;
+    SubtitleCues cues;
+    SubtitleParser parser;
+    int saved = silenceStderr();
+    bool ok = !file.open(path) && parser.parse(file.data(), file.size(), -1, cues);
+    restoreStderr(saved);
+    int64_t parsed = getMonotonicMs() - start;
+    ok &= cues.size() == BENCH_CUES && cueIs(cues, BENCH_CUES - 1, (BENCH_CUES - 1) * 2500,
+            (BENCH_CUES - 1) * 2500 + 2000, "We have 24 hours before they find out.");
+    printf("%20s: %.1f MB, %zu cues, %zu bytes of text, parsed in %lldms\n", "subrip", mb, cues.size(),
+            cues.textSize(), (long long) parsed);
+    file.close();
+
+    // whole load including the timeline which is looked up by the service
+    start = getMonotonicMs();
+    SubtitleManager manager;
+    saved = silenceStderr();
+    const SubtitleTimeline *timeline = manager.load(path);
+    restoreStderr(saved);
+    int64_t loaded = getMonotonicMs() - start;
+    ok &= timeline && timeline->size() == BENCH_CUES;
+    printf("%20s: loaded in %lldms\n", "manager", (long long) loaded);
+    unlink(path.c_str());
+    if (!ok)
+        return false;
+
+    // lookups of the playback, a few per second of the whole file
+    start = getMonotonicMs();
+    std::vector<size_t> active;
+    size_t found = 0;
+    uint32_t next;
+    for (uint32_t t = 0; t < BENCH_CUES * 2500; t += 250)
+    {
+        timeline->getActive(t, t + 50, active);
+        found += active.size() + timeline->getNextStart(t + 50, next);
+    }
+    printf("%20s: %u lookups in %lldms\n", "timeline", BENCH_CUES * 10, (long long) (getMonotonicMs() - start));
+    return found > BENCH_CUES;
+}
+
+int main(int argc, char *argv[])
+{
+    int failed = 0;
+    if (!check("subrip", testSubrip()))
+        failed++;
+    if (!check("ass", testAss()))
+        failed++;
+    if (!check("webvtt", testWebvtt()))
+        failed++;
+    if (!check("microdvd", testMicroDvd()))
+        failed++;
+    if (!check("mpl2", testMpl2()))
+        failed++;
+    if (!check("manager", testManager()))
+        failed++;
+    if (!check("timeline", testTimeline()))
+        failed++;
+    if (!check("benchmark", benchmark()))
+        failed++;
+    if (!check("formats", benchFormats()))
+        failed++;
+    return failed ? 1 : 0;
+}
@@ -0,0 +1,61 @@
+#include <cstdio>
+#include <cstring>
+#include <fcntl.h>
+#include <pthread.h>
+#include <unistd.h>
+#include <arpa/inet.h>
+#include <netinet/in.h>
+#include <sys/socket.h>
+
+#include "testutil.h"
+
+int silenceStderr()
+{
+    fflush(stderr);
+    int saved = dup(2);
+    int null = open("/dev/null", O_WRONLY);
+    dup2(null, 2);
+    close(null);
+    return saved;
+}
+
+void restoreStderr(int saved)
+{
+    fflush(stderr);
+    dup2(saved, 2);
+    close(saved);
+}
+
+bool check(const char *name, bool ok)
+{
+    printf("%20s: %s\n", name, ok ? "OK" : "FAILED");
+    return ok;
+}
+
+int listenLoopback(int type, int &port)
+{
+    int fd = socket(AF_INET, type, 0);
+    struct sockaddr_in addr;
+    memset(&addr, 0, sizeof(addr));
+    addr.sin_family = AF_INET;
+    addr.sin_addr.s_addr = htonl(INADDR_LOOPBACK);
+    socklen_t len = sizeof(addr);
+    if (fd < 0 || bind(fd, (struct sockaddr *) &addr, len) < 0 || (type == SOCK_STREAM && listen(fd, 16) < 0) ||
+            getsockname(fd, (struct sockaddr *) &addr, &len) < 0)
+    {
+        if (fd >= 0)
+            close(fd);
+        return -1;
+    }
+    port = ntohs(addr.sin_port);
+    return fd;
+}
+
+bool startDetached(void *(*fn)(void *), void *arg)
+{
+    pthread_t thread;
+    if (pthread_create(&thread, NULL, fn, arg))
+        return false;
+    pthread_detach(thread);
+    return true;
+}
@@ -0,0 +1,17 @@
+#ifndef __testutil_h
+#define __testutil_h
+
+// Helpers shared by the tests.
+
+// output of the code under test is dropped while stderr is silenced
+int silenceStderr();
+void restoreStderr(int saved);
+// prints result of the named part of the test
+bool check(const char *name, bool ok);
+
+// socket of the type listening on a free port of 127.0.0.1, -1 on error
+int listenLoopback(int type, int &port);
+// runs fn in detached thread
+bool startDetached(void *(*fn)(void *), void *arg);
+
+#endif